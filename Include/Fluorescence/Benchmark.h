@@ -0,0 +1,33 @@
+#pragma once
+
+#include "GpuProfiler.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace flr {
+// Measurements of a headless benchmark run of a project, written as json and
+// compared against a baseline by Tools/Bench/flrbench.py
+struct BenchmarkResults {
+  std::string projectPath;
+  uint32_t warmupFrameCount = 0;
+  uint32_t frameCount = 0;
+  float fixedDeltaTime = 0.0f;
+
+  // from starting the load until the project is ready to run
+  double loadMs = 0.0;
+  // wall time between consecutive frames, including waits on the GPU
+  std::vector<double> cpuFrameMs;
+  std::vector<GpuProfiler::ScopeSummary> gpuScopes;
+
+  uint64_t peakWorkingSetBytes = 0;
+  uint64_t peakPrivateBytes = 0;
+
+  // Samples the peak memory usage of the process so far
+  void recordPeakMemory();
+
+  bool writeJson(const std::filesystem::path& path) const;
+};
+} // namespace flr
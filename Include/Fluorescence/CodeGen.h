@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ParsedFlr.h"
+
+#include <Althea/Shader.h>
+
+#include <filesystem>
+
+using namespace AltheaEngine;
+
+namespace flr {
+// Returns the path of the generated shader file for the given project,
+// <project>.gen.glsl or <project>.gen.hlsl depending on the shader language
+std::filesystem::path getAutoGenFileName(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath);
+
+// Path the background ProjectLoader generates the shader file into before the
+// project replaces the running one, <project>.gen.loading.glsl. It is next to
+// the generated file, so that the includes in it resolve to the same files.
+std::filesystem::path getPendingAutoGenFileName(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath);
+
+struct CodeGenResult {
+  // hash of the generated code
+  uint64_t hash;
+  // false if the file already held the same code and was left untouched
+  bool bWritten;
+};
+
+// Generates the shader file declaring all resources, ui uniforms and entry
+// point wrappers of the project, the user shader file is included by it.
+CodeGenResult
+codeGen(const ParsedFlr& parsed, const std::filesystem::path& projPath);
+CodeGenResult codeGen(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath,
+    const std::filesystem::path& autoGenFileName);
+CodeGenResult codeGenGlsl(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath,
+    const std::filesystem::path& autoGenFileName);
+CodeGenResult codeGenHlsl(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath,
+    const std::filesystem::path& autoGenFileName);
+
+// Defines used to select a single entry point out of the generated file when
+// compiling it
+ShaderDefines getComputeShaderDefines(
+    const ParsedFlr& parsed,
+    const ParsedFlr::ComputeShader& computeShader);
+ShaderDefines getVertexShaderDefines(
+    const ParsedFlr& parsed,
+    const ParsedFlr::RenderPass& pass,
+    const ParsedFlr::Draw& draw);
+ShaderDefines getPixelShaderDefines(
+    const ParsedFlr& parsed,
+    const ParsedFlr::RenderPass& pass,
+    const ParsedFlr::Draw& draw);
+
+// Folds a 1D or 2D dispatch with more groups than the device allows into all
+// three dimensions, the groups are laid out linearly and the generated
+// getLinearThreadIdx() / getThreadIdx2D() undo the folding. Dispatches within
+// the limits are left untouched. Returns false if the dispatch is 3D or does
+// not fit even when folded.
+bool foldGroupCounts(uint32_t groupCounts[3], const uint32_t maxCounts[3]);
+} // namespace flr
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "Benchmark.h"
 #include "Project.h"
+#include "ProjectLoader.h"
 #include "Shared/CommonStructures.h"
 
 #include <Althea/Allocator.h>
@@ -28,6 +30,11 @@
 #include <Althea/TransientUniforms.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 using namespace AltheaEngine;
@@ -44,6 +51,25 @@ struct FlrAppOptions {
   bool bStandaloneMode = true;
 };
 
+// Renders a fixed number of frames of the startup project and saves an image
+// of chosen frames, then closes the app. Time advances by a fixed step per
+// frame, so the output does not depend on the frame rate or load times.
+struct FlrHeadlessOptions {
+  uint32_t frameCount = 1;
+  // frames run before the first counted frame, they are not saved or measured
+  uint32_t warmupFrameCount = 0;
+  float fixedDeltaTime = 1.0f / 60.0f;
+  bool bSaveImages = true;
+  std::filesystem::path outputDir = ".";
+  // the display image if empty
+  std::string imageName;
+  // every saveInterval-th frame is saved, along with the last one
+  uint32_t saveInterval = 1;
+  // Where benchmark results are written to, if not empty the GPU profiler is
+  // enabled and the counted frames are measured
+  std::filesystem::path benchmarkPath;
+};
+
 class IFlrProgram {
 public:
   virtual void setupDescriptorTable(DescriptorSetLayoutBuilder& builder) {}
@@ -62,6 +88,9 @@ public:
   // virtual ~Fluorescence();
 
   void setStartupProject(const char* path);
+  void setHeadless(const FlrHeadlessOptions& options);
+  // Whether a headless run could not load the project or save its images
+  bool hasHeadlessFailed() const { return m_bHeadlessFailed; }
 
   template <typename T, class... TArgs>
   T* registerProgram(TArgs&&... args) {
@@ -98,12 +127,39 @@ private:
   FlrAppOptions m_options;
   std::vector<std::unique_ptr<IFlrProgram>> m_programs;
 
+  void _finishProjectLoad(Application& app);
+
+  void _tickHeadless(Application& app);
+  void _drawHeadless(Application& app, VkCommandBuffer commandBuffer);
+  void _failHeadless(Application& app, const std::string& errMsg);
+  void _finishBenchmark(Application& app);
+  std::optional<FlrHeadlessOptions> m_headless;
+  // frames rendered with the project so far, loading frames are not counted
+  uint32_t m_headlessFrame = 0;
+  bool m_bHeadlessFailed = false;
+  BenchmarkResults m_benchmark;
+  std::chrono::steady_clock::time_point m_lastHeadlessTick;
+  // GPU profiler frame number of the first counted frame
+  uint32_t m_benchmarkGpuFrame = 0;
+
+  std::chrono::steady_clock::time_point m_loadStartTime;
+  double m_lastLoadMs = 0.0;
+
   Project* m_pProject = nullptr;
+  // A project being loaded in the background, the current project keeps
+  // running until the new one is ready to be swapped in
+  std::unique_ptr<ProjectLoader> m_pProjectLoader;
+  // Errors of the last failed load, the previous project is kept in that case
+  std::string m_loadErrMsg;
+  // Parser state of the last load, whether it failed or not, used to only
+  // reparse what changed on the next load of the same project
+  std::shared_ptr<const ParsedFlr::IncrementalState> m_pLastParseState;
   bool m_bOpenFileDialogue = false;
   bool m_bReloadProject = false;
-  uint8_t m_reloadCountDown = 0;
   bool m_bPaused = false;
   bool m_bFreezeTime = false;
+  // Times every task on the GPU and shows the results in an overlay
+  bool m_bProfileGpu = false;
   float m_time = 0.0f;
 };
 } // namespace flr
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <Althea/FrameContext.h>
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace AltheaEngine;
+
+namespace flr {
+// Measures the GPU time of individual tasks with timestamp queries and,
+// optionally, their shader invocation counts with pipeline statistics
+// queries. The queries of a frame are read back the next time its
+// frame-in-flight slot comes around, by then the frame has finished on the
+// GPU and reading the results never stalls.
+class GpuProfiler {
+public:
+  GpuProfiler();
+  ~GpuProfiler();
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  bool isEnabled() const { return m_bEnabled; }
+  void setEnabled(bool bEnabled);
+
+  // Where "Save CSV" in the profiler window writes the captured frames to
+  void setCsvPath(const std::filesystem::path& path) { m_csvPath = path; }
+
+  // Collects the results of the last frame that used this frame-in-flight
+  // slot and resets its queries, must be called before any scope is begun in
+  // the frame.
+  void beginFrame(VkCommandBuffer commandBuffer, const FrameContext& frame);
+
+  // Scopes with the same name are accumulated per frame. Pipeline statistics
+  // queries can not be nested, they are only gathered for leaf scopes. The
+  // returned scope is invalid when profiling is disabled or the frame ran
+  // out of queries, ending it is a no-op.
+  uint32_t beginScope(
+      VkCommandBuffer commandBuffer,
+      const std::string& name,
+      bool bLeaf);
+  void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+  void drawUi();
+
+  // Captured frames are kept until cleared, up to MAX_CAPTURED_FRAMES
+  void setCapturing(bool bCapture) { m_bCapture = bCapture; }
+  // Number of the next frame to begin, captured frames are tagged with it
+  uint32_t getFrameNumber() const { return m_frameNumber; }
+
+  // Writes one row per captured frame with the time of every scope in ms
+  bool writeCsv(const std::filesystem::path& path) const;
+
+  struct ScopeSummary {
+    std::string name;
+    // captured frames the scope ran in
+    uint32_t frameCount;
+    float minMs;
+    float meanMs;
+    float medianMs;
+    float maxMs;
+  };
+  // Per-frame times of every scope over the captured frames numbered
+  // [firstFrame, endFrame)
+  std::vector<ScopeSummary>
+  summarizeCapture(uint32_t firstFrame, uint32_t endFrame) const;
+
+private:
+  void createQueryPools();
+  void destroyQueryPools();
+  void collectResults(uint32_t ringIdx);
+
+  static constexpr uint32_t MAX_SCOPES_PER_FRAME = 512;
+  static constexpr uint32_t HISTORY_LENGTH = 120;
+  static constexpr size_t MAX_CAPTURED_FRAMES = 60 * 60 * 10;
+
+  enum PipelineStatistic : uint32_t {
+    PS_VERTEX_INVOCATIONS = 0,
+    PS_FRAGMENT_INVOCATIONS,
+    PS_COMPUTE_INVOCATIONS,
+    PS_COUNT
+  };
+
+  struct Entry {
+    std::string name;
+    // rolling window of per-frame times in ms
+    float history[HISTORY_LENGTH];
+    uint32_t historyCount;
+    uint32_t historyNext;
+    // of the last frame the entry ran in
+    uint32_t calls;
+    uint64_t statistics[PS_COUNT];
+  };
+  std::vector<Entry> m_entries;
+  std::unordered_map<std::string, uint32_t> m_entryLookup;
+
+  struct PendingScope {
+    uint32_t entry;
+    // ~0u if the scope has no pipeline statistics query
+    uint32_t statisticsQuery;
+  };
+  struct FrameQueries {
+    VkQueryPool timestamps;
+    VkQueryPool statistics;
+    std::vector<PendingScope> scopes;
+    uint32_t statisticsCount;
+    uint32_t frameNumber;
+  };
+  FrameQueries m_frames[MAX_FRAMES_IN_FLIGHT];
+  uint32_t m_currentRingIdx;
+  uint32_t m_frameNumber;
+  bool m_bFrameActive;
+  uint32_t m_openStatisticsQuery;
+
+  struct CapturedFrame {
+    uint32_t frameNumber;
+    std::vector<std::pair<uint32_t, float>> entryMs;
+  };
+  std::vector<CapturedFrame> m_capturedFrames;
+  std::filesystem::path m_csvPath;
+
+  double m_timestampPeriodNs;
+  bool m_bEnabled;
+  bool m_bPipelineStatistics;
+  bool m_bCapture;
+  bool m_bGatherStatistics;
+};
+} // namespace flr
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace flr {
+// 64-bit FNV-1a, used for symbol lookups and content-hash keyed caches
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+constexpr uint64_t
+hashString(std::string_view s, uint64_t h = FNV_OFFSET_BASIS) {
+  for (char c : s) {
+    h ^= static_cast<uint8_t>(c);
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+inline uint64_t
+hashBytes(const void* data, size_t size, uint64_t h = FNV_OFFSET_BASIS) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+template <typename T> uint64_t hashValue(const T& value, uint64_t h) {
+  return hashBytes(&value, sizeof(T), h);
+}
+} // namespace flr
@@ -20,7 +20,8 @@ namespace flr {
       CMD_BUFFER_WRITE,
       CMD_BUFFER_STAGED_UPLOAD,
       CMD_UNIFORM_WRITE,
-      CMD_RUN_TASK
+      CMD_RUN_TASK,
+      CMD_CAPTURE_TRACE
     };
 
     // only valid on introduction
@@ -73,6 +74,10 @@ namespace flr {
       uint32_t taskId;
     };
 
+    struct CmdCaptureTrace {
+      uint32_t frameCount;
+    };
+
     bool processIntroduction(const char* stream, size_t streamSize, flr::FlrParams& params);
     bool processCmdList(Project* project, VkCommandBuffer commandBuffer, const FrameContext& frame, const char* stream, size_t streamSize);
   } // namespace flr_cmds
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace flr {
+// Runs fn(i) for every i in [0, count) on a pool of worker threads and blocks
+// until all of them are finished. The calling thread participates as one of
+// the workers. Order of execution is unspecified.
+template <typename TFunc> void parallelFor(uint32_t count, TFunc&& fn) {
+  if (count == 0)
+    return;
+
+  uint32_t workerCount = std::thread::hardware_concurrency();
+  workerCount = std::clamp(workerCount, 1u, count);
+
+  std::atomic<uint32_t> next = 0;
+  auto work = [&]() {
+    for (uint32_t i = next++; i < count; i = next++)
+      fn(i);
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(workerCount - 1);
+  for (uint32_t i = 1; i < workerCount; i++)
+    workers.emplace_back(work);
+  work();
+  for (std::thread& worker : workers)
+    worker.join();
+}
+} // namespace flr
@@ -1,3 +1,4 @@
+#pragma once
 
 #include <Althea/Application.h>
 #include <Althea/Utilities.h>
@@ -5,6 +6,8 @@
 #include <Althea/Shader.h>
 
 #include <cstdint>
+#include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -15,8 +18,33 @@ using namespace AltheaEngine;
 namespace flr {
 struct FlrParams;
 
+// Properties of the presentation target that a project is parsed against,
+// these are baked into the parsed result (SCREEN_WIDTH, display_image etc.)
+struct FlrTargetInfo {
+  VkExtent2D extent;
+  VkFormat displayFormat;
+  VkFormat depthFormat;
+
+  static FlrTargetInfo fromApplication(Application& app) {
+    return {
+        app.getSwapChainExtent(),
+        app.getSwapChainImageFormat(),
+        app.getDepthImageFormat()};
+  }
+};
+
 struct ParsedFlr {
+  struct IncrementalState;
+
   ParsedFlr(Application& app, const char* projectPath, const FlrParams& params);
+  // If the incremental state of a previous parse of the same project is
+  // provided, parsing resumes after the last part of it that is unaffected by
+  // file changes since then.
+  ParsedFlr(
+      const FlrTargetInfo& target,
+      const char* projectPath,
+      const FlrParams& params,
+      const IncrementalState* pPrevious = nullptr);
 
   AltheaEngine::ShaderLanguage m_language;
 
@@ -134,12 +162,56 @@ struct ParsedFlr {
   };
   std::vector<TaskButton> m_taskButtons;
   
+  // std430 layout derived from a struct body, see ParsedFlrLayout.cpp
+  struct StructLayout {
+    uint32_t size;
+    // 0 if the body uses types the layout can't be derived for
+    uint32_t alignment;
+    // bytes covered by fields, the rest of the size is padding
+    uint32_t dataSize;
+  };
   struct StructDef {
     std::string name;
     std::string body;
+    // stride of buffers of this struct, the std430 size unless given by
+    // struct_size
     uint32_t size;
+    StructLayout layout;
   };
   std::vector<StructDef> m_structDefs;
+  StructLayout computeStructLayout(const StructDef& s) const;
+  // Half precision type of a field that isn't stored in pairs, e.g. "half",
+  // empty if there is none. Such fields need 16-bit storage.
+  std::string findHalfScalarType(const StructDef& s) const;
+
+  // Field types stored packed into one or two uints, like half2 or
+  // unorm8x4. The generated code declares such fields with their storage
+  // type and provides pack_<type>() / unpack_<type>() along with accessors
+  // for each field. The conversions are function bodies taking the packed
+  // value as v and the unpacked value as x. See ParsedFlrLayout.cpp
+  struct PackedFieldType {
+    const char* name;
+    uint32_t size;
+    const char* glslType;
+    const char* glslStorage;
+    const char* glslUnpack;
+    const char* glslPack;
+    const char* hlslType;
+    const char* hlslStorage;
+    const char* hlslUnpack;
+    const char* hlslPack;
+  };
+  static const std::vector<PackedFieldType>& getPackedFieldTypes();
+  static const PackedFieldType* findPackedFieldType(const std::string& name);
+  struct PackedField {
+    std::string name;
+    const PackedFieldType* pType;
+  };
+  // Packed fields of the struct that aren't arrays
+  std::vector<PackedField> getPackedFields(const StructDef& s) const;
+  // Padding wasted by the struct of every buffer, along with a field order
+  // that wastes less if there is one
+  std::string describeBufferLayouts() const;
 
   enum BufferFlags : uint32_t {
     BF_NONE = 0,
@@ -148,7 +220,26 @@ struct ParsedFlr {
     BF_INDIRECT_ARGS = 1 << 2,
     BF_INDEX_BUFFER = 1 << 3,
     BF_READONLY = 1 << 4,
-    BF_SKIP_ZERO_INIT = 1 << 5
+    BF_SKIP_ZERO_INIT = 1 << 5,
+    BF_PREDICATE = 1 << 6,
+    BF_TRANSIENT = 1 << 7,
+    BF_SOA = 1 << 8
+  };
+
+  // A field of a struct stored as its own array in an soa buffer, see
+  // ParsedFlrLayout.cpp
+  struct SoaField {
+    std::string type;
+    std::string name;
+    // array dimensions of the field as written, e.g. "[4]"
+    std::string arrayDims;
+    // offset within the std430 struct
+    uint32_t structOffset;
+    uint32_t size;
+    // stride of the field array
+    uint32_t stride;
+    // offset of the field array within the buffer
+    uint64_t offset;
   };
   struct BufferDesc {
     std::string name;
@@ -163,8 +254,30 @@ struct ParsedFlr {
     bool isIndexBuffer() const { return flags & BF_INDEX_BUFFER; }
     bool isReadOnly() const { return flags & BF_READONLY; }
     bool shouldSkipZeroInit() const { return flags & BF_SKIP_ZERO_INIT; }
+    bool isPredicate() const { return flags & BF_PREDICATE; }
+    bool isTransient() const { return flags & BF_TRANSIENT; }
+    bool isSoa() const { return flags & BF_SOA; }
+
+    // only filled in for soa buffers
+    std::vector<SoaField> soaFields;
   };
   std::vector<BufferDesc> m_buffers;
+  bool computeSoaFields(BufferDesc& desc) const;
+  // Size of the buffer allocation, soa buffers pad each field array
+  uint64_t getBufferByteSize(const BufferDesc& desc) const;
+  // Soa buffers are read and written as if they were arrays of structs by
+  // anything outside of shaders, these convert between both views
+  static void packSoa(
+      const BufferDesc& desc,
+      uint32_t structSize,
+      uint32_t elemCount,
+      const char* aos,
+      char* soa);
+  static void unpackSoa(
+      const BufferDesc& desc,
+      uint32_t structSize,
+      const char* soa,
+      char* aos);
 
   struct BufferFile {
     std::string path;
@@ -173,6 +286,21 @@ struct ParsedFlr {
   };
   std::vector<BufferFile> m_bufferFiles;
 
+  // The contents of a transient buffer only live from its first to its last
+  // access within one run of the task list, or of a task block run on its
+  // own. Transient buffers whose live ranges never overlap share memory, they
+  // are placed at offsets within a single pool by allocateTransientBuffers(),
+  // which returns an error if a transient buffer is read before it is written
+  // in a list that runs on its own. See ParsedFlrTransients.cpp
+  struct TransientBuffer {
+    uint32_t bufferIdx;
+    uint64_t offset;
+    uint64_t size;
+  };
+  std::vector<TransientBuffer> m_transientBuffers;
+  uint64_t m_transientPoolSize;
+  std::string allocateTransientBuffers();
+
   struct ImageDesc {
     std::string name;
     std::string format;
@@ -193,11 +321,37 @@ struct ParsedFlr {
   };
   std::vector<TextureDesc> m_textures;
 
+  // Buffers and images a compute shader or draw-call declares to access with
+  // the reads / writes instructions. Once any access is declared in a project,
+  // the barriers and layout transitions between tasks are derived from these
+  // instead of being written by hand, see ParsedFlrBarriers.cpp. Every compute
+  // shader and draw-call then has to declare its access, "reads: none" if it
+  // doesn't access any buffer or image.
+  struct ResourceAccess {
+    struct BufferAccess {
+      uint32_t buffer;
+      VkAccessFlags accessFlags;
+    };
+    struct ImageAccess {
+      uint32_t image;
+      bool bWrite;
+    };
+    std::vector<BufferAccess> buffers;
+    std::vector<ImageAccess> images;
+    // set by any reads / writes instruction, even "reads: none"
+    bool bDeclared = false;
+
+    void addBuffer(uint32_t buffer, VkAccessFlags accessFlags);
+    void addImage(uint32_t image, bool bWrite);
+    void append(const ResourceAccess& other);
+  };
+
   struct ComputeShader {
     std::string name;
     uint32_t groupSizeX;
     uint32_t groupSizeY;
     uint32_t groupSizeZ;
+    ResourceAccess access;
   };
   std::vector<ComputeShader> m_computeShaders;
 
@@ -221,6 +375,8 @@ struct ParsedFlr {
   };
   static constexpr BufferResourceStateMapping BUFFER_RESOURCE_STATE_TABLE[] = {
     {"rw", VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT},
+    {"read", VK_ACCESS_SHADER_READ_BIT},
+    {"write", VK_ACCESS_SHADER_WRITE_BIT},
     {"indirectArgs", VK_ACCESS_INDIRECT_COMMAND_READ_BIT},
     {"indexBuffer", VK_ACCESS_INDEX_READ_BIT}
   };
@@ -285,6 +441,7 @@ struct ParsedFlr {
     AltheaEngine::PrimitiveType primType;
     float lineWidth;
     uint32_t flags;
+    ResourceAccess access;
 
     bool isDepthDisabled() const { return flags & DF_DISABLE_DEPTH; }
     bool isBackFaceCullingDisabled() const { return flags & DF_DISABLE_BACKFACECULL; }
@@ -311,7 +468,13 @@ struct ParsedFlr {
     TT_BARRIER,
     TT_RENDER,
     TT_TRANSITION,
-    TT_TASK
+    TT_TASK,
+    // idx of both is the repeat in m_repeats
+    TT_REPEAT,
+    TT_REPEAT_END,
+    // idx of both is the condition in m_conditions
+    TT_IF,
+    TT_IF_END
   };
   struct Task {
     uint32_t idx;
@@ -325,6 +488,62 @@ struct ParsedFlr {
   };
   std::vector<TaskBlock> m_taskBlocks;
 
+  // Tasks between repeat and repeat_end run count times in a row, or as many
+  // times as the slider is set to at runtime.
+  struct Repeat {
+    uint32_t count;
+    int sliderUintIdx;
+    // bit i is set for every ping_pong pair i listed after the count
+    uint32_t pingPongMask;
+  };
+  std::vector<Repeat> m_repeats;
+
+  // Buffers whose bindings trade places on every iteration of a repeat that
+  // lists them, "repeat: N ping_pong: a b", so an iteration reads what the
+  // previous one wrote without copying. Other repeats leave the pair alone.
+  // After a repeat the first buffer of a pair holds the result of the last
+  // iteration.
+  struct PingPongPair {
+    uint32_t buffers[2];
+  };
+  std::vector<PingPongPair> m_pingPongPairs;
+  // Every combination of swapped pairs gets descriptor sets of its own
+  static constexpr uint32_t MAX_PING_PONG_PAIRS = 4;
+
+  // Tasks between if and if_end are skipped while the condition is false.
+  // UI conditions are checked on the CPU when recording, so skipped tasks
+  // cost nothing. CS_BUFFER conditions are predicates written on the GPU,
+  // the first uint of the buffer, and use conditional rendering.
+  enum ConditionSource : uint8_t {
+    CS_CONST = 0,
+    CS_CHECKBOX,
+    CS_BUTTON,
+    CS_SLIDER_UINT,
+    CS_SLIDER_INT,
+    CS_BUFFER
+  };
+  struct Condition {
+    ConditionSource source;
+    // the value for CS_CONST, otherwise the ui element or buffer
+    uint32_t idx;
+    bool bNegate;
+  };
+  std::vector<Condition> m_conditions;
+
+  // Set when the project declares resource access on any compute shader or
+  // draw-call. The barrier and transition tasks above are then derived
+  // by inferBarriers() and any hand-written ones are dropped.
+  bool m_bInferBarriers;
+  void inferBarriers();
+  // Resources declared as accessed by a compute dispatch or render pass task,
+  // including its index and indirect args buffers
+  void gatherTaskAccess(const Task& task, ResourceAccess& access) const;
+  // Pipeline stages a task runs in, including indirect args and vertex input
+  VkPipelineStageFlags getTaskStages(const Task& task) const;
+  // Human readable listing of the task list and task blocks, including the
+  // barriers and transitions between tasks
+  std::string describeTaskPlan() const;
+
   enum FeatureFlag : uint32_t {
     FF_NONE = 0,
     FF_PERSPECTIVE_CAMERA = (1 << 0),
@@ -337,10 +556,55 @@ struct ParsedFlr {
   int m_displayImageIdx;
   int m_initializationTaskIdx;
 
+  // Task block run ahead of the task list each frame to advance the
+  // simulation, declared with simulation_task. With SM_SUBSTEPS it runs a
+  // fixed number of times per frame, with SM_FIXED_RATE as many times as fit
+  // into the elapsed time at the given rate (capped at substepCount).
+  enum SimulationMode : uint8_t { SM_SUBSTEPS = 0, SM_FIXED_RATE, SM_COUNT };
+  static constexpr char* SIMULATION_MODE_NAMES[SM_COUNT] = {
+      "substeps",
+      "fixed_rate"};
+  struct SimulationTask {
+    int taskBlockIdx;
+    SimulationMode mode;
+    uint32_t substepCount;
+    // steps per second, SM_FIXED_RATE only
+    float rate;
+  };
+  SimulationTask m_simulationTask;
+
+  // Task blocks that only run on every interval-th frame when run from a task
+  // list, on the frames where frameCount % interval == phase. Declared with
+  // task_cadence, blocks run by a task_button, the initialization_task or
+  // the simulation_task don't wait for their frame.
+  struct TaskCadence {
+    uint32_t taskBlockIdx;
+    uint32_t interval;
+    uint32_t phase;
+  };
+  std::vector<TaskCadence> m_taskCadences;
+  // the cadence of the task block, nullptr if it runs on every frame
+  const TaskCadence* findTaskCadence(uint32_t taskBlockIdx) const {
+    for (const TaskCadence& cadence : m_taskCadences)
+      if (cadence.taskBlockIdx == taskBlockIdx)
+        return &cadence;
+    return nullptr;
+  }
+  // Whether the tasks run a task block with a cadence, directly or through
+  // other blocks. Such task lists differ between frames and can't be recorded
+  // once and replayed.
+  bool runsCadencedTaskBlock(const std::vector<Task>& tasks) const;
+
   bool isFeatureEnabled(FeatureFlag feature) const {
     return (m_featureFlags & feature) != 0;
   }
 
+  bool hasDynamicData() const {
+    return !m_sliderUints.empty() || !m_sliderInts.empty() ||
+           !m_sliderFloats.empty() || !m_colorPickers.empty() ||
+           !m_checkboxes.empty() || !m_buttons.empty();
+  }
+
   static constexpr char* FEATURE_FLAG_NAMES[] = {
       "perspective_camera",
       "system_audio_input" // TODO: mic audio input
@@ -349,6 +613,55 @@ struct ParsedFlr {
   bool m_failed;
   char m_errMsg[2048];
 
+  // Warnings found while parsing, including those of the passes run on the
+  // parsed result. They are part of the .flrc cache and printed again when
+  // the project is loaded from it.
+  std::vector<std::string> m_warnings;
+  void emitWarning(std::string msg);
+  // set when the project was loaded from the .flrc cache instead of parsed
+  bool m_bLoadedFromCache;
+
+  // every .flr / .flrh file read while parsing, in the order they were opened
+  std::vector<std::string> m_sourceFiles;
+
+  // Include graph, parallel to m_sourceFiles. The project file and the
+  // implicitly included Fluorescence.flrh don't have a parent.
+  struct SourceFileInfo {
+    int parentIdx;
+    uint32_t includeLine;
+  };
+  std::vector<SourceFileInfo> m_includeGraph;
+
+  // Contiguous runs of instructions parsed from a single source file, in
+  // parse order. A file appears in several ranges when it includes others.
+  struct DeclarationRange {
+    uint32_t sourceFileIdx;
+    uint32_t firstLine;
+    uint32_t lastLine;
+    uint32_t firstInstr;
+    uint32_t endInstr;
+  };
+  std::vector<DeclarationRange> m_declarationRanges;
+
+  // Parser checkpoints taken at include boundaries, see ParsedFlr.cpp. Not
+  // part of the .flrc cache.
+  std::shared_ptr<const IncrementalState> m_pIncrementalState;
+  // number of instructions that were reused from a previous parse
+  uint32_t m_reusedInstrCount;
+
+  // Binary cache of the parsed project (.flrc), written next to the project.
+  // The cache is keyed on the contents of every source file along with a hash
+  // of the parse parameters. See ParsedFlrCache.cpp
+  static constexpr uint32_t CACHE_VERSION = 13;
+  bool loadCache(const std::filesystem::path& cachePath, uint64_t paramsHash);
+  void saveCache(const std::filesystem::path& cachePath, uint64_t paramsHash)
+      const;
+  bool isCacheable() const {
+    // assets loaded during parsing are not part of the cache
+    return m_bufferFiles.empty() && m_textureFiles.empty() &&
+           m_objModels.empty();
+  }
+
   enum Instr : uint8_t {
     I_CONST_UINT = 0,
     I_CONST_INT,
@@ -372,6 +685,8 @@ struct ParsedFlr {
     I_BUFFER_FILE,
     I_ENABLE_CPU_ACCESS,
     I_BUFFER_READONLY,
+    I_TRANSIENT,
+    I_SOA,
     I_COMPUTE_SHADER,
     I_COMPUTE_DISPATCH, // deprecated...
     I_DISPATCH_THREADS,
@@ -406,8 +721,17 @@ struct ParsedFlr {
     I_TASK_BLOCK_END,
     I_RUN_TASK,
     I_INITIALIZATION_TASK,
+    I_SIMULATION_TASK,
+    I_TASK_CADENCE,
+    I_REPEAT,
+    I_REPEAT_END,
+    I_PING_PONG,
+    I_IF,
+    I_IF_END,
     I_INCLUDE,
     I_LANGUAGE,
+    I_READS,
+    I_WRITES,
     I_COUNT
   };
 
@@ -434,6 +758,8 @@ struct ParsedFlr {
       "buffer_file",
       "enable_cpu_access",
       "buffer_readonly",
+      "transient",
+      "soa",
       "compute_shader",
       "compute_dispatch",
       "dispatch_threads",
@@ -468,8 +794,17 @@ struct ParsedFlr {
       "task_block_end",
       "run_task",
       "initialization_task",
+      "simulation_task",
+      "task_cadence",
+      "repeat",
+      "repeat_end",
+      "ping_pong",
+      "if",
+      "if_end",
       "include",
-      "language"};
+      "language",
+      "reads",
+      "writes"};
 
   struct ImageFormatTableEntry {
     const char* glslFormatName;
@@ -503,5 +838,7 @@ struct ParsedFlr {
 
 struct FlrParams {
   std::vector<ParsedFlr::ConstUint> m_uintParams;
+  // when false, the .flrc cache is neither read nor written
+  bool m_bUseCache = true;
 };
 } // namespace flr
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "GpuProfiler.h"
 #include "ParsedFlr.h"
 #include "Shared/CommonStructures.h"
 #include "SimpleObjLoader.h"
@@ -99,12 +100,29 @@ public:
       const TransientUniforms<FlrUniforms>& flrUniforms,
       const char* projectPath,
       const FlrParams& params);
+  // Creates the project from an already parsed flr, see ProjectLoader
+  Project(
+      SingleTimeCommandBuffer& commandBuffer,
+      const TransientUniforms<FlrUniforms>& flrUniforms,
+      const char* projectPath,
+      ParsedFlr&& parsed);
   ~Project();
 
   void tick(const FrameContext& frame);
 
   void draw(VkCommandBuffer commandBuffer, const FrameContext& frame);
 
+  // Decides how many steps of the simulation_task the next draw runs, given
+  // the time that passed since the last one
+  void advanceSimulation(float deltaTime);
+  uint32_t getSubstepCount() const { return m_substepCount; }
+  float getSubstepDeltaTime() const { return m_substepDeltaTime; }
+  float getSimulationTime() const { return static_cast<float>(m_simulationTime); }
+
+  // The frame count seen by the shaders, task blocks with a task_cadence are
+  // scheduled against it
+  void setFrameCount(uint32_t frameCount) { m_frameCount = frameCount; }
+
   TextureHandle getOutputTexture() const {
     return m_images[m_parsed.m_displayImageIdx].textureHandle;
   }
@@ -121,12 +139,28 @@ public:
 
   void tryRecompile();
 
+  struct LoadStats {
+    uint32_t pipelineCount;
+    // wall-clock time spent loading and compiling shaders, pipelines are
+    // compiled in parallel
+    double shaderCompileWallMs;
+    // shader stages loaded from the shader cache and ones compiled
+    uint32_t shaderCacheHits;
+    uint32_t shaderCacheMisses;
+    // sum of the compile times of the cache misses
+    double shaderCompileSerialMs;
+    // size of the transient buffers declared, and of the pool they share
+    uint64_t transientBufferBytes;
+    uint64_t transientPoolBytes;
+  };
+  const LoadStats& getLoadStats() const { return m_loadStats; }
+
   TaskBlockId findTaskBlock(const char* name) const;
   void executeTaskBlock(TaskBlockId id, VkCommandBuffer commandBuffer, const FrameContext& frame);
 
   ComputeShaderId findComputeShader(const char* name) const;
-  void dispatch(ComputeShaderId compShader, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, VkCommandBuffer commandBuffer, const FrameContext& frame) const;
-  void dispatchThreads(ComputeShaderId compShader, uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ, VkCommandBuffer commandBuffer, const FrameContext& frame) const;
+  void dispatch(ComputeShaderId compShader, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ, VkCommandBuffer commandBuffer, const FrameContext& frame);
+  void dispatchThreads(ComputeShaderId compShader, uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ, VkCommandBuffer commandBuffer, const FrameContext& frame);
 
   FlrUiView<bool> getCheckBox(const char* name) const;
   FlrUiView<float> getSliderFloat(const char* name) const;
@@ -138,7 +172,14 @@ public:
   std::optional<uint32_t> getConstUint(const char* name) const;
   std::optional<int> getConstInt(const char* name) const;
 
+  // Copies the image into a png once the GPU is done with the commands
+  // recorded so far, the display image if no name is given. Returns false
+  // with the reason if there is no image of that name or it isn't rgba8.
+  bool saveImage(const char* imageName, const std::string& fileName, VkCommandBuffer commandBuffer, std::string& errMsg);
+
   BufferId findBuffer(const char* name) const;
+  // Transient buffers have no allocation of their own, they have no
+  // sub-buffers
   BufferAllocation* getBufferAlloc(BufferId buf, uint32_t subBufIdx);
   uint32_t getSubBufferCount(BufferId buf) const;
   void barrierRW(BufferId buf, VkCommandBuffer commandBuffer) const;
@@ -146,15 +187,16 @@ public:
   void setPushConstants(uint32_t push0, uint32_t push1 = 0, uint32_t push2 = 0, uint32 push3 = 0);
 
   const ParsedFlr& getParsedFlr() const { return m_parsed; }
+  GpuProfiler& getGpuProfiler() { return m_gpuProfiler; }
   std::byte* getDynamicDataPtr() { return m_dynamicDataBuffer.data(); }
   size_t getDynamicDataSize() const { return m_dynamicDataBuffer.size(); }
 
 private:
-  void codeGenGlsl(const std::filesystem::path& autoGenFileName);
-  void codeGenHlsl(const std::filesystem::path& autoGenFileName);
   void serializeOptions();
   void loadOptions();
 
+  void recordImageSave(uint32_t imageIdx, const std::string& fileName, VkCommandBuffer commandBuffer);
+
   template <typename TValue, typename TUi>
   static FlrUiView<TValue> getUiElemByName(const char* name, const std::vector<TUi>& elems) {
     if (auto pElem = getElemByName(name, elems))
@@ -162,13 +204,33 @@ private:
     return FlrUiView<TValue>();
   }
 
-  void executeTaskList(const std::vector<ParsedFlr::Task>& tasks, VkCommandBuffer commandBuffer, const FrameContext& frame);
+  struct BakedTaskList;
+  struct BufferSyncState;
+  bool foldDispatch(uint32_t groupCounts[3], uint32_t& unfoldedGroupCountX, const char* shaderName);
+  void bakeTaskLists();
+  void bakeTaskList(const std::vector<ParsedFlr::Task>& tasks, BakedTaskList& baked);
+  void bakeBarriers(const std::vector<ParsedFlr::Task>& tasks, size_t begin, size_t end, std::vector<BufferSyncState>& states, BakedTaskList& baked);
+  VkPipelineStageFlags getConsumerShaderStages(const std::vector<ParsedFlr::Task>& tasks, size_t consumerIdx) const;
+  void addPendingStages(const ParsedFlr::Task& task, std::vector<BufferSyncState>& states) const;
+  void executeBakedTaskList(BakedTaskList& list, VkCommandBuffer commandBuffer, const FrameContext& frame);
+  void recordBakedCommands(const BakedTaskList& list, VkCommandBuffer commandBuffer, const FrameContext& frame, bool bSecondary);
+  void recordBakedCommandRange(const BakedTaskList& list, size_t begin, size_t end, VkCommandBuffer commandBuffer, const FrameContext& frame, bool bSecondary);
+  uint32_t getRepeatCount(uint32_t repeatIdx) const;
+  bool isConditionMet(uint32_t conditionIdx) const;
+  void beginGpuCondition(uint32_t conditionIdx, VkCommandBuffer commandBuffer);
+  VkDescriptorSet getProjectDescriptorSet(const FrameContext& frame);
+  void executeRenderPass(uint32_t passIdx, VkCommandBuffer commandBuffer, const FrameContext& frame);
+  void invalidateRecordedTaskLists();
 
   std::filesystem::path m_projPath;
   ParsedFlr m_parsed;
 
   std::vector<std::vector<BufferAllocation>> m_buffers;
-  std::vector<VkAccessFlags> m_bufferResourceStates;
+  // Transient buffers are ranges of this pool rather than allocations of
+  // their own, see ParsedFlr::allocateTransientBuffers()
+  BufferAllocation m_transientPool;
+  // index into m_parsed.m_transientBuffers per buffer, -1 if not transient
+  std::vector<int> m_transientSlots;
   std::vector<ImageResource> m_images;
   std::vector<ImageResource> m_textureFiles;
   std::vector<ComputePipeline> m_computePipelines;
@@ -187,6 +249,25 @@ private:
   std::vector<DrawPass> m_drawPasses;
 
   PerFrameResources m_descriptorSets;
+  // Same bindings with the buffers of some ping_pong pairs trading places, one
+  // per combination of swapped pairs. Entry i - 1 swaps the pairs set in i.
+  std::vector<PerFrameResources> m_swappedDescriptorSets;
+  // other buffer of the ping_pong pair per buffer, -1 if not in a pair
+  std::vector<int> m_pingPongPartners;
+  // Pairs whose swapped bindings are current, one bit per pair. A repeat
+  // toggles its pairs after every iteration, as commands are recorded.
+  uint32_t m_pingPongSwapMask;
+
+  // maxComputeWorkGroupCount of the device, queried once
+  uint32_t m_maxComputeWorkGroupCount[3];
+
+  // VK_EXT_conditional_rendering, null if the device doesn't have it. Projects
+  // with an if on a buffer then fail to load.
+  PFN_vkCmdBeginConditionalRenderingEXT m_pfnBeginConditionalRendering;
+  PFN_vkCmdEndConditionalRenderingEXT m_pfnEndConditionalRendering;
+  // Whether commands are being recorded within an if on a buffer. Task blocks
+  // are recorded inline there rather than executed as secondaries.
+  bool m_bInGpuCondition;
   DynamicBuffer m_dynamicUniforms;
   std::vector<std::byte> m_dynamicDataBuffer;
 
@@ -218,9 +299,96 @@ private:
     uint32_t push1;
     uint32_t push2;
     uint32_t push3;
+    uint32_t substepIdx;
+    // unfolded group count along x of a folded dispatch, 0 otherwise
+    uint32_t groupCountX;
   };
   GenericPush m_pushData;
 
+  void runSimulation(VkCommandBuffer commandBuffer, const FrameContext& frame);
+  uint32_t m_substepCount;
+  float m_substepDeltaTime;
+  // simulated time at the start of the next step
+  double m_simulationTime;
+  // SM_FIXED_RATE: elapsed time not simulated yet
+  float m_simulationAccumulator;
+
+  uint32_t m_frameCount;
+  // counts calls to draw, starting at 1 for the first frame
+  uint64_t m_drawIdx;
+
+  // Task lists are baked into flat command programs when the project is
+  // created, with pipeline indices, group counts, barrier structs and stage
+  // masks resolved up front.
+  enum BakedCommandType : uint8_t {
+    BC_DISPATCH,
+    BC_DISPATCH_INDIRECT,
+    BC_BARRIER,
+    BC_RENDER,
+    BC_TRANSITION,
+    BC_TASK,
+    BC_REPEAT,
+    BC_IF
+  };
+  struct BakedCommand {
+    BakedCommandType type;
+    // compute pipeline, first barrier in m_bakedBarriers, render pass, image,
+    // task block, repeat or condition
+    uint32_t idx;
+    // BC_DISPATCH: folded group counts and the unfolded count along x, see
+    // foldDispatch()
+    // BC_DISPATCH_INDIRECT: byte offset of the args
+    // BC_BARRIER: barrier count
+    // BC_TRANSITION: VkImageLayout and VkAccessFlags
+    // BC_REPEAT, BC_IF: number of commands in the body that follows
+    uint32_t params[4];
+    // BC_DISPATCH_INDIRECT: args buffer
+    VkBuffer buffer;
+    // BC_BARRIER
+    VkPipelineStageFlags srcStages;
+    // BC_BARRIER, BC_TRANSITION
+    VkPipelineStageFlags dstStages;
+  };
+  static constexpr uint32_t PING_PONG_STATES =
+      1u << ParsedFlr::MAX_PING_PONG_PAIRS;
+  struct BakedTaskList {
+    std::vector<BakedCommand> commands;
+    // Lists that only dispatch compute shaders are recorded once into a
+    // secondary command buffer per frame-in-flight and replayed after that.
+    // Render passes and layout transitions depend on the image layouts
+    // tracked on the CPU, lists containing them are recorded every time, as
+    // are lists with slider controlled repeat counts or UI conditions.
+    // Recordings bake in the ping_pong bindings, there is one for every
+    // combination of swapped pairs. They also bake in the push constants, a recording
+    // invalidated while the frame's command buffer references it is replaced
+    // from the next frame on, the list runs inline until then.
+    bool bStatic;
+    bool bRecorded[MAX_FRAMES_IN_FLIGHT][PING_PONG_STATES];
+    VkCommandBuffer recorded[MAX_FRAMES_IN_FLIGHT][PING_PONG_STATES];
+    // m_drawIdx of the last frame that executed each recording, 0 if none
+    uint64_t executedDraw[MAX_FRAMES_IN_FLIGHT][PING_PONG_STATES];
+    // the ping_pong pairs running the list toggles, known once recorded
+    uint32_t pingPongFlipMask;
+    // Task blocks with a task_cadence are only run from task lists on the
+    // frames where frameCount % cadenceInterval == cadencePhase, lists running
+    // them are recorded every time.
+    uint32_t cadenceInterval;
+    uint32_t cadencePhase;
+  };
+  struct BufferSyncState {
+    // stages the buffer was made visible to by its last barrier
+    VkPipelineStageFlags stageFlags;
+    // stages of the tasks that may have accessed the buffer since
+    VkPipelineStageFlags pendingStageFlags;
+  };
+  BakedTaskList m_bakedTaskList;
+  std::vector<BakedTaskList> m_bakedTaskBlocks;
+  std::vector<VkBufferMemoryBarrier> m_bakedBarriers;
+
+  GpuProfiler m_gpuProfiler;
+
+  LoadStats m_loadStats;
+
   bool m_bHasDynamicData;
   bool m_bFirstDraw;
 
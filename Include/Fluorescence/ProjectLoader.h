@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ParsedFlr.h"
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace flr {
+// Parses a project, generates its shader file and compiles all of its shaders
+// into the shader cache on a background thread. Creating the Project from the
+// result afterwards only has to create the GPU resources and pipelines, which
+// still needs to happen on the main thread.
+//
+// The shader file is generated into getPendingAutoGenFileName(), the running
+// project may still be hot-reloading shaders from the generated file. Once
+// the load is taken over, commitGeneratedCode() moves it into place.
+class ProjectLoader {
+public:
+  ProjectLoader(
+      const char* projPath,
+      const FlrParams& params,
+      const FlrTargetInfo& target,
+      std::shared_ptr<const ParsedFlr::IncrementalState> pPrevious = nullptr);
+  ~ProjectLoader();
+
+  ProjectLoader(const ProjectLoader&) = delete;
+  ProjectLoader& operator=(const ProjectLoader&) = delete;
+
+  bool isFinished() const { return m_bFinished.load(); }
+
+  // Asks the loader thread to stop at the next shader compile, it still has
+  // to be waited for with isFinished(). The destructor cancels as well.
+  void cancel() { m_bCancelled = true; }
+  bool isCancelled() const { return m_bCancelled.load(); }
+
+  const std::string& getProjectPath() const { return m_projPath; }
+
+  // Only valid once the loader is finished. Parse and shader compile errors
+  // are reported through the returned ParsedFlr.
+  std::unique_ptr<ParsedFlr> takeParsedFlr();
+
+  // Replaces the generated shader file of the project with the one generated
+  // by the loader. Only valid once the loader is finished.
+  void commitGeneratedCode();
+
+private:
+  void load();
+
+  std::string m_projPath;
+  FlrParams m_params;
+  FlrTargetInfo m_target;
+  std::shared_ptr<const ParsedFlr::IncrementalState> m_pPrevious;
+
+  std::unique_ptr<ParsedFlr> m_pParsed;
+  std::filesystem::path m_pendingAutoGenFileName;
+  std::filesystem::path m_autoGenFileName;
+
+  std::atomic<bool> m_bCancelled;
+  std::atomic<bool> m_bFinished;
+  std::thread m_thread;
+};
+} // namespace flr
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Althea/Shader.h>
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace AltheaEngine;
+
+namespace flr {
+// Directories the shader compiler searches for included files, besides the
+// directory of the including file for quoted includes
+std::vector<std::filesystem::path> getShaderIncludeDirs();
+
+// The engine's shader compiler makes no guarantee that it can be used from
+// several threads at once, every pipeline hot-reload holds this lock. Project
+// loads compile their shaders with compilers of their own, see
+// ShaderCache::compileShader(), and don't take it.
+std::mutex& getShaderCompilerMutex();
+
+// On-disk cache of compiled SPIR-V, one file per shader stage. Entries are
+// keyed on the contents of the shader source and every file it (transitively)
+// includes, along with the defines, language and stage it is compiled with.
+// Since the key is content based, the cache can be shared by all projects and
+// entries never need to be invalidated explicitly. Shaders that include
+// anything the cache can't resolve to a single file are compiled every time.
+class ShaderCache {
+public:
+  enum Stage : uint8_t { STAGE_COMPUTE = 0, STAGE_VERTEX, STAGE_PIXEL };
+
+  explicit ShaderCache(const std::filesystem::path& cacheDir);
+
+  // A shader stage as it is added to a pipeline builder, along with its cache
+  // key
+  struct ShaderDesc {
+    std::string path;
+    ShaderDefines defines;
+    ShaderLanguage language;
+    Stage stage;
+    // nullopt if the shader can't be cached
+    std::optional<uint64_t> key;
+  };
+
+  // nullopt if the shader can't be cached
+  std::optional<uint64_t> computeKey(
+      const std::string& path,
+      const ShaderDefines& defines,
+      ShaderLanguage language,
+      Stage stage);
+  ShaderDesc describe(
+      const std::string& path,
+      const ShaderDefines& defines,
+      ShaderLanguage language,
+      Stage stage);
+
+  bool load(uint64_t key, std::vector<uint32_t>& spirv) const;
+  void store(uint64_t key, const std::vector<uint32_t>& spirv) const;
+
+  struct CompileStats {
+    // shader stages loaded from the cache and ones compiled
+    uint32_t cacheHits = 0;
+    uint32_t cacheMisses = 0;
+    // time spent compiling the misses
+    double compileMs = 0.0;
+  };
+
+  // Sets the SPIR-V of the shaders added to the pipeline builder, loaded from
+  // the cache or compiled on the calling thread. The descriptions are given in
+  // the order the shaders were added to the builder. Returns the compile
+  // errors, if any.
+  template <typename TBuilder>
+  std::string compile(
+      TBuilder& builder,
+      const ShaderDesc* descs,
+      size_t count,
+      CompileStats& stats) const {
+    std::vector<ShaderBuilder>& shaders = builder.getShaderBuilders();
+    assert(shaders.size() == count);
+
+    for (size_t i = 0; i < count; i++) {
+      std::vector<uint32_t> spirv;
+      if (descs[i].key && load(*descs[i].key, spirv)) {
+        stats.cacheHits++;
+        shaders[i].setCompiledBinary(std::move(spirv));
+        continue;
+      }
+
+      stats.cacheMisses++;
+      auto start = std::chrono::high_resolution_clock::now();
+      std::string errors = compileShader(descs[i], spirv);
+      stats.compileMs += std::chrono::duration<double, std::milli>(
+                             std::chrono::high_resolution_clock::now() - start)
+                             .count();
+      if (errors.size())
+        return errors;
+
+      if (descs[i].key)
+        store(*descs[i].key, spirv);
+      shaders[i].setCompiledBinary(std::move(spirv));
+    }
+
+    return {};
+  }
+
+  // Compiles a single shader stage to SPIR-V with a compiler owned by the
+  // calling thread, so that cache misses compile concurrently. Returns the
+  // compile errors, if any.
+  static std::string
+  compileShader(const ShaderDesc& desc, std::vector<uint32_t>& spirv);
+
+private:
+  std::optional<uint64_t> hashSourceTree(const std::filesystem::path& path);
+
+  std::filesystem::path m_cacheDir;
+
+  // Source files are hashed at most once per cache instance, the generated
+  // file of a project is shared by all of its entry points.
+  std::unordered_map<std::string, std::optional<uint64_t>> m_sourceHashes;
+};
+} // namespace flr
@@ -9,6 +9,12 @@ struct FlrUniforms {
   uint frameCount;
   uint prevInputMask;
   uint inputMask;
+  // Simulation steps run this frame by the simulation_task, they are told
+  // apart by the substepIdx push constant. simulationTime is the time at the
+  // start of the first step.
+  uint substepCount;
+  float substepDeltaTime;
+  float simulationTime;
 };
 
 struct PerspectiveCamera {
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+namespace flr {
+// Low-overhead tracing of scoped CPU zones. Every thread records into its own
+// ring buffer without taking any locks, the oldest events are overwritten
+// once a ring is full. A capture records the next N frames and writes them as
+// a Chrome trace (chrome://tracing, ui.perfetto.dev) once they are done.
+// Outside of captures a zone only costs a relaxed atomic load.
+class CpuTracer {
+public:
+  static bool isEnabled() { return s_bEnabled.load(std::memory_order_relaxed); }
+
+  // Where captures are written to
+  static void setOutputPath(const std::filesystem::path& path);
+
+  // Records the next frameCount frames, a capture that is already running is
+  // restarted
+  static void captureFrames(uint32_t frameCount);
+
+  // Called once at the start of every frame on the main thread, writes the
+  // trace once the capture covers the requested number of frames
+  static void beginFrame();
+
+  // Zone names are not copied and must outlive the capture, e.g. string
+  // literals
+  static void beginZone(const char* name);
+  static void endZone();
+
+private:
+  static std::atomic<bool> s_bEnabled;
+};
+
+class TraceZone {
+public:
+  TraceZone(const char* name) : m_bActive(CpuTracer::isEnabled()) {
+    if (m_bActive)
+      CpuTracer::beginZone(name);
+  }
+  ~TraceZone() {
+    if (m_bActive)
+      CpuTracer::endZone();
+  }
+
+  TraceZone(const TraceZone&) = delete;
+  TraceZone& operator=(const TraceZone&) = delete;
+
+private:
+  bool m_bActive;
+};
+} // namespace flr
+
+#define FLR_TRACE_CONCAT_IMPL(A, B) A##B
+#define FLR_TRACE_CONCAT(A, B) FLR_TRACE_CONCAT_IMPL(A, B)
+#define FLR_TRACE_ZONE(NAME)                                                   \
+  ::flr::TraceZone FLR_TRACE_CONCAT(flrTraceZone, __LINE__)(NAME)
@@ -45,7 +45,7 @@ void CS_HandleInput() {
 }
 
 void CS_InitVelocity() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -54,7 +54,7 @@ void CS_InitVelocity() {
 }
 
 void CS_AdvectVelocity() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -63,7 +63,7 @@ void CS_AdvectVelocity() {
 }
 
 void CS_ComputeDivergence() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -72,7 +72,7 @@ void CS_ComputeDivergence() {
 }
 
 void CS_ComputePressureA() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -81,7 +81,7 @@ void CS_ComputePressureA() {
 }
 
 void CS_ComputePressureB() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -90,7 +90,7 @@ void CS_ComputePressureB() {
 }
 
 void CS_ResolveVelocity() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -99,7 +99,7 @@ void CS_ResolveVelocity() {
 }
 
 void CS_AdvectColor() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -156,7 +156,7 @@ void CS_HandleInput() {
 }
 
 void CS_InitVelocity() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -165,7 +165,7 @@ void CS_InitVelocity() {
 }
 
 void CS_ComputeCurl() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -174,7 +174,7 @@ void CS_ComputeCurl() {
 }
 
 void CS_AdvectVelocity() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -183,7 +183,7 @@ void CS_AdvectVelocity() {
 }
 
 void CS_ComputeDivergence() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -192,7 +192,7 @@ void CS_ComputeDivergence() {
 }
 
 void CS_ComputePressureA() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -201,7 +201,7 @@ void CS_ComputePressureA() {
 }
 
 void CS_ComputePressureB() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -210,7 +210,7 @@ void CS_ComputePressureB() {
 }
 
 void CS_ResolveVelocity() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
@@ -219,7 +219,7 @@ void CS_ResolveVelocity() {
 }
 
 void CS_AdvectColor() {
-  uint flatIdx = gl_GlobalInvocationID.x; 
+  uint flatIdx = getLinearThreadIdx();
   if (flatIdx >= CELLS_COUNT) {
     return;
   }
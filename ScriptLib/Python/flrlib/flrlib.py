@@ -60,6 +60,7 @@ class FlrCmdType(IntEnum):
   CMD_BUFFER_STAGED_UPLOAD = 6
   CMD_UNIFORM_WRITE = 7
   CMD_RUN_TASK = 8
+  CMD_CAPTURE_TRACE = 9
 
 # NOTE Keep in sync with eMessageType in IpcProgram.h
 class FlrMessageType(IntEnum):
@@ -575,6 +576,14 @@ class FlrScriptInterface:
       self.sharedMem.buf[self.perFrameOffset:end] = struct.pack("<II", FlrCmdType.CMD_RUN_TASK, handle.idx)
       self.perFrameOffset = end
 
+  # Records a CPU trace of the app's next frameCount frames, written next to the project
+  # as <project>_cpu_trace.json
+  def cmdCaptureTrace(self, frameCount : int):
+    end = self.perFrameOffset + 4 + 4
+    if self.__validateCmdAlloc(end):
+      self.sharedMem.buf[self.perFrameOffset:end] = struct.pack("<II", FlrCmdType.CMD_CAPTURE_TRACE, frameCount)
+      self.perFrameOffset = end
+
   def __cmdUintParam(self, name : str, value : int):
     ba = name.encode('utf-8')
     nameLen = len(ba)
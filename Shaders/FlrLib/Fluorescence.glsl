@@ -13,6 +13,10 @@ layout(push_constant) uniform _PushConstants{
   uint push1;
   uint push2;
   uint push3;
+  // index of the current simulation substep, 0 outside of the simulation_task
+  uint substepIdx;
+  // unfolded group count along x of a folded dispatch, 0 otherwise
+  uint _flrGroupCountX;
 };
 
 #ifdef IS_VERTEX_SHADER
@@ -69,6 +73,10 @@ ObjVertex FS_ObjVertex() {
 #endif // IS_OBJ_SHADER
 #endif // IS_VERTEX_SHADER
 
+float getSubstepTime() {
+  return uniforms.simulationTime + substepIdx * uniforms.substepDeltaTime;
+}
+
 float wave(float a, float b) {
   return 0.5 * sin(a * uniforms.time + b) + 0.5;
 }
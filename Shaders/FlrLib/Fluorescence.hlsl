@@ -16,6 +16,10 @@
   uint push1;
   uint push2;
   uint push3;
+  // index of the current simulation substep, 0 outside of the simulation_task
+  uint substepIdx;
+  // unused, hlsl dispatches are never folded
+  uint _flrGroupCountX;
 };
 
 #if 0
@@ -63,6 +67,10 @@ vec2 VS_Circle(uint vertexIdx, vec2 pos, float radius, uint circleVerts) {
 #endif // IS_VERTEX_SHADER
 #endif // ...
 
+float getSubstepTime() {
+  return uniforms.simulationTime + substepIdx * uniforms.substepDeltaTime;
+}
+
 float wave(float a, float b) {
   return 0.5 * sin(a * uniforms.time + b) + 0.5;
 }
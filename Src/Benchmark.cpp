@@ -0,0 +1,86 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <fstream>
+
+// clang-format off
+#include <Windows.h>
+#include <psapi.h>
+// clang-format on
+
+namespace flr {
+namespace {
+void writeJsonString(std::ofstream& stream, const std::string& str) {
+  stream << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      stream << '\\';
+    stream << c;
+  }
+  stream << '"';
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+  size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(idx, sorted.size() - 1)];
+}
+} // namespace
+
+void BenchmarkResults::recordPeakMemory() {
+  PROCESS_MEMORY_COUNTERS counters{};
+  counters.cb = sizeof(counters);
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return;
+
+  peakWorkingSetBytes = std::max<uint64_t>(
+      peakWorkingSetBytes,
+      counters.PeakWorkingSetSize);
+  peakPrivateBytes =
+      std::max<uint64_t>(peakPrivateBytes, counters.PeakPagefileUsage);
+}
+
+bool BenchmarkResults::writeJson(const std::filesystem::path& path) const {
+  std::ofstream stream(path, std::ios::trunc);
+  if (!stream.is_open())
+    return false;
+
+  std::vector<double> sortedFrameMs = cpuFrameMs;
+  std::sort(sortedFrameMs.begin(), sortedFrameMs.end());
+  double sumFrameMs = 0.0;
+  for (double ms : cpuFrameMs)
+    sumFrameMs += ms;
+
+  stream << "{\n  \"project\": ";
+  writeJsonString(stream, projectPath);
+  stream << ",\n  \"warmupFrames\": " << warmupFrameCount
+         << ",\n  \"frames\": " << frameCount
+         << ",\n  \"fixedDeltaTime\": " << fixedDeltaTime
+         << ",\n  \"loadMs\": " << loadMs;
+
+  stream << ",\n  \"cpuFrameMs\": {\"mean\": "
+         << (cpuFrameMs.empty() ? 0.0 : sumFrameMs / cpuFrameMs.size())
+         << ", \"median\": " << percentile(sortedFrameMs, 0.5)
+         << ", \"p95\": " << percentile(sortedFrameMs, 0.95)
+         << ", \"max\": " << percentile(sortedFrameMs, 1.0) << "}";
+
+  stream << ",\n  \"peakWorkingSetBytes\": " << peakWorkingSetBytes
+         << ",\n  \"peakPrivateBytes\": " << peakPrivateBytes;
+
+  stream << ",\n  \"gpuScopes\": [";
+  for (size_t i = 0; i < gpuScopes.size(); i++) {
+    const GpuProfiler::ScopeSummary& scope = gpuScopes[i];
+    stream << (i ? ",\n" : "\n") << "    {\"name\": ";
+    writeJsonString(stream, scope.name);
+    stream << ", \"frames\": " << scope.frameCount
+           << ", \"minMs\": " << scope.minMs
+           << ", \"meanMs\": " << scope.meanMs
+           << ", \"medianMs\": " << scope.medianMs
+           << ", \"maxMs\": " << scope.maxMs << "}";
+  }
+  stream << "\n  ]\n}\n";
+
+  return !stream.fail();
+}
+} // namespace flr
@@ -0,0 +1,886 @@
+#include "CodeGen.h"
+
+#include "Hash.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <fstream>
+#include <string>
+
+using namespace AltheaEngine;
+
+namespace flr {
+namespace {
+// Growable printf-style output buffer for the generated code. The content
+// hash is accumulated while appending.
+class CodeEmitter {
+public:
+  CodeEmitter() : m_hash(FNV_OFFSET_BASIS) { m_code.reserve(16 * 1024); }
+
+  void append(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int len = vsnprintf(nullptr, 0, fmt, argsCopy);
+    va_end(argsCopy);
+
+    if (len > 0) {
+      size_t offs = m_code.size();
+      // vsnprintf also writes the null terminator
+      m_code.resize(offs + len + 1);
+      vsnprintf(m_code.data() + offs, len + 1, fmt, args);
+      m_code.pop_back();
+      m_hash = hashBytes(m_code.data() + offs, len, m_hash);
+    }
+    va_end(args);
+  }
+
+  // The file is left untouched if it already holds the same code, so that
+  // its timestamp only changes along with its content
+  CodeGenResult writeIfChanged(const std::filesystem::path& path) const {
+    CodeGenResult result{m_hash, false};
+
+    {
+      std::ifstream existing(path, std::ios::binary | std::ios::ate);
+      if (existing.is_open() &&
+          static_cast<size_t>(existing.tellg()) == m_code.size()) {
+        std::string contents(m_code.size(), '\0');
+        existing.seekg(0);
+        existing.read(contents.data(), contents.size());
+        if (!existing.fail() && contents == m_code)
+          return result;
+      }
+    }
+
+    std::ofstream autoGenFile(path, std::ios::binary | std::ios::trunc);
+    if (autoGenFile.is_open()) {
+      autoGenFile.write(m_code.data(), m_code.size());
+      autoGenFile.close();
+      result.bWritten = true;
+    }
+
+    return result;
+  }
+
+private:
+  std::string m_code;
+  uint64_t m_hash;
+};
+
+// Replaces packed field types in the code with their storage types and flags
+// the packed types that were used
+std::string replacePackedFieldTypes(
+    const std::string& src,
+    bool bHlsl,
+    std::vector<bool>& usedPackedTypes) {
+  const auto& packedTypes = ParsedFlr::getPackedFieldTypes();
+  std::string out;
+  out.reserve(src.size());
+  size_t c = 0;
+  while (c < src.size()) {
+    if (!isalnum(static_cast<unsigned char>(src[c])) && src[c] != '_') {
+      out += src[c++];
+      continue;
+    }
+    size_t tokenEnd = c;
+    while (tokenEnd < src.size() &&
+           (isalnum(static_cast<unsigned char>(src[tokenEnd])) ||
+            src[tokenEnd] == '_'))
+      tokenEnd++;
+    std::string token = src.substr(c, tokenEnd - c);
+    c = tokenEnd;
+
+    if (auto pPacked = ParsedFlr::findPackedFieldType(token)) {
+      usedPackedTypes[pPacked - packedTypes.data()] = true;
+      out += bHlsl ? pPacked->hlslStorage : pPacked->glslStorage;
+    } else {
+      out += token;
+    }
+  }
+  return out;
+}
+
+const char* getStorageType(const std::string& type, bool bHlsl) {
+  if (auto pPacked = ParsedFlr::findPackedFieldType(type))
+    return bHlsl ? pPacked->hlslStorage : pPacked->glslStorage;
+  return type.c_str();
+}
+
+// Emits the struct declarations along with the conversions of the packed
+// field types they use. Packed fields are read with STRUCT_FIELD(S) and
+// written with STRUCT_set_FIELD(S, X), array fields use the conversions
+// directly.
+void emitStructDeclarations(
+    CodeEmitter& code,
+    const ParsedFlr& parsed,
+    bool bHlsl) {
+  const auto& packedTypes = ParsedFlr::getPackedFieldTypes();
+  std::vector<bool> usedPackedTypes(packedTypes.size());
+  std::vector<std::string> bodies;
+  bodies.reserve(parsed.m_structDefs.size());
+  for (const auto& s : parsed.m_structDefs)
+    bodies.push_back(replacePackedFieldTypes(s.body, bHlsl, usedPackedTypes));
+
+  for (size_t i = 0; i < packedTypes.size(); i++) {
+    if (!usedPackedTypes[i])
+      continue;
+    const auto& t = packedTypes[i];
+    const char* type = bHlsl ? t.hlslType : t.glslType;
+    const char* storage = bHlsl ? t.hlslStorage : t.glslStorage;
+    code.append(
+        "%s unpack_%s(%s v) { %s }\n",
+        type,
+        t.name,
+        storage,
+        bHlsl ? t.hlslUnpack : t.glslUnpack);
+    code.append(
+        "%s pack_%s(%s x) { %s }\n",
+        storage,
+        t.name,
+        type,
+        bHlsl ? t.hlslPack : t.glslPack);
+  }
+  if (std::find(usedPackedTypes.begin(), usedPackedTypes.end(), true) !=
+      usedPackedTypes.end())
+    code.append("\n");
+
+  for (size_t i = 0; i < parsed.m_structDefs.size(); i++) {
+    const auto& s = parsed.m_structDefs[i];
+    if (s.body.size() == 0) // skip dummy structs
+      continue;
+    code.append("%s;\n", bodies[i].c_str());
+    for (const auto& field : parsed.getPackedFields(s)) {
+      code.append(
+          "#define %s_%s(S) unpack_%s((S).%s)\n",
+          s.name.c_str(),
+          field.name.c_str(),
+          field.pType->name,
+          field.name.c_str());
+      code.append(
+          "#define %s_set_%s(S, X) (S).%s = pack_%s(X)\n",
+          s.name.c_str(),
+          field.name.c_str(),
+          field.name.c_str(),
+          field.pType->name);
+    }
+    code.append("\n");
+  }
+}
+
+// The field arrays of an soa buffer are accessed as NAME_FIELD(IDX), whole
+// elements are loaded and stored with NAME_load(IDX) / NAME_store(IDX, VALUE).
+// The syntax is the same in glsl and hlsl.
+void emitSoaAccessors(
+    CodeEmitter& code,
+    const ParsedFlr::BufferDesc& parsedBuf,
+    const ParsedFlr::StructDef& structdef) {
+  const char* bufName = parsedBuf.name.c_str();
+  for (const auto& field : parsedBuf.soaFields)
+    code.append(
+        "#define %s_%s(IDX) _SOA_%s_%s[IDX]\n",
+        bufName,
+        field.name.c_str(),
+        bufName,
+        field.name.c_str());
+
+  code.append(
+      "%s %s_load(uint IDX) {\n  %s v;\n",
+      structdef.name.c_str(),
+      bufName,
+      structdef.name.c_str());
+  for (const auto& field : parsedBuf.soaFields)
+    code.append(
+        "  v.%s = _SOA_%s_%s[IDX];\n",
+        field.name.c_str(),
+        bufName,
+        field.name.c_str());
+  code.append("  return v;\n}\n");
+
+  if (parsedBuf.isReadOnly())
+    return;
+  code.append(
+      "void %s_store(uint IDX, %s v) {\n",
+      bufName,
+      structdef.name.c_str());
+  for (const auto& field : parsedBuf.soaFields)
+    code.append(
+        "  _SOA_%s_%s[IDX] = v.%s;\n",
+        bufName,
+        field.name.c_str(),
+        field.name.c_str());
+  code.append("}\n");
+}
+} // namespace
+
+std::filesystem::path getAutoGenFileName(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath) {
+  std::filesystem::path autoGenFileName = projPath;
+  if (parsed.m_language == SHADER_LANGUAGE_GLSL)
+    autoGenFileName.replace_extension(".gen.glsl");
+  else
+    autoGenFileName.replace_extension(".gen.hlsl");
+  return autoGenFileName;
+}
+
+std::filesystem::path getPendingAutoGenFileName(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath) {
+  std::filesystem::path autoGenFileName = projPath;
+  if (parsed.m_language == SHADER_LANGUAGE_GLSL)
+    autoGenFileName.replace_extension(".gen.loading.glsl");
+  else
+    autoGenFileName.replace_extension(".gen.loading.hlsl");
+  return autoGenFileName;
+}
+
+CodeGenResult
+codeGen(const ParsedFlr& parsed, const std::filesystem::path& projPath) {
+  return codeGen(parsed, projPath, getAutoGenFileName(parsed, projPath));
+}
+
+CodeGenResult codeGen(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath,
+    const std::filesystem::path& autoGenFileName) {
+  if (parsed.m_language == SHADER_LANGUAGE_GLSL)
+    return codeGenGlsl(parsed, projPath, autoGenFileName);
+  else
+    return codeGenHlsl(parsed, projPath, autoGenFileName);
+}
+
+ShaderDefines getComputeShaderDefines(
+    const ParsedFlr& parsed,
+    const ParsedFlr::ComputeShader& c) {
+  ShaderDefines defs{};
+  defs.emplace("IS_COMP_SHADER", "");
+  if (parsed.m_language == SHADER_LANGUAGE_HLSL) {
+    /* char buf[128];
+     sprintf(buf, "__hack(){}\n[numthreads(%u,%u,%u)]\nvoid main", c.groupSizeX, c.groupSizeY, c.groupSizeZ);
+     defs.emplace(c.name, std::string(buf));*/
+    defs.emplace(c.name, "main");
+  }
+  defs.emplace(std::string("_ENTRY_POINT_") + c.name, "");
+  return defs;
+}
+
+ShaderDefines getVertexShaderDefines(
+    const ParsedFlr& parsed,
+    const ParsedFlr::RenderPass& pass,
+    const ParsedFlr::Draw& draw) {
+  ShaderDefines defs{};
+  defs.emplace("IS_VERTEX_SHADER", "");
+  if (draw.drawMode == ParsedFlr::DM_DRAW_OBJ)
+    defs.emplace("IS_OBJ_SHADER", "");
+  defs.emplace(std::string("_ENTRY_POINT_") + draw.vertexShader, "");
+  if (parsed.m_language == SHADER_LANGUAGE_HLSL)
+    defs.emplace(draw.vertexShader, "main");
+  defs.emplace(pass.name, "");
+  return defs;
+}
+
+ShaderDefines getPixelShaderDefines(
+    const ParsedFlr& parsed,
+    const ParsedFlr::RenderPass& pass,
+    const ParsedFlr::Draw& draw) {
+  ShaderDefines defs{};
+  defs.emplace("IS_PIXEL_SHADER", "");
+  if (draw.drawMode == ParsedFlr::DM_DRAW_OBJ)
+    defs.emplace("IS_OBJ_SHADER", "");
+  defs.emplace(std::string("_ENTRY_POINT_") + draw.pixelShader, "");
+  defs.emplace(pass.name, "");
+  return defs;
+}
+
+bool foldGroupCounts(uint32_t groupCounts[3], const uint32_t maxCounts[3]) {
+  if (groupCounts[0] <= maxCounts[0] && groupCounts[1] <= maxCounts[1] &&
+      groupCounts[2] <= maxCounts[2])
+    return true;
+  if (groupCounts[2] != 1)
+    return false;
+
+  auto divRoundUp = [](uint64_t a, uint64_t b) { return (a + b - 1) / b; };
+
+  uint64_t total = uint64_t(groupCounts[0]) * groupCounts[1];
+  uint64_t rows = divRoundUp(total, maxCounts[0]);
+  uint64_t layers = divRoundUp(rows, maxCounts[1]);
+  if (layers > maxCounts[2])
+    return false;
+
+  groupCounts[2] = static_cast<uint32_t>(layers);
+  groupCounts[1] = static_cast<uint32_t>(divRoundUp(rows, layers));
+  groupCounts[0] = static_cast<uint32_t>(
+      divRoundUp(total, uint64_t(groupCounts[1]) * groupCounts[2]));
+  return true;
+}
+
+CodeGenResult codeGenGlsl(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath,
+    const std::filesystem::path& autoGenFileName) {
+  assert(parsed.m_language == SHADER_LANGUAGE_GLSL);
+
+  CodeEmitter code;
+
+#define CODE_APPEND(...) code.append(__VA_ARGS__)
+
+  // glsl version / common includes
+  CODE_APPEND("#version 460 core\n\n");
+
+  // constant declarations
+  for (const auto& c : parsed.m_constInts)
+    CODE_APPEND("#define %s %d\n", c.name.c_str(), c.value);
+  for (const auto& c : parsed.m_constUints)
+    CODE_APPEND("#define %s %u\n", c.name.c_str(), c.value);
+  for (const auto& c : parsed.m_constFloats)
+    CODE_APPEND("#define %s %f\n", c.name.c_str(), c.value);
+  CODE_APPEND("\n");
+
+  // struct declarations
+  emitStructDeclarations(code, parsed, false);
+
+  // resource declarations
+  uint32_t slot = 0;
+  {
+    slot++;
+
+    for (int i = 0; i < parsed.m_buffers.size(); ++i) {
+      const auto& parsedBuf = parsed.m_buffers[i];
+      const auto& structdef = parsed.m_structDefs[parsedBuf.structIdx];
+
+      if (parsedBuf.isSoa()) {
+        for (const auto& field : parsedBuf.soaFields)
+          CODE_APPEND(
+              "layout(set=1,binding=%u) %sbuffer BUFFER_%s_%s {  %s "
+              "_SOA_%s_%s[]%s; };\n",
+              slot++,
+              parsedBuf.isReadOnly() ? "readonly " : "",
+              parsedBuf.name.c_str(),
+              field.name.c_str(),
+              getStorageType(field.type, false),
+              parsedBuf.name.c_str(),
+              field.name.c_str(),
+              field.arrayDims.c_str());
+        emitSoaAccessors(code, parsedBuf, structdef);
+      } else if (parsedBuf.bufferCount == 1) {
+        CODE_APPEND(
+            "layout(set=1,binding=%u) %sbuffer BUFFER_%s {  %s %s[]; };\n",
+            slot++,
+            parsedBuf.isReadOnly() ? "readonly " : "",
+            parsedBuf.name.c_str(),
+            structdef.name.c_str(),
+            parsedBuf.name.c_str());
+      } else {
+        CODE_APPEND(
+            "layout(set=1,binding=%u) %sbuffer BUFFER_%s {  %s _INNER_%s[]; } "
+            "_HEAP_%s [%u];\n",
+            slot++,
+            parsedBuf.isReadOnly() ? "readonly " : "",
+            parsedBuf.name.c_str(),
+            structdef.name.c_str(),
+            parsedBuf.name.c_str(),
+            parsedBuf.name.c_str(),
+            parsedBuf.bufferCount);
+        CODE_APPEND(
+            "#define %s(IDX) _HEAP_%s[IDX]._INNER_%s\n",
+            parsedBuf.name.c_str(),
+            parsedBuf.name.c_str(),
+            parsedBuf.name.c_str());
+      }
+    }
+
+    for (int i = 0; i < parsed.m_images.size(); ++i) {
+      const auto& desc = parsed.m_images[i];
+      if ((desc.createOptions.usage & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
+        continue;
+
+      CODE_APPEND(
+          "layout(set=1,binding=%u, %s) uniform image2D %s;\n",
+          slot++,
+          desc.format.c_str(),
+          desc.name.c_str());
+    }
+
+    for (int i = 0; i < parsed.m_textures.size(); ++i) {
+      const auto& txDesc = parsed.m_textures[i];
+      assert(txDesc.imageIdx >= 0 || txDesc.texFileIdx >= 0);
+      CODE_APPEND(
+          "layout(set=1,binding=%u) uniform sampler2D %s;\n",
+          slot++,
+          txDesc.name.c_str());
+    }
+
+    if (parsed.hasDynamicData()) {
+      CODE_APPEND(
+          "\nlayout(set=1, binding=%u) uniform _UserUniforms {\n",
+          slot++);
+
+      for (const auto& cpicker : parsed.m_colorPickers) {
+        CODE_APPEND("\tvec4 %s;\n", cpicker.name.c_str());
+      }
+      for (const auto& uslider : parsed.m_sliderUints) {
+        CODE_APPEND("\tuint %s;\n", uslider.name.c_str());
+      }
+      for (const auto& islider : parsed.m_sliderInts) {
+        CODE_APPEND("\tint %s;\n", islider.name.c_str());
+      }
+      for (const auto& fslider : parsed.m_sliderFloats) {
+        CODE_APPEND("\tfloat %s;\n", fslider.name.c_str());
+      }
+      for (const auto& checkbox : parsed.m_checkboxes) {
+        CODE_APPEND("\tbool %s;\n", checkbox.name.c_str());
+      }
+      for (const auto& button : parsed.m_buttons) {
+        CODE_APPEND("\tbool %s;\n", button.name.c_str());
+      }
+
+      CODE_APPEND("};\n\n");
+    }
+  }
+
+  // includes
+  CODE_APPEND("#include <FlrLib/Fluorescence.glsl>\n\n");
+
+  // camera uniforms (references included structs)
+  if (parsed.isFeatureEnabled(ParsedFlr::FF_PERSPECTIVE_CAMERA)) {
+    CODE_APPEND(
+        "layout(set=1, binding=%u) uniform _CameraUniforms { PerspectiveCamera "
+        "camera; };\n\n",
+        slot++);
+  }
+
+  // audio uniforms
+  if (parsed.isFeatureEnabled(ParsedFlr::FF_SYSTEM_AUDIO_INPUT)) {
+    CODE_APPEND(
+        "layout(set=1, binding=%u) uniform _AudioUniforms { AudioInput "
+        "audio; };\n\n",
+        slot++);
+  }
+
+  for (int i = 0; i < parsed.m_objModels.size(); ++i) {
+    const auto& objName = parsed.m_objModels[i].name;
+    CODE_APPEND(
+        "layout(set=1,binding=%u) readonly buffer BUFFER_%s_VB { ObjVertex "
+        "%s_vertices[]; };\n",
+        slot++,
+        objName.c_str(),
+        objName.c_str());
+    CODE_APPEND(
+        "layout(set=1,binding=%u) readonly buffer BUFFER_%s_IB { uint "
+        "%s_indices[]; };\n",
+        slot++,
+        objName.c_str(),
+        objName.c_str());
+  }
+
+  // auto-gen pixel shader block, pre-include of user-file
+  {
+    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
+    for (const auto& pass : parsed.m_renderPasses) {
+      for (const auto& draw : pass.draws) {
+        CODE_APPEND(
+            "#if defined(_ENTRY_POINT_%s) && "
+            "!defined(_ENTRY_POINT_%s_ATTACHMENTS)\n",
+            draw.pixelShader.c_str(),
+            draw.pixelShader.c_str());
+        CODE_APPEND(
+            "#define _ENTRY_POINT_%s_ATTACHMENTS\n",
+            draw.pixelShader.c_str());
+        uint32_t colorAttachmentIdx = 0;
+        for (const auto& attachmentRef : pass.attachments) {
+          const auto& img = parsed.m_images[attachmentRef.imageIdx];
+          if ((img.createOptions.usage &
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            CODE_APPEND(
+                "layout(location = %d) out vec4 %s;\n",
+                colorAttachmentIdx++,
+                attachmentRef.aliasName.c_str());
+          }
+        }
+        CODE_APPEND("#endif // _ENTRY_POINT_%s\n", draw.pixelShader.c_str());
+      }
+    }
+    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
+  }
+
+  // compute shader group sizes and thread index helpers, ahead of the
+  // user-file since gl_WorkGroupSize can only be used after the group size
+  // is declared
+  {
+    CODE_APPEND("#ifdef IS_COMP_SHADER\n");
+    for (const auto& c : parsed.m_computeShaders) {
+      if (c.groupSizeX == 0 || c.groupSizeY == 0 || c.groupSizeZ == 0)
+        continue;
+      CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", c.name.c_str());
+      CODE_APPEND(
+          "layout(local_size_x = %u, local_size_y = %u, local_size_z = %u) "
+          "in;\n",
+          c.groupSizeX,
+          c.groupSizeY,
+          c.groupSizeZ);
+      CODE_APPEND("#endif // _ENTRY_POINT_%s\n", c.name.c_str());
+    }
+    // Dispatches with more groups than the device allows are folded into all
+    // three dimensions, see foldGroupCounts(). These give the index of the
+    // thread within the unfolded dispatch, for 1D and 2D dispatches.
+    CODE_APPEND(
+        "#define _FLR_LINEAR_GROUP_IDX (gl_WorkGroupID.x + gl_NumWorkGroups.x "
+        "* (gl_WorkGroupID.y + gl_NumWorkGroups.y * gl_WorkGroupID.z))\n");
+    CODE_APPEND(
+        "#define getLinearThreadIdx() (_FLR_LINEAR_GROUP_IDX * "
+        "(gl_WorkGroupSize.x * gl_WorkGroupSize.y * gl_WorkGroupSize.z) + "
+        "gl_LocalInvocationIndex)\n");
+    // _flrGroupCountX is the unfolded group count along x, 0 if the dispatch
+    // is not folded
+    CODE_APPEND(
+        "#define getThreadIdx2D() (_flrGroupCountX == 0 ? "
+        "gl_GlobalInvocationID.xy : uvec2(_FLR_LINEAR_GROUP_IDX % "
+        "_flrGroupCountX, _FLR_LINEAR_GROUP_IDX / _flrGroupCountX) * "
+        "gl_WorkGroupSize.xy + gl_LocalInvocationID.xy)\n");
+    CODE_APPEND(
+        "#define isThreadInBounds(COUNT) (getLinearThreadIdx() < (COUNT))\n");
+    CODE_APPEND(
+        "#define isThreadInBounds2D(EXTENT) all(lessThan(getThreadIdx2D(), "
+        "uvec2(EXTENT)))\n");
+    CODE_APPEND("#endif // IS_COMP_SHADER\n\n");
+  }
+
+  std::filesystem::path shaderFileName = projPath;
+  shaderFileName.replace_extension(".glsl");
+
+  std::string userShaderName = shaderFileName.filename().string();
+  CODE_APPEND("#include \"%s\"\n\n", userShaderName.c_str());
+
+  // auto-gen compute shader block, post-include of user-file
+  {
+    CODE_APPEND("#ifdef IS_COMP_SHADER\n");
+    for (const auto& c : parsed.m_computeShaders) {
+      CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", c.name.c_str());
+      if (c.groupSizeX > 0 && c.groupSizeY > 0 && c.groupSizeZ > 0) {
+        CODE_APPEND("void main() { %s(); }\n", c.name.c_str());
+      } else {
+        CODE_APPEND("#define %s main\n", c.name.c_str());
+      }
+      CODE_APPEND("#endif // _ENTRY_POINT_%s\n", c.name.c_str());
+    }
+    CODE_APPEND("#endif // IS_COMP_SHADER\n");
+  }
+
+  // auto-gen vertex shader block, post-include of user-file
+  {
+    CODE_APPEND("\n\n#ifdef IS_VERTEX_SHADER\n");
+    for (const auto& pass : parsed.m_renderPasses) {
+      for (const auto& draw : pass.draws) {
+        CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", draw.vertexShader.c_str());
+        if (draw.vertexOutputStructIdx >= 0) {
+          CODE_APPEND(
+              "layout(location = 0) out %s _VERTEX_OUTPUT;\n",
+              parsed.m_structDefs[draw.vertexOutputStructIdx].name.c_str());
+          CODE_APPEND(
+              "void main() { _VERTEX_OUTPUT = %s(%s); }\n",
+              draw.vertexShader.c_str(),
+              (draw.drawMode == ParsedFlr::DM_DRAW_OBJ) ? "FS_ObjVertex()" : "");
+        } else {
+          CODE_APPEND("void main() { %s(%s); }\n", 
+            draw.vertexShader.c_str(),
+            (draw.drawMode == ParsedFlr::DM_DRAW_OBJ) ? "FS_ObjVertex()" : "");
+        }
+        CODE_APPEND("#endif // _ENTRY_POINT_%s\n", draw.vertexShader.c_str());
+      }
+    }
+    CODE_APPEND("#endif // IS_VERTEX_SHADER\n");
+  }
+
+  // auto-gen pixel shader block, post-include of user-file
+  {
+    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
+    for (const auto& pass : parsed.m_renderPasses) {
+      for (const auto& draw : pass.draws) {
+        CODE_APPEND(
+            "#if defined(_ENTRY_POINT_%s) && "
+            "!defined(_ENTRY_POINT_%s_INTERPOLANTS)\n",
+            draw.pixelShader.c_str(),
+            draw.pixelShader.c_str());
+        CODE_APPEND(
+            "#define _ENTRY_POINT_%s_INTERPOLANTS\n",
+            draw.pixelShader.c_str());
+
+        if (draw.vertexOutputStructIdx >= 0) {
+          CODE_APPEND(
+              "layout(location = 0) in %s _VERTEX_INPUT;\n",
+              parsed.m_structDefs[draw.vertexOutputStructIdx].name.c_str());
+          CODE_APPEND(
+              "void main() { %s(_VERTEX_INPUT); }\n",
+              draw.pixelShader.c_str());
+        } else {
+          CODE_APPEND("void main() { %s(); }\n", draw.pixelShader.c_str());
+        }
+        CODE_APPEND("#endif // _ENTRY_POINT_%s\n", draw.pixelShader.c_str());
+      }
+    }
+    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
+  }
+#undef CODE_APPEND
+
+  return code.writeIfChanged(autoGenFileName);
+}
+
+CodeGenResult codeGenHlsl(
+    const ParsedFlr& parsed,
+    const std::filesystem::path& projPath,
+    const std::filesystem::path& autoGenFileName) {
+  assert(parsed.m_language == SHADER_LANGUAGE_HLSL);
+
+  CodeEmitter code;
+
+#define CODE_APPEND(...) code.append(__VA_ARGS__)
+
+  // constant declarations
+  for (const auto& c : parsed.m_constInts)
+    CODE_APPEND("#define %s %d\n", c.name.c_str(), c.value);
+  for (const auto& c : parsed.m_constUints)
+    CODE_APPEND("#define %s %u\n", c.name.c_str(), c.value);
+  for (const auto& c : parsed.m_constFloats)
+    CODE_APPEND("#define %s %f\n", c.name.c_str(), c.value);
+  CODE_APPEND("\n");
+
+  // struct declarations
+  emitStructDeclarations(code, parsed, true);
+
+  // resource declarations
+  uint32_t slot = 0;
+  {
+    slot++;
+
+    for (int i = 0; i < parsed.m_buffers.size(); ++i) {
+      const auto& parsedBuf = parsed.m_buffers[i];
+      const auto& structdef = parsed.m_structDefs[parsedBuf.structIdx];
+
+      if (parsedBuf.isSoa()) {
+        for (const auto& field : parsedBuf.soaFields)
+          CODE_APPEND(
+              "[[vk::binding(%u, 1)]] %sStructuredBuffer<%s> _SOA_%s_%s;\n",
+              slot++,
+              parsedBuf.isReadOnly() ? "" : "RW",
+              getStorageType(field.type, true),
+              parsedBuf.name.c_str(),
+              field.name.c_str());
+        emitSoaAccessors(code, parsedBuf, structdef);
+      } else if (parsedBuf.bufferCount == 1) {
+        CODE_APPEND(
+            "[[vk::binding(%u, 1)]] %sStructuredBuffer<%s> %s;\n",
+            slot++,
+            parsedBuf.isReadOnly() ? "" : "RW",
+            structdef.name.c_str(),
+            parsedBuf.name.c_str());
+      } else {
+        assert(false); // TODO impl support for buffer heaps...
+        /*  CODE_APPEND(
+            "layout(set=1,binding=%u) buffer BUFFER_%s {  %s _INNER_%s[]; } _HEAP_%s [%u];\n",
+            slot++,
+            parsedBuf.name.c_str(),
+            structdef.name.c_str(),
+            parsedBuf.name.c_str(),
+            parsedBuf.name.c_str(),
+            parsedBuf.bufferCount);
+          CODE_APPEND(
+            "#define %s(IDX) _HEAP_%s[IDX]._INNER_%s\n",
+            parsedBuf.name.c_str(),
+            parsedBuf.name.c_str(),
+            parsedBuf.name.c_str());*/
+      }
+    }
+
+    for (int i = 0; i < parsed.m_images.size(); ++i) {
+      const auto& desc = parsed.m_images[i];
+      if ((desc.createOptions.usage & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
+        continue;
+
+      CODE_APPEND(
+          "[[vk::binding(%u, 1)]] RWTexture2D<%s> %s;\n",
+          slot++,
+          desc.format.c_str(),
+          desc.name.c_str());
+    }
+
+    for (int i = 0; i < parsed.m_textures.size(); ++i) {
+      const auto& txDesc = parsed.m_textures[i];
+      assert(txDesc.imageIdx >= 0 || txDesc.texFileIdx >= 0);
+      CODE_APPEND(
+          "[[vk::binding(%u, 1)]] Texture2D %s;\n",
+          slot++,
+          txDesc.name.c_str());
+    }
+
+    if (parsed.hasDynamicData()) {
+      CODE_APPEND("\n[[vk::binding(%u, 1)]] cbuffer _UserUniforms {\n", slot++);
+
+      for (const auto& cpicker : parsed.m_colorPickers) {
+        CODE_APPEND("\tfloat4 %s;\n", cpicker.name.c_str());
+      }
+      for (const auto& uslider : parsed.m_sliderUints) {
+        CODE_APPEND("\tuint %s;\n", uslider.name.c_str());
+      }
+      for (const auto& islider : parsed.m_sliderInts) {
+        CODE_APPEND("\tint %s;\n", islider.name.c_str());
+      }
+      for (const auto& fslider : parsed.m_sliderFloats) {
+        CODE_APPEND("\tfloat %s;\n", fslider.name.c_str());
+      }
+      for (const auto& checkbox : parsed.m_checkboxes) {
+        CODE_APPEND("\tbool %s;\n", checkbox.name.c_str());
+      }
+      for (const auto& button : parsed.m_buttons) {
+        CODE_APPEND("\tbool %s;\n", button.name.c_str());
+      }
+
+      CODE_APPEND("};\n\n");
+    }
+  }
+
+  // TODO - both compute shader and vertex shader entry points are compiled
+  // by swapping in "main" via macros
+  // Would be better to use the compiler feature that does this automatically
+  for (const auto& c : parsed.m_computeShaders) {
+    CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", c.name.c_str());
+    CODE_APPEND("#define %s main\n", c.name.c_str());
+    CODE_APPEND("#endif // _ENTRY_POINT_%s\n\n", c.name.c_str());
+  }
+
+  {
+    CODE_APPEND("\n\n#ifdef IS_VERTEX_SHADER\n");
+    for (const auto& pass : parsed.m_renderPasses) {
+      for (const auto& draw : pass.draws) {
+        CODE_APPEND(
+            "#if defined(_ENTRY_POINT_%s) && !defined(%s)\n",
+            draw.vertexShader.c_str(),
+            draw.vertexShader.c_str());
+        CODE_APPEND("#define %s main\n", draw.vertexShader.c_str());
+        CODE_APPEND(
+            "#endif // defined(_ENTRY_POINT_%s) && !defined(%s)\n\n",
+            draw.vertexShader.c_str(),
+            draw.vertexShader.c_str());
+      }
+    }
+    CODE_APPEND("#endif // IS_VERTEX_SHADER\n\n");
+  }
+
+  // TODO have a special subdir for hlsl versions of FlrLib ?
+  // includes
+  CODE_APPEND("#include <FlrLib/Fluorescence.hlsl>\n\n");
+
+  // camera uniforms (references included structs)
+  if (parsed.isFeatureEnabled(ParsedFlr::FF_PERSPECTIVE_CAMERA)) {
+    CODE_APPEND(
+        "[[vk::binding(%u, 1)]] cbuffer _CameraUniforms { PerspectiveCamera "
+        "camera; };\n\n",
+        slot++);
+  }
+
+  // audio uniforms
+  if (parsed.isFeatureEnabled(ParsedFlr::FF_SYSTEM_AUDIO_INPUT)) {
+    CODE_APPEND(
+        "[[vk::binding(%u, 1)]] cbuffer _AudioUniforms { AudioInput audio; "
+        "};\n\n",
+        slot++);
+  }
+
+  for (int i = 0; i < parsed.m_objModels.size(); ++i) {
+    const auto& objName = parsed.m_objModels[i].name;
+    CODE_APPEND(
+        "[[vk::binding(%u, 1)]] StructuredBuffer<ObjVertex> %s_vertices;\n",
+        slot++,
+        objName.c_str());
+    CODE_APPEND(
+        "[[vk::binding(%u, 1)]] Buffer<uint> %s_indices;\n",
+        slot++,
+        objName.c_str());
+  }
+
+  // auto-gen pixel shader block, pre-include of user-file
+  {
+    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
+    for (const auto& pass : parsed.m_renderPasses) {
+      for (const auto& attachmentRef : pass.attachments) {
+        const auto& img = parsed.m_images[attachmentRef.imageIdx];
+        if ((img.createOptions.usage &
+             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+          CODE_APPEND(
+              "#ifndef _ATTACHMENT_VAR_%s\n",
+              attachmentRef.aliasName.c_str());
+          CODE_APPEND(
+              "#define _ATTACHMENT_VAR_%s\n",
+              attachmentRef.aliasName.c_str());
+          CODE_APPEND("static float4 %s;\n", attachmentRef.aliasName.c_str());
+          CODE_APPEND(
+              "#endif // _ATTACHMENT_VAR_ %s\n",
+              attachmentRef.aliasName.c_str());
+        }
+      }
+    }
+    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
+  }
+
+  std::filesystem::path shaderFileName = projPath;
+  shaderFileName.replace_extension(".hlsl");
+
+  std::string userShaderName = shaderFileName.filename().string();
+  CODE_APPEND("#include \"%s\"\n\n", userShaderName.c_str());
+
+  {
+    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
+    for (const auto& pass : parsed.m_renderPasses) {
+      for (const auto& draw : pass.draws) {
+        CODE_APPEND(
+            "#if defined(_ENTRY_POINT_%s) && !defined(_PS_WRAPPER)\n",
+            draw.pixelShader.c_str());
+        CODE_APPEND("#define _PS_WRAPPER\n");
+        CODE_APPEND("struct _PixelOutput {\n");
+        uint32_t colorAttachmentIdx = 0;
+        for (const auto& attachmentRef : pass.attachments) {
+          const auto& img = parsed.m_images[attachmentRef.imageIdx];
+          if ((img.createOptions.usage &
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            CODE_APPEND(
+                "\tfloat4 _%s : SV_Target%u;\n",
+                attachmentRef.aliasName.c_str(),
+                colorAttachmentIdx++);
+          }
+        }
+        const auto& structdef =
+            parsed.m_structDefs[draw.vertexOutputStructIdx];
+        CODE_APPEND("}; // struct _PixelOutput\n");
+        CODE_APPEND("_PixelOutput main(%s IN) {\n", structdef.name.c_str());
+        CODE_APPEND("\t_PixelOutput OUT;\n");
+        CODE_APPEND("\t%s(IN);\n", draw.pixelShader.c_str());
+        for (const auto& attachmentRef : pass.attachments) {
+          const auto& img = parsed.m_images[attachmentRef.imageIdx];
+          if ((img.createOptions.usage &
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
+            CODE_APPEND(
+                "\tOUT._%s = %s;\n",
+                attachmentRef.aliasName.c_str(),
+                attachmentRef.aliasName.c_str());
+          }
+        }
+        CODE_APPEND("\treturn OUT;\n");
+        CODE_APPEND("}\n");
+        CODE_APPEND(
+            "#endif // defined(_ENTRY_POINT_%s) && !defined(_PS_WRAPPER)\n",
+            draw.pixelShader.c_str());
+      }
+    }
+    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
+  }
+#undef CODE_APPEND
+
+  return code.writeIfChanged(autoGenFileName);
+}
+
+} // namespace flr
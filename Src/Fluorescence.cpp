@@ -1,6 +1,8 @@
 #include "Fluorescence.h"
 
 #include "GraphEditor/Graph.h"
+#include "ShaderCache.h"
+#include "Trace.h"
 
 #include <Althea/Application.h>
 #include <Althea/Camera.h>
@@ -27,13 +29,18 @@
 
 #include <array>
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 static char s_filename[512] = {0};
 
+// frames covered by a CPU trace started with ctrl+shift+G
+static constexpr uint32_t CPU_TRACE_FRAME_COUNT = 120;
+
 using namespace AltheaEngine;
 
 namespace flr {
@@ -45,6 +52,20 @@ void Fluorescence::setStartupProject(const char* path) {
   m_bReloadProject = true;
 }
 
+void Fluorescence::setHeadless(const FlrHeadlessOptions& options) {
+  m_headless = options;
+  if (m_headless->saveInterval == 0)
+    m_headless->saveInterval = 1;
+
+  if (!m_headless->benchmarkPath.empty()) {
+    m_bProfileGpu = true;
+    m_benchmark.warmupFrameCount = m_headless->warmupFrameCount;
+    m_benchmark.frameCount = m_headless->frameCount;
+    m_benchmark.fixedDeltaTime = m_headless->fixedDeltaTime;
+    m_benchmark.cpuFrameMs.reserve(m_headless->frameCount);
+  }
+}
+
 Fluorescence::Fluorescence(const FlrAppOptions& options)
   : m_options(options) {}
 
@@ -59,13 +80,14 @@ void Fluorescence::initGame(Application& app) {
   input.addKeyBinding(
       {GLFW_KEY_R, GLFW_PRESS, GLFW_MOD_CONTROL},
       [&app, this]() {
-        m_displayPass.tryRecompile(app);
-        if (m_pProject) {
-          if (m_pProject->hasFailed()) {
-            m_bReloadProject = true;
-          } else {
-            m_pProject->tryRecompile();
-          }
+        {
+          std::lock_guard<std::mutex> lock(getShaderCompilerMutex());
+          m_displayPass.tryRecompile(app);
+        }
+        if (m_pProject && m_loadErrMsg.empty()) {
+          m_pProject->tryRecompile();
+        } else {
+          m_bReloadProject = true;
         }
       });
 
@@ -75,7 +97,10 @@ void Fluorescence::initGame(Application& app) {
   input.addKeyBinding(
       {GLFW_KEY_R, GLFW_PRESS, GLFW_MOD_CONTROL | GLFW_MOD_SHIFT},
       [&app, this]() {
-        m_displayPass.tryRecompile(app);
+        {
+          std::lock_guard<std::mutex> lock(getShaderCompilerMutex());
+          m_displayPass.tryRecompile(app);
+        }
         m_bReloadProject = true;
       });
 
@@ -88,6 +113,12 @@ void Fluorescence::initGame(Application& app) {
   input.addKeyBinding({GLFW_KEY_P, GLFW_PRESS, 0}, [&app, this]() {
     m_bPaused = !m_bPaused;
   });
+  input.addKeyBinding(
+      {GLFW_KEY_G, GLFW_PRESS, GLFW_MOD_CONTROL},
+      [&app, this]() { m_bProfileGpu = !m_bProfileGpu; });
+  input.addKeyBinding(
+      {GLFW_KEY_G, GLFW_PRESS, GLFW_MOD_CONTROL | GLFW_MOD_SHIFT},
+      [&app, this]() { CpuTracer::captureFrames(CPU_TRACE_FRAME_COUNT); });
 }
 
 void Fluorescence::shutdownGame(Application& app) {}
@@ -112,6 +143,11 @@ void Fluorescence::destroyRenderState(Application& app) {
 
   m_descriptorSets = {};
 
+  // the loaded project depends on the swapchain extent and format, which may
+  // be about to change. Destroying the loader cancels it, this only waits for
+  // the shader compiles in flight.
+  m_pProjectLoader.reset();
+
   delete m_pProject;
   m_pProject = nullptr;
   m_bReloadProject = true;
@@ -129,6 +165,9 @@ static uint32_t s_frameCount = 0;
 uint32_t Fluorescence::getFrameCount() { return s_frameCount; }
 
 void Fluorescence::tick(Application& app, const FrameContext& frame) {
+  CpuTracer::beginFrame();
+  FLR_TRACE_ZONE("Fluorescence::tick");
+
   {
     ++s_frameCount;
 
@@ -173,66 +212,43 @@ void Fluorescence::tick(Application& app, const FrameContext& frame) {
       }
     }
 
-    if (m_bReloadProject) {
-      if (m_pProject) {
-        app.addDeletiontask(DeletionTask{
-            [pProject = m_pProject]() { delete pProject; },
-            app.getCurrentFrameRingBufferIndex() });
-        m_pProject = nullptr;
-        m_reloadCountDown = MAX_FRAMES_IN_FLIGHT;
-      } else if (m_reloadCountDown) {
-        m_reloadCountDown--;
-      } else {
-        m_bReloadProject = false;
-        if (Utilities::checkFileExists(std::string(s_filename))) {
-          for (auto& program : m_programs)
-            program->destroyRenderState();
-
-          FlrParams params;
-          for (auto& program : m_programs)
-            program->setupParams(params);
-
-          SingleTimeCommandBuffer commandBuffer(app);
-          m_pProject =
-            new Project(commandBuffer, m_uniforms, (const char*)s_filename, params);
-          if (m_pProject->isReady())
-          {
-            for (auto& program : m_programs)
-              program->createRenderState(m_pProject, commandBuffer);
-
-            PerFrameResources* prevDescTables = new PerFrameResources(std::move(m_descriptorSets));
-            app.addDeletiontask(DeletionTask{ [prevDescTables]() {
-                delete prevDescTables;
-              }, app.getCurrentFrameRingBufferIndex() });
-
-            DescriptorSetLayoutBuilder builder{};
-            builder.addUniformBufferBinding();
-
-            for (auto& program : m_programs)
-              program->setupDescriptorTable(builder);
-
-            m_descriptorSets = PerFrameResources(app, builder);
-
-            ResourcesAssignment assignment = m_descriptorSets.assign();
-            assignment.bindTransientUniforms(m_uniforms);
-
-            for (auto& program : m_programs)
-              program->createDescriptors(assignment);
-          }
-        }
+    // A new load is only started once the previous one is finished. That one
+    // is cancelled, its result is outdated, and the request stays pending
+    // until it stopped.
+    if (m_bReloadProject && m_pProjectLoader)
+      m_pProjectLoader->cancel();
+    if (m_bReloadProject && !m_pProjectLoader) {
+      m_bReloadProject = false;
+      if (Utilities::checkFileExists(std::string(s_filename))) {
+        FlrParams params;
+        for (auto& program : m_programs)
+          program->setupParams(params);
+
+        m_loadStartTime = std::chrono::steady_clock::now();
+        m_pProjectLoader = std::make_unique<ProjectLoader>(
+            s_filename,
+            params,
+            FlrTargetInfo::fromApplication(app),
+            m_pLastParseState);
       }
     }
 
-    if (m_pProject &&
-        (m_pProject->hasFailed() || m_pProject->hasRecompileFailed())) {
+    if (m_pProjectLoader && m_pProjectLoader->isFinished())
+      _finishProjectLoad(app);
+
+    if (m_headless)
+      _tickHeadless(app);
+
+    if (!m_loadErrMsg.empty() ||
+        (m_pProject && m_pProject->hasRecompileFailed())) {
       if (ImGui::Begin("Project Errors", false)) {
         char buf[2048];
         snprintf(
             buf,
             2048,
             "%s",
-            m_pProject->hasFailed() ? m_pProject->getErrorMessage()
-                                    : m_pProject->getShaderCompileErrors());
+            !m_loadErrMsg.empty() ? m_loadErrMsg.c_str()
+                                  : m_pProject->getShaderCompileErrors());
         ImGui::PushStyleColor(0, ImVec4(0.9f, 0.2f, 0.4f, 1.0f));
         size_t errOffset = 0;
         size_t errStrLen = strlen(buf);
@@ -249,6 +265,7 @@ void Fluorescence::tick(Application& app, const FrameContext& frame) {
     }
 
     if (m_pProject && m_pProject->isReady()) {
+      m_pProject->getGpuProfiler().setEnabled(m_bProfileGpu);
       m_pProject->tick(frame);
       for (auto& program : m_programs)
         program->tick(m_pProject, frame);
@@ -265,8 +282,13 @@ void Fluorescence::tick(Application& app, const FrameContext& frame) {
 
   static uint32_t prevInputMask = inputMask;
 
-  if (!m_bFreezeTime)
-    m_time += frame.deltaTime;
+  float deltaTime = m_bFreezeTime ? 0.0f : frame.deltaTime;
+  if (m_headless) {
+    deltaTime = m_headless->fixedDeltaTime;
+    m_time = m_headless->fixedDeltaTime * m_headlessFrame;
+  } else {
+    m_time += deltaTime;
+  }
 
   FlrUniforms uniforms;
   uniforms.mouseUv.x =
@@ -274,15 +296,222 @@ void Fluorescence::tick(Application& app, const FrameContext& frame) {
   uniforms.mouseUv.y =
       static_cast<float>(0.5 - 0.5 * mpos.y);
   uniforms.time = m_time;
-  uniforms.frameCount = s_frameCount;
+  uniforms.frameCount = m_headless ? m_headlessFrame : s_frameCount;
   uniforms.prevInputMask = prevInputMask;
   uniforms.inputMask = inputMask;
+  uniforms.substepCount = 0;
+  uniforms.substepDeltaTime = 0.0f;
+  uniforms.simulationTime = 0.0f;
+  // the project is not drawn while paused, neither is the simulation advanced
+  if (m_pProject && m_pProject->isReady() && !m_bPaused) {
+    m_pProject->setFrameCount(uniforms.frameCount);
+    m_pProject->advanceSimulation(deltaTime);
+    uniforms.substepCount = m_pProject->getSubstepCount();
+    uniforms.substepDeltaTime = m_pProject->getSubstepDeltaTime();
+    uniforms.simulationTime = m_pProject->getSimulationTime();
+  }
 
   prevInputMask = inputMask;
 
   m_uniforms.getCurrentUniformBuffer(frame).updateUniforms(uniforms);
 }
 
+void Fluorescence::_finishProjectLoad(Application& app) {
+  FLR_TRACE_ZONE("Fluorescence::_finishProjectLoad");
+
+  std::string projPath = m_pProjectLoader->getProjectPath();
+  bool bCancelled = m_pProjectLoader->isCancelled();
+  std::unique_ptr<ParsedFlr> pParsed = m_pProjectLoader->takeParsedFlr();
+  if (!bCancelled && !pParsed->m_failed)
+    m_pProjectLoader->commitGeneratedCode();
+  m_pProjectLoader.reset();
+
+  if (pParsed->m_pIncrementalState)
+    m_pLastParseState = pParsed->m_pIncrementalState;
+
+  if (bCancelled)
+    return;
+
+  if (pParsed->m_failed) {
+    m_loadErrMsg = pParsed->m_errMsg;
+    return;
+  }
+
+  Project* pNewProject = nullptr;
+  {
+    SingleTimeCommandBuffer commandBuffer(app);
+    pNewProject = new Project(
+        commandBuffer,
+        m_uniforms,
+        projPath.c_str(),
+        std::move(*pParsed));
+  }
+
+  if (!pNewProject->isReady()) {
+    // Keep the running project, the failed one may still have uploads
+    // referencing it in flight
+    m_loadErrMsg = pNewProject->getErrorMessage();
+    app.addDeletiontask(DeletionTask{
+        [pNewProject]() { delete pNewProject; },
+        app.getCurrentFrameRingBufferIndex()});
+    return;
+  }
+
+  m_loadErrMsg.clear();
+  m_lastLoadMs = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - m_loadStartTime)
+                     .count();
+
+  {
+    std::filesystem::path path(projPath);
+    CpuTracer::setOutputPath(
+        path.parent_path() / (path.stem().string() + "_cpu_trace.json"));
+  }
+
+  for (auto& program : m_programs)
+    program->destroyRenderState();
+
+  if (m_pProject) {
+    app.addDeletiontask(DeletionTask{
+        [pProject = m_pProject]() { delete pProject; },
+        app.getCurrentFrameRingBufferIndex()});
+  }
+  m_pProject = pNewProject;
+
+  SingleTimeCommandBuffer commandBuffer(app);
+  for (auto& program : m_programs)
+    program->createRenderState(m_pProject, commandBuffer);
+
+  PerFrameResources* prevDescTables =
+      new PerFrameResources(std::move(m_descriptorSets));
+  app.addDeletiontask(DeletionTask{
+      [prevDescTables]() { delete prevDescTables; },
+      app.getCurrentFrameRingBufferIndex()});
+
+  DescriptorSetLayoutBuilder builder{};
+  builder.addUniformBufferBinding();
+
+  for (auto& program : m_programs)
+    program->setupDescriptorTable(builder);
+
+  m_descriptorSets = PerFrameResources(app, builder);
+
+  ResourcesAssignment assignment = m_descriptorSets.assign();
+  assignment.bindTransientUniforms(m_uniforms);
+
+  for (auto& program : m_programs)
+    program->createDescriptors(assignment);
+}
+
+void Fluorescence::_tickHeadless(Application& app) {
+  if (m_bHeadlessFailed)
+    return;
+
+  // Without a window to report to, a project that fails to load ends the run
+  bool bLoading = m_bReloadProject || m_pProjectLoader;
+  if (!bLoading && (!m_pProject || !m_pProject->isReady())) {
+    _failHeadless(
+        app,
+        !m_loadErrMsg.empty() ? m_loadErrMsg
+                              : std::string("Could not open ") + s_filename);
+    return;
+  }
+  if (!m_pProject || !m_pProject->isReady())
+    return;
+
+  uint32_t firstFrame = m_headless->warmupFrameCount;
+  uint32_t endFrame = firstFrame + m_headless->frameCount;
+  if (!m_headless->benchmarkPath.empty()) {
+    // The time between the ticks of frames k and k + 1 is the time of frame k
+    auto now = std::chrono::steady_clock::now();
+    if (m_headlessFrame > firstFrame && m_headlessFrame <= endFrame)
+      m_benchmark.cpuFrameMs.push_back(
+          std::chrono::duration<double, std::milli>(now - m_lastHeadlessTick)
+              .count());
+    m_lastHeadlessTick = now;
+
+    if (m_headlessFrame == firstFrame) {
+      m_pProject->getGpuProfiler().setCapturing(true);
+      m_benchmarkGpuFrame = m_pProject->getGpuProfiler().getFrameNumber();
+    }
+  }
+
+  // The images saved by the last frames are written by deletion tasks, which
+  // run once the frame-in-flight slot comes around again. Likewise, GPU
+  // timings are read back once the slot of their frame comes around.
+  if (m_headlessFrame == endFrame + MAX_FRAMES_IN_FLIGHT) {
+    glfwSetWindowShouldClose(app.getWindow(), GLFW_TRUE);
+    if (!m_headless->benchmarkPath.empty())
+      _finishBenchmark(app);
+    else
+      std::cout << "Rendered " << m_headless->frameCount << " frames to "
+                << m_headless->outputDir.string() << std::endl;
+  }
+}
+
+void Fluorescence::_finishBenchmark(Application& app) {
+  m_benchmark.projectPath = s_filename;
+  m_benchmark.loadMs = m_lastLoadMs;
+  m_benchmark.gpuScopes = m_pProject->getGpuProfiler().summarizeCapture(
+      m_benchmarkGpuFrame,
+      m_benchmarkGpuFrame + m_headless->frameCount);
+  m_benchmark.recordPeakMemory();
+
+  if (!m_benchmark.writeJson(m_headless->benchmarkPath)) {
+    _failHeadless(
+        app,
+        "Could not write benchmark results to " +
+            m_headless->benchmarkPath.string());
+    return;
+  }
+
+  std::cout << "Wrote benchmark results of " << m_headless->frameCount
+            << " frames to " << m_headless->benchmarkPath.string()
+            << std::endl;
+}
+
+void Fluorescence::_drawHeadless(
+    Application& app,
+    VkCommandBuffer commandBuffer) {
+  if (m_bHeadlessFailed)
+    return;
+
+  if (m_headlessFrame++ < m_headless->warmupFrameCount ||
+      !m_headless->bSaveImages)
+    return;
+
+  uint32_t frameIdx = m_headlessFrame - 1 - m_headless->warmupFrameCount;
+  if (frameIdx >= m_headless->frameCount)
+    return;
+
+  bool bLastFrame = frameIdx + 1 == m_headless->frameCount;
+  if (!bLastFrame && frameIdx % m_headless->saveInterval != 0)
+    return;
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), "_%05u.png", frameIdx);
+  std::string fileName =
+      (m_headless->outputDir /
+       ((m_headless->imageName.empty() ? "display_image"
+                                       : m_headless->imageName) +
+        suffix))
+          .string();
+
+  std::string errMsg;
+  if (!m_pProject->saveImage(
+          m_headless->imageName.c_str(),
+          fileName,
+          commandBuffer,
+          errMsg))
+    _failHeadless(app, errMsg);
+}
+
+void Fluorescence::_failHeadless(Application& app, const std::string& errMsg) {
+  std::cerr << "ERROR: " << errMsg << std::endl;
+  m_bHeadlessFailed = true;
+  glfwSetWindowShouldClose(app.getWindow(), GLFW_TRUE);
+}
+
 void Fluorescence::_createGlobalResources(
     Application& app,
     SingleTimeCommandBuffer& commandBuffer) {
@@ -356,12 +585,16 @@ void Fluorescence::draw(
     Application& app,
     VkCommandBuffer commandBuffer,
     const FrameContext& frame) {
+  FLR_TRACE_ZONE("Fluorescence::draw");
 
   VkDescriptorSet heapDescriptorSet = m_heap.getDescriptorSet();
   if (m_pProject && m_pProject->isReady() && !m_bPaused) {
     m_pProject->draw(commandBuffer, frame);
     for (auto& program : m_programs)
       program->draw(m_pProject, commandBuffer, frame);
+
+    if (m_headless)
+      _drawHeadless(app, commandBuffer);
   }
 
   {
@@ -0,0 +1,486 @@
+#include "GpuProfiler.h"
+
+#include <Althea/Application.h>
+#include <Althea/Gui.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+using namespace AltheaEngine;
+
+namespace flr {
+extern Application* GApplication;
+
+namespace {
+// In the order the results are written, which follows the bit order
+constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+enum ProfilerColumn : uint32_t {
+  PC_NAME = 0,
+  PC_CALLS,
+  PC_LAST,
+  PC_MIN,
+  PC_AVG,
+  PC_MAX,
+  PC_VERTEX_INVOCATIONS,
+  PC_FRAGMENT_INVOCATIONS,
+  PC_COMPUTE_INVOCATIONS,
+  PC_COUNT
+};
+} // namespace
+
+GpuProfiler::GpuProfiler()
+    : m_entries(),
+      m_entryLookup(),
+      m_frames(),
+      m_currentRingIdx(0),
+      m_frameNumber(0),
+      m_bFrameActive(false),
+      m_openStatisticsQuery(~0u),
+      m_capturedFrames(),
+      m_csvPath(),
+      m_timestampPeriodNs(1.0),
+      m_bEnabled(false),
+      m_bPipelineStatistics(false),
+      m_bCapture(false),
+      m_bGatherStatistics(false) {}
+
+GpuProfiler::~GpuProfiler() { destroyQueryPools(); }
+
+void GpuProfiler::setEnabled(bool bEnabled) {
+  if (bEnabled == m_bEnabled)
+    return;
+
+  m_bEnabled = bEnabled;
+  m_bFrameActive = false;
+  for (FrameQueries& frame : m_frames) {
+    frame.scopes.clear();
+    frame.statisticsCount = 0;
+  }
+}
+
+void GpuProfiler::createQueryPools() {
+  VkDevice device = GApplication->getDevice();
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(GApplication->getPhysicalDevice(), &properties);
+  m_timestampPeriodNs = properties.limits.timestampPeriod;
+
+  for (FrameQueries& frame : m_frames) {
+    if (frame.timestamps == VK_NULL_HANDLE) {
+      VkQueryPoolCreateInfo createInfo{};
+      createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      createInfo.queryCount = 2 * MAX_SCOPES_PER_FRAME;
+      if (vkCreateQueryPool(device, &createInfo, nullptr, &frame.timestamps) !=
+          VK_SUCCESS) {
+        std::cerr << "WARNING: Could not create GPU profiler queries"
+                  << std::endl;
+        frame.timestamps = VK_NULL_HANDLE;
+        m_bEnabled = false;
+        return;
+      }
+    }
+
+    if (m_bPipelineStatistics && frame.statistics == VK_NULL_HANDLE) {
+      VkQueryPoolCreateInfo createInfo{};
+      createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+      createInfo.queryCount = MAX_SCOPES_PER_FRAME;
+      createInfo.pipelineStatistics = PIPELINE_STATISTICS;
+      if (vkCreateQueryPool(device, &createInfo, nullptr, &frame.statistics) !=
+          VK_SUCCESS) {
+        std::cerr << "WARNING: Pipeline statistics queries are not supported"
+                  << std::endl;
+        frame.statistics = VK_NULL_HANDLE;
+        m_bPipelineStatistics = false;
+      }
+    }
+  }
+}
+
+void GpuProfiler::destroyQueryPools() {
+  // The owning project is only destroyed once no frame in flight uses it
+  for (FrameQueries& frame : m_frames) {
+    if (frame.timestamps != VK_NULL_HANDLE)
+      vkDestroyQueryPool(GApplication->getDevice(), frame.timestamps, nullptr);
+    if (frame.statistics != VK_NULL_HANDLE)
+      vkDestroyQueryPool(GApplication->getDevice(), frame.statistics, nullptr);
+    frame.timestamps = VK_NULL_HANDLE;
+    frame.statistics = VK_NULL_HANDLE;
+  }
+}
+
+void GpuProfiler::beginFrame(
+    VkCommandBuffer commandBuffer,
+    const FrameContext& frame) {
+  m_bFrameActive = false;
+  if (!m_bEnabled)
+    return;
+
+  // Pools are kept around until the profiler is destroyed, toggling
+  // statistics off only stops new scopes from using them
+  if (m_frames[0].timestamps == VK_NULL_HANDLE ||
+      (m_bPipelineStatistics && m_frames[0].statistics == VK_NULL_HANDLE))
+    createQueryPools();
+  if (!m_bEnabled)
+    return;
+  m_bGatherStatistics = m_bPipelineStatistics;
+
+  m_currentRingIdx = frame.frameRingBufferIndex;
+  collectResults(m_currentRingIdx);
+
+  FrameQueries& queries = m_frames[m_currentRingIdx];
+  vkCmdResetQueryPool(
+      commandBuffer,
+      queries.timestamps,
+      0,
+      2 * MAX_SCOPES_PER_FRAME);
+  if (m_bGatherStatistics && queries.statistics != VK_NULL_HANDLE)
+    vkCmdResetQueryPool(
+        commandBuffer,
+        queries.statistics,
+        0,
+        MAX_SCOPES_PER_FRAME);
+
+  queries.scopes.clear();
+  queries.statisticsCount = 0;
+  queries.frameNumber = m_frameNumber++;
+  m_openStatisticsQuery = ~0u;
+  m_bFrameActive = true;
+}
+
+uint32_t GpuProfiler::beginScope(
+    VkCommandBuffer commandBuffer,
+    const std::string& name,
+    bool bLeaf) {
+  if (!m_bFrameActive)
+    return ~0u;
+
+  FrameQueries& queries = m_frames[m_currentRingIdx];
+  if (queries.scopes.size() == MAX_SCOPES_PER_FRAME)
+    return ~0u;
+
+  auto it = m_entryLookup.find(name);
+  if (it == m_entryLookup.end()) {
+    it = m_entryLookup.emplace(name, static_cast<uint32_t>(m_entries.size()))
+             .first;
+    Entry& entry = m_entries.emplace_back();
+    entry = {};
+    entry.name = name;
+  }
+
+  uint32_t scope = static_cast<uint32_t>(queries.scopes.size());
+  PendingScope& pending = queries.scopes.emplace_back();
+  pending.entry = it->second;
+  pending.statisticsQuery = ~0u;
+
+  vkCmdWriteTimestamp(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+      queries.timestamps,
+      2 * scope);
+
+  if (bLeaf && m_bGatherStatistics && m_openStatisticsQuery == ~0u) {
+    pending.statisticsQuery = queries.statisticsCount++;
+    m_openStatisticsQuery = pending.statisticsQuery;
+    vkCmdBeginQuery(
+        commandBuffer,
+        queries.statistics,
+        pending.statisticsQuery,
+        0);
+  }
+
+  return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+  if (!m_bFrameActive || scope == ~0u)
+    return;
+
+  FrameQueries& queries = m_frames[m_currentRingIdx];
+  const PendingScope& pending = queries.scopes[scope];
+  if (pending.statisticsQuery != ~0u) {
+    vkCmdEndQuery(commandBuffer, queries.statistics, pending.statisticsQuery);
+    m_openStatisticsQuery = ~0u;
+  }
+
+  vkCmdWriteTimestamp(
+      commandBuffer,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      queries.timestamps,
+      2 * scope + 1);
+}
+
+void GpuProfiler::collectResults(uint32_t ringIdx) {
+  FrameQueries& queries = m_frames[ringIdx];
+  if (queries.scopes.empty())
+    return;
+
+  VkDevice device = GApplication->getDevice();
+  uint32_t scopeCount = static_cast<uint32_t>(queries.scopes.size());
+
+  std::vector<uint64_t> timestamps(2 * scopeCount);
+  if (vkGetQueryPoolResults(
+          device,
+          queries.timestamps,
+          0,
+          2 * scopeCount,
+          timestamps.size() * sizeof(uint64_t),
+          timestamps.data(),
+          sizeof(uint64_t),
+          VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    return;
+
+  std::vector<uint64_t> statistics(PS_COUNT * queries.statisticsCount);
+  if (queries.statisticsCount &&
+      vkGetQueryPoolResults(
+          device,
+          queries.statistics,
+          0,
+          queries.statisticsCount,
+          statistics.size() * sizeof(uint64_t),
+          statistics.data(),
+          PS_COUNT * sizeof(uint64_t),
+          VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    statistics.clear();
+
+  // scopes sharing an entry are summed up into a single sample
+  std::vector<double> entryMs(m_entries.size(), -1.0);
+  for (const PendingScope& pending : queries.scopes) {
+    size_t scope = &pending - queries.scopes.data();
+    uint64_t ticks = timestamps[2 * scope + 1] - timestamps[2 * scope];
+    double ms = double(ticks) * m_timestampPeriodNs * 1e-6;
+
+    Entry& entry = m_entries[pending.entry];
+    if (entryMs[pending.entry] < 0.0) {
+      entryMs[pending.entry] = 0.0;
+      entry.calls = 0;
+      for (uint64_t& stat : entry.statistics)
+        stat = 0;
+    }
+    entryMs[pending.entry] += ms;
+    entry.calls++;
+
+    if (pending.statisticsQuery != ~0u && statistics.size())
+      for (uint32_t i = 0; i < PS_COUNT; i++)
+        entry.statistics[i] +=
+            statistics[PS_COUNT * pending.statisticsQuery + i];
+  }
+
+  CapturedFrame* pCaptured = nullptr;
+  if (m_bCapture && m_capturedFrames.size() < MAX_CAPTURED_FRAMES) {
+    pCaptured = &m_capturedFrames.emplace_back();
+    pCaptured->frameNumber = queries.frameNumber;
+  }
+
+  for (uint32_t entryIdx = 0; entryIdx < m_entries.size(); entryIdx++) {
+    if (entryMs[entryIdx] < 0.0)
+      continue;
+
+    Entry& entry = m_entries[entryIdx];
+    entry.history[entry.historyNext] = static_cast<float>(entryMs[entryIdx]);
+    entry.historyNext = (entry.historyNext + 1) % HISTORY_LENGTH;
+    if (entry.historyCount < HISTORY_LENGTH)
+      entry.historyCount++;
+
+    if (pCaptured)
+      pCaptured->entryMs.emplace_back(
+          entryIdx,
+          static_cast<float>(entryMs[entryIdx]));
+  }
+
+  queries.scopes.clear();
+  queries.statisticsCount = 0;
+}
+
+void GpuProfiler::drawUi() {
+  if (!m_bEnabled)
+    return;
+
+  if (ImGui::Begin("GPU Profiler", false)) {
+    ImGui::Checkbox("Pipeline statistics", &m_bPipelineStatistics);
+
+    ImGui::Checkbox("Capture frames", &m_bCapture);
+    ImGui::SameLine();
+    ImGui::Text("(%u captured)", (uint32_t)m_capturedFrames.size());
+    if (ImGui::Button("Save CSV")) {
+      if (writeCsv(m_csvPath))
+        std::cout << "Saved GPU timings to " << m_csvPath.string()
+                  << std::endl;
+      else
+        std::cerr << "WARNING: Could not write " << m_csvPath.string()
+                  << std::endl;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+      m_capturedFrames.clear();
+      for (Entry& entry : m_entries) {
+        entry.historyCount = 0;
+        entry.historyNext = 0;
+      }
+    }
+
+    struct Row {
+      uint32_t entry;
+      float values[PC_COUNT];
+    };
+    std::vector<Row> rows;
+    rows.reserve(m_entries.size());
+    for (uint32_t entryIdx = 0; entryIdx < m_entries.size(); entryIdx++) {
+      const Entry& entry = m_entries[entryIdx];
+      if (entry.historyCount == 0)
+        continue;
+
+      Row& row = rows.emplace_back();
+      row.entry = entryIdx;
+      row.values[PC_NAME] = 0.0f;
+      row.values[PC_CALLS] = static_cast<float>(entry.calls);
+      uint32_t lastIdx =
+          (entry.historyNext + HISTORY_LENGTH - 1) % HISTORY_LENGTH;
+      row.values[PC_LAST] = entry.history[lastIdx];
+      float minMs = entry.history[0];
+      float maxMs = entry.history[0];
+      float sumMs = 0.0f;
+      for (uint32_t i = 0; i < entry.historyCount; i++) {
+        minMs = std::min(minMs, entry.history[i]);
+        maxMs = std::max(maxMs, entry.history[i]);
+        sumMs += entry.history[i];
+      }
+      row.values[PC_MIN] = minMs;
+      row.values[PC_AVG] = sumMs / entry.historyCount;
+      row.values[PC_MAX] = maxMs;
+      for (uint32_t i = 0; i < PS_COUNT; i++)
+        row.values[PC_VERTEX_INVOCATIONS + i] =
+            static_cast<float>(entry.statistics[i]);
+    }
+
+    uint32_t columnCount = m_bGatherStatistics ? PC_COUNT : PC_MAX + 1;
+    ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_RowBg |
+                            ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("GpuTimings", columnCount, flags)) {
+      ImGui::TableSetupColumn("Task", ImGuiTableColumnFlags_DefaultSort);
+      ImGui::TableSetupColumn("Calls");
+      ImGui::TableSetupColumn("Last (ms)");
+      ImGui::TableSetupColumn("Min (ms)");
+      ImGui::TableSetupColumn("Avg (ms)");
+      ImGui::TableSetupColumn("Max (ms)");
+      if (m_bGatherStatistics) {
+        ImGui::TableSetupColumn("VS invocations");
+        ImGui::TableSetupColumn("PS invocations");
+        ImGui::TableSetupColumn("CS invocations");
+      }
+      ImGui::TableHeadersRow();
+
+      if (ImGuiTableSortSpecs* pSortSpecs = ImGui::TableGetSortSpecs()) {
+        if (pSortSpecs->SpecsCount > 0) {
+          const ImGuiTableColumnSortSpecs& spec = pSortSpecs->Specs[0];
+          bool bAscending =
+              spec.SortDirection == ImGuiSortDirection_Ascending;
+          uint32_t column = spec.ColumnIndex;
+          std::stable_sort(
+              rows.begin(),
+              rows.end(),
+              [&](const Row& a, const Row& b) {
+                if (column == PC_NAME) {
+                  int cmp = m_entries[a.entry].name.compare(
+                      m_entries[b.entry].name);
+                  return bAscending ? cmp < 0 : cmp > 0;
+                }
+                return bAscending ? a.values[column] < b.values[column]
+                                  : a.values[column] > b.values[column];
+              });
+        }
+      }
+
+      for (const Row& row : rows) {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(m_entries[row.entry].name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", (uint32_t)row.values[PC_CALLS]);
+        for (uint32_t column = PC_LAST; column <= PC_MAX; column++) {
+          ImGui::TableNextColumn();
+          ImGui::Text("%.3f", row.values[column]);
+        }
+        if (m_bGatherStatistics) {
+          for (uint32_t i = 0; i < PS_COUNT; i++) {
+            ImGui::TableNextColumn();
+            ImGui::Text(
+                "%llu",
+                (unsigned long long)m_entries[row.entry].statistics[i]);
+          }
+        }
+      }
+
+      ImGui::EndTable();
+    }
+  }
+  ImGui::End();
+}
+
+bool GpuProfiler::writeCsv(const std::filesystem::path& path) const {
+  std::ofstream stream(path, std::ios::trunc);
+  if (!stream.is_open())
+    return false;
+
+  stream << "frame";
+  for (const Entry& entry : m_entries)
+    stream << "," << entry.name;
+  stream << "\n";
+
+  std::vector<float> rowMs(m_entries.size());
+  for (const CapturedFrame& frame : m_capturedFrames) {
+    std::fill(rowMs.begin(), rowMs.end(), -1.0f);
+    for (const auto& [entryIdx, ms] : frame.entryMs)
+      rowMs[entryIdx] = ms;
+
+    stream << frame.frameNumber;
+    for (float ms : rowMs) {
+      stream << ",";
+      // tasks that did not run in a frame are left empty
+      if (ms >= 0.0f)
+        stream << ms;
+    }
+    stream << "\n";
+  }
+
+  return !stream.fail();
+}
+
+std::vector<GpuProfiler::ScopeSummary>
+GpuProfiler::summarizeCapture(uint32_t firstFrame, uint32_t endFrame) const {
+  std::vector<std::vector<float>> entryMs(m_entries.size());
+  for (const CapturedFrame& frame : m_capturedFrames) {
+    if (frame.frameNumber < firstFrame || frame.frameNumber >= endFrame)
+      continue;
+    for (const auto& [entryIdx, ms] : frame.entryMs)
+      entryMs[entryIdx].push_back(ms);
+  }
+
+  std::vector<ScopeSummary> summaries;
+  for (uint32_t entryIdx = 0; entryIdx < m_entries.size(); entryIdx++) {
+    std::vector<float>& samples = entryMs[entryIdx];
+    if (samples.empty())
+      continue;
+
+    std::sort(samples.begin(), samples.end());
+    double sumMs = 0.0;
+    for (float ms : samples)
+      sumMs += ms;
+
+    ScopeSummary& summary = summaries.emplace_back();
+    summary.name = m_entries[entryIdx].name;
+    summary.frameCount = static_cast<uint32_t>(samples.size());
+    summary.minMs = samples.front();
+    summary.meanMs = static_cast<float>(sumMs / samples.size());
+    summary.medianMs = samples[samples.size() / 2];
+    summary.maxMs = samples.back();
+  }
+
+  return summaries;
+}
+} // namespace flr
@@ -1,5 +1,6 @@
 #pragma once
 #include "IpcProgram.h"
+#include "Trace.h"
 
 #include <stdio.h>
 #include <tchar.h>
@@ -140,6 +141,48 @@ bool processCmdList(
       if (auto cmd = streamView.read<CmdBufferStagedUpload>()) {
         BufferAllocation* alloc =
             project->getBufferAlloc(BufferId(cmd->bufferId), cmd->subBufIdx);
+        const ParsedFlr& parsed = project->getParsedFlr();
+        const ParsedFlr::BufferDesc& desc = parsed.m_buffers[cmd->bufferId];
+        if (desc.isSoa()) {
+          // clients upload whole structs, which are scattered into the field
+          // arrays
+          uint32_t structSize = parsed.m_structDefs[desc.structIdx].size;
+          uint32_t elemCount = cmd->sizeBytes / structSize;
+          if (cmd->sizeBytes % structSize != 0 || elemCount > desc.elemCount) {
+            streamView.setFailed();
+            break;
+          }
+          std::vector<char> aos(cmd->sizeBytes);
+          streamView.copyTo(aos.data(), cmd->srcOffset, cmd->sizeBytes);
+
+          BufferAllocation staging = BufferUtilities::createStagingBuffer(
+              parsed.getBufferByteSize(desc));
+          char* pMapped = (char*)staging.mapMemory();
+          ParsedFlr::packSoa(desc, structSize, elemCount, aos.data(), pMapped);
+          staging.unmapMemory();
+
+          std::vector<VkBufferCopy> regions;
+          for (const auto& field : desc.soaFields) {
+            VkBufferCopy& region = regions.emplace_back();
+            region.srcOffset = field.offset;
+            region.dstOffset = field.offset;
+            region.size = uint64_t(field.stride) * elemCount;
+          }
+          if (elemCount > 0)
+            vkCmdCopyBuffer(
+                commandBuffer,
+                staging.getBuffer(),
+                alloc->getBuffer(),
+                static_cast<uint32_t>(regions.size()),
+                regions.data());
+          GApplication->addDeletiontask(
+              {[pStaging = new BufferAllocation(std::move(staging))]() {
+                 delete pStaging;
+               },
+               frame.frameRingBufferIndex});
+          break;
+        }
+
         BufferAllocation staging =
             BufferUtilities::createStagingBuffer(cmd->sizeBytes);
         char* pMapped = (char*)staging.mapMemory();
@@ -180,6 +223,12 @@ bool processCmdList(
       }
       break;
     }
+    case CMD_CAPTURE_TRACE: {
+      if (auto cmd = streamView.read<CmdCaptureTrace>()) {
+        CpuTracer::captureFrames(cmd->frameCount);
+      }
+      break;
+    }
     default: {
       return false;
     }
@@ -486,18 +535,29 @@ void IpcProgram::draw(
     Project* project,
     VkCommandBuffer commandBuffer,
     const FrameContext& frame) {
+  FLR_TRACE_ZONE("IpcProgram::draw");
 
-  WaitForSingleObject(m_writeDoneSemaphoreHandle, INFINITE);
-
-  bool result = flr_cmds::processCmdList(
-      project,
-      commandBuffer,
-      frame,
-      (char*)m_sharedMemoryBuffer,
-      BUF_SIZE);
-  if (!result)
-    std::cerr << "Could not parse commandlist" << std::endl;
-  flr_packets::assembleUpdatePacket(project, (char*)m_sharedMemoryBuffer, BUF_SIZE);
+  {
+    FLR_TRACE_ZONE("Wait for script");
+    WaitForSingleObject(m_writeDoneSemaphoreHandle, INFINITE);
+  }
+
+  {
+    FLR_TRACE_ZONE("Process commands");
+    bool result = flr_cmds::processCmdList(
+        project,
+        commandBuffer,
+        frame,
+        (char*)m_sharedMemoryBuffer,
+        BUF_SIZE);
+    if (!result)
+      std::cerr << "Could not parse commandlist" << std::endl;
+  }
+
+  {
+    FLR_TRACE_ZONE("Assemble update packet");
+    flr_packets::assembleUpdatePacket(project, (char*)m_sharedMemoryBuffer, BUF_SIZE);
+  }
 
   ReleaseSemaphore(m_readDoneSemaphoreHandle, 1, nullptr);
 }
@@ -1,11 +1,16 @@
 
 #include "ParsedFlr.h"
 
+#include "Hash.h"
+
 #include <Althea/Parser.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <optional>
 #include <utility>
 #include <xstring>
@@ -15,115 +20,491 @@ using namespace AltheaEngine;
 namespace flr {
 
 namespace {
-template <typename T, typename V, V T::*Vptr>
-std::optional<V> findValueByName(const std::vector<T>& ts, std::string_view n) {
-  for (const T& t : ts) {
-    if (t.name.size() == n.size() &&
-        !strncmp(t.name.data(), n.data(), n.size())) {
-      return t.*Vptr;
+template <size_t N>
+std::optional<uint32_t>
+findIndexByName(char* const (&names)[N], std::string_view n) {
+  for (uint32_t i = 0; i < N; i++) {
+    if (strlen(names[i]) == n.size() &&
+        !strncmp(names[i], n.data(), n.size())) {
+      return i;
     }
   }
 
   return std::nullopt;
 }
 
-template <typename T>
-std::optional<uint32_t>
-findIndexByName(const std::vector<T>& ts, std::string_view n) {
-  uint32_t idx = 0;
-  for (const T& t : ts) {
-    if (t.name.size() == n.size() &&
-        !strncmp(t.name.data(), n.data(), n.size())) {
-      return idx;
-    }
-    idx++;
+constexpr size_t nextPow2(size_t n) {
+  size_t p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+// Open-addressing lookup table over a fixed array of names, built at compile
+// time. Slots store (index + 1) so that zero-initialized slots are empty.
+template <size_t N> struct StaticNameTable {
+  static constexpr size_t SLOT_COUNT = nextPow2(2 * N);
+  static constexpr size_t SLOT_MASK = SLOT_COUNT - 1;
+
+  template <typename TGetName>
+  constexpr StaticNameTable(TGetName getName) : m_slots() {
+    for (size_t i = 0; i < N; i++) {
+      size_t slot = hashString(getName(i)) & SLOT_MASK;
+      while (m_slots[slot])
+        slot = (slot + 1) & SLOT_MASK;
+      m_slots[slot] = static_cast<uint16_t>(i + 1);
+    }
   }
 
-  return std::nullopt;
-}
+  template <typename TGetName>
+  std::optional<uint32_t> find(std::string_view n, TGetName getName) const {
+    for (size_t slot = hashString(n) & SLOT_MASK; m_slots[slot];
+         slot = (slot + 1) & SLOT_MASK) {
+      uint32_t idx = m_slots[slot] - 1u;
+      if (getName(idx) == n)
+        return idx;
+    }
+    return std::nullopt;
+  }
 
-template <size_t N>
-std::optional<uint32_t>
-findIndexByName(char* const (&names)[N], std::string_view n) {
-  for (uint32_t i = 0; i < N; i++) {
-    if (strlen(names[i]) == n.size() &&
-        !strncmp(names[i], n.data(), n.size())) {
-      return i;
+  uint16_t m_slots[SLOT_COUNT];
+};
+
+constexpr auto getInstrName = [](size_t i) {
+  return std::string_view(ParsedFlr::INSTR_NAMES[i]);
+};
+constexpr StaticNameTable<ParsedFlr::I_COUNT> INSTR_LOOKUP(getInstrName);
+
+constexpr auto getImageFormatName = [](size_t i) {
+  return std::string_view(ParsedFlr::IMAGE_FORMAT_TABLE[i].glslFormatName);
+};
+constexpr StaticNameTable<std::size(ParsedFlr::IMAGE_FORMAT_TABLE)>
+    IMAGE_FORMAT_LOOKUP(getImageFormatName);
+
+constexpr auto getBufferResourceStateName = [](size_t i) {
+  return std::string_view(ParsedFlr::BUFFER_RESOURCE_STATE_TABLE[i].name);
+};
+constexpr StaticNameTable<std::size(ParsedFlr::BUFFER_RESOURCE_STATE_TABLE)>
+    BUFFER_RESOURCE_STATE_LOOKUP(getBufferResourceStateName);
+
+// Open-addressing name -> index map over a vector of named elements. The
+// table does not own any strings, slots only store the element index and the
+// name is compared against the element itself. Elements appended to the
+// vector are indexed lazily on the next lookup. Like the linear search it
+// replaces, the first element declared with a given name wins.
+template <typename T> class NameTable {
+public:
+  NameTable(const std::vector<T>& elems)
+      : m_elems(elems), m_slots(), m_indexedCount(0) {}
+
+  std::optional<uint32_t> find(std::string_view n) {
+    sync();
+    if (m_slots.empty())
+      return std::nullopt;
+    return findSlot(n, static_cast<uint32_t>(hashString(n)));
+  }
+
+private:
+  static constexpr uint32_t EMPTY_SLOT = ~0u;
+  struct Slot {
+    uint32_t hash;
+    uint32_t idx;
+  };
+
+  std::optional<uint32_t> findSlot(std::string_view n, uint32_t hash) const {
+    size_t mask = m_slots.size() - 1;
+    for (size_t slot = hash & mask; m_slots[slot].idx != EMPTY_SLOT;
+         slot = (slot + 1) & mask) {
+      const Slot& s = m_slots[slot];
+      if (s.hash == hash && m_elems[s.idx].name == n)
+        return s.idx;
     }
+    return std::nullopt;
+  }
+
+  void insert(uint32_t idx, uint32_t hash) {
+    size_t mask = m_slots.size() - 1;
+    size_t slot = hash & mask;
+    while (m_slots[slot].idx != EMPTY_SLOT)
+      slot = (slot + 1) & mask;
+    m_slots[slot] = {hash, idx};
+  }
+
+  void sync() {
+    while (m_indexedCount < m_elems.size()) {
+      // keep the load factor under 1/2
+      if (2 * (m_indexedCount + 1) > m_slots.size()) {
+        std::vector<Slot> prevSlots = std::move(m_slots);
+        m_slots.assign(
+            std::max<size_t>(16, 2 * prevSlots.size()),
+            {0, EMPTY_SLOT});
+        for (const Slot& s : prevSlots)
+          if (s.idx != EMPTY_SLOT)
+            insert(s.idx, s.hash);
+      }
+
+      uint32_t idx = static_cast<uint32_t>(m_indexedCount++);
+      std::string_view n = m_elems[idx].name;
+      uint32_t hash = static_cast<uint32_t>(hashString(n));
+      if (!findSlot(n, hash))
+        insert(idx, hash);
+    }
+  }
+
+  const std::vector<T>& m_elems;
+  std::vector<Slot> m_slots;
+  size_t m_indexedCount;
+};
+
+// Each file is read into memory with a single read and then split into lines
+// in-place, by overwriting line endings with null-terminators. The parser runs
+// directly over the file contents, without per-line copies or line-length
+// limits.
+struct File {
+  File(const std::string& filename)
+      : m_filename(filename),
+        m_contents(),
+        m_offset(0),
+        m_lineNumber(0),
+        m_sourceFileIdx(0),
+        m_prefixHash(FNV_OFFSET_BASIS) {
+    std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+    if (!stream.is_open())
+      return;
+    size_t size = static_cast<size_t>(stream.tellg());
+    m_contents.resize(size + 1, 0);
+    stream.seekg(0);
+    stream.read(m_contents.data(), size);
+  }
+
+  bool isOpen() const { return !m_contents.empty(); }
+
+  size_t getSize() const {
+    return m_contents.empty() ? 0 : m_contents.size() - 1;
+  }
+
+  char* nextLine() {
+    if (m_offset + 1 >= m_contents.size())
+      return nullptr;
+
+    char* line = m_contents.data() + m_offset;
+    char* end = static_cast<char*>(
+        memchr(line, '\n', m_contents.size() - 1 - m_offset));
+    if (!end)
+      end = m_contents.data() + m_contents.size() - 1;
+    size_t lineStart = m_offset;
+    m_offset = (end - m_contents.data()) + 1;
+
+    // hash the consumed bytes before they are modified below
+    size_t consumedEnd = std::min(m_offset, getSize());
+    m_prefixHash = hashBytes(line, consumedEnd - lineStart, m_prefixHash);
+
+    *end = 0;
+    if (end > line && *(end - 1) == '\r')
+      *(end - 1) = 0;
+
+    m_lineNumber++;
+    return line;
+  }
+
+  std::string m_filename;
+  std::vector<char> m_contents;
+  size_t m_offset;
+  uint32_t m_lineNumber;
+  uint32_t m_sourceFileIdx;
+  // hash of the original contents of the file up to m_offset
+  uint64_t m_prefixHash;
+};
+
+// The declaration that reads / writes instructions apply to
+enum AccessOwner : uint8_t { AO_NONE = 0, AO_COMPUTE_SHADER, AO_DRAW };
+} // namespace
+
+// Incremental reparsing
+//
+// Since later declarations can refer to anything declared before them, the
+// result of parsing a prefix of the instruction stream only depends on the
+// lines consumed so far. Whenever a file is pushed (include) or popped, a
+// checkpoint of the full parser state is taken, along with how much of each
+// source file was consumed up to that point. On reload, the last checkpoint
+// whose consumed file contents are unchanged is restored and parsing resumes
+// from there, so only the changed files and everything parsed after them are
+// reparsed.
+struct ParsedFlr::IncrementalState {
+  struct OpenFile {
+    uint32_t sourceFileIdx;
+    size_t offset;
+    uint32_t lineNumber;
+    uint64_t prefixHash;
+  };
+  struct ConsumedFile {
+    uint32_t sourceFileIdx;
+    size_t size;
+    uint64_t hash;
+  };
+  struct Checkpoint {
+    // open files, bottom of the stack first
+    std::vector<OpenFile> fileStack;
+    std::vector<ConsumedFile> consumedFiles;
+    uint32_t uiIdx;
+    uint32_t instrIdx;
+    bool bTaskBlockActive;
+    AccessOwner accessOwner;
+    std::shared_ptr<const ParsedFlr> pSnapshot;
+  };
+
+  std::string rootFile;
+  uint64_t paramsHash;
+  std::vector<Checkpoint> checkpoints;
+};
+
+namespace {
+using IncrementalState = ParsedFlr::IncrementalState;
+
+// Returns the index of the last checkpoint that is still valid for the current
+// contents of the source files
+std::optional<size_t> findResumeCheckpoint(
+    const IncrementalState& prev,
+    const char* rootFile,
+    uint64_t paramsHash) {
+  if (prev.paramsHash != paramsHash || prev.rootFile != rootFile ||
+      prev.checkpoints.empty())
+    return std::nullopt;
+
+  // every checkpoint indexes into the source files of the last one
+  const std::vector<std::string>& sourceFiles =
+      prev.checkpoints.back().pSnapshot->m_sourceFiles;
+  std::vector<std::optional<std::vector<char>>> contents(sourceFiles.size());
+  auto getContents = [&](uint32_t idx) -> const std::vector<char>* {
+    if (!contents[idx]) {
+      std::vector<char>& c = contents[idx].emplace();
+      std::ifstream stream(sourceFiles[idx], std::ios::binary | std::ios::ate);
+      if (!stream.is_open())
+        return nullptr;
+      c.resize(static_cast<size_t>(stream.tellg()));
+      stream.seekg(0);
+      stream.read(c.data(), c.size());
+    }
+    return &*contents[idx];
+  };
+
+  for (size_t i = prev.checkpoints.size(); i-- > 0;) {
+    const IncrementalState::Checkpoint& cp = prev.checkpoints[i];
+    bool bValid = true;
+    for (const auto& f : cp.fileStack) {
+      const std::vector<char>* c = getContents(f.sourceFileIdx);
+      if (!c || c->size() < f.offset ||
+          hashBytes(c->data(), std::min(f.offset, c->size())) !=
+              f.prefixHash) {
+        bValid = false;
+        break;
+      }
+    }
+    for (size_t j = 0; bValid && j < cp.consumedFiles.size(); j++) {
+      const auto& f = cp.consumedFiles[j];
+      const std::vector<char>* c = getContents(f.sourceFileIdx);
+      if (!c || c->size() != f.size || hashBytes(c->data(), c->size()) != f.hash)
+        bValid = false;
+    }
+    if (bValid)
+      return i;
   }
 
   return std::nullopt;
 }
 } // namespace
 
+void ParsedFlr::emitWarning(std::string msg) {
+  std::cerr << msg << std::endl;
+  m_warnings.push_back(std::move(msg));
+}
+
 ParsedFlr::ParsedFlr(
     Application& app,
     const char* flrFileName,
     const FlrParams& params)
+    : ParsedFlr(FlrTargetInfo::fromApplication(app), flrFileName, params) {}
+
+ParsedFlr::ParsedFlr(
+    const FlrTargetInfo& target,
+    const char* flrFileName,
+    const FlrParams& params,
+    const IncrementalState* pPrevious)
     : m_language(SHADER_LANGUAGE_GLSL),
       m_constUints(params.m_uintParams),
       m_featureFlags(FF_NONE),
+      m_maxCameraSpeed(8.0f),
       m_displayImageIdx(-1),
       m_initializationTaskIdx(-1),
+      m_simulationTask{-1, SM_SUBSTEPS, 1, 0.0f},
+      m_transientPoolSize(0),
+      m_bInferBarriers(false),
       m_failed(true),
-      m_errMsg() {
-
-  m_constUints.push_back({"SCREEN_WIDTH", app.getSwapChainExtent().width});
-  m_constUints.push_back({"SCREEN_HEIGHT", app.getSwapChainExtent().height});
-
-  uint32_t uintDummyStructIdx = m_structDefs.size();
-  m_structDefs.push_back({"uint", "", 4});
-  m_structDefs.push_back({"int", "", 4});
-  m_structDefs.push_back({"float", "", 4});
-  m_structDefs.push_back({"vec2", "", 8});
-  m_structDefs.push_back({"float2", "", 8});
-  m_structDefs.push_back({"uvec2", "", 8});
-  m_structDefs.push_back({"uint2", "", 8});
-  // vec3 buffers would work fine on the gpu size with stride 16
-  // but they seem like a foot-gun on the CPU side since sizeof(glm::vec3) == 12
-  // ...
-  // uint32_t vec3DummyStructIdx = m_structDefs.size();
-  //m_structDefs.push_back({ "vec3", "", 16 });
-  m_structDefs.push_back({"vec4", "", 16});
-  m_structDefs.push_back({"float4", "", 16});
-  m_structDefs.push_back({"uvec4", "", 16});
-  m_structDefs.push_back({"uint4", "", 16});
-
-  m_structDefs.push_back({"mat4", "", 64});
-
-  struct File {
-    File(const char* filename)
-        : m_filename(filename), m_stream(filename), m_lineNumber(0) {}
-    File(const std::string& filename)
-        : m_filename(filename), m_stream(filename), m_lineNumber(0) {}
-    std::string m_filename;
-    std::ifstream m_stream;
-    uint32_t m_lineNumber;
-  };
+      m_errMsg(),
+      m_bLoadedFromCache(false),
+      m_pIncrementalState(nullptr),
+      m_reusedInstrCount(0) {
+
+  uint64_t paramsHash = FNV_OFFSET_BASIS;
+  for (const ConstUint& c : params.m_uintParams) {
+    paramsHash = hashString(c.name, paramsHash);
+    paramsHash = hashValue(c.value, paramsHash);
+  }
+  paramsHash = hashValue(target.extent, paramsHash);
+  paramsHash = hashValue(target.displayFormat, paramsHash);
+  paramsHash = hashValue(target.depthFormat, paramsHash);
+
+  std::filesystem::path cachePath(flrFileName);
+  cachePath.replace_extension(".flrc");
+  if (params.m_bUseCache && loadCache(cachePath, paramsHash)) {
+    for (const std::string& warning : m_warnings)
+      std::cerr << warning << std::endl;
+    m_bLoadedFromCache = true;
+    m_failed = false;
+    return;
+  }
+
+  std::optional<size_t> resumeCheckpointIdx = std::nullopt;
+  if (pPrevious)
+    resumeCheckpointIdx =
+        findResumeCheckpoint(*pPrevious, flrFileName, paramsHash);
+
+  auto pIncrementalState = std::make_shared<IncrementalState>();
+  pIncrementalState->rootFile = flrFileName;
+  pIncrementalState->paramsHash = paramsHash;
+
+  uint32_t uintDummyStructIdx = 0;
+  if (resumeCheckpointIdx) {
+    const IncrementalState::Checkpoint& checkpoint =
+        pPrevious->checkpoints[*resumeCheckpointIdx];
+    *this = *checkpoint.pSnapshot;
+    m_reusedInstrCount = checkpoint.instrIdx;
+    for (const std::string& warning : m_warnings)
+      std::cerr << warning << std::endl;
+    // the earlier checkpoints are still valid as well
+    pIncrementalState->checkpoints.assign(
+        pPrevious->checkpoints.begin(),
+        pPrevious->checkpoints.begin() + *resumeCheckpointIdx + 1);
+  } else {
+    m_constUints.push_back({"SCREEN_WIDTH", target.extent.width});
+    m_constUints.push_back({"SCREEN_HEIGHT", target.extent.height});
+
+    uintDummyStructIdx = m_structDefs.size();
+    m_structDefs.push_back({"uint", "", 4});
+    m_structDefs.push_back({"int", "", 4});
+    m_structDefs.push_back({"float", "", 4});
+    m_structDefs.push_back({"vec2", "", 8});
+    m_structDefs.push_back({"float2", "", 8});
+    m_structDefs.push_back({"uvec2", "", 8});
+    m_structDefs.push_back({"uint2", "", 8});
+    // vec3 buffers would work fine on the gpu size with stride 16
+    // but they seem like a foot-gun on the CPU side since
+    // sizeof(glm::vec3) == 12 ...
+    // uint32_t vec3DummyStructIdx = m_structDefs.size();
+    //m_structDefs.push_back({ "vec3", "", 16 });
+    m_structDefs.push_back({"vec4", "", 16});
+    m_structDefs.push_back({"float4", "", 16});
+    m_structDefs.push_back({"uvec4", "", 16});
+    m_structDefs.push_back({"uint4", "", 16});
+
+    m_structDefs.push_back({"mat4", "", 64});
+    for (StructDef& s : m_structDefs)
+      s.layout = computeStructLayout(s);
+  }
+  m_pIncrementalState = pIncrementalState;
+
+  NameTable<ConstUint> constUintTable(m_constUints);
+  NameTable<ConstInt> constIntTable(m_constInts);
+  NameTable<ConstFloat> constFloatTable(m_constFloats);
+  NameTable<StructDef> structTable(m_structDefs);
+  NameTable<BufferDesc> bufferTable(m_buffers);
+  NameTable<ImageDesc> imageTable(m_images);
+  NameTable<TextureDesc> textureTable(m_textures);
+  NameTable<ComputeShader> computeShaderTable(m_computeShaders);
+  NameTable<ObjMesh> objModelTable(m_objModels);
+  NameTable<TaskBlock> taskBlockTable(m_taskBlocks);
+
   std::vector<File> flrFileStack;
-  flrFileStack.emplace_back(flrFileName);
-  flrFileStack.emplace_back(
-      GProjectDirectory + "/Shaders/FlrLib/Fluorescence.flrh");
+  std::vector<IncrementalState::ConsumedFile> consumedFiles;
+  auto pushFile = [&](const std::string& path, int parentIdx) {
+    uint32_t includeLine =
+        parentIdx >= 0 ? flrFileStack.back().m_lineNumber : 0;
+    File& file = flrFileStack.emplace_back(path);
+    if (file.isOpen()) {
+      file.m_sourceFileIdx = static_cast<uint32_t>(m_sourceFiles.size());
+      m_sourceFiles.push_back(path);
+      m_includeGraph.push_back({parentIdx, includeLine});
+    }
+  };
 
-  char lineBuf[1024];
+  char* lineBuf = nullptr;
 
   uint32_t uiIdx = 0;
   uint32_t instrIdx = 0;
 
   bool bTaskBlockActive = false;
+  AccessOwner accessOwner = AO_NONE;
+
+  if (resumeCheckpointIdx) {
+    const IncrementalState::Checkpoint& checkpoint =
+        pPrevious->checkpoints[*resumeCheckpointIdx];
+    for (const auto& f : checkpoint.fileStack) {
+      File& file = flrFileStack.emplace_back(m_sourceFiles[f.sourceFileIdx]);
+      file.m_offset = f.offset;
+      file.m_lineNumber = f.lineNumber;
+      file.m_sourceFileIdx = f.sourceFileIdx;
+      file.m_prefixHash = f.prefixHash;
+    }
+    consumedFiles = checkpoint.consumedFiles;
+    uiIdx = checkpoint.uiIdx;
+    instrIdx = checkpoint.instrIdx;
+    bTaskBlockActive = checkpoint.bTaskBlockActive;
+    accessOwner = checkpoint.accessOwner;
+  } else {
+    pushFile(flrFileName, -1);
+    pushFile(GProjectDirectory + "/Shaders/FlrLib/Fluorescence.flrh", -1);
+  }
+
+  // Checkpoints are only taken before any assets are loaded, snapshots of
+  // those would be too large
+  auto takeCheckpoint = [&]() {
+    if (!m_bufferFiles.empty() || !m_textureFiles.empty() ||
+        !m_objModels.empty())
+      return;
+
+    IncrementalState::Checkpoint& checkpoint =
+        pIncrementalState->checkpoints.emplace_back();
+    for (const File& file : flrFileStack)
+      checkpoint.fileStack.push_back(
+          {file.m_sourceFileIdx,
+           file.m_offset,
+           file.m_lineNumber,
+           file.m_prefixHash});
+    checkpoint.consumedFiles = consumedFiles;
+    checkpoint.uiIdx = uiIdx;
+    checkpoint.instrIdx = instrIdx;
+    checkpoint.bTaskBlockActive = bTaskBlockActive;
+    checkpoint.accessOwner = accessOwner;
+
+    auto pSnapshot = std::make_shared<ParsedFlr>(*this);
+    pSnapshot->m_pIncrementalState = nullptr;
+    checkpoint.pSnapshot = std::move(pSnapshot);
+  };
+  bool bCheckpointPending = false;
 
   auto emitParserError = [&](const char* msg) {
-    sprintf(
-        m_errMsg,
-        "ERROR: %s ON LINE: %u IN FILE: %s\n",
-        msg,
-        flrFileStack.back().m_lineNumber,
-        flrFileStack.back().m_filename.c_str());
+    // errors found after parsing all files are not tied to a line
+    if (flrFileStack.empty())
+      sprintf(m_errMsg, "ERROR: %s IN FILE: %s\n", msg, flrFileName);
+    else
+      sprintf(
+          m_errMsg,
+          "ERROR: %s ON LINE: %u IN FILE: %s\n",
+          msg,
+          flrFileStack.back().m_lineNumber,
+          flrFileStack.back().m_filename.c_str());
     std::cerr << m_errMsg << std::endl;
-    while (!flrFileStack.empty()) {
-      flrFileStack.back().m_stream.close();
-      flrFileStack.pop_back();
-    }
+    flrFileStack.clear();
   };
 
   auto emitParserWarning = [&](const char* msg) {
@@ -134,7 +515,7 @@ ParsedFlr::ParsedFlr(
         msg,
         flrFileStack.back().m_lineNumber,
         flrFileStack.back().m_filename.c_str());
-    std::cerr << warn << std::endl;
+    emitWarning(warn);
   };
 
 #define PARSER_VERIFY(X, MSG)                                                  \
@@ -148,32 +529,97 @@ ParsedFlr::ParsedFlr(
     emitParserWarning(MSG);                                                    \
   }
 
+  // innermost repeat or if without its end in the task list being declared
+  auto findOpenScope = [&]() -> std::optional<Task> {
+    const std::vector<Task>& tasks =
+        bTaskBlockActive ? m_taskBlocks.back().tasks : m_taskList;
+    uint32_t closedCount = 0;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+      if (it->type == TT_REPEAT_END || it->type == TT_IF_END)
+        closedCount++;
+      else if (
+          (it->type == TT_REPEAT || it->type == TT_IF) && closedCount-- == 0)
+        return *it;
+    }
+    return std::nullopt;
+  };
+
+  // Whether the tasks start conditional rendering, which can't be nested, or
+  // repeat anything. Repeats swap their ping_pong pairs while recording, even
+  // if the GPU ends up skipping their tasks.
+  std::function<bool(const std::vector<Task>&)> conflictsWithGpuCondition =
+      [&](const std::vector<Task>& tasks) {
+        for (const Task& task : tasks) {
+          if (task.type == TT_REPEAT)
+            return true;
+          if (task.type == TT_IF &&
+              m_conditions[task.idx].source == CS_BUFFER)
+            return true;
+          if (task.type == TT_TASK &&
+              conflictsWithGpuCondition(m_taskBlocks[task.idx].tasks))
+            return true;
+        }
+        return false;
+      };
+  // whether a task pushed now would be inside an if on a buffer predicate
+  auto isInsideGpuCondition = [&]() {
+    const std::vector<Task>& tasks =
+        bTaskBlockActive ? m_taskBlocks.back().tasks : m_taskList;
+    uint32_t closedCount = 0;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+      if (it->type == TT_IF_END) {
+        closedCount++;
+      } else if (it->type == TT_IF) {
+        if (closedCount > 0)
+          closedCount--;
+        else if (m_conditions[it->idx].source == CS_BUFFER)
+          return true;
+      }
+    }
+    return false;
+  };
+
   while (!flrFileStack.empty()) {
-    if (!flrFileStack.back().m_stream.getline(lineBuf, 1024)) {
-      flrFileStack.back().m_stream.close();
+    if (bCheckpointPending) {
+      takeCheckpoint();
+      bCheckpointPending = false;
+    }
+
+    File& file = flrFileStack.back();
+    lineBuf = file.nextLine();
+    if (!lineBuf) {
+      consumedFiles.push_back(
+          {file.m_sourceFileIdx, file.getSize(), file.m_prefixHash});
       flrFileStack.pop_back();
+      bCheckpointPending = true;
       continue;
     }
-    flrFileStack.back().m_lineNumber++;
+
+    if (m_declarationRanges.empty() ||
+        m_declarationRanges.back().sourceFileIdx != file.m_sourceFileIdx)
+      m_declarationRanges.push_back(
+          {file.m_sourceFileIdx,
+           file.m_lineNumber,
+           file.m_lineNumber,
+           instrIdx,
+           instrIdx});
 
     Parser p{lineBuf};
 
     auto constUintResolver =
         [&](std::string_view n) -> std::optional<uint32_t> {
-      return findValueByName<ConstUint, uint32_t, &ConstUint::value>(
-          m_constUints,
-          n);
+      if (auto idx = constUintTable.find(n))
+        return m_constUints[*idx].value;
+      return std::nullopt;
     };
     auto constIntResolver = [&](std::string_view n) -> std::optional<int32_t> {
-      return findValueByName<ConstInt, int32_t, &ConstInt::value>(
-          m_constInts,
-          n);
+      if (auto idx = constIntTable.find(n))
+        return m_constInts[*idx].value;
+      return std::nullopt;
     };
     auto constFloatResolver = [&](std::string_view n) -> std::optional<float> {
-      if (auto f = findValueByName<ConstFloat, float, &ConstFloat::value>(
-              m_constFloats,
-              n))
-        return f;
+      if (auto idx = constFloatTable.find(n))
+        return m_constFloats[*idx].value;
       if (auto u = constUintResolver(n))
         return static_cast<float>(*u);
       if (auto i = constIntResolver(n))
@@ -193,7 +639,7 @@ ParsedFlr::ParsedFlr(
 
     auto parseInstruction = [&]() -> std::optional<Instr> {
       return p.parseRef<Instr>([&](std::string_view n) -> std::optional<Instr> {
-        if (auto idx = findIndexByName(INSTR_NAMES, n))
+        if (auto idx = INSTR_LOOKUP.find(n, getInstrName))
           return (Instr)*idx;
         return std::nullopt;
       });
@@ -202,30 +648,23 @@ ParsedFlr::ParsedFlr(
     auto parseStructRef = [&]() -> std::optional<uint32_t> {
       return p.parseRef<uint32_t>(
           [&](std::string_view n) -> std::optional<uint32_t> {
-            return findIndexByName(m_structDefs, n);
+            return structTable.find(n);
           });
     };
 
     auto findVkFormat =
         [&](std::string_view glslFormat) -> std::optional<VkFormat> {
-      for (const auto& entry : IMAGE_FORMAT_TABLE) {
-        if (glslFormat.size() == strlen(entry.glslFormatName) &&
-            !strncmp(
-                glslFormat.data(),
-                entry.glslFormatName,
-                glslFormat.size()))
-          return entry.vkFormat;
-      }
+      if (auto idx = IMAGE_FORMAT_LOOKUP.find(glslFormat, getImageFormatName))
+        return IMAGE_FORMAT_TABLE[*idx].vkFormat;
       return std::nullopt;
     };
 
     auto findVkAccessFlags =
         [&](std::string_view brsName) -> std::optional<VkAccessFlags> {
-      for (const auto& entry : BUFFER_RESOURCE_STATE_TABLE) {
-        if (brsName.size() == strlen(entry.name) &&
-            !strncmp(brsName.data(), entry.name, brsName.size()))
-          return entry.accessFlags;
-      }
+      if (auto idx = BUFFER_RESOURCE_STATE_LOOKUP.find(
+              brsName,
+              getBufferResourceStateName))
+        return BUFFER_RESOURCE_STATE_TABLE[*idx].accessFlags;
       return std::nullopt;
     };
 
@@ -426,7 +865,7 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           imageName,
           "Could not parse image name in save_image_button instruction.");
-      auto imageIdx = findIndexByName(m_images, *imageName);
+      auto imageIdx = imageTable.find(*imageName);
       PARSER_VERIFY(
           imageIdx,
           "Could not find specified image in save_image_button "
@@ -451,7 +890,7 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           bufferName,
           "Could not parse buffer name in save_buffer_button instruction.");
-      auto bufferIdx = findIndexByName(m_buffers, *bufferName);
+      auto bufferIdx = bufferTable.find(*bufferName);
       PARSER_VERIFY(
           bufferIdx,
           "Could not find specified buffer in save_buffer_button "
@@ -470,7 +909,7 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           taskName,
           "Could not parse task name in task_button instruction.");
-      auto taskIdx = findIndexByName(m_taskBlocks, *taskName);
+      auto taskIdx = taskBlockTable.find(*taskName);
       PARSER_VERIFY(
           taskIdx,
           "Could not find specified task in task_button instruction.");
@@ -506,8 +945,7 @@ ParsedFlr::ParsedFlr(
 
       std::string nameStr(*name);
 
-      char body[1024] = {0};
-      uint32_t offs = 0;
+      std::string body;
       uint32_t structStartLine = flrFileStack.back().m_lineNumber;
       while (true) {
         bool breakOuter = false;
@@ -520,26 +958,41 @@ ParsedFlr::ParsedFlr(
           ++p.c;
         }
 
-        offs += sprintf(body + offs, "%s", lineBuf);
+        body += lineBuf;
 
         if (breakOuter)
           break;
 
-        *(body + offs) = '\n';
-        offs++;
+        body += '\n';
 
-        if (!flrFileStack.back().m_stream.getline(lineBuf, 1024)) {
+        lineBuf = flrFileStack.back().nextLine();
+        if (!lineBuf) {
           flrFileStack.back().m_lineNumber =
               structStartLine; // reset line to start of struct
           PARSER_VERIFY(
               false,
               "Found unterminated struct declaration, expected \'}\'.");
         }
-        flrFileStack.back().m_lineNumber++;
         p.c = lineBuf;
       }
 
-      m_structDefs.push_back({nameStr, std::string(body), 0});
+      StructDef& structDef =
+          m_structDefs.emplace_back(StructDef{nameStr, std::move(body), 0});
+      std::string halfType = findHalfScalarType(structDef);
+      if (!halfType.empty()) {
+        char msg[256];
+        snprintf(
+            msg,
+            sizeof(msg),
+            "Struct %s declares a %s field. Half precision values need 16-bit "
+            "storage on their own, declare them in pairs as half2 or half4.",
+            nameStr.c_str(),
+            halfType.c_str());
+        PARSER_VERIFY(false, msg);
+      }
+      structDef.layout = computeStructLayout(structDef);
+      // struct_size is only needed when the layout can't be derived
+      structDef.size = structDef.layout.size;
 
       break;
     }
@@ -562,6 +1015,22 @@ ParsedFlr::ParsedFlr(
           "Could not find struct referenced in structured-buffer declaration.");
 
       const auto& s = m_structDefs[*structIdx];
+      PARSER_VERIFY(
+          s.size > 0,
+          "Could not derive the std430 layout of the struct referenced in "
+          "structured-buffer declaration, declare its size with struct_size.");
+      if (s.layout.alignment && s.size != s.layout.size) {
+        char msg[256];
+        snprintf(
+            msg,
+            sizeof(msg),
+            "The struct_size of %s is %u bytes, but its std430 size is %u "
+            "bytes.",
+            s.name.c_str(),
+            s.size,
+            s.layout.size);
+        emitParserWarning(msg);
+      }
       bool bIndirectDispatch = s.name == "IndirectDispatch";
       bool bIndirectArgs = s.name == "IndirectArgs" ||
                            s.name == "IndexedIndirectArgs" || bIndirectDispatch;
@@ -653,6 +1122,32 @@ ParsedFlr::ParsedFlr(
       m_buffers.back().flags |= BF_READONLY;
       break;
     }
+    case I_TRANSIENT: {
+      PARSER_VERIFY(
+          m_buffers.size(),
+          "Instruction transient must be preceded by structured buffer "
+          "declaration.");
+      // transient contents are discarded anyway
+      m_buffers.back().flags |= BF_TRANSIENT | BF_SKIP_ZERO_INIT;
+      break;
+    }
+    case I_SOA: {
+      PARSER_VERIFY(
+          m_buffers.size(),
+          "Instruction soa must be preceded by structured buffer "
+          "declaration.");
+      PARSER_VERIFY(
+          computeSoaFields(m_buffers.back()),
+          "The struct of an soa buffer must be declared with a body whose "
+          "layout can be derived.");
+      PARSER_VERIFY(
+          m_structDefs[m_buffers.back().structIdx].size >=
+              m_structDefs[m_buffers.back().structIdx].layout.size,
+          "The struct_size of an soa buffer's struct cannot be smaller than "
+          "its std430 size.");
+      m_buffers.back().flags |= BF_SOA;
+      break;
+    }
     case I_COMPUTE_SHADER: {
       PARSER_VERIFY(name, "Could not parse compute-shader name.");
 
@@ -682,6 +1177,7 @@ ParsedFlr::ParsedFlr(
       }
 
       m_computeShaders.push_back({std::string(*name), gsx, gsy, gsz});
+      accessOwner = AO_COMPUTE_SHADER;
 
       break;
     }
@@ -714,18 +1210,12 @@ ParsedFlr::ParsedFlr(
           dispatchSizeZ,
           "Could not parse dispatchSizeZ in compute-dispatch declaration.");
 
-      uint32_t computeShaderIdx = 0;
-      for (const auto& c : m_computeShaders) {
-        if (c.name.size() == compShader->size() &&
-            !strncmp(c.name.data(), compShader->data(), c.name.size()))
-          break;
-        ++computeShaderIdx;
-      }
+      auto computeShaderIdx = computeShaderTable.find(*compShader);
       PARSER_VERIFY(
-          computeShaderIdx < m_computeShaders.size(),
+          computeShaderIdx,
           "Could not find referenced compute-shader referenced in "
           "compute-dispatch declaration.");
-      auto& cs = m_computeShaders[computeShaderIdx];
+      auto& cs = m_computeShaders[*computeShaderIdx];
       PARSER_VERIFY(
           cs.groupSizeX > 0 && cs.groupSizeY > 0 && cs.groupSizeZ > 0,
           "dispatch_threads can only be used if the group-sizes are annotated "
@@ -733,7 +1223,7 @@ ParsedFlr::ParsedFlr(
           "instead.");
       pushTask((uint32_t)m_computeDispatches.size(), TT_COMPUTE);
       m_computeDispatches.push_back(
-          {computeShaderIdx,
+          {*computeShaderIdx,
            *dispatchSizeX,
            *dispatchSizeY,
            *dispatchSizeZ,
@@ -764,21 +1254,15 @@ ParsedFlr::ParsedFlr(
           dispatchSizeZ,
           "Could not parse dispatchSizeZ in compute-dispatch declaration.");
 
-      uint32_t computeShaderIdx = 0;
-      for (const auto& c : m_computeShaders) {
-        if (c.name.size() == compShader->size() &&
-            !strncmp(c.name.data(), compShader->data(), c.name.size()))
-          break;
-        ++computeShaderIdx;
-      }
+      auto computeShaderIdx = computeShaderTable.find(*compShader);
       PARSER_VERIFY(
-          computeShaderIdx < m_computeShaders.size(),
+          computeShaderIdx,
           "Could not find referenced compute-shader referenced in "
           "compute-dispatch declaration.");
 
       pushTask((uint32_t)m_computeDispatches.size(), TT_COMPUTE);
       m_computeDispatches.push_back(
-          {computeShaderIdx,
+          {*computeShaderIdx,
            *dispatchSizeX,
            *dispatchSizeY,
            *dispatchSizeZ,
@@ -792,15 +1276,9 @@ ParsedFlr::ParsedFlr(
           "Could not parse compute-shader name in compute-dispatch "
           "declaration.");
 
-      uint32_t computeShaderIdx = 0;
-      for (const auto& c : m_computeShaders) {
-        if (c.name.size() == compShader->size() &&
-            !strncmp(c.name.data(), compShader->data(), c.name.size()))
-          break;
-        ++computeShaderIdx;
-      }
+      auto computeShaderIdx = computeShaderTable.find(*compShader);
       PARSER_VERIFY(
-          computeShaderIdx < m_computeShaders.size(),
+          computeShaderIdx,
           "Could not find referenced compute-shader referenced in "
           "dispatch_indirect declaration.");
 
@@ -809,7 +1287,7 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           bufName,
           "Could not parse buffer name in dispatch_indirect instruction");
-      auto bufIdx = findIndexByName(m_buffers, *bufName);
+      auto bufIdx = bufferTable.find(*bufName);
       PARSER_VERIFY(
           bufIdx,
           "Could not find specified buffer in dispatch_indirect instruction.");
@@ -830,7 +1308,7 @@ ParsedFlr::ParsedFlr(
 
       pushTask((uint32_t)m_computeDispatches.size(), TT_COMPUTE);
       m_computeDispatches.push_back(
-          {computeShaderIdx, *bufIdx, elemIdx ? *elemIdx : 0, 0, DM_INDIRECT});
+          {*computeShaderIdx, *bufIdx, elemIdx ? *elemIdx : 0, 0, DM_INDIRECT});
       break;
     }
     case I_BARRIER: {
@@ -853,20 +1331,12 @@ ParsedFlr::ParsedFlr(
       std::vector<uint32_t> buffers;
 
       while (bn) {
-        uint32_t bufferIdx = 0;
-        for (const BufferDesc& b : m_buffers) {
-          if (bn->size() == b.name.size() &&
-              !strncmp(bn->data(), b.name.data(), b.name.size())) {
-            break;
-          }
-          ++bufferIdx;
-        }
-
+        auto bufferIdx = bufferTable.find(*bn);
         PARSER_VERIFY(
-            bufferIdx < m_buffers.size(),
+            bufferIdx,
             "Could not find referenced buffer in barrier declaration.");
 
-        buffers.push_back(bufferIdx);
+        buffers.push_back(*bufferIdx);
 
         p.parseWhitespace();
         bn = p.parseName();
@@ -891,9 +1361,9 @@ ParsedFlr::ParsedFlr(
       desc.name = std::string(*name);
       desc.format = "";
       desc.createOptions = ImageOptions{};
-      desc.createOptions.width = app.getSwapChainExtent().width;
-      desc.createOptions.height = app.getSwapChainExtent().height;
-      desc.createOptions.format = app.getSwapChainImageFormat();
+      desc.createOptions.width = target.extent.width;
+      desc.createOptions.height = target.extent.height;
+      desc.createOptions.format = target.displayFormat;
       desc.createOptions.usage =
           VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
       desc.createOptions.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -905,6 +1375,7 @@ ParsedFlr::ParsedFlr(
 
       pushTask((uint32_t)m_renderPasses.size(), TT_RENDER);
       m_renderPasses.push_back({std::string(*name), {}, {}, -1, -1});
+      accessOwner = AO_NONE;
 
       if (auto width = parseUintOrVar()) {
         m_renderPasses.back().width = *width;
@@ -966,7 +1437,7 @@ ParsedFlr::ParsedFlr(
         PARSER_VERIFY(
             imageName,
             "Could not parse image name in load_attachments instruction.");
-        auto imageIdx = findIndexByName(m_images, *imageName);
+        auto imageIdx = imageTable.find(*imageName);
         PARSER_VERIFY(
             imageIdx,
             "Could not find specified image in load_attachments "
@@ -996,7 +1467,7 @@ ParsedFlr::ParsedFlr(
             imageName,
             "Could not parse image name in store_attachments "
             "instruction.");
-        auto imageIdx = findIndexByName(m_images, *imageName);
+        auto imageIdx = imageTable.find(*imageName);
         PARSER_VERIFY(
             imageIdx,
             "Could not find specified image in store_attachments "
@@ -1026,7 +1497,7 @@ ParsedFlr::ParsedFlr(
             imageName,
             "Could not parse image name in loadstore_attachments "
             "instruction.");
-        auto imageIdx = findIndexByName(m_images, *imageName);
+        auto imageIdx = imageTable.find(*imageName);
         PARSER_VERIFY(
             imageIdx,
             "Could not find specified image in loadstore_attachments "
@@ -1049,7 +1520,7 @@ ParsedFlr::ParsedFlr(
           imageName,
           "Could not parse image name in load_depth "
           "instruction.");
-      auto imageIdx = findIndexByName(m_images, *imageName);
+      auto imageIdx = imageTable.find(*imageName);
       PARSER_VERIFY(
           imageIdx,
           "Could not find specified image in load_depth "
@@ -1074,7 +1545,7 @@ ParsedFlr::ParsedFlr(
           imageName,
           "Could not parse image name in store_depth "
           "instruction.");
-      auto imageIdx = findIndexByName(m_images, *imageName);
+      auto imageIdx = imageTable.find(*imageName);
       PARSER_VERIFY(
           imageIdx,
           "Could not find specified image in store_depth "
@@ -1099,7 +1570,7 @@ ParsedFlr::ParsedFlr(
           imageName,
           "Could not parse image name in loadstore_depth "
           "instruction.");
-      auto imageIdx = findIndexByName(m_images, *imageName);
+      auto imageIdx = imageTable.find(*imageName);
       PARSER_VERIFY(
           imageIdx,
           "Could not find specified image in loadstore_depth "
@@ -1153,6 +1624,7 @@ ParsedFlr::ParsedFlr(
            AltheaEngine::PrimitiveType::TRIANGLES,
            0.0f,
            DF_NONE});
+      accessOwner = AO_DRAW;
       break;
     }
     case I_DRAW_INDEXED: {
@@ -1181,7 +1653,7 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           bufName,
           "Could not parse index buffer name in draw_indexed instruction");
-      auto bufIdx = findIndexByName(m_buffers, *bufName);
+      auto bufIdx = bufferTable.find(*bufName);
       PARSER_VERIFY(
           bufIdx,
           "Could not find specified index buffer in draw_indexed instruction.");
@@ -1210,6 +1682,7 @@ ParsedFlr::ParsedFlr(
            AltheaEngine::PrimitiveType::TRIANGLES,
            0.0f,
            DF_NONE});
+      accessOwner = AO_DRAW;
       break;
     }
     case I_DRAW_INDIRECT: {
@@ -1234,7 +1707,7 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           bufName,
           "Could not parse buffer name in draw_indirect instruction");
-      auto bufIdx = findIndexByName(m_buffers, *bufName);
+      auto bufIdx = bufferTable.find(*bufName);
       PARSER_VERIFY(
           bufIdx,
           "Could not find specified buffer in draw_indirect instruction.");
@@ -1266,6 +1739,7 @@ ParsedFlr::ParsedFlr(
            AltheaEngine::PrimitiveType::TRIANGLES,
            0.0f,
            DF_NONE});
+      accessOwner = AO_DRAW;
       break;
     }
     case I_DRAW_OBJ: {
@@ -1282,7 +1756,7 @@ ParsedFlr::ParsedFlr(
           "Could not parse obj name in draw-call declaration.");
       p.parseWhitespace();
 
-      auto idx = findIndexByName(m_objModels, *objName);
+      auto idx = objModelTable.find(*objName);
       PARSER_VERIFY(
           idx,
           "Could not find referenced obj mesh specified in draw-call "
@@ -1313,6 +1787,7 @@ ParsedFlr::ParsedFlr(
            AltheaEngine::PrimitiveType::TRIANGLES,
            0.0f,
            DF_NONE});
+      accessOwner = AO_DRAW;
       break;
     }
     case I_PRIM_TYPE: {
@@ -1434,7 +1909,7 @@ ParsedFlr::ParsedFlr(
       desc.createOptions = ImageOptions{};
       desc.createOptions.width = *width;
       desc.createOptions.height = *height;
-      desc.createOptions.format = app.getDepthImageFormat();
+      desc.createOptions.format = target.depthFormat;
       desc.createOptions.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
       desc.createOptions.aspectMask =
           VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
@@ -1517,7 +1992,7 @@ ParsedFlr::ParsedFlr(
           imageName,
           "Could not parse image name for transition_layout declaration.");
 
-      auto imageIdx = findIndexByName(m_images, *imageName);
+      auto imageIdx = imageTable.find(*imageName);
       PARSER_VERIFY(
           imageIdx,
           "Could not find specified image name in transition_layout "
@@ -1587,6 +2062,10 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           bTaskBlockActive,
           "Encountered task_block_end without corresponding task_block_start.");
+      PARSER_VERIFY(
+          !findOpenScope(),
+          "Encountered task_block_end with a repeat or if that is missing its "
+          "repeat_end / if_end.");
       bTaskBlockActive = false;
       break;
     };
@@ -1595,13 +2074,18 @@ ParsedFlr::ParsedFlr(
       PARSER_VERIFY(
           taskName,
           "Could not parse task name specified in run_task instruction.");
-      auto taskIdx = findIndexByName(m_taskBlocks, *taskName);
+      auto taskIdx = taskBlockTable.find(*taskName);
       PARSER_VERIFY(taskIdx, "Could not find task block with specified name.");
       if (bTaskBlockActive)
         PARSER_VERIFY(
             taskIdx < (m_taskBlocks.size() - 1),
             "A task block cannot be invoked within itself, invalid usage of "
             "run_task");
+      PARSER_VERIFY(
+          !isInsideGpuCondition() ||
+              !conflictsWithGpuCondition(m_taskBlocks[*taskIdx].tasks),
+          "A task block containing a repeat or an if on a buffer cannot be "
+          "run inside an if on a buffer.");
       pushTask(*taskIdx, TT_TASK);
       break;
     };
@@ -1611,11 +2095,263 @@ ParsedFlr::ParsedFlr(
           taskName,
           "Could not parse task name specified in initialization_task "
           "instruction.");
-      auto taskIdx = findIndexByName(m_taskBlocks, *taskName);
+      auto taskIdx = taskBlockTable.find(*taskName);
       PARSER_VERIFY(taskIdx, "Could not find task block with specified name.");
       m_initializationTaskIdx = *taskIdx;
       break;
     };
+    case I_SIMULATION_TASK: {
+      auto taskName = p.parseName();
+      PARSER_VERIFY(
+          taskName,
+          "Could not parse task name specified in simulation_task "
+          "instruction.");
+      auto taskIdx = taskBlockTable.find(*taskName);
+      PARSER_VERIFY(taskIdx, "Could not find task block with specified name.");
+      p.parseWhitespace();
+
+      auto mode =
+          p.parseToken<SimulationMode>(SIMULATION_MODE_NAMES, SM_COUNT);
+      PARSER_VERIFY(
+          mode,
+          "Expected substeps or fixed_rate after the simulation_task block "
+          "name.");
+      p.parseWhitespace();
+
+      SimulationTask& sim = m_simulationTask;
+      sim.taskBlockIdx = *taskIdx;
+      sim.mode = *mode;
+      if (*mode == SM_SUBSTEPS) {
+        auto substepCount = parseUintOrVar();
+        PARSER_VERIFY(
+            substepCount && *substepCount > 0,
+            "Expected a substep count greater than 0 in simulation_task.");
+        sim.substepCount = *substepCount;
+        sim.rate = 0.0f;
+      } else {
+        auto rate = parseFloatOrVar();
+        PARSER_VERIFY(
+            rate && *rate > 0.0f,
+            "Expected a step rate greater than 0 in simulation_task.");
+        sim.rate = *rate;
+        p.parseWhitespace();
+        // optional cap on the steps per frame, so a slow frame can't make
+        // the next one even slower
+        auto maxSubsteps = parseUintOrVar();
+        sim.substepCount = maxSubsteps && *maxSubsteps > 0 ? *maxSubsteps : 8;
+      }
+      p.parseWhitespace();
+      break;
+    };
+    case I_TASK_CADENCE: {
+      auto taskName = p.parseName();
+      PARSER_VERIFY(
+          taskName,
+          "Could not parse task name specified in task_cadence instruction.");
+      auto taskIdx = taskBlockTable.find(*taskName);
+      PARSER_VERIFY(taskIdx, "Could not find task block with specified name.");
+      for (const TaskCadence& cadence : m_taskCadences)
+        PARSER_VERIFY(
+            cadence.taskBlockIdx != *taskIdx,
+            "A task block can only have a single task_cadence.");
+      p.parseWhitespace();
+
+      auto interval = parseUintOrVar();
+      PARSER_VERIFY(
+          interval && *interval > 0,
+          "Expected a frame interval greater than 0 in task_cadence.");
+      p.parseWhitespace();
+      // optional, staggers blocks with the same interval
+      auto phase = parseUintOrVar();
+      PARSER_VERIFY(
+          !phase || *phase < *interval,
+          "The task_cadence phase must be less than the frame interval.");
+      m_taskCadences.push_back({*taskIdx, *interval, phase ? *phase : 0});
+      p.parseWhitespace();
+      break;
+    };
+    case I_REPEAT: {
+      PARSER_VERIFY(
+          !isInsideGpuCondition(),
+          "A repeat cannot be used inside an if on a buffer.");
+      Repeat repeat{0, -1, 0};
+      if (auto countName = p.parseName()) {
+        if (auto constIdx = constUintTable.find(*countName)) {
+          repeat.count = m_constUints[*constIdx].value;
+        } else {
+          for (uint32_t i = 0; i < m_sliderUints.size(); i++) {
+            if (m_sliderUints[i].name == *countName) {
+              repeat.sliderUintIdx = static_cast<int>(i);
+              break;
+            }
+          }
+          PARSER_VERIFY(
+              repeat.sliderUintIdx >= 0,
+              "Could not find uint constant or slider_uint specified as "
+              "repeat count.");
+          repeat.count = m_sliderUints[repeat.sliderUintIdx].defaultValue;
+        }
+      } else {
+        auto count = parseUintOrVar();
+        PARSER_VERIFY(
+            count,
+            "Expected a uint, uint constant or slider_uint as repeat count.");
+        repeat.count = *count;
+      }
+
+      // optionally followed by the ping_pong pairs swapped after every
+      // iteration
+      p.parseWhitespace();
+      if (auto keyword = p.parseName()) {
+        PARSER_VERIFY(
+            *keyword == "ping_pong" && p.parseChar(':'),
+            "Expected ping_pong: after the repeat count.");
+        do {
+          std::optional<uint32_t> bufferIdx[2];
+          for (uint32_t i = 0; i < 2; i++) {
+            p.parseWhitespace();
+            auto bn = p.parseName();
+            PARSER_VERIFY(
+                bn,
+                "Expected the two buffers of each ping_pong pair swapped by "
+                "the repeat.");
+            bufferIdx[i] = bufferTable.find(*bn);
+            PARSER_VERIFY(
+                bufferIdx[i],
+                "Could not find referenced buffer in repeat ping_pong list.");
+          }
+          uint32_t pairIdx = 0;
+          while (pairIdx < m_pingPongPairs.size()) {
+            const PingPongPair& pair = m_pingPongPairs[pairIdx];
+            if ((pair.buffers[0] == *bufferIdx[0] &&
+                 pair.buffers[1] == *bufferIdx[1]) ||
+                (pair.buffers[0] == *bufferIdx[1] &&
+                 pair.buffers[1] == *bufferIdx[0]))
+              break;
+            pairIdx++;
+          }
+          PARSER_VERIFY(
+              pairIdx < m_pingPongPairs.size(),
+              "The buffers swapped by a repeat must be declared as a "
+              "ping_pong pair.");
+          repeat.pingPongMask |= 1u << pairIdx;
+          p.parseWhitespace();
+        } while (!p.parseChar('#') && !p.parseChar(0));
+      }
+      pushTask(static_cast<uint32_t>(m_repeats.size()), TT_REPEAT);
+      m_repeats.push_back(repeat);
+      break;
+    };
+    case I_REPEAT_END: {
+      auto scope = findOpenScope();
+      PARSER_VERIFY(
+          scope && scope->type == TT_REPEAT,
+          "Encountered repeat_end without corresponding repeat.");
+      pushTask(scope->idx, TT_REPEAT_END);
+      break;
+    };
+    case I_IF: {
+      Condition condition{CS_CONST, 0, false};
+      condition.bNegate = p.parseChar('!');
+      p.parseWhitespace();
+      auto conditionName = p.parseName();
+      PARSER_VERIFY(
+          conditionName,
+          "Expected a checkbox, button, slider, uint constant or buffer as "
+          "if condition.");
+
+      auto findUiElem = [&](const auto& elems) -> std::optional<uint32_t> {
+        for (uint32_t i = 0; i < elems.size(); i++)
+          if (elems[i].name == *conditionName)
+            return i;
+        return std::nullopt;
+      };
+      if (auto constIdx = constUintTable.find(*conditionName)) {
+        condition.idx = m_constUints[*constIdx].value;
+      } else if (auto checkboxIdx = findUiElem(m_checkboxes)) {
+        condition = {CS_CHECKBOX, *checkboxIdx, condition.bNegate};
+      } else if (auto buttonIdx = findUiElem(m_buttons)) {
+        condition = {CS_BUTTON, *buttonIdx, condition.bNegate};
+      } else if (auto sliderIdx = findUiElem(m_sliderUints)) {
+        condition = {CS_SLIDER_UINT, *sliderIdx, condition.bNegate};
+      } else if (auto sliderIdx = findUiElem(m_sliderInts)) {
+        condition = {CS_SLIDER_INT, *sliderIdx, condition.bNegate};
+      } else if (auto bufferIdx = bufferTable.find(*conditionName)) {
+        PARSER_VERIFY(
+            !isInsideGpuCondition(),
+            "An if on a buffer cannot be nested inside another if on a "
+            "buffer.");
+        condition = {CS_BUFFER, *bufferIdx, condition.bNegate};
+        m_buffers[*bufferIdx].flags |= BF_PREDICATE;
+      } else {
+        PARSER_VERIFY(
+            false,
+            "Could not find checkbox, button, slider, uint constant or buffer "
+            "specified as if condition.");
+      }
+
+      pushTask(static_cast<uint32_t>(m_conditions.size()), TT_IF);
+      m_conditions.push_back(condition);
+      p.parseWhitespace();
+      break;
+    };
+    case I_IF_END: {
+      auto scope = findOpenScope();
+      PARSER_VERIFY(
+          scope && scope->type == TT_IF,
+          "Encountered if_end without corresponding if.");
+      pushTask(scope->idx, TT_IF_END);
+      break;
+    };
+    case I_PING_PONG: {
+      if (m_pingPongPairs.size() == MAX_PING_PONG_PAIRS) {
+        char msg[256];
+        snprintf(
+            msg,
+            sizeof(msg),
+            "Too many ping_pong pairs, at most %u are supported.",
+            MAX_PING_PONG_PAIRS);
+        PARSER_VERIFY(false, msg);
+      }
+      PingPongPair pair;
+      for (uint32_t i = 0; i < 2; i++) {
+        p.parseWhitespace();
+        auto bn = p.parseName();
+        PARSER_VERIFY(bn, "Expected two buffers in ping_pong declaration.");
+        auto bufferIdx = bufferTable.find(*bn);
+        PARSER_VERIFY(
+            bufferIdx,
+            "Could not find referenced buffer in ping_pong declaration.");
+        for (const PingPongPair& other : m_pingPongPairs)
+          PARSER_VERIFY(
+              other.buffers[0] != *bufferIdx && other.buffers[1] != *bufferIdx,
+              "A buffer can only be part of a single ping_pong pair.");
+        pair.buffers[i] = *bufferIdx;
+      }
+
+      const BufferDesc& a = m_buffers[pair.buffers[0]];
+      const BufferDesc& b = m_buffers[pair.buffers[1]];
+      PARSER_VERIFY(
+          pair.buffers[0] != pair.buffers[1],
+          "The buffers of a ping_pong pair must be different.");
+      // the bindings are swapped, so the shaders need to see the same layout
+      // through either one
+      PARSER_VERIFY(
+          a.structIdx == b.structIdx && a.elemCount == b.elemCount &&
+              a.bufferCount == b.bufferCount,
+          "The buffers of a ping_pong pair must have the same struct, element "
+          "count and array count.");
+      // index and indirect args buffers are bound directly by the commands
+      // using them, not through the descriptor set
+      PARSER_VERIFY(
+          !a.isIndexBuffer() && !b.isIndexBuffer() && !a.isIndirectArgs() &&
+              !b.isIndirectArgs(),
+          "Index buffers and indirect args buffers cannot be part of a "
+          "ping_pong pair.");
+      m_pingPongPairs.push_back(pair);
+      p.parseWhitespace();
+      break;
+    };
     case I_INCLUDE: {
       auto pathLiteral = p.parseStringLiteral();
       PARSER_VERIFY(pathLiteral, "Could not parse included flr header path");
@@ -1636,11 +2372,13 @@ ParsedFlr::ParsedFlr(
         path = fpath.u8string();
       }
 
-      flrFileStack.emplace_back(path.c_str());
-      if (!flrFileStack.back().m_stream.is_open()) {
+      uint32_t parentIdx = flrFileStack.back().m_sourceFileIdx;
+      pushFile(path, static_cast<int>(parentIdx));
+      if (!flrFileStack.back().isOpen()) {
         flrFileStack.pop_back();
         PARSER_VERIFY(false, "Could not open included flr header file");
       }
+      bCheckpointPending = true;
 
       break;
     };
@@ -1661,6 +2399,63 @@ ParsedFlr::ParsedFlr(
       m_language = *lang;
       break;
     };
+    case I_READS:
+    case I_WRITES: {
+      ResourceAccess* pAccess = nullptr;
+      if (accessOwner == AO_COMPUTE_SHADER)
+        pAccess = &m_computeShaders.back().access;
+      else if (accessOwner == AO_DRAW)
+        pAccess = &m_renderPasses.back().draws.back().access;
+      PARSER_VERIFY(
+          pAccess,
+          "reads and writes instructions must follow a compute_shader or "
+          "draw-call declaration.");
+
+      bool bWrite = *instr == I_WRITES;
+
+      // without a colon, the first resource is parsed as the name token
+      auto rn = name ? name : p.parseName();
+      PARSER_VERIFY(
+          rn,
+          "Expected at least one buffer or image in reads / writes "
+          "declaration.");
+
+      while (rn) {
+        if (auto bufferIdx = bufferTable.find(*rn)) {
+          PARSER_VERIFY(
+              !bWrite || !m_buffers[*bufferIdx].isReadOnly(),
+              "Cannot declare writes to a buffer marked buffer_readonly.");
+          pAccess->addBuffer(
+              *bufferIdx,
+              bWrite ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT);
+        } else if (auto imageIdx = imageTable.find(*rn)) {
+          pAccess->addImage(*imageIdx, bWrite);
+        } else if (auto textureIdx = textureTable.find(*rn)) {
+          // textures loaded from file are never written on the GPU and don't
+          // need any synchronization
+          const TextureDesc& texture = m_textures[*textureIdx];
+          PARSER_VERIFY(
+              texture.imageIdx >= 0 || !bWrite,
+              "Cannot declare writes to a texture_file.");
+          if (texture.imageIdx >= 0)
+            pAccess->addImage(static_cast<uint32_t>(texture.imageIdx), bWrite);
+        } else if (*rn == "none") {
+          // declares that no buffer or image is accessed
+        } else {
+          PARSER_VERIFY(
+              false,
+              "Could not find referenced buffer or image in reads / writes "
+              "declaration.");
+        }
+
+        p.parseWhitespace();
+        rn = p.parseName();
+      }
+
+      pAccess->bDeclared = true;
+      m_bInferBarriers = true;
+      break;
+    };
     default:
       PARSER_VERIFY(false, "Encountered unknown instruction.");
       continue;
@@ -1670,10 +2465,119 @@ ParsedFlr::ParsedFlr(
     // it is valid
     PARSER_VERIFY(!arrayCount, "Array syntax not valid for this instruction.");
     instrIdx++;
+
+    DeclarationRange& range = m_declarationRanges.back();
+    range.endInstr = instrIdx;
+    if (flrFileStack.back().m_sourceFileIdx == range.sourceFileIdx)
+      range.lastLine = flrFileStack.back().m_lineNumber;
   }
 
   // post-process
   PARSER_VERIFY(m_displayImageIdx >= 0, "Must specify a display_image");
+  PARSER_VERIFY(
+      !findOpenScope(),
+      "Encountered a repeat or if that is missing its repeat_end / if_end.");
+
+  // Barriers are only derived from declared access, a task that doesn't
+  // declare any would silently race with the tasks around it
+  if (m_bInferBarriers) {
+    for (const ComputeShader& c : m_computeShaders) {
+      if (!c.access.bDeclared) {
+        char msg[256];
+        snprintf(
+            msg,
+            sizeof(msg),
+            "Compute shader %s does not declare its resource access, which "
+            "is required once any task does. Use reads: none if it doesn't "
+            "access any buffer or image.",
+            c.name.c_str());
+        PARSER_VERIFY(false, msg);
+      }
+    }
+    for (const RenderPass& pass : m_renderPasses) {
+      for (const Draw& draw : pass.draws) {
+        if (!draw.access.bDeclared) {
+          char msg[256];
+          snprintf(
+              msg,
+              sizeof(msg),
+              "Draw-call %s / %s in render pass %s does not declare its "
+              "resource access, which is required once any task does. Use "
+              "reads: none if it doesn't access any buffer or image.",
+              draw.vertexShader.c_str(),
+              draw.pixelShader.c_str(),
+              pass.name.c_str());
+          PARSER_VERIFY(false, msg);
+        }
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < m_buffers.size(); i++) {
+    const BufferDesc& desc = m_buffers[i];
+    if (!desc.isTransient())
+      continue;
+
+    // live ranges are derived from the declared resource access
+    PARSER_VERIFY(
+        m_bInferBarriers,
+        "Transient buffers require the resource access of tasks to be "
+        "declared with reads / writes.");
+    // only the descriptor set binding points into the pool, anything that
+    // uses the buffer directly needs an allocation of its own
+    PARSER_VERIFY(
+        desc.bufferCount == 1 && !desc.isCpuVisible() &&
+            !desc.isTransferSrc() && !desc.isIndirectArgs() &&
+            !desc.isIndexBuffer() && !desc.isPredicate() &&
+            !desc.isReadOnly(),
+        "Transient buffers cannot be buffer arrays, read-only, cpu accessible, "
+        "saved, used as index / indirect args buffers or as if predicates.");
+    for (const BufferFile& bufferFile : m_bufferFiles)
+      PARSER_VERIFY(
+          bufferFile.bufferIdx != i,
+          "Transient buffers cannot be loaded from a buffer_file.");
+  }
+  for (uint32_t i = 0; i < m_pingPongPairs.size(); i++) {
+    bool bSwapped = false;
+    for (const Repeat& repeat : m_repeats)
+      bSwapped |= (repeat.pingPongMask & (1u << i)) != 0;
+    if (!bSwapped)
+      emitWarning(
+          "WARNING: The ping_pong pair " +
+          m_buffers[m_pingPongPairs[i].buffers[0]].name + " " +
+          m_buffers[m_pingPongPairs[i].buffers[1]].name +
+          " is not swapped by any repeat, list it after the repeat count "
+          "with ping_pong: to swap it.");
+  }
+  for (const PingPongPair& pair : m_pingPongPairs)
+    PARSER_VERIFY(
+        m_buffers[pair.buffers[0]].isTransient() ==
+            m_buffers[pair.buffers[1]].isTransient(),
+        "Either both or neither buffer of a ping_pong pair must be transient.");
+
+  for (const BufferDesc& desc : m_buffers) {
+    if (!desc.isSoa())
+      continue;
+
+    // every field array gets a binding of its own, anything that uses the
+    // buffer directly would see the fields one after the other
+    PARSER_VERIFY(
+        desc.bufferCount == 1 && !desc.isCpuVisible() &&
+            !desc.isIndirectArgs() && !desc.isIndexBuffer() &&
+            !desc.isPredicate() && !desc.isTransient(),
+        "Soa buffers cannot be buffer arrays, transient, cpu accessible, used "
+        "as index / indirect args buffers or as if predicates.");
+    if (m_language == AltheaEngine::SHADER_LANGUAGE_HLSL)
+      for (const SoaField& field : desc.soaFields)
+        PARSER_VERIFY(
+            field.arrayDims.empty(),
+            "Soa buffers cannot have array fields in hlsl mode.");
+  }
+  for (const PingPongPair& pair : m_pingPongPairs)
+    PARSER_VERIFY(
+        m_buffers[pair.buffers[0]].isSoa() ==
+            m_buffers[pair.buffers[1]].isSoa(),
+        "Either both or neither buffer of a ping_pong pair must be soa.");
 
   // enforce valid vertex output existence for hlsl
   if (m_language == AltheaEngine::SHADER_LANGUAGE_HLSL) {
@@ -1724,15 +2628,24 @@ ParsedFlr::ParsedFlr(
     image.createOptions = ImageOptions{};
     image.createOptions.width = pass.width;
     image.createOptions.height = pass.height;
-    image.createOptions.format = app.getDepthImageFormat();
+    image.createOptions.format = target.depthFormat;
     image.createOptions.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     image.createOptions.aspectMask =
         VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
   }
 
+  std::string transientError = allocateTransientBuffers();
+  PARSER_VERIFY(transientError.empty(), transientError.c_str());
+
 #undef PARSER_VERIFY
 #undef PARSER_VERIFY_WARN
 
+  if (m_bInferBarriers)
+    inferBarriers();
+
   m_failed = false;
+
+  if (params.m_bUseCache && isCacheable())
+    saveCache(cachePath, paramsHash);
 }
 } // namespace flr
\ No newline at end of file
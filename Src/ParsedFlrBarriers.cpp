@@ -0,0 +1,620 @@
+#include "ParsedFlr.h"
+
+#include <cstdio>
+#include <optional>
+#include <string>
+
+// Barrier inference
+//
+// Compute shaders and draw-calls can declare the buffers and images they
+// access with the reads / writes instructions. Each task list is then walked
+// in execution order, tracking the accesses made to every resource since its
+// last barrier or layout transition. A buffer barrier is only inserted before
+// a task on a read-after-write, write-after-write or write-after-read hazard,
+// and an image transition only when the image is needed in a different
+// layout or on one of those hazards. All barriers needed before a task are
+// grouped by their destination access.
+//
+// A barrier only makes a write visible to the shader stages and access of the
+// task it is placed before. A later reader of the same write in another stage
+// (a draw after a compute read) or with another access (indirect args, index
+// data) gets a barrier of its own, the same goes for images sampled from
+// another stage after their transition.
+//
+// Task lists are derived independently of each other. What executed before a
+// list starts is not known (the previous frame, a task block triggered from
+// the UI, ...), so the first access of every resource in a list is treated as
+// following a write, unless the resource is never written by any task at all.
+// Running a task block leaves everything the block touched in that same
+// unknown state.
+//
+// The body of a repeat follows both the tasks before it and its own previous
+// iteration, and every iteration swaps the ping_pong pairs of the repeat. The
+// start and end of a repeat therefore forget the state of everything touched
+// in the body, along with both buffers of those pairs since their bindings
+// may have swapped.
+// The body of an if may be skipped, so its end forgets the state of
+// everything touched in the body as well.
+//
+// Transient buffers sharing pool memory have disjoint live ranges within a
+// list, the barrier before the first access of a written buffer also orders
+// it after the accesses made to the buffers it aliases.
+
+namespace flr {
+namespace {
+using Task = ParsedFlr::Task;
+using ResourceAccess = ParsedFlr::ResourceAccess;
+
+constexpr VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT;
+constexpr VkAccessFlags SHADER_ACCESS_MASK =
+    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+constexpr VkPipelineStageFlags SHADER_STAGES_MASK =
+    VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+bool isWriteAccess(VkAccessFlags accessFlags) {
+  return (accessFlags & WRITE_ACCESS_MASK) != 0;
+}
+
+bool isReadAccess(VkAccessFlags accessFlags) {
+  return (accessFlags & ~WRITE_ACCESS_MASK) != 0;
+}
+
+// Accesses made to a resource since its last barrier or transition
+struct SyncState {
+  bool bWritten;
+  bool bRead;
+  // only used for images, nullopt if unknown
+  std::optional<ParsedFlr::LayoutTransitionTarget> layout;
+  // What the barriers and transitions since the last write made it visible
+  // to, the access is only used for buffers
+  VkAccessFlags visibleAccess;
+  VkPipelineStageFlags visibleStages;
+};
+
+// A resource nothing writes to is visible to everything
+constexpr VkAccessFlags ALL_ACCESS = ~VkAccessFlags(0);
+constexpr VkPipelineStageFlags ALL_STAGES = ~VkPipelineStageFlags(0);
+
+class BarrierInference {
+public:
+  BarrierInference(ParsedFlr& parsed) : m_parsed(parsed) {
+    m_bBufferWritten.resize(m_parsed.m_buffers.size());
+    auto markWrites = [&](const ResourceAccess& access) {
+      for (const auto& b : access.buffers)
+        if (isWriteAccess(b.accessFlags))
+          m_bBufferWritten[b.buffer] = true;
+    };
+    for (const auto& c : m_parsed.m_computeShaders)
+      markWrites(c.access);
+    for (const auto& pass : m_parsed.m_renderPasses)
+      for (const auto& draw : pass.draws)
+        markWrites(draw.access);
+    // a write through either binding of a ping_pong pair may land in both
+    for (const auto& pair : m_parsed.m_pingPongPairs) {
+      if (m_bBufferWritten[pair.buffers[0]] ||
+          m_bBufferWritten[pair.buffers[1]]) {
+        m_bBufferWritten[pair.buffers[0]] = true;
+        m_bBufferWritten[pair.buffers[1]] = true;
+      }
+    }
+
+    // task blocks can only run blocks declared before them
+    m_repeatAccess.resize(m_parsed.m_repeats.size());
+    m_conditionAccess.resize(m_parsed.m_conditions.size());
+    m_blockAccess.resize(m_parsed.m_taskBlocks.size());
+    for (size_t i = 0; i < m_parsed.m_taskBlocks.size(); i++) {
+      gatherScopeAccess(m_parsed.m_taskBlocks[i].tasks);
+      for (const Task& task : m_parsed.m_taskBlocks[i].tasks) {
+        gatherTaskAccess(task, m_blockAccess[i]);
+        if (task.type == ParsedFlr::TT_RENDER)
+          for (const auto& a : m_parsed.m_renderPasses[task.idx].attachments)
+            m_blockAccess[i].addImage(static_cast<uint32_t>(a.imageIdx), true);
+      }
+    }
+  }
+
+  std::vector<Task> derive(const std::vector<Task>& tasks) {
+    m_buffers.resize(m_parsed.m_buffers.size());
+    for (size_t i = 0; i < m_buffers.size(); i++)
+      m_buffers[i] =
+          {m_bBufferWritten[i], false, std::nullopt, ALL_ACCESS, ALL_STAGES};
+    m_images.assign(
+        m_parsed.m_images.size(),
+        {true, false, std::nullopt, 0, 0});
+
+    gatherScopeAccess(tasks);
+
+    std::vector<Task> derived;
+    derived.reserve(tasks.size());
+    for (const Task& task : tasks) {
+      if (task.type == ParsedFlr::TT_BARRIER ||
+          task.type == ParsedFlr::TT_TRANSITION)
+        continue;
+
+      if (task.type == ParsedFlr::TT_TASK ||
+          task.type == ParsedFlr::TT_REPEAT ||
+          task.type == ParsedFlr::TT_REPEAT_END ||
+          task.type == ParsedFlr::TT_IF_END) {
+        ResourceAccess access;
+        gatherTaskAccess(task, access);
+        forgetState(access);
+        derived.push_back(task);
+        continue;
+      }
+
+      if (task.type == ParsedFlr::TT_IF) {
+        // the predicate is made visible to conditional rendering when the if
+        // is recorded, only a later write needs to wait for the read
+        const auto& condition = m_parsed.m_conditions[task.idx];
+        if (condition.source == ParsedFlr::CS_BUFFER)
+          m_buffers[condition.idx].bRead = true;
+        derived.push_back(task);
+        continue;
+      }
+
+      ResourceAccess access;
+      gatherTaskAccess(task, access);
+      VkPipelineStageFlags shaderStages =
+          m_parsed.getTaskStages(task) & SHADER_STAGES_MASK;
+      emitBufferBarriers(access, shaderStages, derived);
+      emitImageTransitions(access, shaderStages, derived);
+      derived.push_back(task);
+
+      // render passes leave their attachments in attachment layout
+      if (task.type == ParsedFlr::TT_RENDER)
+        for (const auto& a : m_parsed.m_renderPasses[task.idx].attachments)
+          m_images[a.imageIdx] =
+              {true, false, ParsedFlr::LTT_ATTACHMENT, 0, 0};
+    }
+
+    return derived;
+  }
+
+private:
+  // Accumulates the accesses made within the body of every repeat and if in
+  // tasks
+  void gatherScopeAccess(const std::vector<Task>& tasks) {
+    std::vector<ResourceAccess*> openScopes;
+    for (const Task& task : tasks) {
+      if (task.type == ParsedFlr::TT_REPEAT_END ||
+          task.type == ParsedFlr::TT_IF_END) {
+        openScopes.pop_back();
+      } else {
+        ResourceAccess access;
+        gatherTaskAccess(task, access);
+        if (task.type == ParsedFlr::TT_RENDER)
+          for (const auto& a : m_parsed.m_renderPasses[task.idx].attachments)
+            access.addImage(static_cast<uint32_t>(a.imageIdx), true);
+        for (ResourceAccess* pScopeAccess : openScopes)
+          pScopeAccess->append(access);
+      }
+
+      if (task.type == ParsedFlr::TT_REPEAT)
+        openScopes.push_back(&m_repeatAccess[task.idx]);
+      else if (task.type == ParsedFlr::TT_IF)
+        openScopes.push_back(&m_conditionAccess[task.idx]);
+    }
+  }
+
+  void gatherTaskAccess(const Task& task, ResourceAccess& access) const {
+    switch (task.type) {
+    case ParsedFlr::TT_COMPUTE:
+    case ParsedFlr::TT_RENDER: {
+      m_parsed.gatherTaskAccess(task, access);
+      break;
+    }
+    case ParsedFlr::TT_TASK: {
+      access.append(m_blockAccess[task.idx]);
+      break;
+    }
+    case ParsedFlr::TT_REPEAT:
+    case ParsedFlr::TT_REPEAT_END: {
+      access.append(m_repeatAccess[task.idx]);
+      uint32_t mask = m_parsed.m_repeats[task.idx].pingPongMask;
+      for (uint32_t i = 0; i < m_parsed.m_pingPongPairs.size(); i++)
+        if (mask & (1u << i))
+          for (uint32_t bufferIdx : m_parsed.m_pingPongPairs[i].buffers)
+            access.addBuffer(
+                bufferIdx,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+      break;
+    }
+    case ParsedFlr::TT_IF:
+    case ParsedFlr::TT_IF_END: {
+      access.append(m_conditionAccess[task.idx]);
+      const auto& condition = m_parsed.m_conditions[task.idx];
+      if (condition.source == ParsedFlr::CS_BUFFER)
+        access.addBuffer(condition.idx, VK_ACCESS_SHADER_READ_BIT);
+      break;
+    }
+    default:
+      break;
+    };
+  }
+
+  void emitBufferBarriers(
+      const ResourceAccess& access,
+      VkPipelineStageFlags shaderStages,
+      std::vector<Task>& derived) {
+    size_t firstBarrier = m_parsed.m_barriers.size();
+    for (const auto& b : access.buffers) {
+      SyncState& state = m_buffers[b.buffer];
+      bool bWrite = isWriteAccess(b.accessFlags);
+      // indirect and index reads happen in fixed stages
+      VkPipelineStageFlags accessStages =
+          (b.accessFlags & SHADER_ACCESS_MASK) ? shaderStages : 0;
+      bool bVisible = (b.accessFlags & ~state.visibleAccess) == 0 &&
+                      (accessStages & ~state.visibleStages) == 0;
+      if (state.bWritten || (bWrite && state.bRead) || !bVisible) {
+        ParsedFlr::Barrier* pBarrier = nullptr;
+        for (size_t i = firstBarrier; i < m_parsed.m_barriers.size(); i++) {
+          if (m_parsed.m_barriers[i].accessFlags == b.accessFlags) {
+            pBarrier = &m_parsed.m_barriers[i];
+            break;
+          }
+        }
+        if (!pBarrier) {
+          derived.push_back(
+              {static_cast<uint32_t>(m_parsed.m_barriers.size()),
+               ParsedFlr::TT_BARRIER});
+          pBarrier = &m_parsed.m_barriers.emplace_back();
+          pBarrier->accessFlags = b.accessFlags;
+        }
+        pBarrier->buffers.push_back(b.buffer);
+        if (state.bWritten) {
+          state.visibleAccess = 0;
+          state.visibleStages = 0;
+        }
+        state.visibleAccess |= b.accessFlags;
+        state.visibleStages |= accessStages;
+        state.bWritten = false;
+        state.bRead = false;
+      }
+      state.bWritten |= bWrite;
+      state.bRead |= isReadAccess(b.accessFlags);
+    }
+  }
+
+  void emitImageTransitions(
+      const ResourceAccess& access,
+      VkPipelineStageFlags shaderStages,
+      std::vector<Task>& derived) {
+    for (const auto& i : access.images) {
+      SyncState& state = m_images[i.image];
+      ParsedFlr::LayoutTransitionTarget target =
+          i.bWrite ? ParsedFlr::LTT_IMAGE_RW : ParsedFlr::LTT_TEXTURE;
+      bool bSameLayout = state.layout == target && !state.bWritten;
+      if (!bSameLayout || (i.bWrite && state.bRead) ||
+          (shaderStages & ~state.visibleStages) != 0) {
+        derived.push_back(
+            {static_cast<uint32_t>(m_parsed.m_transitions.size()),
+             ParsedFlr::TT_TRANSITION});
+        m_parsed.m_transitions.push_back({i.image, target});
+        VkPipelineStageFlags visibleStages =
+            bSameLayout ? state.visibleStages : 0;
+        state = {false, false, target, 0, visibleStages | shaderStages};
+      }
+      state.bWritten |= i.bWrite;
+      state.bRead |= !i.bWrite;
+    }
+  }
+
+  void forgetState(const ResourceAccess& access) {
+    for (const auto& b : access.buffers) {
+      m_buffers[b.buffer].bWritten |= isWriteAccess(b.accessFlags);
+      m_buffers[b.buffer].bRead |= isReadAccess(b.accessFlags);
+    }
+    for (const auto& i : access.images) {
+      m_images[i.image].bWritten |= i.bWrite;
+      m_images[i.image].bRead |= !i.bWrite;
+      m_images[i.image].layout = std::nullopt;
+    }
+  }
+
+  ParsedFlr& m_parsed;
+  std::vector<bool> m_bBufferWritten;
+  std::vector<ResourceAccess> m_blockAccess;
+  std::vector<ResourceAccess> m_repeatAccess;
+  std::vector<ResourceAccess> m_conditionAccess;
+  std::vector<SyncState> m_buffers;
+  std::vector<SyncState> m_images;
+};
+
+void appendAccessFlagsName(std::string& out, VkAccessFlags accessFlags) {
+  for (const auto& state : ParsedFlr::BUFFER_RESOURCE_STATE_TABLE) {
+    if (state.accessFlags == accessFlags) {
+      out += state.name;
+      return;
+    }
+  }
+
+  bool bFirst = true;
+  for (const auto& state : ParsedFlr::BUFFER_RESOURCE_STATE_TABLE) {
+    if ((accessFlags & state.accessFlags) == state.accessFlags) {
+      if (!bFirst)
+        out += "|";
+      out += state.name;
+      accessFlags &= ~state.accessFlags;
+      bFirst = false;
+    }
+  }
+
+  if (accessFlags) {
+    char hex[16];
+    snprintf(hex, sizeof(hex), "%s0x%x", bFirst ? "" : "|", accessFlags);
+    out += hex;
+  }
+}
+} // namespace
+
+void ParsedFlr::ResourceAccess::addBuffer(
+    uint32_t buffer,
+    VkAccessFlags accessFlags) {
+  for (auto& b : buffers) {
+    if (b.buffer == buffer) {
+      b.accessFlags |= accessFlags;
+      return;
+    }
+  }
+  buffers.push_back({buffer, accessFlags});
+}
+
+void ParsedFlr::ResourceAccess::addImage(uint32_t image, bool bWrite) {
+  for (auto& i : images) {
+    if (i.image == image) {
+      i.bWrite |= bWrite;
+      return;
+    }
+  }
+  images.push_back({image, bWrite});
+}
+
+void ParsedFlr::ResourceAccess::append(const ResourceAccess& other) {
+  for (const auto& b : other.buffers)
+    addBuffer(b.buffer, b.accessFlags);
+  for (const auto& i : other.images)
+    addImage(i.image, i.bWrite);
+}
+
+void ParsedFlr::gatherTaskAccess(const Task& task, ResourceAccess& access)
+    const {
+  if (task.type == TT_COMPUTE) {
+    const auto& dispatch = m_computeDispatches[task.idx];
+    access.append(m_computeShaders[dispatch.computeShaderIndex].access);
+    if (dispatch.mode == DM_INDIRECT)
+      access.addBuffer(dispatch.param0, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  } else if (task.type == TT_RENDER) {
+    for (const auto& draw : m_renderPasses[task.idx].draws) {
+      access.append(draw.access);
+      if (draw.drawMode == DM_DRAW_INDEXED)
+        access.addBuffer(draw.param1, VK_ACCESS_INDEX_READ_BIT);
+      else if (draw.drawMode == DM_DRAW_INDIRECT)
+        access.addBuffer(draw.param0, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+    }
+  }
+}
+
+VkPipelineStageFlags ParsedFlr::getTaskStages(const Task& task) const {
+  switch (task.type) {
+  case TT_COMPUTE: {
+    const auto& dispatch = m_computeDispatches[task.idx];
+    if (dispatch.mode == DM_INDIRECT)
+      return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  }
+  case TT_RENDER: {
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    for (const auto& draw : m_renderPasses[task.idx].draws) {
+      if (draw.drawMode == DM_DRAW_INDIRECT)
+        stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+      else if (draw.drawMode != DM_DRAW)
+        stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    return stages;
+  }
+  case TT_TASK: {
+    VkPipelineStageFlags stages = 0;
+    for (const auto& blockTask : m_taskBlocks[task.idx].tasks)
+      stages |= getTaskStages(blockTask);
+    return stages;
+  }
+  default:
+    return 0;
+  };
+}
+
+bool ParsedFlr::runsCadencedTaskBlock(const std::vector<Task>& tasks) const {
+  for (const Task& task : tasks)
+    if (task.type == TT_TASK &&
+        (findTaskCadence(task.idx) ||
+         runsCadencedTaskBlock(m_taskBlocks[task.idx].tasks)))
+      return true;
+  return false;
+}
+
+void ParsedFlr::inferBarriers() {
+  size_t manualCount = m_barriers.size() + m_transitions.size();
+  if (manualCount)
+    emitWarning(
+        "WARNING: Ignoring " + std::to_string(manualCount) +
+        " barrier / transition_layout instructions, barriers are derived "
+        "from the declared reads and writes.");
+
+  BarrierInference inference(*this);
+
+  m_barriers.clear();
+  m_transitions.clear();
+  m_taskList = inference.derive(m_taskList);
+  for (TaskBlock& block : m_taskBlocks)
+    block.tasks = inference.derive(block.tasks);
+}
+
+std::string ParsedFlr::describeTaskPlan() const {
+  std::string out;
+  auto describeTasks = [&](const std::vector<Task>& tasks) {
+    uint32_t depth = 1;
+    for (const Task& task : tasks) {
+      if (task.type == TT_REPEAT_END || task.type == TT_IF_END)
+        depth--;
+      out.append(2 * depth, ' ');
+      switch (task.type) {
+      case TT_COMPUTE: {
+        const auto& dispatch = m_computeDispatches[task.idx];
+        out += "dispatch ";
+        out += m_computeShaders[dispatch.computeShaderIndex].name;
+        break;
+      }
+      case TT_BARRIER: {
+        const auto& barrier = m_barriers[task.idx];
+        out += "barrier ";
+        appendAccessFlagsName(out, barrier.accessFlags);
+        out += ":";
+        for (uint32_t bufferIdx : barrier.buffers) {
+          out += " ";
+          out += m_buffers[bufferIdx].name;
+        }
+        break;
+      }
+      case TT_RENDER: {
+        out += "render_pass ";
+        out += m_renderPasses[task.idx].name;
+        break;
+      }
+      case TT_TRANSITION: {
+        const auto& transition = m_transitions[task.idx];
+        out += "transition_layout: ";
+        out += m_images[transition.image].name;
+        out += " ";
+        out += TRANSITION_TARGET_NAMES[transition.transitionTarget];
+        break;
+      }
+      case TT_TASK: {
+        out += "run_task: ";
+        out += m_taskBlocks[task.idx].name;
+        break;
+      }
+      case TT_REPEAT: {
+        const Repeat& repeat = m_repeats[task.idx];
+        out += "repeat: ";
+        if (repeat.sliderUintIdx >= 0) {
+          out += m_sliderUints[repeat.sliderUintIdx].name;
+          out += " (slider_uint)";
+        } else {
+          out += std::to_string(repeat.count);
+        }
+        for (uint32_t i = 0; i < m_pingPongPairs.size(); i++) {
+          if (repeat.pingPongMask & (1u << i)) {
+            out += " ping_pong: ";
+            out += m_buffers[m_pingPongPairs[i].buffers[0]].name;
+            out += " ";
+            out += m_buffers[m_pingPongPairs[i].buffers[1]].name;
+          }
+        }
+        depth++;
+        break;
+      }
+      case TT_REPEAT_END: {
+        out += "repeat_end";
+        break;
+      }
+      case TT_IF: {
+        const Condition& condition = m_conditions[task.idx];
+        out += "if: ";
+        if (condition.bNegate)
+          out += "!";
+        switch (condition.source) {
+        case CS_CONST:
+          out += std::to_string(condition.idx);
+          break;
+        case CS_CHECKBOX:
+          out += m_checkboxes[condition.idx].name;
+          break;
+        case CS_BUTTON:
+          out += m_buttons[condition.idx].name;
+          break;
+        case CS_SLIDER_UINT:
+          out += m_sliderUints[condition.idx].name;
+          break;
+        case CS_SLIDER_INT:
+          out += m_sliderInts[condition.idx].name;
+          break;
+        case CS_BUFFER:
+          out += m_buffers[condition.idx].name;
+          out += " (gpu predicate)";
+          break;
+        };
+        depth++;
+        break;
+      }
+      case TT_IF_END: {
+        out += "if_end";
+        break;
+      }
+      };
+      out += "\n";
+    }
+  };
+
+  if (m_simulationTask.taskBlockIdx >= 0) {
+    char buf[128];
+    if (m_simulationTask.mode == SM_SUBSTEPS)
+      snprintf(buf, sizeof(buf), "substeps %u", m_simulationTask.substepCount);
+    else
+      snprintf(
+          buf,
+          sizeof(buf),
+          "fixed_rate %g (at most %u per frame)",
+          m_simulationTask.rate,
+          m_simulationTask.substepCount);
+    out += "simulation_task: ";
+    out += m_taskBlocks[m_simulationTask.taskBlockIdx].name;
+    out += " ";
+    out += buf;
+    out += "\n";
+  }
+
+  for (const PingPongPair& pair : m_pingPongPairs) {
+    out += "ping_pong: ";
+    out += m_buffers[pair.buffers[0]].name;
+    out += " ";
+    out += m_buffers[pair.buffers[1]].name;
+    out += "\n";
+  }
+
+  if (!m_transientBuffers.empty()) {
+    uint64_t transientSize = 0;
+    for (const TransientBuffer& transient : m_transientBuffers) {
+      out += "transient: ";
+      out += m_buffers[transient.bufferIdx].name;
+      out += " " + std::to_string(transient.size) + " bytes at offset " +
+             std::to_string(transient.offset) + "\n";
+      transientSize += transient.size;
+    }
+    out += "transient pool: " + std::to_string(m_transientPoolSize) +
+           " bytes for " + std::to_string(transientSize) +
+           " bytes of transient buffers\n";
+  }
+
+  for (const TaskCadence& cadence : m_taskCadences) {
+    out += "task_cadence: ";
+    out += m_taskBlocks[cadence.taskBlockIdx].name;
+    out += " every " + std::to_string(cadence.interval) + " frames, phase " +
+           std::to_string(cadence.phase) + "\n";
+  }
+
+  out += "task_list\n";
+  describeTasks(m_taskList);
+  for (const TaskBlock& block : m_taskBlocks) {
+    out += "task_block ";
+    out += block.name;
+    out += "\n";
+    describeTasks(block.tasks);
+  }
+
+  return out;
+}
+} // namespace flr
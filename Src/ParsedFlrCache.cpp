@@ -0,0 +1,419 @@
+#include "Hash.h"
+#include "ParsedFlr.h"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <type_traits>
+
+namespace flr {
+namespace {
+constexpr uint32_t CACHE_MAGIC = 0x43524C46; // "FLRC"
+
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint64_t bodyHash;
+  uint64_t bodySize;
+};
+
+class CacheWriter {
+public:
+  static constexpr bool IS_READING = false;
+
+  void bytes(void* src, size_t size) {
+    const char* pSrc = static_cast<const char*>(src);
+    m_data.insert(m_data.end(), pSrc, pSrc + size);
+  }
+
+  const std::vector<char>& getData() const { return m_data; }
+
+private:
+  std::vector<char> m_data;
+};
+
+class CacheReader {
+public:
+  static constexpr bool IS_READING = true;
+
+  CacheReader(const char* data, size_t size)
+      : m_pData(data), m_offset(0), m_size(size), m_bFailed(false) {}
+
+  void bytes(void* dst, size_t size) {
+    if (m_bFailed || (m_offset + size) > m_size) {
+      m_bFailed = true;
+      memset(dst, 0, size);
+      return;
+    }
+    memcpy(dst, m_pData + m_offset, size);
+    m_offset += size;
+  }
+
+  bool isFailed() const { return m_bFailed; }
+
+private:
+  const char* m_pData;
+  size_t m_offset;
+  size_t m_size;
+  bool m_bFailed;
+};
+
+// A single transfer routine per type is used for both reading and writing the
+// cache, so the two can't get out of sync.
+template <
+    typename TArchive,
+    typename T,
+    typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
+void transfer(TArchive& ar, T& t) {
+  ar.bytes(&t, sizeof(T));
+}
+
+template <typename TArchive> void transfer(TArchive& ar, std::string& s) {
+  uint32_t size = static_cast<uint32_t>(s.size());
+  transfer(ar, size);
+  if constexpr (TArchive::IS_READING)
+    s.resize(size);
+  ar.bytes(s.data(), size);
+}
+
+template <typename TArchive, typename T>
+void transfer(TArchive& ar, std::vector<T>& v) {
+  uint32_t size = static_cast<uint32_t>(v.size());
+  transfer(ar, size);
+  if constexpr (TArchive::IS_READING)
+    v.resize(size);
+  for (T& t : v)
+    transfer(ar, t);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ConstUint& c) {
+  transfer(ar, c.name);
+  transfer(ar, c.value);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ConstInt& c) {
+  transfer(ar, c.name);
+  transfer(ar, c.value);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ConstFloat& c) {
+  transfer(ar, c.name);
+  transfer(ar, c.value);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::GenericNamedElement& e) {
+  transfer(ar, e.name);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::SliderUint& s) {
+  transfer(ar, s.name);
+  transfer(ar, s.defaultValue);
+  transfer(ar, s.min);
+  transfer(ar, s.max);
+  transfer(ar, s.uiIdx);
+  s.pValue = nullptr;
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::SliderInt& s) {
+  transfer(ar, s.name);
+  transfer(ar, s.defaultValue);
+  transfer(ar, s.min);
+  transfer(ar, s.max);
+  transfer(ar, s.uiIdx);
+  s.pValue = nullptr;
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::SliderFloat& s) {
+  transfer(ar, s.name);
+  transfer(ar, s.defaultValue);
+  transfer(ar, s.min);
+  transfer(ar, s.max);
+  transfer(ar, s.uiIdx);
+  s.pValue = nullptr;
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ColorPicker& c) {
+  transfer(ar, c.name);
+  transfer(ar, c.defaultValue);
+  transfer(ar, c.uiIdx);
+  c.pValue = nullptr;
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::Checkbox& c) {
+  transfer(ar, c.name);
+  transfer(ar, c.defaultValue);
+  transfer(ar, c.uiIdx);
+  c.pValue = nullptr;
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::Button& b) {
+  transfer(ar, b.name);
+  transfer(ar, b.uiIdx);
+  b.pValue = nullptr;
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::StructDef& s) {
+  transfer(ar, s.name);
+  transfer(ar, s.body);
+  transfer(ar, s.size);
+  transfer(ar, s.layout);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::SoaField& f) {
+  transfer(ar, f.type);
+  transfer(ar, f.name);
+  transfer(ar, f.arrayDims);
+  transfer(ar, f.structOffset);
+  transfer(ar, f.size);
+  transfer(ar, f.stride);
+  transfer(ar, f.offset);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::BufferDesc& b) {
+  transfer(ar, b.name);
+  transfer(ar, b.structIdx);
+  transfer(ar, b.elemCount);
+  transfer(ar, b.bufferCount);
+  transfer(ar, b.flags);
+  transfer(ar, b.soaFields);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ImageDesc& i) {
+  transfer(ar, i.name);
+  transfer(ar, i.format);
+  transfer(ar, i.createOptions);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::TextureDesc& t) {
+  transfer(ar, t.name);
+  transfer(ar, t.imageIdx);
+  transfer(ar, t.texFileIdx);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ResourceAccess& a) {
+  transfer(ar, a.buffers);
+  transfer(ar, a.images);
+  transfer(ar, a.bDeclared);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::ComputeShader& c) {
+  transfer(ar, c.name);
+  transfer(ar, c.groupSizeX);
+  transfer(ar, c.groupSizeY);
+  transfer(ar, c.groupSizeZ);
+  transfer(ar, c.access);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::Barrier& b) {
+  transfer(ar, b.buffers);
+  transfer(ar, b.accessFlags);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::Draw& d) {
+  transfer(ar, d.vertexShader);
+  transfer(ar, d.pixelShader);
+  transfer(ar, d.param0);
+  transfer(ar, d.param1);
+  transfer(ar, d.param2);
+  transfer(ar, d.vertexOutputStructIdx);
+  transfer(ar, d.drawMode);
+  transfer(ar, d.primType);
+  transfer(ar, d.lineWidth);
+  transfer(ar, d.flags);
+  transfer(ar, d.access);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::AttachmentRef& a) {
+  transfer(ar, a.aliasName);
+  transfer(ar, a.imageIdx);
+  transfer(ar, a.bLoad);
+  transfer(ar, a.bStore);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::RenderPass& r) {
+  transfer(ar, r.name);
+  transfer(ar, r.draws);
+  transfer(ar, r.attachments);
+  transfer(ar, r.width);
+  transfer(ar, r.height);
+}
+
+template <typename TArchive>
+void transfer(TArchive& ar, ParsedFlr::TaskBlock& t) {
+  transfer(ar, t.name);
+  transfer(ar, t.tasks);
+}
+
+template <typename TArchive> void transfer(TArchive& ar, ParsedFlr& p) {
+  transfer(ar, p.m_language);
+  transfer(ar, p.m_constUints);
+  transfer(ar, p.m_constInts);
+  transfer(ar, p.m_constFloats);
+  transfer(ar, p.m_uiElements);
+  transfer(ar, p.m_genericNamedElements);
+  transfer(ar, p.m_sliderUints);
+  transfer(ar, p.m_sliderInts);
+  transfer(ar, p.m_sliderFloats);
+  transfer(ar, p.m_colorPickers);
+  transfer(ar, p.m_checkboxes);
+  transfer(ar, p.m_buttons);
+  transfer(ar, p.m_saveImageButtons);
+  transfer(ar, p.m_saveBufferButtons);
+  transfer(ar, p.m_taskButtons);
+  transfer(ar, p.m_structDefs);
+  transfer(ar, p.m_buffers);
+  transfer(ar, p.m_transientBuffers);
+  transfer(ar, p.m_transientPoolSize);
+  transfer(ar, p.m_images);
+  transfer(ar, p.m_textures);
+  transfer(ar, p.m_computeShaders);
+  transfer(ar, p.m_computeDispatches);
+  transfer(ar, p.m_barriers);
+  transfer(ar, p.m_transitions);
+  transfer(ar, p.m_renderPasses);
+  transfer(ar, p.m_taskList);
+  transfer(ar, p.m_taskBlocks);
+  transfer(ar, p.m_repeats);
+  transfer(ar, p.m_pingPongPairs);
+  transfer(ar, p.m_conditions);
+  transfer(ar, p.m_bInferBarriers);
+  transfer(ar, p.m_featureFlags);
+  transfer(ar, p.m_maxCameraSpeed);
+  transfer(ar, p.m_displayImageIdx);
+  transfer(ar, p.m_initializationTaskIdx);
+  transfer(ar, p.m_simulationTask);
+  transfer(ar, p.m_taskCadences);
+  transfer(ar, p.m_includeGraph);
+  transfer(ar, p.m_declarationRanges);
+  transfer(ar, p.m_warnings);
+}
+
+bool readWholeFile(const std::filesystem::path& path, std::vector<char>& out) {
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream.is_open())
+    return false;
+  size_t size = static_cast<size_t>(stream.tellg());
+  out.resize(size);
+  stream.seekg(0);
+  stream.read(out.data(), size);
+  return !stream.fail();
+}
+
+// Combines the parse parameters with the current contents of every source
+// file. Returns nullopt if any of the files can no longer be read.
+std::optional<uint64_t> computeCacheKey(
+    const std::vector<std::string>& sourceFiles,
+    uint64_t paramsHash) {
+  uint64_t key = hashValue(ParsedFlr::CACHE_VERSION, paramsHash);
+  std::vector<char> contents;
+  for (const std::string& file : sourceFiles) {
+    if (!readWholeFile(file, contents))
+      return std::nullopt;
+    key = hashString(file, key);
+    key = hashValue(contents.size(), key);
+    key = hashBytes(contents.data(), contents.size(), key);
+  }
+  return key;
+}
+} // namespace
+
+bool ParsedFlr::loadCache(
+    const std::filesystem::path& cachePath,
+    uint64_t paramsHash) {
+  std::vector<char> data;
+  if (!readWholeFile(cachePath, data))
+    return false;
+
+  CacheReader reader(data.data(), data.size());
+
+  CacheHeader header;
+  transfer(reader, header);
+  if (reader.isFailed() || header.magic != CACHE_MAGIC ||
+      header.version != CACHE_VERSION)
+    return false;
+
+  std::vector<std::string> sourceFiles;
+  transfer(reader, sourceFiles);
+  if (reader.isFailed())
+    return false;
+
+  auto key = computeCacheKey(sourceFiles, paramsHash);
+  if (!key || *key != header.key)
+    return false;
+
+  size_t bodyOffset = data.size() - header.bodySize;
+  if (header.bodySize > data.size() ||
+      hashBytes(data.data() + bodyOffset, header.bodySize) != header.bodyHash)
+    return false;
+
+  // The body has been validated against its hash at this point, so nothing
+  // below can fail without a missing CACHE_VERSION bump.
+  CacheReader bodyReader(data.data() + bodyOffset, header.bodySize);
+  transfer(bodyReader, *this);
+  assert(!bodyReader.isFailed());
+
+  m_sourceFiles = std::move(sourceFiles);
+  return !bodyReader.isFailed();
+}
+
+void ParsedFlr::saveCache(
+    const std::filesystem::path& cachePath,
+    uint64_t paramsHash) const {
+  assert(!m_failed && isCacheable());
+
+  auto key = computeCacheKey(m_sourceFiles, paramsHash);
+  if (!key)
+    return;
+
+  // the writer only reads from the parsed flr, the transfer routines are
+  // shared with the reader though, which needs mutable access
+  ParsedFlr& self = const_cast<ParsedFlr&>(*this);
+
+  CacheWriter body;
+  transfer(body, self);
+
+  CacheHeader header{};
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.key = *key;
+  header.bodySize = body.getData().size();
+  header.bodyHash = hashBytes(body.getData().data(), body.getData().size());
+
+  CacheWriter prefix;
+  transfer(prefix, header);
+  transfer(prefix, self.m_sourceFiles);
+
+  std::ofstream stream(cachePath, std::ios::binary | std::ios::trunc);
+  if (!stream.is_open()) {
+    std::cerr << "WARNING: Could not write project cache "
+              << cachePath.string() << std::endl;
+    return;
+  }
+  stream.write(prefix.getData().data(), prefix.getData().size());
+  stream.write(body.getData().data(), body.getData().size());
+}
+} // namespace flr
@@ -0,0 +1,647 @@
+#include "ParsedFlr.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+// Struct layout
+//
+// Buffers are declared in glsl with the default std430 layout, the
+// alignment of a field is the size of its scalar for scalars and two-component
+// vectors, and four times that for three and four-component vectors. Matrices
+// are arrays of column vectors. Arrays and structs are aligned like their
+// most aligned element and their size is rounded up to that alignment, so
+// vec3 fields followed by anything but a scalar waste four bytes each.
+//
+// The layout is derived from the struct body when it is declared. Bodies with
+// unknown types, or array sizes that aren't uint literals or constants, have
+// no derived layout and rely on struct_size.
+//
+// Buffers declared soa store every field of the struct as its own array
+// instead, one after the other within the allocation. The field arrays start
+// at offsets aligned to 256 bytes so each can be bound separately, and their
+// stride is the std430 array stride of the field. Uploads and downloads still
+// use the std430 array of structs, packSoa() and unpackSoa() convert.
+//
+// Packed field types are laid out like the uint or uvec2 they are stored in.
+// Half precision scalars aren't supported, storing them on their own would
+// need 16-bit storage, which the engine doesn't enable on the device. Structs
+// declaring them are rejected, pairs of them are declared as half2.
+
+namespace flr {
+namespace {
+struct FieldLayout {
+  // declaration of the field as written, e.g. "vec3 pos[4]"
+  std::string decl;
+  std::string type;
+  std::string name;
+  std::string arrayDims;
+  uint32_t size;
+  uint32_t alignment;
+  uint32_t dataSize;
+};
+
+uint32_t alignUp(uint32_t value, uint32_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+bool parseDigit(const char* c, uint32_t& value) {
+  if (*c < '2' || *c > '4')
+    return false;
+  value = static_cast<uint32_t>(*c - '0');
+  return true;
+}
+
+// Layout of scalars, vectors and matrices, glsl and hlsl spellings
+bool getBuiltinLayout(const std::string& type, FieldLayout& field) {
+  static constexpr struct {
+    const char* name;
+    uint32_t scalarSize;
+  } SCALARS[] = {
+      {"float", 4},
+      {"int", 4},
+      {"uint", 4},
+      {"bool", 4},
+      {"double", 8}};
+  static constexpr struct {
+    const char* prefix;
+    uint32_t scalarSize;
+  } GLSL_PREFIXES[] = {{"", 4}, {"i", 4}, {"u", 4}, {"b", 4}, {"d", 8}};
+
+  uint32_t scalarSize = 0;
+  uint32_t components = 1;
+  uint32_t columns = 1;
+  for (const auto& scalar : SCALARS) {
+    size_t len = strlen(scalar.name);
+    if (type.compare(0, len, scalar.name) != 0)
+      continue;
+    // float, float3
+    if (type.size() == len ||
+        (type.size() == len + 1 && parseDigit(&type[len], components)))
+      scalarSize = scalar.scalarSize;
+  }
+
+  for (const auto& prefix : GLSL_PREFIXES) {
+    if (scalarSize)
+      break;
+    size_t len = strlen(prefix.prefix);
+    if (type.compare(0, len, prefix.prefix) != 0)
+      continue;
+    const char* rest = type.c_str() + len;
+    // vec3
+    if (!strncmp(rest, "vec", 3) && strlen(rest) == 4 &&
+        parseDigit(rest + 3, components)) {
+      scalarSize = prefix.scalarSize;
+    }
+    // mat3, mat4x3, only float and double matrices exist
+    else if (
+        (len == 0 || prefix.prefix[0] == 'd') && !strncmp(rest, "mat", 3) &&
+        parseDigit(rest + 3, columns)) {
+      if (strlen(rest) == 4)
+        components = columns;
+      else if (
+          strlen(rest) != 6 || rest[4] != 'x' ||
+          !parseDigit(rest + 5, components))
+        continue;
+      scalarSize = prefix.scalarSize;
+    }
+  }
+
+  if (!scalarSize)
+    return false;
+
+  field.alignment = components == 1   ? scalarSize
+                    : components == 2 ? 2 * scalarSize
+                                      : 4 * scalarSize;
+  field.size = columns == 1
+                   ? components * scalarSize
+                   : columns * alignUp(components * scalarSize, field.alignment);
+  field.dataSize = columns * components * scalarSize;
+  return true;
+}
+
+const std::vector<ParsedFlr::PackedFieldType> PACKED_FIELD_TYPES = {
+    {"half2",
+     4,
+     "vec2",
+     "uint",
+     "return unpackHalf2x16(v);",
+     "return packHalf2x16(x);",
+     "float2",
+     "uint",
+     "return f16tof32(uint2(v, v >> 16));",
+     "uint2 h = f32tof16(x); return h.x | (h.y << 16);"},
+    {"half4",
+     8,
+     "vec4",
+     "uvec2",
+     "return vec4(unpackHalf2x16(v.x), unpackHalf2x16(v.y));",
+     "return uvec2(packHalf2x16(x.xy), packHalf2x16(x.zw));",
+     "float4",
+     "uint2",
+     "return f16tof32(uint4(v.x, v.x >> 16, v.y, v.y >> 16));",
+     "uint4 h = f32tof16(x); return uint2(h.x | (h.y << 16), h.z | (h.w << "
+     "16));"},
+    {"unorm8x4",
+     4,
+     "vec4",
+     "uint",
+     "return unpackUnorm4x8(v);",
+     "return packUnorm4x8(x);",
+     "float4",
+     "uint",
+     "return float4((v >> uint4(0, 8, 16, 24)) & 0xff) / 255.0;",
+     "uint4 b = uint4(round(saturate(x) * 255.0)); return b.x | (b.y << 8) | "
+     "(b.z << 16) | (b.w << 24);"},
+    {"snorm8x4",
+     4,
+     "vec4",
+     "uint",
+     "return unpackSnorm4x8(v);",
+     "return packSnorm4x8(x);",
+     "float4",
+     "uint",
+     "return max(float4(int4(v << uint4(24, 16, 8, 0)) >> 24) / 127.0, -1.0);",
+     "uint4 b = uint4(int4(round(clamp(x, -1.0, 1.0) * 127.0))) & 0xff; "
+     "return b.x | (b.y << 8) | (b.z << 16) | (b.w << 24);"},
+    {"unorm16x2",
+     4,
+     "vec2",
+     "uint",
+     "return unpackUnorm2x16(v);",
+     "return packUnorm2x16(x);",
+     "float2",
+     "uint",
+     "return float2(v & 0xffff, v >> 16) / 65535.0;",
+     "uint2 b = uint2(round(saturate(x) * 65535.0)); return b.x | (b.y << "
+     "16);"},
+    {"snorm16x2",
+     4,
+     "vec2",
+     "uint",
+     "return unpackSnorm2x16(v);",
+     "return packSnorm2x16(x);",
+     "float2",
+     "uint",
+     "return max(float2(int2(v << uint2(16, 0)) >> 16) / 32767.0, -1.0);",
+     "uint2 b = uint2(int2(round(clamp(x, -1.0, 1.0) * 32767.0))) & 0xffff; "
+     "return b.x | (b.y << 16);"},
+    {"unorm16x4",
+     8,
+     "vec4",
+     "uvec2",
+     "return vec4(unpackUnorm2x16(v.x), unpackUnorm2x16(v.y));",
+     "return uvec2(packUnorm2x16(x.xy), packUnorm2x16(x.zw));",
+     "float4",
+     "uint2",
+     "return float4(v.x & 0xffff, v.x >> 16, v.y & 0xffff, v.y >> 16) / "
+     "65535.0;",
+     "uint4 b = uint4(round(saturate(x) * 65535.0)); return uint2(b.x | (b.y "
+     "<< 16), b.z | (b.w << 16));"},
+    {"snorm16x4",
+     8,
+     "vec4",
+     "uvec2",
+     "return vec4(unpackSnorm2x16(v.x), unpackSnorm2x16(v.y));",
+     "return uvec2(packSnorm2x16(x.xy), packSnorm2x16(x.zw));",
+     "float4",
+     "uint2",
+     "return max(float4(int4(uint4(v.x << 16, v.x, v.y << 16, v.y)) >> 16) / "
+     "32767.0, -1.0);",
+     "uint4 b = uint4(int4(round(clamp(x, -1.0, 1.0) * 32767.0))) & 0xffff; "
+     "return uint2(b.x | (b.y << 16), b.z | (b.w << 16));"}};
+
+bool isIdentifierChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+std::string trim(const std::string& str) {
+  size_t begin = str.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos)
+    return "";
+  size_t end = str.find_last_not_of(" \t\r\n");
+  return str.substr(begin, end - begin + 1);
+}
+
+std::string stripComments(const std::string& body) {
+  std::string out;
+  for (size_t i = 0; i < body.size(); i++) {
+    if (body.compare(i, 2, "//") == 0 || body[i] == '#') {
+      i = body.find('\n', i);
+      if (i == std::string::npos)
+        break;
+    } else if (body.compare(i, 2, "/*") == 0) {
+      i = body.find("*/", i + 2);
+      if (i == std::string::npos)
+        break;
+      i++;
+      continue;
+    }
+    out += body[i];
+  }
+  return out;
+}
+
+class LayoutParser {
+public:
+  LayoutParser(const ParsedFlr& parsed) : m_parsed(parsed) {}
+
+  bool parseFields(const std::string& body, std::vector<FieldLayout>& fields)
+      const {
+    std::vector<std::string> decls;
+    if (!splitDeclarations(body, decls))
+      return false;
+    for (const std::string& decl : decls)
+      if (!parseDeclaration(decl, fields))
+        return false;
+    return !fields.empty();
+  }
+
+  // "half x;" and friends, see the top of the file
+  std::string findHalfScalarType(const std::string& body) const {
+    static const char* HALF_SCALAR_TYPES[] = {
+        "half",
+        "half3",
+        "float16_t",
+        "f16vec2",
+        "f16vec3",
+        "f16vec4"};
+    std::vector<std::string> decls;
+    splitDeclarations(body, decls);
+    for (const std::string& decl : decls) {
+      size_t typeEnd = 0;
+      while (typeEnd < decl.size() && isIdentifierChar(decl[typeEnd]))
+        typeEnd++;
+      std::string type = decl.substr(0, typeEnd);
+      for (const char* halfType : HALF_SCALAR_TYPES)
+        if (type == halfType)
+          return type;
+    }
+    return {};
+  }
+
+  bool getTypeLayout(const std::string& type, FieldLayout& field) const {
+    if (getBuiltinLayout(type, field))
+      return true;
+
+    if (auto pPacked = ParsedFlr::findPackedFieldType(type)) {
+      field.size = pPacked->size;
+      field.alignment = pPacked->size;
+      field.dataSize = pPacked->size;
+      return true;
+    }
+
+    for (const auto& s : m_parsed.m_structDefs) {
+      if (s.name == type && s.layout.alignment) {
+        field.size = s.layout.size;
+        field.alignment = s.layout.alignment;
+        field.dataSize = s.layout.dataSize;
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  // the members of "{ ... }", without comments
+  static bool
+  splitDeclarations(const std::string& body, std::vector<std::string>& decls) {
+    size_t open = body.find('{');
+    size_t close = body.rfind('}');
+    if (open == std::string::npos || close == std::string::npos ||
+        close < open)
+      return false;
+
+    std::string members =
+        stripComments(body.substr(open + 1, close - open - 1));
+    size_t declBegin = 0;
+    while (true) {
+      size_t declEnd = members.find(';', declBegin);
+      if (declEnd == std::string::npos)
+        return trim(members.substr(declBegin)).empty();
+      std::string decl = trim(members.substr(declBegin, declEnd - declBegin));
+      declBegin = declEnd + 1;
+      if (!decl.empty())
+        decls.push_back(decl);
+    }
+  }
+
+  // "vec3 a, b[2]" declares a and b, the array size is a uint literal or a
+  // uint constant
+  bool parseDeclaration(const std::string& decl, std::vector<FieldLayout>& fields)
+      const {
+    size_t typeEnd = 0;
+    while (typeEnd < decl.size() && isIdentifierChar(decl[typeEnd]))
+      typeEnd++;
+    std::string type = decl.substr(0, typeEnd);
+
+    FieldLayout typeLayout;
+    if (type.empty() || !getTypeLayout(type, typeLayout))
+      return false;
+
+    size_t declaratorBegin = typeEnd;
+    while (declaratorBegin <= decl.size()) {
+      size_t declaratorEnd = decl.find(',', declaratorBegin);
+      if (declaratorEnd == std::string::npos)
+        declaratorEnd = decl.size();
+      std::string declarator = trim(
+          decl.substr(declaratorBegin, declaratorEnd - declaratorBegin));
+      declaratorBegin = declaratorEnd + 1;
+
+      size_t nameEnd = 0;
+      while (nameEnd < declarator.size() &&
+             isIdentifierChar(declarator[nameEnd]))
+        nameEnd++;
+      if (nameEnd == 0)
+        return false;
+
+      FieldLayout field = typeLayout;
+      field.decl = type + " " + declarator;
+      field.type = type;
+      field.name = declarator.substr(0, nameEnd);
+      field.arrayDims = trim(declarator.substr(nameEnd));
+      uint32_t count = 1;
+      size_t c = nameEnd;
+      while (c < declarator.size()) {
+        if (declarator[c] == ' ') {
+          c++;
+          continue;
+        }
+        size_t arrayEnd = declarator.find(']', c);
+        if (declarator[c] != '[' || arrayEnd == std::string::npos)
+          return false;
+        auto arraySize =
+            parseArraySize(trim(declarator.substr(c + 1, arrayEnd - c - 1)));
+        if (!arraySize)
+          return false;
+        count *= *arraySize;
+        c = arrayEnd + 1;
+      }
+
+      if (count > 1) {
+        field.size = count * alignUp(typeLayout.size, typeLayout.alignment);
+        field.dataSize = count * typeLayout.dataSize;
+      }
+      fields.push_back(field);
+    }
+
+    return true;
+  }
+
+  std::optional<uint32_t> parseArraySize(const std::string& str) const {
+    if (str.empty())
+      return std::nullopt;
+    if (std::all_of(str.begin(), str.end(), [](char c) {
+          return isdigit(static_cast<unsigned char>(c));
+        }))
+      return static_cast<uint32_t>(strtoul(str.c_str(), nullptr, 10));
+    for (const auto& c : m_parsed.m_constUints)
+      if (c.name == str)
+        return c.value;
+    return std::nullopt;
+  }
+
+  const ParsedFlr& m_parsed;
+};
+
+ParsedFlr::StructLayout layoutFields(
+    const std::vector<FieldLayout>& fields,
+    const std::vector<size_t>& order) {
+  ParsedFlr::StructLayout layout{0, 1, 0};
+  for (size_t i : order) {
+    const FieldLayout& field = fields[i];
+    layout.size = alignUp(layout.size, field.alignment) + field.size;
+    layout.alignment = std::max(layout.alignment, field.alignment);
+    layout.dataSize += field.dataSize;
+  }
+  layout.size = alignUp(layout.size, layout.alignment);
+  return layout;
+}
+
+// Places the most aligned field first, then at every offset the most aligned
+// field that doesn't need padding before it, so scalars fill the gaps behind
+// vec3s
+std::vector<size_t> packFields(const std::vector<FieldLayout>& fields) {
+  std::vector<size_t> remaining(fields.size());
+  for (size_t i = 0; i < fields.size(); i++)
+    remaining[i] = i;
+
+  std::vector<size_t> order;
+  uint32_t offset = 0;
+  while (!remaining.empty()) {
+    auto best = remaining.end();
+    for (auto it = remaining.begin(); it != remaining.end(); ++it) {
+      const FieldLayout& field = fields[*it];
+      if (best == remaining.end()) {
+        best = it;
+        continue;
+      }
+      const FieldLayout& bestField = fields[*best];
+      bool bFits = offset % field.alignment == 0;
+      bool bBestFits = offset % bestField.alignment == 0;
+      if (bFits != bBestFits ? bFits
+                             : field.alignment > bestField.alignment ||
+                                   (field.alignment == bestField.alignment &&
+                                    field.size > bestField.size))
+        best = it;
+    }
+
+    const FieldLayout& field = fields[*best];
+    offset = alignUp(offset, field.alignment) + field.size;
+    order.push_back(*best);
+    remaining.erase(best);
+  }
+  return order;
+}
+
+// satisfies any minStorageBufferOffsetAlignment the spec allows
+constexpr uint64_t SOA_FIELD_ALIGNMENT = 256;
+
+std::string formatBytes(uint64_t bytes) {
+  char buf[64];
+  if (bytes >= 1024 * 1024)
+    snprintf(buf, sizeof(buf), "%.1f MB", bytes / (1024.0 * 1024.0));
+  else if (bytes >= 1024)
+    snprintf(buf, sizeof(buf), "%.1f KB", bytes / 1024.0);
+  else
+    snprintf(buf, sizeof(buf), "%llu bytes", (unsigned long long)bytes);
+  return buf;
+}
+} // namespace
+
+ParsedFlr::StructLayout ParsedFlr::computeStructLayout(const StructDef& s)
+    const {
+  LayoutParser parser(*this);
+  std::vector<FieldLayout> fields;
+  // the builtin structs used for buffers of plain types have no body
+  if (s.body.empty()) {
+    FieldLayout field;
+    if (!parser.getTypeLayout(s.name, field))
+      return {0, 0, 0};
+    fields.push_back(field);
+  } else if (!parser.parseFields(s.body, fields)) {
+    return {0, 0, 0};
+  }
+
+  std::vector<size_t> order(fields.size());
+  for (size_t i = 0; i < fields.size(); i++)
+    order[i] = i;
+  return layoutFields(fields, order);
+}
+
+std::string ParsedFlr::findHalfScalarType(const StructDef& s) const {
+  return LayoutParser(*this).findHalfScalarType(s.body);
+}
+
+/*static*/
+const std::vector<ParsedFlr::PackedFieldType>&
+ParsedFlr::getPackedFieldTypes() {
+  return PACKED_FIELD_TYPES;
+}
+
+/*static*/
+const ParsedFlr::PackedFieldType*
+ParsedFlr::findPackedFieldType(const std::string& name) {
+  for (const PackedFieldType& type : PACKED_FIELD_TYPES)
+    if (name == type.name)
+      return &type;
+  return nullptr;
+}
+
+std::vector<ParsedFlr::PackedField>
+ParsedFlr::getPackedFields(const StructDef& s) const {
+  std::vector<PackedField> packedFields;
+  std::vector<FieldLayout> fields;
+  if (s.body.empty() || !LayoutParser(*this).parseFields(s.body, fields))
+    return packedFields;
+  for (const FieldLayout& field : fields)
+    if (auto pPacked = findPackedFieldType(field.type))
+      if (field.arrayDims.empty())
+        packedFields.push_back({field.name, pPacked});
+  return packedFields;
+}
+
+bool ParsedFlr::computeSoaFields(BufferDesc& desc) const {
+  const StructDef& s = m_structDefs[desc.structIdx];
+  std::vector<FieldLayout> fields;
+  if (s.body.empty() || !s.layout.alignment ||
+      !LayoutParser(*this).parseFields(s.body, fields))
+    return false;
+
+  desc.soaFields.clear();
+  uint32_t structOffset = 0;
+  uint64_t offset = 0;
+  for (const FieldLayout& field : fields) {
+    SoaField& soaField = desc.soaFields.emplace_back();
+    soaField.type = field.type;
+    soaField.name = field.name;
+    soaField.arrayDims = field.arrayDims;
+    soaField.structOffset = alignUp(structOffset, field.alignment);
+    soaField.size = field.size;
+    soaField.stride = alignUp(field.size, field.alignment);
+    soaField.offset = offset;
+
+    structOffset = soaField.structOffset + field.size;
+    offset += uint64_t(soaField.stride) * desc.elemCount;
+    offset = (offset + SOA_FIELD_ALIGNMENT - 1) / SOA_FIELD_ALIGNMENT *
+             SOA_FIELD_ALIGNMENT;
+  }
+  return true;
+}
+
+uint64_t ParsedFlr::getBufferByteSize(const BufferDesc& desc) const {
+  if (desc.soaFields.empty())
+    return uint64_t(m_structDefs[desc.structIdx].size) * desc.elemCount;
+  const SoaField& last = desc.soaFields.back();
+  return last.offset + uint64_t(last.stride) * desc.elemCount;
+}
+
+/*static*/
+void ParsedFlr::packSoa(
+    const BufferDesc& desc,
+    uint32_t structSize,
+    uint32_t elemCount,
+    const char* aos,
+    char* soa) {
+  for (const SoaField& field : desc.soaFields)
+    for (uint32_t i = 0; i < elemCount; i++)
+      memcpy(
+          soa + field.offset + uint64_t(i) * field.stride,
+          aos + uint64_t(i) * structSize + field.structOffset,
+          field.size);
+}
+
+/*static*/
+void ParsedFlr::unpackSoa(
+    const BufferDesc& desc,
+    uint32_t structSize,
+    const char* soa,
+    char* aos) {
+  // padding between fields reads back as zero
+  memset(aos, 0, uint64_t(structSize) * desc.elemCount);
+  for (const SoaField& field : desc.soaFields)
+    for (uint32_t i = 0; i < desc.elemCount; i++)
+      memcpy(
+          aos + uint64_t(i) * structSize + field.structOffset,
+          soa + field.offset + uint64_t(i) * field.stride,
+          field.size);
+}
+
+std::string ParsedFlr::describeBufferLayouts() const {
+  LayoutParser parser(*this);
+  std::string out;
+  uint64_t totalPadding = 0;
+  uint64_t totalSavings = 0;
+  for (const BufferDesc& buffer : m_buffers) {
+    const StructDef& s = m_structDefs[buffer.structIdx];
+    uint64_t elemCount = uint64_t(buffer.elemCount) * buffer.bufferCount;
+    out += "buffer " + buffer.name + ": " + s.name + " x " +
+           std::to_string(elemCount) + ", " + std::to_string(s.size) +
+           " bytes per element";
+    if (!s.layout.alignment) {
+      out += ", layout unknown\n";
+      continue;
+    }
+
+    if (buffer.isSoa()) {
+      uint64_t soaPadding =
+          getBufferByteSize(buffer) - uint64_t(s.layout.dataSize) * elemCount;
+      totalPadding += soaPadding;
+      out += ", soa with " + std::to_string(buffer.soaFields.size()) +
+             " field arrays, " + formatBytes(soaPadding) + " of padding\n";
+      continue;
+    }
+
+    uint32_t padding = s.size > s.layout.dataSize ? s.size - s.layout.dataSize
+                                                  : 0;
+    totalPadding += padding * elemCount;
+    out += ", " + std::to_string(padding) + " of them padding (" +
+           formatBytes(padding * elemCount) + ")\n";
+    if (s.size != s.layout.size)
+      out += "  struct_size differs from the std430 size of " +
+             std::to_string(s.layout.size) + " bytes\n";
+
+    std::vector<FieldLayout> fields;
+    if (!parser.parseFields(s.body, fields))
+      continue;
+    std::vector<size_t> order = packFields(fields);
+    StructLayout packed = layoutFields(fields, order);
+    if (packed.size >= s.layout.size)
+      continue;
+
+    uint32_t saved = s.layout.size - packed.size;
+    totalSavings += saved * elemCount;
+    out += "  reorder as {";
+    for (size_t i : order)
+      out += " " + fields[i].decl + ";";
+    out += " } for " + std::to_string(packed.size) + " bytes per element, " +
+           "saving " + formatBytes(saved * elemCount) + "\n";
+  }
+
+  out += "total padding " + formatBytes(totalPadding) + ", " +
+         formatBytes(totalSavings) + " of it can be saved by reordering\n";
+  return out;
+}
+} // namespace flr
@@ -0,0 +1,232 @@
+#include "ParsedFlr.h"
+
+#include <algorithm>
+#include <optional>
+#include <string>
+
+// Transient buffer allocation
+//
+// Every task list that can run on its own is flattened into a timeline of
+// compute dispatches and render passes, task blocks run from within a list
+// are inlined. The roots are the task list and every task block, since
+// blocks may also be run on their own by a task_button, the
+// initialization_task, the simulation_task or a script. The live range of a
+// transient buffer within a timeline spans from its first to its last
+// access. The body of a repeat also follows its own previous iteration, so a
+// buffer accessed within the body is live throughout the whole repeat.
+//
+// Two transient buffers interfere when their live ranges overlap in any
+// timeline, the buffers of a ping_pong pair always interfere. Buffers are
+// placed largest first, each at the lowest offset of the pool that does not
+// overlap any interfering buffer placed before it.
+
+namespace flr {
+namespace {
+using Task = ParsedFlr::Task;
+
+// satisfies any minStorageBufferOffsetAlignment the spec allows
+constexpr uint64_t TRANSIENT_ALIGNMENT = 256;
+
+struct LiveRange {
+  uint32_t first;
+  uint32_t last;
+};
+
+class LiveRangeTimeline {
+public:
+  LiveRangeTimeline(const ParsedFlr& parsed)
+      : m_parsed(parsed), m_position(0), m_ranges(parsed.m_buffers.size()) {
+    m_pingPongPartners.assign(m_parsed.m_buffers.size(), -1);
+    for (const auto& pair : m_parsed.m_pingPongPairs) {
+      m_pingPongPartners[pair.buffers[0]] = static_cast<int>(pair.buffers[1]);
+      m_pingPongPartners[pair.buffers[1]] = static_cast<int>(pair.buffers[0]);
+    }
+    m_bReadFirst.resize(m_parsed.m_buffers.size());
+  }
+
+  void walk(const std::vector<Task>& tasks) {
+    std::vector<uint32_t> repeatStarts;
+    for (const Task& task : tasks) {
+      switch (task.type) {
+      case ParsedFlr::TT_COMPUTE:
+      case ParsedFlr::TT_RENDER: {
+        ParsedFlr::ResourceAccess access;
+        m_parsed.gatherTaskAccess(task, access);
+        for (const auto& b : access.buffers) {
+          bool bWrite = (b.accessFlags & VK_ACCESS_SHADER_WRITE_BIT) != 0;
+          markAccess(b.buffer, bWrite);
+          // either buffer of a pair may be bound under the name
+          if (m_pingPongPartners[b.buffer] >= 0)
+            markAccess(
+                static_cast<uint32_t>(m_pingPongPartners[b.buffer]),
+                bWrite);
+        }
+        m_position++;
+        break;
+      }
+      case ParsedFlr::TT_TASK: {
+        walk(m_parsed.m_taskBlocks[task.idx].tasks);
+        break;
+      }
+      case ParsedFlr::TT_REPEAT: {
+        repeatStarts.push_back(m_position);
+        break;
+      }
+      case ParsedFlr::TT_REPEAT_END: {
+        uint32_t start = repeatStarts.back();
+        repeatStarts.pop_back();
+        // anything last accessed after the start was accessed in the body
+        for (auto& range : m_ranges) {
+          if (range && m_position > start && range->last >= start) {
+            range->first = std::min(range->first, start);
+            range->last = m_position - 1;
+          }
+        }
+        break;
+      }
+      default:
+        break;
+      };
+    }
+  }
+
+  const std::optional<LiveRange>& getRange(uint32_t bufferIdx) const {
+    return m_ranges[bufferIdx];
+  }
+
+  bool isReadFirst(uint32_t bufferIdx) const { return m_bReadFirst[bufferIdx]; }
+
+private:
+  void markAccess(uint32_t bufferIdx, bool bWrite) {
+    std::optional<LiveRange>& range = m_ranges[bufferIdx];
+    if (!range) {
+      range = LiveRange{m_position, m_position};
+      m_bReadFirst[bufferIdx] = !bWrite;
+    }
+    range->last = m_position;
+  }
+
+  const ParsedFlr& m_parsed;
+  uint32_t m_position;
+  std::vector<std::optional<LiveRange>> m_ranges;
+  std::vector<bool> m_bReadFirst;
+  std::vector<int> m_pingPongPartners;
+};
+} // namespace
+
+std::string ParsedFlr::allocateTransientBuffers() {
+  m_transientBuffers.clear();
+  m_transientPoolSize = 0;
+
+  for (uint32_t i = 0; i < m_buffers.size(); i++) {
+    const BufferDesc& desc = m_buffers[i];
+    if (desc.isTransient())
+      m_transientBuffers.push_back(
+          {i,
+           0,
+           static_cast<uint64_t>(m_structDefs[desc.structIdx].size) *
+               desc.elemCount});
+  }
+  if (m_transientBuffers.empty())
+    return {};
+
+  const size_t transientCount = m_transientBuffers.size();
+  std::vector<bool> interferes(transientCount * transientCount);
+  std::string error;
+  auto addTimeline = [&](const std::vector<Task>& tasks,
+                         const char* name,
+                         bool bRunOnItsOwn) {
+    LiveRangeTimeline timeline(*this);
+    timeline.walk(tasks);
+    for (size_t i = 0; i < transientCount; i++) {
+      uint32_t bufferIdx = m_transientBuffers[i].bufferIdx;
+      const auto& a = timeline.getRange(bufferIdx);
+      if (!a)
+        continue;
+
+      // blocks run from a task list may read what the list wrote before
+      if (bRunOnItsOwn && timeline.isReadFirst(bufferIdx) && error.empty())
+        error = "Transient buffer " + m_buffers[bufferIdx].name +
+                " is read before it is written in " + name +
+                ", its contents are undefined there.";
+
+      for (size_t j = 0; j < i; j++) {
+        const auto& b = timeline.getRange(m_transientBuffers[j].bufferIdx);
+        if (b && a->first <= b->last && b->first <= a->last) {
+          interferes[i * transientCount + j] = true;
+          interferes[j * transientCount + i] = true;
+        }
+      }
+    }
+  };
+
+  std::vector<bool> bRunOnItsOwn(m_taskBlocks.size());
+  for (const TaskButton& button : m_taskButtons)
+    bRunOnItsOwn[button.taskBlockIdx] = true;
+  if (m_initializationTaskIdx >= 0)
+    bRunOnItsOwn[m_initializationTaskIdx] = true;
+  if (m_simulationTask.taskBlockIdx >= 0)
+    bRunOnItsOwn[m_simulationTask.taskBlockIdx] = true;
+
+  addTimeline(m_taskList, "the task list", true);
+  for (size_t i = 0; i < m_taskBlocks.size(); i++)
+    addTimeline(
+        m_taskBlocks[i].tasks,
+        m_taskBlocks[i].name.c_str(),
+        bRunOnItsOwn[i]);
+  if (!error.empty())
+    return error;
+
+  for (size_t i = 0; i < transientCount; i++) {
+    for (size_t j = 0; j < transientCount; j++) {
+      for (const PingPongPair& pair : m_pingPongPairs) {
+        if (pair.buffers[0] == m_transientBuffers[i].bufferIdx &&
+            pair.buffers[1] == m_transientBuffers[j].bufferIdx) {
+          interferes[i * transientCount + j] = true;
+          interferes[j * transientCount + i] = true;
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> order(transientCount);
+  for (size_t i = 0; i < transientCount; i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return m_transientBuffers[a].size > m_transientBuffers[b].size;
+  });
+
+  std::vector<const TransientBuffer*> occupied;
+  for (size_t placedCount = 0; placedCount < transientCount; placedCount++) {
+    size_t i = order[placedCount];
+    TransientBuffer& transient = m_transientBuffers[i];
+
+    occupied.clear();
+    for (size_t p = 0; p < placedCount; p++)
+      if (interferes[i * transientCount + order[p]])
+        occupied.push_back(&m_transientBuffers[order[p]]);
+    std::sort(
+        occupied.begin(),
+        occupied.end(),
+        [](const TransientBuffer* a, const TransientBuffer* b) {
+          return a->offset < b->offset;
+        });
+
+    uint64_t offset = 0;
+    for (const TransientBuffer* pOther : occupied) {
+      if (offset + transient.size <= pOther->offset)
+        break;
+      uint64_t end = pOther->offset + pOther->size;
+      end = (end + TRANSIENT_ALIGNMENT - 1) / TRANSIENT_ALIGNMENT *
+            TRANSIENT_ALIGNMENT;
+      offset = std::max(offset, end);
+    }
+
+    transient.offset = offset;
+    m_transientPoolSize =
+        std::max(m_transientPoolSize, transient.offset + transient.size);
+  }
+
+  return {};
+}
+} // namespace flr
@@ -1,7 +1,11 @@
 #include "Project.h"
 
 #include "Audio.h"
+#include "CodeGen.h"
+#include "Parallel.h"
+#include "ShaderCache.h"
 #include "Shared/CommonStructures.h"
+#include "Trace.h"
 
 #include <Althea/BufferUtilities.h>
 #include <Althea/DescriptorSet.h>
@@ -15,9 +19,13 @@
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <utility>
 #include <xstring>
@@ -32,18 +40,58 @@ namespace flr {
 extern Application* GApplication;
 extern GlobalHeap* GGlobalHeap;
 
+namespace {
+constexpr VkPipelineStageFlags ALL_SHADER_STAGES =
+    VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+// The stages a buffer access of the given type happens in, for a task that
+// runs the given shader stages
+VkPipelineStageFlags
+getAccessStages(VkAccessFlags accessFlags, VkPipelineStageFlags shaderStages) {
+  VkPipelineStageFlags stages = 0;
+  if (accessFlags & (VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT))
+    stages |= shaderStages;
+  if (accessFlags & VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+    stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+  if (accessFlags & VK_ACCESS_INDEX_READ_BIT)
+    stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+  return stages ? stages : shaderStages;
+}
+} // namespace
+
 Project::Project(
     SingleTimeCommandBuffer& commandBuffer,
     const TransientUniforms<FlrUniforms>& flrUniforms,
     const char* projPath,
     const FlrParams& params)
+    : Project(
+          commandBuffer,
+          flrUniforms,
+          projPath,
+          ParsedFlr(*GApplication, projPath, params)) {}
+
+Project::Project(
+    SingleTimeCommandBuffer& commandBuffer,
+    const TransientUniforms<FlrUniforms>& flrUniforms,
+    const char* projPath,
+    ParsedFlr&& parsed)
     : m_projPath(projPath),
-      m_parsed(*GApplication, projPath, params),
+      m_parsed(std::move(parsed)),
       m_buffers(),
+      m_transientPool(),
+      m_transientSlots(),
       m_images(),
       m_computePipelines(),
       m_drawPasses(),
       m_descriptorSets(),
+      m_swappedDescriptorSets(),
+      m_pingPongPartners(),
+      m_pingPongSwapMask(0),
+      m_pfnBeginConditionalRendering(nullptr),
+      m_pfnEndConditionalRendering(nullptr),
+      m_bInGpuCondition(false),
       m_dynamicUniforms(),
       m_dynamicDataBuffer(),
       m_cameraController(),
@@ -52,11 +100,20 @@ Project::Project(
       m_audioInput(),
       m_pAudio(nullptr),
       m_pendingSaveImage(std::nullopt),
+      m_loadStats(),
       m_bHasDynamicData(false),
       m_bFirstDraw(true),
       m_failedShaderCompile(false),
       m_shaderCompileErrMsg(),
-      m_pushData() {
+      m_pushData(),
+      m_substepCount(0),
+      m_substepDeltaTime(0.0f),
+      m_simulationTime(0.0),
+      m_simulationAccumulator(0.0f),
+      m_frameCount(0),
+      m_drawIdx(0) {
+  FLR_TRACE_ZONE("Project::Project");
+
   // TODO: split out resource creation vs code generation
   if (m_parsed.m_failed)
     return;
@@ -64,11 +121,54 @@ Project::Project(
   std::filesystem::path projName = m_projPath.stem();
   std::filesystem::path folder = m_projPath.parent_path();
 
+  // dispatches are folded against these limits as they are recorded
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(GApplication->getPhysicalDevice(), &properties);
+  for (uint32_t i = 0; i < 3; i++)
+    m_maxComputeWorkGroupCount[i] =
+        properties.limits.maxComputeWorkGroupCount[i];
+
+  // only returned if the extension is enabled on the device
+  m_pfnBeginConditionalRendering =
+      reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(
+          vkGetDeviceProcAddr(
+              GApplication->getDevice(),
+              "vkCmdBeginConditionalRenderingEXT"));
+  m_pfnEndConditionalRendering =
+      reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(
+          vkGetDeviceProcAddr(
+              GApplication->getDevice(),
+              "vkCmdEndConditionalRenderingEXT"));
+  if (!m_pfnBeginConditionalRendering || !m_pfnEndConditionalRendering) {
+    m_pfnBeginConditionalRendering = nullptr;
+    m_pfnEndConditionalRendering = nullptr;
+    // Running the body unconditionally could do anything from wasting time to
+    // corrupting the simulation, the project cannot run as written.
+    for (const auto& condition : m_parsed.m_conditions) {
+      if (condition.source == ParsedFlr::CS_BUFFER) {
+        m_parsed.m_failed = true;
+        snprintf(
+            m_parsed.m_errMsg,
+            sizeof(m_parsed.m_errMsg),
+            "ERROR: The project uses an if on buffer %s, which requires "
+            "VK_EXT_conditional_rendering. The device does not support it.",
+            m_parsed.m_buffers[condition.idx].name.c_str());
+        std::cerr << m_parsed.m_errMsg << std::endl;
+        return;
+      }
+    }
+  }
+
   m_buffers.reserve(m_parsed.m_buffers.size());
   for (const ParsedFlr::BufferDesc& desc : m_parsed.m_buffers) {
     const ParsedFlr::StructDef& structdef =
         m_parsed.m_structDefs[desc.structIdx];
 
+    if (desc.isTransient()) {
+      m_buffers.emplace_back();
+      continue;
+    }
+
     VmaAllocationCreateInfo allocInfo{};
     VkBufferUsageFlags usageFlags =
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
@@ -78,6 +178,8 @@ Project::Project(
       usageFlags |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
     if (desc.isIndexBuffer())
       usageFlags |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    if (desc.isPredicate() && m_pfnBeginConditionalRendering)
+      usageFlags |= VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT;
     if (desc.isCpuVisible()) {
       allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
       allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
@@ -86,32 +188,54 @@ Project::Project(
       allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
     }
 
+    uint64_t byteSize = m_parsed.getBufferByteSize(desc);
     auto& bufCollection = m_buffers.emplace_back();
-    m_bufferResourceStates.emplace_back() =
-        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
     for (int bi = 0; bi < desc.bufferCount; bi++) {
       bufCollection.push_back(BufferUtilities::createBuffer(
           *GApplication,
-          structdef.size * desc.elemCount,
+          byteSize,
           usageFlags,
           allocInfo));
       if (!desc.shouldSkipZeroInit()) {
         if (desc.isCpuVisible()) {
           void* pMapped = bufCollection.back().mapMemory();
-          memset(pMapped, 0, structdef.size * desc.elemCount);
+          memset(pMapped, 0, byteSize);
           bufCollection.back().unmapMemory();
         } else {
           vkCmdFillBuffer(
               commandBuffer,
               bufCollection.back().getBuffer(),
               0,
-              structdef.size * desc.elemCount,
+              byteSize,
               0);
         }
       }
     }
   }
 
+  m_transientSlots.assign(m_buffers.size(), -1);
+  m_loadStats.transientBufferBytes = 0;
+  m_loadStats.transientPoolBytes = m_parsed.m_transientPoolSize;
+  for (size_t i = 0; i < m_parsed.m_transientBuffers.size(); i++) {
+    const auto& transient = m_parsed.m_transientBuffers[i];
+    m_transientSlots[transient.bufferIdx] = static_cast<int>(i);
+    m_loadStats.transientBufferBytes += transient.size;
+  }
+  if (m_parsed.m_transientPoolSize) {
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    m_transientPool = BufferUtilities::createBuffer(
+        *GApplication,
+        m_parsed.m_transientPoolSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        allocInfo);
+
+    std::cout << "Aliased " << m_parsed.m_transientBuffers.size()
+              << " transient buffers (" << m_loadStats.transientBufferBytes
+              << " bytes) into a pool of " << m_loadStats.transientPoolBytes
+              << " bytes" << std::endl;
+  }
+
   for (ParsedFlr::BufferFile& bufferFile : m_parsed.m_bufferFiles) {
     const ParsedFlr::BufferDesc& desc =
         m_parsed.m_buffers[bufferFile.bufferIdx];
@@ -122,6 +246,19 @@ Project::Project(
     size_t bufSize = structdef.size * desc.elemCount;
     assert(bufSize == bufferFile.data.size());
 
+    // buffer files hold the array of structs
+    if (desc.isSoa()) {
+      std::vector<char> soa(m_parsed.getBufferByteSize(desc));
+      ParsedFlr::packSoa(
+          desc,
+          structdef.size,
+          desc.elemCount,
+          bufferFile.data.data(),
+          soa.data());
+      bufferFile.data = std::move(soa);
+      bufSize = bufferFile.data.size();
+    }
+
     if (desc.isCpuVisible()) {
       void* pMapped = buf.mapMemory();
       memcpy(pMapped, bufferFile.data.data(), bufSize);
@@ -195,10 +332,7 @@ Project::Project(
     }
   }
 
-  m_bHasDynamicData =
-      !m_parsed.m_sliderUints.empty() || !m_parsed.m_sliderInts.empty() ||
-      !m_parsed.m_sliderFloats.empty() || !m_parsed.m_colorPickers.empty() ||
-      !m_parsed.m_checkboxes.empty() || !m_parsed.m_buttons.empty();
+  m_bHasDynamicData = m_parsed.hasDynamicData();
   if (m_bHasDynamicData) {
     size_t size = 0;
     size += 16 * m_parsed.m_colorPickers.size();
@@ -275,11 +409,17 @@ Project::Project(
 
   DescriptorSetLayoutBuilder dsBuilder{};
   dsBuilder.addUniformBufferBinding();
-  for (const auto& b : m_buffers) {
-    if (b.size() == 1)
+  for (const auto& desc : m_parsed.m_buffers) {
+    // transient buffers are bound at their offset within the pool, which
+    // only a buffer heap binding supports
+    // so are the field arrays of soa buffers, at theirs within the buffer
+    if (desc.isSoa()) {
+      for (size_t f = 0; f < desc.soaFields.size(); f++)
+        dsBuilder.addBufferHeapBinding(1, VK_SHADER_STAGE_ALL);
+    } else if (desc.bufferCount == 1 && !desc.isTransient())
       dsBuilder.addStorageBufferBinding(VK_SHADER_STAGE_ALL);
     else
-      dsBuilder.addBufferHeapBinding(b.size(), VK_SHADER_STAGE_ALL);
+      dsBuilder.addBufferHeapBinding(desc.bufferCount, VK_SHADER_STAGE_ALL);
   }
   for (const ImageResource& rsc : m_images) {
     if ((rsc.image.getOptions().usage & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
@@ -310,6 +450,12 @@ Project::Project(
 
   m_descriptorSets = PerFrameResources(*GApplication, dsBuilder);
 
+  m_pingPongPartners.assign(m_buffers.size(), -1);
+  for (const auto& pair : m_parsed.m_pingPongPairs) {
+    m_pingPongPartners[pair.buffers[0]] = static_cast<int>(pair.buffers[1]);
+    m_pingPongPartners[pair.buffers[1]] = static_cast<int>(pair.buffers[0]);
+  }
+
   struct HeapBinder {
     std::vector<VkDescriptorBufferInfo> bufferInfos;
     const std::vector<VkDescriptorBufferInfo>& getBufferInfos() const {
@@ -319,16 +465,50 @@ Project::Project(
   std::vector<HeapBinder> heapBinders;
 
   // resource declarations
-  {
-    ResourcesAssignment assign = m_descriptorSets.assign();
+  auto assignResources = [&](PerFrameResources& descriptorSets,
+                             uint32_t pingPongSwapMask) {
+    ResourcesAssignment assign = descriptorSets.assign();
     assign.bindTransientUniforms(flrUniforms);
 
+    // the buffers of a pair have the same layout, only which one is bound
+    // changes
+    std::vector<int> boundBuffers(m_buffers.size());
+    for (int i = 0; i < m_buffers.size(); ++i)
+      boundBuffers[i] = i;
+    for (uint32_t i = 0; i < m_parsed.m_pingPongPairs.size(); ++i) {
+      if (pingPongSwapMask & (1u << i)) {
+        const auto& pair = m_parsed.m_pingPongPairs[i];
+        std::swap(boundBuffers[pair.buffers[0]], boundBuffers[pair.buffers[1]]);
+      }
+    }
+
     for (int i = 0; i < m_buffers.size(); ++i) {
       const auto& parsedBuf = m_parsed.m_buffers[i];
       const auto& structdef = m_parsed.m_structDefs[parsedBuf.structIdx];
-      const auto& bufCollection = m_buffers[i];
+      int boundIdx = boundBuffers[i];
+      const auto& bufCollection = m_buffers[boundIdx];
+
+      if (m_transientSlots[boundIdx] >= 0) {
+        const auto& transient =
+            m_parsed.m_transientBuffers[m_transientSlots[boundIdx]];
+        auto& binder = heapBinders.emplace_back();
+        VkDescriptorBufferInfo& info = binder.bufferInfos.emplace_back();
+        info.buffer = m_transientPool.getBuffer();
+        info.offset = transient.offset;
+        info.range = transient.size;
+
+        assign.bindBufferHeap(binder);
+      } else if (parsedBuf.isSoa()) {
+        for (const auto& field : parsedBuf.soaFields) {
+          auto& binder = heapBinders.emplace_back();
+          VkDescriptorBufferInfo& info = binder.bufferInfos.emplace_back();
+          info.buffer = bufCollection[0].getBuffer();
+          info.offset = field.offset;
+          info.range = uint64_t(field.stride) * parsedBuf.elemCount;
 
-      if (parsedBuf.bufferCount == 1) {
+          assign.bindBufferHeap(binder);
+        }
+      } else if (parsedBuf.bufferCount == 1) {
         assign.bindStorageBuffer(
             bufCollection[0],
             structdef.size * parsedBuf.elemCount,
@@ -388,30 +568,39 @@ Project::Project(
       assign.bindStorageBuffer(VB.getAllocation(), VB.getSize(), false);
       assign.bindStorageBuffer(IB.getAllocation(), IB.getSize(), false);
     }
+  };
+  assignResources(m_descriptorSets, 0);
+  uint32_t pingPongStates = 1u << m_parsed.m_pingPongPairs.size();
+  m_swappedDescriptorSets.reserve(pingPongStates - 1);
+  for (uint32_t mask = 1; mask < pingPongStates; mask++) {
+    assignResources(
+        m_swappedDescriptorSets.emplace_back(*GApplication, dsBuilder),
+        mask);
   }
 
-  std::filesystem::path autoGenFileName = m_projPath;
-  if (m_parsed.m_language == SHADER_LANGUAGE_GLSL) {
-    autoGenFileName.replace_extension(".gen.glsl");
-    codeGenGlsl(autoGenFileName);
-  } else {
-    autoGenFileName.replace_extension(".gen.hlsl");
-    codeGenHlsl(autoGenFileName);
-  }
+  std::filesystem::path autoGenFileName =
+      getAutoGenFileName(m_parsed, m_projPath);
+  codeGen(m_parsed, m_projPath);
+
+  ShaderCache shaderCache(GProjectDirectory + "/ShaderCache");
 
-  m_computePipelines.reserve(m_parsed.m_computeShaders.size());
+  // All pipeline builders are set up first, their shaders are then loaded
+  // from the shader cache or compiled in parallel and the pipelines are
+  // created once every compile succeeded. Cache keys are computed up front,
+  // the shader cache is not thread-safe.
+  std::vector<ComputePipelineBuilder> computeBuilders;
+  std::vector<ShaderCache::ShaderDesc> computeShaders;
+  computeBuilders.reserve(m_parsed.m_computeShaders.size());
+  computeShaders.reserve(m_parsed.m_computeShaders.size());
   for (const auto& c : m_parsed.m_computeShaders) {
-    ShaderDefines defs{};
-    defs.emplace("IS_COMP_SHADER", "");
-    if (m_parsed.m_language == SHADER_LANGUAGE_HLSL) {
-      /* char buf[128];
-       sprintf(buf, "__hack(){}\n[numthreads(%u,%u,%u)]\nvoid main", c.groupSizeX, c.groupSizeY, c.groupSizeZ);
-       defs.emplace(c.name, std::string(buf));*/
-      defs.emplace(c.name, "main");
-    }
-    defs.emplace(std::string("_ENTRY_POINT_") + c.name, "");
+    ShaderDefines defs = getComputeShaderDefines(m_parsed, c);
+    computeShaders.push_back(shaderCache.describe(
+        autoGenFileName.string(),
+        defs,
+        m_parsed.m_language,
+        ShaderCache::STAGE_COMPUTE));
 
-    ComputePipelineBuilder builder{};
+    ComputePipelineBuilder& builder = computeBuilders.emplace_back();
     builder.setComputeShader(
         autoGenFileName.string(),
         defs,
@@ -420,22 +609,20 @@ Project::Project(
         .addDescriptorSet(GGlobalHeap->getDescriptorSetLayout())
         .addDescriptorSet(m_descriptorSets.getLayout())
         .addPushConstants<GenericPush>(VK_SHADER_STAGE_COMPUTE_BIT);
-
-    {
-      std::string errors = builder.compileShadersGetErrors();
-      if (errors.size()) {
-        m_parsed.m_failed = true;
-        strncpy(m_parsed.m_errMsg, errors.c_str(), errors.size());
-        return;
-      }
-    }
-
-    m_computePipelines.emplace_back(*GApplication, std::move(builder));
   }
 
-  m_drawPasses.reserve(m_parsed.m_renderPasses.size());
-  for (const auto& pass : m_parsed.m_renderPasses) {
+  struct PendingDrawPass {
+    std::vector<Attachment> attachments;
     std::vector<SubpassBuilder> subpassBuilders;
+    std::vector<VkImageView> attachmentViews;
+    // vertex and pixel shader of each subpass
+    std::vector<std::array<ShaderCache::ShaderDesc, 2>> shaders;
+  };
+  std::vector<PendingDrawPass> pendingDrawPasses;
+  pendingDrawPasses.reserve(m_parsed.m_renderPasses.size());
+  for (const auto& pass : m_parsed.m_renderPasses) {
+    PendingDrawPass& pending = pendingDrawPasses.emplace_back();
+    std::vector<SubpassBuilder>& subpassBuilders = pending.subpassBuilders;
     subpassBuilders.reserve(pass.draws.size());
 
     VkClearValue colorClear;
@@ -443,10 +630,10 @@ Project::Project(
     VkClearValue depthClear;
     depthClear.depthStencil = {1.0f, 0};
 
-    std::vector<Attachment> attachments;
+    std::vector<Attachment>& attachments = pending.attachments;
     std::vector<uint32_t> colorAttachments;
     std::optional<uint32_t> depthAttachment = std::nullopt;
-    std::vector<VkImageView> attachmentViews;
+    std::vector<VkImageView>& attachmentViews = pending.attachmentViews;
     for (const auto& attachmentRef : pass.attachments) {
       const auto& imageDesc = m_parsed.m_images[attachmentRef.imageIdx];
       const auto& imageRsc = m_images[attachmentRef.imageIdx];
@@ -501,64 +688,130 @@ Project::Project(
             offsetof(ObjVertex, uvs));
       }
 
-      {
-        ShaderDefines defs{};
-        defs.emplace("IS_VERTEX_SHADER", "");
-        if (draw.drawMode == ParsedFlr::DM_DRAW_OBJ)
-          defs.emplace("IS_OBJ_SHADER", "");
-        defs.emplace(std::string("_ENTRY_POINT_") + draw.vertexShader, "");
-        if (m_parsed.m_language == SHADER_LANGUAGE_HLSL)
-          defs.emplace(draw.vertexShader, "main");
-        defs.emplace(pass.name, "");
-        builder.addVertexShader(
-            autoGenFileName.string(),
-            defs,
-            m_parsed.m_language);
-      }
-      {
-        ShaderDefines defs{};
-        defs.emplace("IS_PIXEL_SHADER", "");
-        if (draw.drawMode == ParsedFlr::DM_DRAW_OBJ)
-          defs.emplace("IS_OBJ_SHADER", "");
-        defs.emplace(std::string("_ENTRY_POINT_") + draw.pixelShader, "");
-        defs.emplace(pass.name, "");
-        builder.addFragmentShader(
-            autoGenFileName.string(),
-            defs,
-            m_parsed.m_language);
-      }
-
-      {
-        std::string errors = builder.compileShadersGetErrors();
-        if (errors.size()) {
-          m_parsed.m_failed = true;
-          strncpy(m_parsed.m_errMsg, errors.c_str(), errors.size());
-          return;
-        }
-      }
+      ShaderDefines vertexDefs = getVertexShaderDefines(m_parsed, pass, draw);
+      ShaderDefines pixelDefs = getPixelShaderDefines(m_parsed, pass, draw);
+      pending.shaders.push_back(
+          {shaderCache.describe(
+               autoGenFileName.string(),
+               vertexDefs,
+               m_parsed.m_language,
+               ShaderCache::STAGE_VERTEX),
+           shaderCache.describe(
+               autoGenFileName.string(),
+               pixelDefs,
+               m_parsed.m_language,
+               ShaderCache::STAGE_PIXEL)});
+
+      builder.addVertexShader(
+          autoGenFileName.string(),
+          vertexDefs,
+          m_parsed.m_language);
+      builder.addFragmentShader(
+          autoGenFileName.string(),
+          pixelDefs,
+          m_parsed.m_language);
 
       builder.layoutBuilder
           .addDescriptorSet(GGlobalHeap->getDescriptorSetLayout())
           .addDescriptorSet(m_descriptorSets.getLayout())
           .addPushConstants<GenericPush>();
     }
+  }
+
+  {
+    // Flattened list of compile jobs, compute pipelines first and then the
+    // subpasses in declaration order. This is also the order errors are
+    // reported in, same as when compiling serially.
+    struct CompileJob {
+      ComputePipelineBuilder* pCompute;
+      GraphicsPipelineBuilder* pGraphics;
+      const ShaderCache::ShaderDesc* pShaders;
+    };
+    std::vector<CompileJob> jobs;
+    for (size_t i = 0; i < computeBuilders.size(); i++)
+      jobs.push_back({&computeBuilders[i], nullptr, &computeShaders[i]});
+    for (auto& pending : pendingDrawPasses)
+      for (size_t i = 0; i < pending.subpassBuilders.size(); i++)
+        jobs.push_back(
+            {nullptr,
+             &pending.subpassBuilders[i].pipelineBuilder,
+             pending.shaders[i].data()});
+
+    std::vector<std::string> jobErrors(jobs.size());
+    std::vector<ShaderCache::CompileStats> jobStats(jobs.size());
+    auto compileStart = std::chrono::high_resolution_clock::now();
+    parallelFor(static_cast<uint32_t>(jobs.size()), [&](uint32_t i) {
+      FLR_TRACE_ZONE("Compile pipeline");
+      const CompileJob& job = jobs[i];
+      if (job.pCompute)
+        jobErrors[i] =
+            shaderCache.compile(*job.pCompute, job.pShaders, 1, jobStats[i]);
+      else
+        jobErrors[i] =
+            shaderCache.compile(*job.pGraphics, job.pShaders, 2, jobStats[i]);
+    });
+
+    m_loadStats.pipelineCount = static_cast<uint32_t>(jobs.size());
+    m_loadStats.shaderCompileWallMs =
+        std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - compileStart)
+            .count();
+    m_loadStats.shaderCacheHits = 0;
+    m_loadStats.shaderCacheMisses = 0;
+    m_loadStats.shaderCompileSerialMs = 0.0;
+    for (const ShaderCache::CompileStats& stats : jobStats) {
+      m_loadStats.shaderCacheHits += stats.cacheHits;
+      m_loadStats.shaderCacheMisses += stats.cacheMisses;
+      m_loadStats.shaderCompileSerialMs += stats.compileMs;
+    }
+
+    std::cout << "Loaded " << m_loadStats.pipelineCount << " pipelines in "
+              << m_loadStats.shaderCompileWallMs << "ms, "
+              << m_loadStats.shaderCacheHits << " shaders from the cache and "
+              << m_loadStats.shaderCacheMisses << " compiled in "
+              << m_loadStats.shaderCompileSerialMs << "ms serial"
+              << std::endl;
+
+    for (const std::string& errors : jobErrors) {
+      if (errors.size()) {
+        m_parsed.m_failed = true;
+        strncpy(m_parsed.m_errMsg, errors.c_str(), errors.size());
+        return;
+      }
+    }
+  }
+
+  m_computePipelines.reserve(computeBuilders.size());
+  for (ComputePipelineBuilder& builder : computeBuilders)
+    m_computePipelines.emplace_back(*GApplication, std::move(builder));
+
+  m_drawPasses.reserve(m_parsed.m_renderPasses.size());
+  for (size_t passIdx = 0; passIdx < m_parsed.m_renderPasses.size();
+       passIdx++) {
+    const auto& pass = m_parsed.m_renderPasses[passIdx];
+    PendingDrawPass& pending = pendingDrawPasses[passIdx];
 
     DrawPass& drawPass = m_drawPasses.emplace_back();
     drawPass.m_renderPass = RenderPass(
         *GApplication,
         {(uint32_t)pass.width, (uint32_t)pass.height},
-        std::move(attachments),
-        std::move(subpassBuilders));
+        std::move(pending.attachments),
+        std::move(pending.subpassBuilders));
 
     drawPass.m_frameBuffer = FrameBuffer(
         *GApplication,
         drawPass.m_renderPass,
         {(uint32_t)pass.width, (uint32_t)pass.height},
-        std::move(attachmentViews));
+        std::move(pending.attachmentViews));
   }
 
   m_images[m_parsed.m_displayImageIdx].registerToTextureHeap(*GGlobalHeap);
 
+  bakeTaskLists();
+  if (m_parsed.m_failed)
+    return;
+  m_gpuProfiler.setCsvPath(folder / (projName.string() + "_gpu_timings.csv"));
+
   if (m_parsed.isFeatureEnabled(ParsedFlr::FF_SYSTEM_AUDIO_INPUT)) {
     m_pAudio = std::make_unique<Audio>(true);
   }
@@ -572,10 +825,28 @@ Project::~Project() {
   if (isReady()) {
     serializeOptions();
   }
+
+  // Projects are only destroyed once no frame in flight uses them
+  auto freeRecorded = [](const BakedTaskList& list) {
+    for (const auto& recordedPair : list.recorded)
+      for (VkCommandBuffer commandBuffer : recordedPair)
+        if (commandBuffer != VK_NULL_HANDLE)
+          vkFreeCommandBuffers(
+              GApplication->getDevice(),
+              GApplication->getCommandPool(),
+              1,
+              &commandBuffer);
+  };
+  freeRecorded(m_bakedTaskList);
+  for (const BakedTaskList& list : m_bakedTaskBlocks)
+    freeRecorded(list);
 }
 
 void Project::tick(const FrameContext& frame) {
+  FLR_TRACE_ZONE("Project::tick");
+
   if (m_parsed.isFeatureEnabled(ParsedFlr::FF_SYSTEM_AUDIO_INPUT)) {
+    FLR_TRACE_ZONE("Audio input");
     AudioInput audioInput;
     m_pAudio->play();
     m_pAudio->copySamples(&audioInput.packedSamples[0][0], 512 * 4);
@@ -587,6 +858,7 @@ void Project::tick(const FrameContext& frame) {
   }
 
   if (m_parsed.m_uiElements.size()) {
+    FLR_TRACE_ZONE("Options UI");
     if (!GInputManager->getMouseCursorHidden()) {
       if (ImGui::Begin("Options", false)) {
         char nameBuf[128];
@@ -770,7 +1042,10 @@ void Project::tick(const FrameContext& frame) {
         m_dynamicDataBuffer);
   }
 
+  m_gpuProfiler.drawUi();
+
   if (m_parsed.isFeatureEnabled(ParsedFlr::FF_PERSPECTIVE_CAMERA)) {
+    FLR_TRACE_ZONE("Camera");
     m_cameraController.tick(frame.deltaTime);
     m_cameraArgs.prevView = m_cameraArgs.view;
     m_cameraArgs.prevInverseView = m_cameraArgs.inverseView;
@@ -782,25 +1057,71 @@ void Project::tick(const FrameContext& frame) {
   }
 }
 
+bool Project::foldDispatch(
+    uint32_t groupCounts[3],
+    uint32_t& unfoldedGroupCountX,
+    const char* shaderName) {
+  unfoldedGroupCountX = 0;
+  if (groupCounts[0] <= m_maxComputeWorkGroupCount[0] &&
+      groupCounts[1] <= m_maxComputeWorkGroupCount[1] &&
+      groupCounts[2] <= m_maxComputeWorkGroupCount[2])
+    return true;
+
+  // the generated hlsl has no thread index helpers that undo the folding
+  uint32_t groupCountX = groupCounts[0];
+  if (m_parsed.m_language != SHADER_LANGUAGE_HLSL &&
+      foldGroupCounts(groupCounts, m_maxComputeWorkGroupCount)) {
+    unfoldedGroupCountX = groupCountX;
+    return true;
+  }
+
+  // Dropping groups would silently skip work, the project cannot run as
+  // written.
+  m_parsed.m_failed = true;
+  snprintf(
+      m_parsed.m_errMsg,
+      sizeof(m_parsed.m_errMsg),
+      "ERROR: The dispatch of %s with %u x %u x %u groups exceeds the device "
+      "limits of %u x %u x %u and cannot be folded%s.",
+      shaderName,
+      groupCounts[0],
+      groupCounts[1],
+      groupCounts[2],
+      m_maxComputeWorkGroupCount[0],
+      m_maxComputeWorkGroupCount[1],
+      m_maxComputeWorkGroupCount[2],
+      (m_parsed.m_language == SHADER_LANGUAGE_HLSL) ? " in an hlsl project"
+                                                     : "");
+  std::cerr << m_parsed.m_errMsg << std::endl;
+  return false;
+}
+
 void Project::dispatch(
     ComputeShaderId compShader,
     uint32_t groupCountX,
     uint32_t groupCountY,
     uint32_t groupCountZ,
     VkCommandBuffer commandBuffer,
-    const FrameContext& frame) const {
+    const FrameContext& frame) {
   assert(compShader.isValid());
 
   VkDescriptorSet sets[] = {
       GGlobalHeap->getDescriptorSet(),
-      m_descriptorSets.getCurrentDescriptorSet(frame)};
+      getProjectDescriptorSet(frame)};
 
   const ComputePipeline& c = m_computePipelines[compShader.idx];
   c.bindPipeline(commandBuffer);
   c.bindDescriptorSets(commandBuffer, sets, 2);
+
+  const auto& csInfo = m_parsed.m_computeShaders[compShader.idx];
+  uint32_t groupCounts[3] = {groupCountX, groupCountY, groupCountZ};
+  if (!foldDispatch(groupCounts, m_pushData.groupCountX, csInfo.name.c_str()))
+    return;
   c.setPushConstants(commandBuffer, m_pushData);
 
-  vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+  uint32_t scope = m_gpuProfiler.beginScope(commandBuffer, csInfo.name, true);
+  vkCmdDispatch(commandBuffer, groupCounts[0], groupCounts[1], groupCounts[2]);
+  m_gpuProfiler.endScope(commandBuffer, scope);
 }
 
 void Project::dispatchThreads(
@@ -809,298 +1130,892 @@ void Project::dispatchThreads(
     uint32_t threadCountY,
     uint32_t threadCountZ,
     VkCommandBuffer commandBuffer,
-    const FrameContext& frame) const {
+    const FrameContext& frame) {
   assert(compShader.isValid());
 
   VkDescriptorSet sets[] = {
       GGlobalHeap->getDescriptorSet(),
-      m_descriptorSets.getCurrentDescriptorSet(frame)};
+      getProjectDescriptorSet(frame)};
 
   const auto& csInfo = m_parsed.m_computeShaders[compShader.idx];
   const ComputePipeline& c = m_computePipelines[compShader.idx];
   c.bindPipeline(commandBuffer);
   c.bindDescriptorSets(commandBuffer, sets, 2);
-  c.setPushConstants(commandBuffer, m_pushData);
 
-  uint32_t groupCountX =
-      (threadCountX + csInfo.groupSizeX - 1) / csInfo.groupSizeX;
-  uint32_t groupCountY =
-      (threadCountY + csInfo.groupSizeY - 1) / csInfo.groupSizeY;
-  uint32_t groupCountZ =
-      (threadCountZ + csInfo.groupSizeZ - 1) / csInfo.groupSizeZ;
-  vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+  uint32_t groupCounts[3] = {
+      (threadCountX + csInfo.groupSizeX - 1) / csInfo.groupSizeX,
+      (threadCountY + csInfo.groupSizeY - 1) / csInfo.groupSizeY,
+      (threadCountZ + csInfo.groupSizeZ - 1) / csInfo.groupSizeZ};
+  if (!foldDispatch(groupCounts, m_pushData.groupCountX, csInfo.name.c_str()))
+    return;
+  c.setPushConstants(commandBuffer, m_pushData);
+  uint32_t scope = m_gpuProfiler.beginScope(commandBuffer, csInfo.name, true);
+  vkCmdDispatch(commandBuffer, groupCounts[0], groupCounts[1], groupCounts[2]);
+  m_gpuProfiler.endScope(commandBuffer, scope);
 }
 
 void Project::executeTaskBlock(
     TaskBlockId id,
     VkCommandBuffer commandBuffer,
     const FrameContext& frame) {
-  executeTaskList(m_parsed.m_taskBlocks[id.idx].tasks, commandBuffer, frame);
+  uint32_t scope = m_gpuProfiler.beginScope(
+      commandBuffer,
+      m_parsed.m_taskBlocks[id.idx].name,
+      false);
+  executeBakedTaskList(m_bakedTaskBlocks[id.idx], commandBuffer, frame);
+  m_gpuProfiler.endScope(commandBuffer, scope);
 }
 
-void Project::executeTaskList(
+VkPipelineStageFlags Project::getConsumerShaderStages(
     const std::vector<ParsedFlr::Task>& tasks,
-    VkCommandBuffer commandBuffer,
-    const FrameContext& frame) {
-  VkDescriptorSet sets[] = {
-      GGlobalHeap->getDescriptorSet(),
-      m_descriptorSets.getCurrentDescriptorSet(frame)};
+    size_t consumerIdx) const {
+  // Derived barriers and transitions are placed right before the task that
+  // needs them, hand-written ones may be consumed by any later task.
+  if (!m_parsed.m_bInferBarriers)
+    return ALL_SHADER_STAGES;
+
+  for (size_t i = consumerIdx; i < tasks.size(); i++) {
+    if (tasks[i].type == ParsedFlr::TT_BARRIER ||
+        tasks[i].type == ParsedFlr::TT_TRANSITION)
+      continue;
+    VkPipelineStageFlags stages = m_parsed.getTaskStages(tasks[i]) & ALL_SHADER_STAGES;
+    return stages ? stages : ALL_SHADER_STAGES;
+  }
+
+  return ALL_SHADER_STAGES;
+}
+
+void Project::addPendingStages(
+    const ParsedFlr::Task& task,
+    std::vector<BufferSyncState>& states) const {
+  VkPipelineStageFlags stages = m_parsed.getTaskStages(task);
+
+  // Without declared access, any task may have touched any buffer
+  if (!m_parsed.m_bInferBarriers) {
+    for (auto& state : states)
+      state.pendingStageFlags |= stages;
+    return;
+  }
+
+  // either buffer of a ping_pong pair may be bound under its name
+  auto addBuffer = [&](uint32_t bufferIdx) {
+    states[bufferIdx].pendingStageFlags |= stages;
+    if (m_pingPongPartners[bufferIdx] >= 0)
+      states[m_pingPongPartners[bufferIdx]].pendingStageFlags |= stages;
+  };
+  auto addAccess = [&](const ParsedFlr::ResourceAccess& access) {
+    for (const auto& b : access.buffers)
+      addBuffer(b.buffer);
+  };
+
+  if (task.type == ParsedFlr::TT_COMPUTE) {
+    const auto& dispatch = m_parsed.m_computeDispatches[task.idx];
+    addAccess(m_parsed.m_computeShaders[dispatch.computeShaderIndex].access);
+    if (dispatch.mode == ParsedFlr::DM_INDIRECT)
+      addBuffer(dispatch.param0);
+  } else if (task.type == ParsedFlr::TT_RENDER) {
+    for (const auto& draw : m_parsed.m_renderPasses[task.idx].draws) {
+      addAccess(draw.access);
+      if (draw.drawMode == ParsedFlr::DM_DRAW_INDEXED)
+        addBuffer(draw.param1);
+      else if (draw.drawMode == ParsedFlr::DM_DRAW_INDIRECT)
+        addBuffer(draw.param0);
+    }
+  }
+}
+
+void Project::bakeTaskLists() {
+  m_bakedBarriers.clear();
+
+  // task blocks can only run blocks declared before them, so every block a
+  // list runs is already baked
+  m_bakedTaskBlocks.resize(m_parsed.m_taskBlocks.size());
+  for (size_t i = 0; i < m_parsed.m_taskBlocks.size(); i++) {
+    bakeTaskList(m_parsed.m_taskBlocks[i].tasks, m_bakedTaskBlocks[i]);
+    if (m_parsed.m_failed)
+      return;
+    if (const auto* pCadence = m_parsed.findTaskCadence(i)) {
+      m_bakedTaskBlocks[i].cadenceInterval = pCadence->interval;
+      m_bakedTaskBlocks[i].cadencePhase = pCadence->phase;
+    }
+  }
+  bakeTaskList(m_parsed.m_taskList, m_bakedTaskList);
+}
+
+void Project::bakeTaskList(
+    const std::vector<ParsedFlr::Task>& tasks,
+    BakedTaskList& baked) {
+  baked.commands.clear();
+  baked.commands.reserve(tasks.size());
+  baked.bStatic = true;
+  baked.pingPongFlipMask = 0;
+  baked.cadenceInterval = 1;
+  baked.cadencePhase = 0;
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (uint32_t j = 0; j < PING_PONG_STATES; j++) {
+      baked.bRecorded[i][j] = false;
+      baked.recorded[i][j] = VK_NULL_HANDLE;
+      baked.executedDraw[i][j] = 0;
+    }
+  }
 
-  for (const auto& task : tasks) {
+  // What ran before the list starts is not known, it may have accessed any
+  // buffer from any stage. The same goes for whatever a task block did.
+  const VkPipelineStageFlags conditionalRenderingStage =
+      m_pfnBeginConditionalRendering
+          ? VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT
+          : 0;
+  const BufferSyncState unknownState = {
+      ALL_SHADER_STAGES | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | conditionalRenderingStage,
+      0};
+  std::vector<BufferSyncState> states(m_buffers.size(), unknownState);
+  // BC_REPEAT and BC_IF commands still waiting for the end of their body
+  std::vector<size_t> openScopes;
+
+  for (size_t taskIdx = 0; taskIdx < tasks.size(); taskIdx++) {
+    const auto& task = tasks[taskIdx];
     switch (task.type) {
     case ParsedFlr::TT_COMPUTE: {
       const auto& dispatch = m_parsed.m_computeDispatches[task.idx];
       const auto& compute =
           m_parsed.m_computeShaders[dispatch.computeShaderIndex];
-      ComputePipeline& c = m_computePipelines[dispatch.computeShaderIndex];
-      c.bindPipeline(commandBuffer);
-      c.bindDescriptorSets(commandBuffer, sets, 2);
-      c.setPushConstants(commandBuffer, m_pushData);
 
+      BakedCommand& command = baked.commands.emplace_back();
+      command.idx = dispatch.computeShaderIndex;
       if (dispatch.mode == ParsedFlr::DM_INDIRECT) {
-        vkCmdDispatchIndirect(
-            commandBuffer,
-            m_buffers[dispatch.param0][0].getBuffer(),
-            12 * dispatch.param1);
+        command.type = BC_DISPATCH_INDIRECT;
+        command.buffer = m_buffers[dispatch.param0][0].getBuffer();
+        command.params[0] = 12 * dispatch.param1;
+      } else if (dispatch.mode == ParsedFlr::DM_THREADS) {
+        command.type = BC_DISPATCH;
+        command.params[0] =
+            (dispatch.param0 + compute.groupSizeX - 1) / compute.groupSizeX;
+        command.params[1] =
+            (dispatch.param1 + compute.groupSizeY - 1) / compute.groupSizeY;
+        command.params[2] =
+            (dispatch.param2 + compute.groupSizeZ - 1) / compute.groupSizeZ;
       } else {
-        uint32_t groupCountX, groupCountY, groupCountZ;
-        if (dispatch.mode == ParsedFlr::DM_THREADS) {
-          groupCountX =
-              (dispatch.param0 + compute.groupSizeX - 1) / compute.groupSizeX;
-          groupCountY =
-              (dispatch.param1 + compute.groupSizeY - 1) / compute.groupSizeY;
-          groupCountZ =
-              (dispatch.param2 + compute.groupSizeZ - 1) / compute.groupSizeZ;
-        } else {
-          groupCountX = dispatch.param0;
-          groupCountY = dispatch.param1;
-          groupCountZ = dispatch.param2;
-        }
-
-        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+        command.type = BC_DISPATCH;
+        command.params[0] = dispatch.param0;
+        command.params[1] = dispatch.param1;
+        command.params[2] = dispatch.param2;
       }
+      if (command.type == BC_DISPATCH &&
+          !foldDispatch(
+              command.params,
+              command.params[3],
+              compute.name.c_str()))
+        return;
+
+      addPendingStages(task, states);
       break;
     }
 
     case ParsedFlr::TT_BARRIER: {
-      const auto& parsedBarrier = m_parsed.m_barriers[task.idx];
-      VkAccessFlags dstAccess = parsedBarrier.accessFlags;
-      for (uint32_t bufferIdx : parsedBarrier.buffers) {
-        const auto& parsedBuf = m_parsed.m_buffers[bufferIdx];
-        const auto& parsedStruct = m_parsed.m_structDefs[parsedBuf.structIdx];
-        VkAccessFlags srcAccess = m_bufferResourceStates[bufferIdx];
-        for (const auto& buf : m_buffers[bufferIdx]) {
-          VkBufferMemoryBarrier barrier{};
-          barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-          barrier.buffer = buf.getBuffer();
-          barrier.offset = 0;
-          barrier.size = parsedBuf.elemCount * parsedStruct.size;
-          barrier.srcAccessMask = srcAccess;
-          barrier.dstAccessMask = dstAccess;
-
-          vkCmdPipelineBarrier(
-              commandBuffer,
-              VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-              VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-              0,
-              0,
-              nullptr,
-              1,
-              &barrier,
-              0,
-              nullptr);
-        }
-        m_bufferResourceStates[bufferIdx] = dstAccess;
-      }
+      // runs of consecutive barrier tasks are issued as a single barrier
+      size_t runEnd = taskIdx + 1;
+      while (runEnd < tasks.size() &&
+             tasks[runEnd].type == ParsedFlr::TT_BARRIER)
+        runEnd++;
+      bakeBarriers(tasks, taskIdx, runEnd, states, baked);
+      taskIdx = runEnd - 1;
       break;
     }
 
     case ParsedFlr::TT_RENDER: {
-      const auto& passDesc = m_parsed.m_renderPasses[task.idx];
-      auto& drawPass = m_drawPasses[task.idx];
-
-      {
-        ActiveRenderPass pass = drawPass.m_renderPass.begin(
-            *GApplication,
-            commandBuffer,
-            frame,
-            drawPass.m_frameBuffer);
-        pass.setGlobalDescriptorSets(gsl::span(sets, 2));
-        pass.getDrawContext().bindDescriptorSets();
-        pass.getDrawContext().updatePushConstants(m_pushData, 0);
-        for (const auto& draw : m_parsed.m_renderPasses[task.idx].draws) {
-          switch (draw.drawMode) {
-          case ParsedFlr::DM_DRAW: {
-            pass.getDrawContext().draw(draw.param0, draw.param1);
-            break;
-          }
-          case ParsedFlr::DM_DRAW_INDEXED: {
-            const auto& b = m_buffers[draw.param1][draw.param2];
-            uint32_t indexCount = m_parsed.m_buffers[draw.param1].elemCount;
-            vkCmdBindIndexBuffer(
-                commandBuffer,
-                b.getBuffer(),
-                0,
-                VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(commandBuffer, indexCount, draw.param0, 0, 0, 0);
-            break;
-          }
-          case ParsedFlr::DM_DRAW_INDIRECT: {
-            const auto& b = m_buffers[draw.param0];
-            assert(b.size() == 1);
-            vkCmdDrawIndirect(
-                commandBuffer,
-                b[draw.param2].getBuffer(),
-                0,
-                draw.param1,
-                16);
-            break;
-          }
-          case ParsedFlr::DM_DRAW_OBJ: {
-            SimpleObjLoader::LoadedObj& obj = m_objModels[draw.param0];
-            for (SimpleObjLoader::LoadedObjMesh& mesh : obj.m_meshes) {
-              pass.getDrawContext().bindIndexBuffer(mesh.m_indices);
-              pass.getDrawContext().bindVertexBuffer(obj.m_vertices);
-              pass.getDrawContext().drawIndexed(
-                  mesh.m_indices.getIndexCount(),
-                  draw.param1);
-            }
-            break;
-          }
-          };
-
-          if (!pass.isLastSubpass())
-            pass.nextSubpass();
-        }
-      }
-
-      for (const auto& attachmentRef : passDesc.attachments)
-        m_images[attachmentRef.imageIdx].image.clearLayout();
+      BakedCommand& command = baked.commands.emplace_back();
+      command.type = BC_RENDER;
+      command.idx = task.idx;
+      baked.bStatic = false;
 
+      addPendingStages(task, states);
       break;
     }
 
     case ParsedFlr::TT_TRANSITION: {
       const auto& transition = m_parsed.m_transitions[task.idx];
-      auto& rsc = m_images[transition.image];
 
+      BakedCommand& command = baked.commands.emplace_back();
+      command.type = BC_TRANSITION;
+      command.idx = transition.image;
       switch (transition.transitionTarget) {
       case ParsedFlr::LTT_TEXTURE: {
-        rsc.image.transitionLayout(
-            commandBuffer,
-            VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
-            VK_ACCESS_SHADER_READ_BIT,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        command.params[0] = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+        command.params[1] = VK_ACCESS_SHADER_READ_BIT;
+        command.dstStages = getConsumerShaderStages(tasks, taskIdx + 1);
         break;
       }
       case ParsedFlr::LTT_IMAGE_RW: {
-        rsc.image.transitionLayout(
-            commandBuffer,
-            VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL,
-            VK_ACCESS_SHADER_READ_BIT,
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        // storage images are only accessible in the general layout, and
+        // later writes need to be ordered after this one
+        command.params[0] = VK_IMAGE_LAYOUT_GENERAL;
+        command.params[1] =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        command.dstStages = getConsumerShaderStages(tasks, taskIdx + 1);
         break;
       }
       case ParsedFlr::LTT_ATTACHMENT: {
-        rsc.image.transitionLayout(
-            commandBuffer,
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        command.params[0] = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        command.params[1] = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        command.dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
         break;
       }
       }
+      baked.bStatic = false;
       break;
     }
 
     case ParsedFlr::TT_TASK: {
-      // TODO: would be nice to handle this without recursion, but this should
-      // be safe since it is validated during parsing
-      executeTaskBlock(TaskBlockId(task.idx), commandBuffer, frame);
+      BakedCommand& command = baked.commands.emplace_back();
+      command.type = BC_TASK;
+      command.idx = task.idx;
+      const BakedTaskList& block = m_bakedTaskBlocks[task.idx];
+      baked.bStatic &= block.bStatic;
+
+      std::fill(states.begin(), states.end(), unknownState);
+      break;
+    }
+
+    case ParsedFlr::TT_REPEAT: {
+      openScopes.push_back(baked.commands.size());
+      BakedCommand& command = baked.commands.emplace_back();
+      command.type = BC_REPEAT;
+      command.idx = task.idx;
+      if (m_parsed.m_repeats[task.idx].sliderUintIdx >= 0)
+        baked.bStatic = false;
+
+      // the body also runs after its own previous iteration
+      std::fill(states.begin(), states.end(), unknownState);
+      break;
+    }
+
+    case ParsedFlr::TT_IF: {
+      const auto& condition = m_parsed.m_conditions[task.idx];
+      openScopes.push_back(baked.commands.size());
+      BakedCommand& command = baked.commands.emplace_back();
+      command.type = BC_IF;
+      command.idx = task.idx;
+      if (condition.source == ParsedFlr::CS_BUFFER)
+        states[condition.idx].pendingStageFlags |= conditionalRenderingStage;
+      else if (condition.source != ParsedFlr::CS_CONST)
+        baked.bStatic = false;
+      break;
+    }
+
+    case ParsedFlr::TT_REPEAT_END:
+    case ParsedFlr::TT_IF_END: {
+      size_t scopeCommand = openScopes.back();
+      openScopes.pop_back();
+      baked.commands[scopeCommand].params[0] =
+          static_cast<uint32_t>(baked.commands.size() - scopeCommand - 1);
+
+      // the body may have been skipped or run several times
+      std::fill(states.begin(), states.end(), unknownState);
       break;
     }
     };
   }
-}
 
-void Project::draw(VkCommandBuffer commandBuffer, const FrameContext& frame) {
+  // cadenced blocks only run on some frames
+  if (baked.commands.empty() || m_parsed.runsCadencedTaskBlock(tasks))
+    baked.bStatic = false;
+}
 
-  if (m_pendingSaveImage) {
-    auto& img = m_images[m_pendingSaveImage->imageIdx].image;
-    // TODO: assumes r8g8b8a8_unorm, generalize
-    uint32_t width = img.getOptions().width;
-    uint32_t height = img.getOptions().height;
-    size_t byteSize = width * height * 4;
-    BufferAllocation* pStaging = new BufferAllocation(
-        BufferUtilities::createStagingBufferForDownload(byteSize));
+void Project::bakeBarriers(
+    const std::vector<ParsedFlr::Task>& tasks,
+    size_t begin,
+    size_t end,
+    std::vector<BufferSyncState>& states,
+    BakedTaskList& baked) {
+  VkPipelineStageFlags consumerStages = getConsumerShaderStages(tasks, end);
+
+  uint32_t firstBarrier = static_cast<uint32_t>(m_bakedBarriers.size());
+  VkPipelineStageFlags srcStages = 0;
+  VkPipelineStageFlags dstStages = 0;
+  for (size_t i = begin; i < end; i++) {
+    const auto& parsedBarrier = m_parsed.m_barriers[tasks[i].idx];
+    VkAccessFlags dstAccess = parsedBarrier.accessFlags;
+    VkPipelineStageFlags barrierDstStages =
+        getAccessStages(dstAccess, consumerStages);
+    for (uint32_t bufferIdx : parsedBarrier.buffers) {
+      const auto& parsedBuf = m_parsed.m_buffers[bufferIdx];
+
+      // Which buffer of a ping_pong pair is bound under the name is only
+      // known when recording, the barrier covers both
+      uint32_t physicalBuffers[2] = {bufferIdx, bufferIdx};
+      uint32_t physicalCount = 1;
+      if (m_pingPongPartners[bufferIdx] >= 0)
+        physicalBuffers[physicalCount++] =
+            static_cast<uint32_t>(m_pingPongPartners[bufferIdx]);
+
+      for (uint32_t j = 0; j < physicalCount; j++) {
+        auto addBarrier = [&](VkBuffer buffer, VkDeviceSize offset) {
+          VkBufferMemoryBarrier& barrier = m_bakedBarriers.emplace_back();
+          barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+          barrier.pNext = nullptr;
+          barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          barrier.buffer = buffer;
+          barrier.offset = offset;
+          barrier.size = m_parsed.getBufferByteSize(parsedBuf);
+          // shaders are the only writers, reads only need the execution
+          // dependency
+          barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+          barrier.dstAccessMask = dstAccess;
+        };
+        int transientSlot = m_transientSlots[physicalBuffers[j]];
+        if (transientSlot >= 0)
+          addBarrier(
+              m_transientPool.getBuffer(),
+              m_parsed.m_transientBuffers[transientSlot].offset);
+        for (const auto& buf : m_buffers[physicalBuffers[j]])
+          addBarrier(buf.getBuffer(), 0);
+
+        // Chaining through the stages of the previous barrier keeps earlier
+        // writes visible to the new destination access.
+        BufferSyncState& state = states[physicalBuffers[j]];
+        srcStages |= state.stageFlags | state.pendingStageFlags;
+        dstStages |= barrierDstStages;
+        state = {barrierDstStages, 0};
+      }
+    }
+  }
 
-    img.copyMipToBuffer(commandBuffer, pStaging->getBuffer(), 0, 0);
-    img.transitionLayout(
-        commandBuffer,
-        VK_IMAGE_LAYOUT_GENERAL,
-        VK_ACCESS_NONE,
-        VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+  uint32_t barrierCount =
+      static_cast<uint32_t>(m_bakedBarriers.size()) - firstBarrier;
+  if (barrierCount == 0)
+    return;
 
-    GApplication->addDeletiontask(
-        {[pStaging,
-          width,
-          height,
-          byteSize,
-          fileName = m_pendingSaveImage->m_saveFileName]() {
-           const std::byte* mapped =
-               reinterpret_cast<const std::byte*>(pStaging->mapMemory());
-           Utilities::savePng(
-               fileName,
-               width,
-               height,
-               gsl::span(mapped, byteSize));
-           pStaging->unmapMemory();
-           delete pStaging;
-         },
-         GApplication->getCurrentFrameRingBufferIndex()});
+  BakedCommand& command = baked.commands.emplace_back();
+  command.type = BC_BARRIER;
+  command.idx = firstBarrier;
+  command.params[0] = barrierCount;
+  command.srcStages = srcStages;
+  command.dstStages = dstStages;
+}
 
-    m_pendingSaveImage = std::nullopt;
+void Project::executeBakedTaskList(
+    BakedTaskList& list,
+    VkCommandBuffer commandBuffer,
+    const FrameContext& frame) {
+  // Tasks can only be timed individually when recorded into the frame's
+  // command buffer
+  if (!list.bStatic || m_gpuProfiler.isEnabled()) {
+    recordBakedCommands(list, commandBuffer, frame, false);
+    return;
   }
 
-  if (m_pendingSaveBuffer) {
-    auto& buf = m_buffers[m_pendingSaveBuffer->bufferIdx];
-    // TODO support saving buffer heap...
-    assert(buf.size() == 1);
-    const auto& desc = m_parsed.m_buffers[m_pendingSaveBuffer->bufferIdx];
-    const auto& s = m_parsed.m_structDefs[desc.structIdx];
-    size_t byteSize = s.size * desc.elemCount;
-    BufferAllocation* pStaging = new BufferAllocation(
-        BufferUtilities::createStagingBufferForDownload(byteSize));
+  uint32_t ringIdx = frame.frameRingBufferIndex;
+  uint32_t swapMask = m_pingPongSwapMask;
+  VkCommandBuffer& recorded = list.recorded[ringIdx][swapMask];
+  if (!list.bRecorded[ringIdx][swapMask]) {
+    // The recording was invalidated after this frame's command buffer already
+    // executed it, e.g. by push constants changing between two runs of the
+    // block. It has to stay untouched until the frame completes, so the list
+    // is recorded inline for the rest of the frame.
+    if (list.executedDraw[ringIdx][swapMask] == m_drawIdx) {
+      recordBakedCommands(list, commandBuffer, frame, false);
+      return;
+    }
 
-    VkBufferCopy2 region{};
-    region.sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2;
-    region.dstOffset = 0;
-    region.srcOffset = 0;
-    region.size = byteSize;
-    region.pNext = nullptr;
+    // Whichever frame last executed the recording used the same ring buffer
+    // slot and has completed. Rather than resetting it, which the engine's
+    // command pool may not allow, the recording is replaced by a fresh one.
+    if (recorded != VK_NULL_HANDLE) {
+      vkFreeCommandBuffers(
+          GApplication->getDevice(),
+          GApplication->getCommandPool(),
+          1,
+          &recorded);
+      recorded = VK_NULL_HANDLE;
+    }
 
-    VkCopyBufferInfo2 copy{};
-    copy.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2;
-    copy.dstBuffer = pStaging->getBuffer();
-    copy.srcBuffer = buf[0].getBuffer();
-    copy.pRegions = &region;
-    copy.regionCount = 1;
-    copy.pNext = nullptr;
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = GApplication->getCommandPool();
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(
+            GApplication->getDevice(),
+            &allocInfo,
+            &recorded) != VK_SUCCESS) {
+      recorded = VK_NULL_HANDLE;
+      recordBakedCommands(list, commandBuffer, frame, false);
+      return;
+    }
 
-    VkBufferMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-    barrier.buffer = buf[0].getBuffer();
-    barrier.offset = 0;
-    barrier.size = byteSize;
-    barrier.srcAccessMask =
-        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    // Task blocks may be run several times within the same frame
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+
+    vkBeginCommandBuffer(recorded, &beginInfo);
+    recordBakedCommands(list, recorded, frame, true);
+    vkEndCommandBuffer(recorded);
+    list.bRecorded[ringIdx][swapMask] = true;
+    list.pingPongFlipMask = m_pingPongSwapMask ^ swapMask;
+  }
 
-    VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT;
-    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        srcStage,
+  vkCmdExecuteCommands(commandBuffer, 1, &recorded);
+  list.executedDraw[ringIdx][swapMask] = m_drawIdx;
+  m_pingPongSwapMask = swapMask ^ list.pingPongFlipMask;
+}
+
+void Project::recordBakedCommands(
+    const BakedTaskList& list,
+    VkCommandBuffer commandBuffer,
+    const FrameContext& frame,
+    bool bSecondary) {
+  recordBakedCommandRange(
+      list,
+      0,
+      list.commands.size(),
+      commandBuffer,
+      frame,
+      bSecondary);
+}
+
+void Project::recordBakedCommandRange(
+    const BakedTaskList& list,
+    size_t begin,
+    size_t end,
+    VkCommandBuffer commandBuffer,
+    const FrameContext& frame,
+    bool bSecondary) {
+  VkDescriptorSet sets[] = {
+      GGlobalHeap->getDescriptorSet(),
+      getProjectDescriptorSet(frame)};
+
+  // consecutive dispatches of the same shader share their bindings
+  uint32_t boundPipeline = ~0u;
+  for (size_t commandIdx = begin; commandIdx < end; commandIdx++) {
+    const BakedCommand& command = list.commands[commandIdx];
+    switch (command.type) {
+    case BC_DISPATCH:
+    case BC_DISPATCH_INDIRECT: {
+      // indirect dispatches are never folded
+      uint32_t groupCountX =
+          (command.type == BC_DISPATCH) ? command.params[3] : 0;
+      if (command.idx != boundPipeline ||
+          groupCountX != m_pushData.groupCountX) {
+        ComputePipeline& c = m_computePipelines[command.idx];
+        if (command.idx != boundPipeline) {
+          c.bindPipeline(commandBuffer);
+          c.bindDescriptorSets(commandBuffer, sets, 2);
+          boundPipeline = command.idx;
+        }
+        m_pushData.groupCountX = groupCountX;
+        c.setPushConstants(commandBuffer, m_pushData);
+      }
+
+      uint32_t scope = m_gpuProfiler.beginScope(
+          commandBuffer,
+          m_parsed.m_computeShaders[command.idx].name,
+          true);
+      if (command.type == BC_DISPATCH_INDIRECT)
+        vkCmdDispatchIndirect(commandBuffer, command.buffer, command.params[0]);
+      else
+        vkCmdDispatch(
+            commandBuffer,
+            command.params[0],
+            command.params[1],
+            command.params[2]);
+      m_gpuProfiler.endScope(commandBuffer, scope);
+      break;
+    }
+
+    case BC_BARRIER: {
+      vkCmdPipelineBarrier(
+          commandBuffer,
+          command.srcStages,
+          command.dstStages,
+          0,
+          0,
+          nullptr,
+          command.params[0],
+          &m_bakedBarriers[command.idx],
+          0,
+          nullptr);
+      break;
+    }
+
+    case BC_RENDER: {
+      uint32_t scope = m_gpuProfiler.beginScope(
+          commandBuffer,
+          m_parsed.m_renderPasses[command.idx].name,
+          true);
+      executeRenderPass(command.idx, commandBuffer, frame);
+      m_gpuProfiler.endScope(commandBuffer, scope);
+      boundPipeline = ~0u;
+      break;
+    }
+
+    case BC_TRANSITION: {
+      m_images[command.idx].image.transitionLayout(
+          commandBuffer,
+          static_cast<VkImageLayout>(command.params[0]),
+          static_cast<VkAccessFlags>(command.params[1]),
+          command.dstStages);
+      break;
+    }
+
+    case BC_TASK: {
+      // TODO: would be nice to handle this without recursion, but this should
+      // be safe since it is validated during parsing
+      BakedTaskList& block = m_bakedTaskBlocks[command.idx];
+      // not this block's frame, nothing is recorded
+      if (m_frameCount % block.cadenceInterval != block.cadencePhase)
+        break;
+      // secondary command buffers cannot execute other secondaries, the
+      // block is recorded inline instead. Secondaries would not inherit the
+      // predicate of an if on a buffer either.
+      if (bSecondary || m_bInGpuCondition) {
+        recordBakedCommands(block, commandBuffer, frame, bSecondary);
+      } else {
+        uint32_t scope = m_gpuProfiler.beginScope(
+            commandBuffer,
+            m_parsed.m_taskBlocks[command.idx].name,
+            false);
+        executeBakedTaskList(block, commandBuffer, frame);
+        m_gpuProfiler.endScope(commandBuffer, scope);
+      }
+      // the block may have left the ping_pong pairs swapped
+      sets[1] = getProjectDescriptorSet(frame);
+      boundPipeline = ~0u;
+      break;
+    }
+
+    case BC_REPEAT: {
+      size_t bodyBegin = commandIdx + 1;
+      size_t bodyEnd = bodyBegin + command.params[0];
+      uint32_t count = getRepeatCount(command.idx);
+      for (uint32_t i = 0; i < count; i++) {
+        recordBakedCommandRange(
+            list,
+            bodyBegin,
+            bodyEnd,
+            commandBuffer,
+            frame,
+            bSecondary);
+        // the next iteration reads what this one wrote
+        m_pingPongSwapMask ^= m_parsed.m_repeats[command.idx].pingPongMask;
+      }
+      commandIdx = bodyEnd - 1;
+      sets[1] = getProjectDescriptorSet(frame);
+      boundPipeline = ~0u;
+      break;
+    }
+
+    case BC_IF: {
+      size_t bodyEnd = commandIdx + 1 + command.params[0];
+      if (m_parsed.m_conditions[command.idx].source != ParsedFlr::CS_BUFFER) {
+        // nothing of a skipped body is recorded
+        if (!isConditionMet(command.idx))
+          commandIdx = bodyEnd - 1;
+        break;
+      }
+
+      beginGpuCondition(command.idx, commandBuffer);
+      m_bInGpuCondition = true;
+      recordBakedCommandRange(
+          list,
+          commandIdx + 1,
+          bodyEnd,
+          commandBuffer,
+          frame,
+          bSecondary);
+      m_bInGpuCondition = false;
+      m_pfnEndConditionalRendering(commandBuffer);
+      commandIdx = bodyEnd - 1;
+      sets[1] = getProjectDescriptorSet(frame);
+      boundPipeline = ~0u;
+      break;
+    }
+    };
+  }
+}
+
+uint32_t Project::getRepeatCount(uint32_t repeatIdx) const {
+  const ParsedFlr::Repeat& repeat = m_parsed.m_repeats[repeatIdx];
+  if (repeat.sliderUintIdx >= 0)
+    return *m_parsed.m_sliderUints[repeat.sliderUintIdx].pValue;
+  return repeat.count;
+}
+
+bool Project::isConditionMet(uint32_t conditionIdx) const {
+  const ParsedFlr::Condition& condition = m_parsed.m_conditions[conditionIdx];
+  bool bValue = false;
+  switch (condition.source) {
+  case ParsedFlr::CS_CONST:
+    bValue = condition.idx != 0;
+    break;
+  case ParsedFlr::CS_CHECKBOX:
+    bValue = *m_parsed.m_checkboxes[condition.idx].pValue != 0;
+    break;
+  case ParsedFlr::CS_BUTTON:
+    bValue = *m_parsed.m_buttons[condition.idx].pValue != 0;
+    break;
+  case ParsedFlr::CS_SLIDER_UINT:
+    bValue = *m_parsed.m_sliderUints[condition.idx].pValue != 0;
+    break;
+  case ParsedFlr::CS_SLIDER_INT:
+    bValue = *m_parsed.m_sliderInts[condition.idx].pValue != 0;
+    break;
+  case ParsedFlr::CS_BUFFER:
+    // evaluated on the GPU
+    bValue = true;
+    break;
+  };
+  return bValue != condition.bNegate;
+}
+
+void Project::beginGpuCondition(
+    uint32_t conditionIdx,
+    VkCommandBuffer commandBuffer) {
+  const ParsedFlr::Condition& condition = m_parsed.m_conditions[conditionIdx];
+  VkBuffer predicate = m_buffers[condition.idx][0].getBuffer();
+
+  // the predicate is written by shaders
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = predicate;
+  barrier.offset = 0;
+  barrier.size = sizeof(uint32_t);
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      ALL_SHADER_STAGES,
+      VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT,
+      0,
+      0,
+      nullptr,
+      1,
+      &barrier,
+      0,
+      nullptr);
+
+  VkConditionalRenderingBeginInfoEXT beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+  beginInfo.buffer = predicate;
+  beginInfo.offset = 0;
+  beginInfo.flags =
+      condition.bNegate ? VK_CONDITIONAL_RENDERING_INVERTED_BIT_EXT : 0;
+  m_pfnBeginConditionalRendering(commandBuffer, &beginInfo);
+}
+
+VkDescriptorSet Project::getProjectDescriptorSet(const FrameContext& frame) {
+  if (m_pingPongSwapMask)
+    return m_swappedDescriptorSets[m_pingPongSwapMask - 1]
+        .getCurrentDescriptorSet(frame);
+  return m_descriptorSets.getCurrentDescriptorSet(frame);
+}
+
+void Project::invalidateRecordedTaskLists() {
+  auto invalidate = [](BakedTaskList& list) {
+    for (auto& bRecordedPair : list.bRecorded)
+      for (bool& bRecorded : bRecordedPair)
+        bRecorded = false;
+  };
+  invalidate(m_bakedTaskList);
+  for (BakedTaskList& list : m_bakedTaskBlocks)
+    invalidate(list);
+}
+
+void Project::executeRenderPass(
+    uint32_t passIdx,
+    VkCommandBuffer commandBuffer,
+    const FrameContext& frame) {
+  VkDescriptorSet sets[] = {
+      GGlobalHeap->getDescriptorSet(),
+      getProjectDescriptorSet(frame)};
+
+  const auto& passDesc = m_parsed.m_renderPasses[passIdx];
+  auto& drawPass = m_drawPasses[passIdx];
+
+  {
+    ActiveRenderPass pass = drawPass.m_renderPass.begin(
+        *GApplication,
+        commandBuffer,
+        frame,
+        drawPass.m_frameBuffer);
+    pass.setGlobalDescriptorSets(gsl::span(sets, 2));
+    pass.getDrawContext().bindDescriptorSets();
+    pass.getDrawContext().updatePushConstants(m_pushData, 0);
+    for (const auto& draw : passDesc.draws) {
+      switch (draw.drawMode) {
+      case ParsedFlr::DM_DRAW: {
+        pass.getDrawContext().draw(draw.param0, draw.param1);
+        break;
+      }
+      case ParsedFlr::DM_DRAW_INDEXED: {
+        const auto& b = m_buffers[draw.param1][draw.param2];
+        uint32_t indexCount = m_parsed.m_buffers[draw.param1].elemCount;
+        vkCmdBindIndexBuffer(
+            commandBuffer,
+            b.getBuffer(),
+            0,
+            VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexed(commandBuffer, indexCount, draw.param0, 0, 0, 0);
+        break;
+      }
+      case ParsedFlr::DM_DRAW_INDIRECT: {
+        const auto& b = m_buffers[draw.param0];
+        assert(b.size() == 1);
+        vkCmdDrawIndirect(
+            commandBuffer,
+            b[draw.param2].getBuffer(),
+            0,
+            draw.param1,
+            16);
+        break;
+      }
+      case ParsedFlr::DM_DRAW_OBJ: {
+        SimpleObjLoader::LoadedObj& obj = m_objModels[draw.param0];
+        for (SimpleObjLoader::LoadedObjMesh& mesh : obj.m_meshes) {
+          pass.getDrawContext().bindIndexBuffer(mesh.m_indices);
+          pass.getDrawContext().bindVertexBuffer(obj.m_vertices);
+          pass.getDrawContext().drawIndexed(
+              mesh.m_indices.getIndexCount(),
+              draw.param1);
+        }
+        break;
+      }
+      };
+
+      if (!pass.isLastSubpass())
+        pass.nextSubpass();
+    }
+  }
+
+  for (const auto& attachmentRef : passDesc.attachments)
+    m_images[attachmentRef.imageIdx].image.clearLayout();
+}
+
+void Project::recordImageSave(
+    uint32_t imageIdx,
+    const std::string& fileName,
+    VkCommandBuffer commandBuffer) {
+  auto& img = m_images[imageIdx].image;
+  // only rgba8 images are saved, see saveImage()
+  assert(
+      img.getOptions().format == VK_FORMAT_R8G8B8A8_UNORM ||
+      img.getOptions().format == VK_FORMAT_R8G8B8A8_SRGB);
+  uint32_t width = img.getOptions().width;
+  uint32_t height = img.getOptions().height;
+  size_t byteSize = width * height * 4;
+  BufferAllocation* pStaging = new BufferAllocation(
+      BufferUtilities::createStagingBufferForDownload(byteSize));
+
+  img.copyMipToBuffer(commandBuffer, pStaging->getBuffer(), 0, 0);
+  img.transitionLayout(
+      commandBuffer,
+      VK_IMAGE_LAYOUT_GENERAL,
+      VK_ACCESS_NONE,
+      VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+
+  GApplication->addDeletiontask(
+      {[pStaging, width, height, byteSize, fileName]() {
+         const std::byte* mapped =
+             reinterpret_cast<const std::byte*>(pStaging->mapMemory());
+         Utilities::savePng(
+             fileName,
+             width,
+             height,
+             gsl::span(mapped, byteSize));
+         pStaging->unmapMemory();
+         delete pStaging;
+       },
+       GApplication->getCurrentFrameRingBufferIndex()});
+}
+
+bool Project::saveImage(
+    const char* imageName,
+    const std::string& fileName,
+    VkCommandBuffer commandBuffer,
+    std::string& errMsg) {
+  uint32_t imageIdx = m_parsed.m_displayImageIdx;
+  if (imageName && *imageName) {
+    imageIdx = ~0u;
+    for (uint32_t i = 0; i < m_parsed.m_images.size(); i++)
+      if (m_parsed.m_images[i].name == imageName)
+        imageIdx = i;
+    if (imageIdx == ~0u) {
+      errMsg = std::string("Could not find image ") + imageName;
+      return false;
+    }
+  }
+
+  // the png is written straight from the downloaded texels
+  VkFormat format = m_parsed.m_images[imageIdx].createOptions.format;
+  if (format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB) {
+    errMsg = "Saving image " + m_parsed.m_images[imageIdx].name +
+             " is not supported, only rgba8 images can be saved.";
+    return false;
+  }
+
+  recordImageSave(imageIdx, fileName, commandBuffer);
+  return true;
+}
+
+void Project::draw(VkCommandBuffer commandBuffer, const FrameContext& frame) {
+  FLR_TRACE_ZONE("Project::draw");
+  m_drawIdx++;
+  m_gpuProfiler.beginFrame(commandBuffer, frame);
+
+  if (m_pendingSaveImage) {
+    recordImageSave(
+        m_pendingSaveImage->imageIdx,
+        m_pendingSaveImage->m_saveFileName,
+        commandBuffer);
+    m_pendingSaveImage = std::nullopt;
+  }
+
+  if (m_pendingSaveBuffer) {
+    auto& buf = m_buffers[m_pendingSaveBuffer->bufferIdx];
+    // TODO support saving buffer heap...
+    assert(buf.size() == 1);
+    const auto& desc = m_parsed.m_buffers[m_pendingSaveBuffer->bufferIdx];
+    const auto& s = m_parsed.m_structDefs[desc.structIdx];
+    size_t byteSize = m_parsed.getBufferByteSize(desc);
+    BufferAllocation* pStaging = new BufferAllocation(
+        BufferUtilities::createStagingBufferForDownload(byteSize));
+
+    VkBufferCopy2 region{};
+    region.sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2;
+    region.dstOffset = 0;
+    region.srcOffset = 0;
+    region.size = byteSize;
+    region.pNext = nullptr;
+
+    VkCopyBufferInfo2 copy{};
+    copy.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2;
+    copy.dstBuffer = pStaging->getBuffer();
+    copy.srcBuffer = buf[0].getBuffer();
+    copy.pRegions = &region;
+    copy.regionCount = 1;
+    copy.pNext = nullptr;
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.buffer = buf[0].getBuffer();
+    barrier.offset = 0;
+    barrier.size = byteSize;
+    barrier.srcAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStage,
         dstStage,
         0,
         0,
@@ -1130,11 +2045,26 @@ void Project::draw(VkCommandBuffer commandBuffer, const FrameContext& frame) {
     GApplication->addDeletiontask(
         {[pStaging,
           byteSize,
+          desc,
+          structSize = s.size,
           fileName = m_pendingSaveBuffer->m_saveFileName]() {
            void* pMapped = pStaging->mapMemory();
-           Utilities::writeFile(
-               fileName,
-               gsl::span((const char*)pMapped, byteSize));
+           // saved files hold the array of structs, like buffer files
+           if (desc.isSoa()) {
+             std::vector<char> aos(size_t(structSize) * desc.elemCount);
+             ParsedFlr::unpackSoa(
+                 desc,
+                 structSize,
+                 (const char*)pMapped,
+                 aos.data());
+             Utilities::writeFile(
+                 fileName,
+                 gsl::span((const char*)aos.data(), aos.size()));
+           } else {
+             Utilities::writeFile(
+                 fileName,
+                 gsl::span((const char*)pMapped, byteSize));
+           }
            pStaging->unmapMemory();
            delete pStaging;
          },
@@ -1156,13 +2086,105 @@ void Project::draw(VkCommandBuffer commandBuffer, const FrameContext& frame) {
     executeTaskBlock(TaskBlockId(taskBlockIdx), commandBuffer, frame);
   m_pendingTaskBlockExecs.clear();
 
-  executeTaskList(m_parsed.m_taskList, commandBuffer, frame);
+  runSimulation(commandBuffer, frame);
+
+  executeBakedTaskList(m_bakedTaskList, commandBuffer, frame);
+}
+
+void Project::advanceSimulation(float deltaTime) {
+  const ParsedFlr::SimulationTask& sim = m_parsed.m_simulationTask;
+  if (sim.taskBlockIdx < 0)
+    return;
+
+  m_simulationTime += m_substepCount * m_substepDeltaTime;
+
+  if (sim.mode == ParsedFlr::SM_SUBSTEPS) {
+    m_substepCount = sim.substepCount;
+    m_substepDeltaTime = deltaTime / sim.substepCount;
+    return;
+  }
+
+  m_substepDeltaTime = 1.0f / sim.rate;
+  m_simulationAccumulator += deltaTime;
+  m_substepCount =
+      static_cast<uint32_t>(m_simulationAccumulator / m_substepDeltaTime);
+  if (m_substepCount > sim.substepCount) {
+    // Falling behind, the simulation slows down instead of trying to catch
+    // up on later frames
+    m_substepCount = sim.substepCount;
+    m_simulationAccumulator = 0.0f;
+  } else {
+    m_simulationAccumulator -= m_substepCount * m_substepDeltaTime;
+  }
+}
+
+void Project::runSimulation(
+    VkCommandBuffer commandBuffer,
+    const FrameContext& frame) {
+  if (m_substepCount == 0)
+    return;
+
+  uint32_t blockIdx =
+      static_cast<uint32_t>(m_parsed.m_simulationTask.taskBlockIdx);
+  uint32_t scope = m_gpuProfiler.beginScope(
+      commandBuffer,
+      m_parsed.m_taskBlocks[blockIdx].name,
+      false);
+
+  // Inferred barriers make no assumption about what ran before the block, so
+  // consecutive steps are already ordered. Hand-written ones only order the
+  // tasks within a step, each step has to see everything the previous one
+  // wrote, and so do the tasks after the simulation.
+  VkMemoryBarrier stepBarrier{};
+  stepBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  stepBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  stepBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+  auto recordStepBarrier = [&]() {
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        ALL_SHADER_STAGES,
+        ALL_SHADER_STAGES | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+        0,
+        1,
+        &stepBarrier,
+        0,
+        nullptr,
+        0,
+        nullptr);
+  };
+
+  // Every step pushes its own index, so the block is recorded inline rather
+  // than replayed, along with any blocks it runs
+  for (uint32_t i = 0; i < m_substepCount; i++) {
+    if (i > 0 && !m_parsed.m_bInferBarriers)
+      recordStepBarrier();
+    m_pushData.substepIdx = i;
+    recordBakedCommands(
+        m_bakedTaskBlocks[blockIdx],
+        commandBuffer,
+        frame,
+        true);
+  }
+  m_pushData.substepIdx = 0;
+  if (!m_parsed.m_bInferBarriers)
+    recordStepBarrier();
+
+  m_gpuProfiler.endScope(commandBuffer, scope);
 }
 
 void Project::tryRecompile() {
   m_failedShaderCompile = false;
   *m_shaderCompileErrMsg = 0;
 
+  // recorded task lists reference the pipelines being replaced
+  invalidateRecordedTaskLists();
+
+  std::lock_guard<std::mutex> compilerLock(getShaderCompilerMutex());
+
   std::string error;
   for (auto& c : m_computePipelines) {
     c.tryRecompile(*GApplication);
@@ -1313,531 +2335,6 @@ void Project::loadOptions() {
   stream.close();
 }
 
-void Project::codeGenGlsl(const std::filesystem::path& autoGenFileName) {
-  assert(m_parsed.m_language == SHADER_LANGUAGE_GLSL);
-
-  const uint32_t BUF_SIZE = 10000;
-  char* codeBuf = new char[BUF_SIZE];
-  size_t codeOffs = 0;
-  memset(codeBuf, 0, BUF_SIZE);
-
-#define CODE_APPEND(...)                                                       \
-  codeOffs += snprintf(codeBuf + codeOffs, BUF_SIZE - codeOffs, __VA_ARGS__)
-
-  // glsl version / common includes
-  CODE_APPEND("#version 460 core\n\n");
-
-  // constant declarations
-  for (const auto& c : m_parsed.m_constInts)
-    CODE_APPEND("#define %s %d\n", c.name.c_str(), c.value);
-  for (const auto& c : m_parsed.m_constUints)
-    CODE_APPEND("#define %s %u\n", c.name.c_str(), c.value);
-  for (const auto& c : m_parsed.m_constFloats)
-    CODE_APPEND("#define %s %f\n", c.name.c_str(), c.value);
-  CODE_APPEND("\n");
-
-  // struct declarations
-  for (const auto& s : m_parsed.m_structDefs) {
-    if (s.body.size() > 0) // skip dummy structs
-      CODE_APPEND("%s;\n\n", s.body.c_str());
-  }
-
-  // resource declarations
-  uint32_t slot = 0;
-  {
-    slot++;
-
-    for (int i = 0; i < m_buffers.size(); ++i) {
-      const auto& parsedBuf = m_parsed.m_buffers[i];
-      const auto& structdef = m_parsed.m_structDefs[parsedBuf.structIdx];
-
-      if (parsedBuf.bufferCount == 1) {
-        CODE_APPEND(
-            "layout(set=1,binding=%u) %sbuffer BUFFER_%s {  %s %s[]; };\n",
-            slot++,
-            parsedBuf.isReadOnly() ? "readonly " : "",
-            parsedBuf.name.c_str(),
-            structdef.name.c_str(),
-            parsedBuf.name.c_str());
-      } else {
-        CODE_APPEND(
-            "layout(set=1,binding=%u) %sbuffer BUFFER_%s {  %s _INNER_%s[]; } "
-            "_HEAP_%s [%u];\n",
-            slot++,
-            parsedBuf.isReadOnly() ? "readonly " : "",
-            parsedBuf.name.c_str(),
-            structdef.name.c_str(),
-            parsedBuf.name.c_str(),
-            parsedBuf.name.c_str(),
-            parsedBuf.bufferCount);
-        CODE_APPEND(
-            "#define %s(IDX) _HEAP_%s[IDX]._INNER_%s\n",
-            parsedBuf.name.c_str(),
-            parsedBuf.name.c_str(),
-            parsedBuf.name.c_str());
-      }
-    }
-
-    for (int i = 0; i < m_images.size(); ++i) {
-      const auto& desc = m_parsed.m_images[i];
-      if ((desc.createOptions.usage & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
-        continue;
-
-      CODE_APPEND(
-          "layout(set=1,binding=%u, %s) uniform image2D %s;\n",
-          slot++,
-          desc.format.c_str(),
-          desc.name.c_str());
-    }
-
-    for (int i = 0; i < m_parsed.m_textures.size(); ++i) {
-      const auto& txDesc = m_parsed.m_textures[i];
-      assert(txDesc.imageIdx >= 0 || txDesc.texFileIdx >= 0);
-      CODE_APPEND(
-          "layout(set=1,binding=%u) uniform sampler2D %s;\n",
-          slot++,
-          txDesc.name.c_str());
-    }
-
-    if (m_bHasDynamicData) {
-      CODE_APPEND(
-          "\nlayout(set=1, binding=%u) uniform _UserUniforms {\n",
-          slot++);
-
-      for (const auto& cpicker : m_parsed.m_colorPickers) {
-        CODE_APPEND("\tvec4 %s;\n", cpicker.name.c_str());
-      }
-      for (const auto& uslider : m_parsed.m_sliderUints) {
-        CODE_APPEND("\tuint %s;\n", uslider.name.c_str());
-      }
-      for (const auto& islider : m_parsed.m_sliderInts) {
-        CODE_APPEND("\tint %s;\n", islider.name.c_str());
-      }
-      for (const auto& fslider : m_parsed.m_sliderFloats) {
-        CODE_APPEND("\tfloat %s;\n", fslider.name.c_str());
-      }
-      for (const auto& checkbox : m_parsed.m_checkboxes) {
-        CODE_APPEND("\tbool %s;\n", checkbox.name.c_str());
-      }
-      for (const auto& button : m_parsed.m_buttons) {
-        CODE_APPEND("\tbool %s;\n", button.name.c_str());
-      }
-
-      CODE_APPEND("};\n\n");
-    }
-  }
-
-  // includes
-  CODE_APPEND("#include <FlrLib/Fluorescence.glsl>\n\n");
-
-  // camera uniforms (references included structs)
-  if (m_parsed.isFeatureEnabled(ParsedFlr::FF_PERSPECTIVE_CAMERA)) {
-    CODE_APPEND(
-        "layout(set=1, binding=%u) uniform _CameraUniforms { PerspectiveCamera "
-        "camera; };\n\n",
-        slot++);
-  }
-
-  // audio uniforms
-  if (m_parsed.isFeatureEnabled(ParsedFlr::FF_SYSTEM_AUDIO_INPUT)) {
-    CODE_APPEND(
-        "layout(set=1, binding=%u) uniform _AudioUniforms { AudioInput "
-        "audio; };\n\n",
-        slot++);
-  }
-
-  for (int i = 0; i < m_objModels.size(); ++i) {
-    const auto& objName = m_parsed.m_objModels[i].name;
-    const auto& obj = m_objModels[i];
-    CODE_APPEND(
-        "layout(set=1,binding=%u) readonly buffer BUFFER_%s_VB { ObjVertex "
-        "%s_vertices[]; };\n",
-        slot++,
-        objName.c_str(),
-        objName.c_str());
-    CODE_APPEND(
-        "layout(set=1,binding=%u) readonly buffer BUFFER_%s_IB { uint "
-        "%s_indices[]; };\n",
-        slot++,
-        objName.c_str(),
-        objName.c_str());
-  }
-
-  // auto-gen pixel shader block, pre-include of user-file
-  {
-    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
-    for (const auto& pass : m_parsed.m_renderPasses) {
-      for (const auto& draw : pass.draws) {
-        CODE_APPEND(
-            "#if defined(_ENTRY_POINT_%s) && "
-            "!defined(_ENTRY_POINT_%s_ATTACHMENTS)\n",
-            draw.pixelShader.c_str(),
-            draw.pixelShader.c_str());
-        CODE_APPEND(
-            "#define _ENTRY_POINT_%s_ATTACHMENTS\n",
-            draw.pixelShader.c_str());
-        uint32_t colorAttachmentIdx = 0;
-        for (const auto& attachmentRef : pass.attachments) {
-          const auto& img = m_images[attachmentRef.imageIdx];
-          if ((img.image.getOptions().usage &
-               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
-            CODE_APPEND(
-                "layout(location = %d) out vec4 %s;\n",
-                colorAttachmentIdx++,
-                attachmentRef.aliasName.c_str());
-          }
-        }
-        CODE_APPEND("#endif // _ENTRY_POINT_%s\n", draw.pixelShader.c_str());
-      }
-    }
-    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
-  }
-
-  std::filesystem::path shaderFileName = m_projPath;
-  shaderFileName.replace_extension(".glsl");
-
-  std::string userShaderName = shaderFileName.filename().string();
-  CODE_APPEND("#include \"%s\"\n\n", userShaderName.c_str());
-
-  // auto-gen compute shader block, post-include of user-file
-  {
-    CODE_APPEND("#ifdef IS_COMP_SHADER\n");
-    for (const auto& c : m_parsed.m_computeShaders) {
-      CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", c.name.c_str());
-      if (c.groupSizeX > 0 && c.groupSizeY > 0 && c.groupSizeZ > 0) {
-        CODE_APPEND(
-            "layout(local_size_x = %u, local_size_y = %u, local_size_z = %u) "
-            "in;\n",
-            c.groupSizeX,
-            c.groupSizeY,
-            c.groupSizeZ);
-        CODE_APPEND("void main() { %s(); }\n", c.name.c_str());
-      } else {
-        CODE_APPEND("#define %s main\n", c.name.c_str());
-      }
-      CODE_APPEND("#endif // _ENTRY_POINT_%s\n", c.name.c_str());
-    }
-    CODE_APPEND("#endif // IS_COMP_SHADER\n");
-  }
-
-  // auto-gen vertex shader block, post-include of user-file
-  {
-    CODE_APPEND("\n\n#ifdef IS_VERTEX_SHADER\n");
-    for (const auto& pass : m_parsed.m_renderPasses) {
-      for (const auto& draw : pass.draws) {
-        CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", draw.vertexShader.c_str());
-        if (draw.vertexOutputStructIdx >= 0) {
-          CODE_APPEND(
-              "layout(location = 0) out %s _VERTEX_OUTPUT;\n",
-              m_parsed.m_structDefs[draw.vertexOutputStructIdx].name.c_str());
-          CODE_APPEND(
-              "void main() { _VERTEX_OUTPUT = %s(%s); }\n",
-              draw.vertexShader.c_str(),
-              (draw.drawMode == ParsedFlr::DM_DRAW_OBJ) ? "FS_ObjVertex()" : "");
-        } else {
-          CODE_APPEND("void main() { %s(%s); }\n", 
-            draw.vertexShader.c_str(),
-            (draw.drawMode == ParsedFlr::DM_DRAW_OBJ) ? "FS_ObjVertex()" : "");
-        }
-        CODE_APPEND("#endif // _ENTRY_POINT_%s\n", draw.vertexShader.c_str());
-      }
-    }
-    CODE_APPEND("#endif // IS_VERTEX_SHADER\n");
-  }
-
-  // auto-gen pixel shader block, post-include of user-file
-  {
-    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
-    for (const auto& pass : m_parsed.m_renderPasses) {
-      for (const auto& draw : pass.draws) {
-        CODE_APPEND(
-            "#if defined(_ENTRY_POINT_%s) && "
-            "!defined(_ENTRY_POINT_%s_INTERPOLANTS)\n",
-            draw.pixelShader.c_str(),
-            draw.pixelShader.c_str());
-        CODE_APPEND(
-            "#define _ENTRY_POINT_%s_INTERPOLANTS\n",
-            draw.pixelShader.c_str());
-
-        if (draw.vertexOutputStructIdx >= 0) {
-          CODE_APPEND(
-              "layout(location = 0) in %s _VERTEX_INPUT;\n",
-              m_parsed.m_structDefs[draw.vertexOutputStructIdx].name.c_str());
-          CODE_APPEND(
-              "void main() { %s(_VERTEX_INPUT); }\n",
-              draw.pixelShader.c_str());
-        } else {
-          CODE_APPEND("void main() { %s(); }\n", draw.pixelShader.c_str());
-        }
-        CODE_APPEND("#endif // _ENTRY_POINT_%s\n", draw.pixelShader.c_str());
-      }
-    }
-    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
-  }
-#undef CODE_APPEND
-
-  std::ofstream autoGenFile(autoGenFileName);
-  if (autoGenFile.is_open()) {
-    autoGenFile.write(codeBuf, codeOffs);
-    autoGenFile.close();
-  }
-
-  delete[] codeBuf;
-}
-
-void Project::codeGenHlsl(const std::filesystem::path& autoGenFileName) {
-  assert(m_parsed.m_language == SHADER_LANGUAGE_HLSL);
-
-  const uint32_t BUF_SIZE = 10000;
-  char* codeBuf = new char[BUF_SIZE];
-  size_t codeOffs = 0;
-  memset(codeBuf, 0, BUF_SIZE);
-
-#define CODE_APPEND(...)                                                       \
-  codeOffs += snprintf(codeBuf + codeOffs, BUF_SIZE - codeOffs, __VA_ARGS__)
-
-  // constant declarations
-  for (const auto& c : m_parsed.m_constInts)
-    CODE_APPEND("#define %s %d\n", c.name.c_str(), c.value);
-  for (const auto& c : m_parsed.m_constUints)
-    CODE_APPEND("#define %s %u\n", c.name.c_str(), c.value);
-  for (const auto& c : m_parsed.m_constFloats)
-    CODE_APPEND("#define %s %f\n", c.name.c_str(), c.value);
-  CODE_APPEND("\n");
-
-  // struct declarations
-  for (const auto& s : m_parsed.m_structDefs) {
-    if (s.body.size() > 0) // skip dummy structs
-      CODE_APPEND("%s;\n\n", s.body.c_str());
-  }
-
-  // resource declarations
-  uint32_t slot = 0;
-  {
-    slot++;
-
-    for (int i = 0; i < m_buffers.size(); ++i) {
-      const auto& parsedBuf = m_parsed.m_buffers[i];
-      const auto& structdef = m_parsed.m_structDefs[parsedBuf.structIdx];
-
-      if (parsedBuf.bufferCount == 1) {
-        CODE_APPEND(
-            "[[vk::binding(%u, 1)]] %sStructuredBuffer<%s> %s;\n",
-            slot++,
-            parsedBuf.isReadOnly() ? "" : "RW",
-            structdef.name.c_str(),
-            parsedBuf.name.c_str());
-      } else {
-        assert(false); // TODO impl support for buffer heaps...
-        /*  CODE_APPEND(
-            "layout(set=1,binding=%u) buffer BUFFER_%s {  %s _INNER_%s[]; } _HEAP_%s [%u];\n",
-            slot++,
-            parsedBuf.name.c_str(),
-            structdef.name.c_str(),
-            parsedBuf.name.c_str(),
-            parsedBuf.name.c_str(),
-            parsedBuf.bufferCount);
-          CODE_APPEND(
-            "#define %s(IDX) _HEAP_%s[IDX]._INNER_%s\n",
-            parsedBuf.name.c_str(),
-            parsedBuf.name.c_str(),
-            parsedBuf.name.c_str());*/
-      }
-    }
-
-    for (int i = 0; i < m_images.size(); ++i) {
-      const auto& desc = m_parsed.m_images[i];
-      if ((desc.createOptions.usage & VK_IMAGE_USAGE_STORAGE_BIT) == 0)
-        continue;
-
-      CODE_APPEND(
-          "[[vk::binding(%u, 1)]] RWTexture2D<%s> %s;\n",
-          slot++,
-          desc.format.c_str(),
-          desc.name.c_str());
-    }
-
-    for (int i = 0; i < m_parsed.m_textures.size(); ++i) {
-      const auto& txDesc = m_parsed.m_textures[i];
-      assert(txDesc.imageIdx >= 0 || txDesc.texFileIdx >= 0);
-      CODE_APPEND(
-          "[[vk::binding(%u, 1)]] Texture2D %s;\n",
-          slot++,
-          txDesc.name.c_str());
-    }
-
-    if (m_bHasDynamicData) {
-      CODE_APPEND("\n[[vk::binding(%u, 1)]] cbuffer _UserUniforms {\n", slot++);
-
-      for (const auto& cpicker : m_parsed.m_colorPickers) {
-        CODE_APPEND("\tfloat4 %s;\n", cpicker.name.c_str());
-      }
-      for (const auto& uslider : m_parsed.m_sliderUints) {
-        CODE_APPEND("\tuint %s;\n", uslider.name.c_str());
-      }
-      for (const auto& islider : m_parsed.m_sliderInts) {
-        CODE_APPEND("\tint %s;\n", islider.name.c_str());
-      }
-      for (const auto& fslider : m_parsed.m_sliderFloats) {
-        CODE_APPEND("\tfloat %s;\n", fslider.name.c_str());
-      }
-      for (const auto& checkbox : m_parsed.m_checkboxes) {
-        CODE_APPEND("\tbool %s;\n", checkbox.name.c_str());
-      }
-      for (const auto& button : m_parsed.m_buttons) {
-        CODE_APPEND("\tbool %s;\n", button.name.c_str());
-      }
-
-      CODE_APPEND("};\n\n");
-    }
-  }
-
-  // TODO - both compute shader and vertex shader entry points are compiled
-  // by swapping in "main" via macros
-  // Would be better to use the compiler feature that does this automatically
-  for (const auto& c : m_parsed.m_computeShaders) {
-    CODE_APPEND("#ifdef _ENTRY_POINT_%s\n", c.name.c_str());
-    CODE_APPEND("#define %s main\n", c.name.c_str());
-    CODE_APPEND("#endif // _ENTRY_POINT_%s\n\n", c.name.c_str());
-  }
-
-  {
-    CODE_APPEND("\n\n#ifdef IS_VERTEX_SHADER\n");
-    for (const auto& pass : m_parsed.m_renderPasses) {
-      for (const auto& draw : pass.draws) {
-        CODE_APPEND(
-            "#if defined(_ENTRY_POINT_%s) && !defined(%s)\n",
-            draw.vertexShader.c_str(),
-            draw.vertexShader.c_str());
-        CODE_APPEND("#define %s main\n", draw.vertexShader.c_str());
-        CODE_APPEND(
-            "#endif // defined(_ENTRY_POINT_%s) && !defined(%s)\n\n",
-            draw.vertexShader.c_str(),
-            draw.vertexShader.c_str());
-      }
-    }
-    CODE_APPEND("#endif // IS_VERTEX_SHADER\n\n");
-  }
-
-  // TODO have a special subdir for hlsl versions of FlrLib ?
-  // includes
-  CODE_APPEND("#include <FlrLib/Fluorescence.hlsl>\n\n");
-
-  // camera uniforms (references included structs)
-  if (m_parsed.isFeatureEnabled(ParsedFlr::FF_PERSPECTIVE_CAMERA)) {
-    CODE_APPEND(
-        "[[vk::binding(%u, 1)]] cbuffer _CameraUniforms { PerspectiveCamera "
-        "camera; };\n\n",
-        slot++);
-  }
-
-  // audio uniforms
-  if (m_parsed.isFeatureEnabled(ParsedFlr::FF_SYSTEM_AUDIO_INPUT)) {
-    CODE_APPEND(
-        "[[vk::binding(%u, 1)]] cbuffer _AudioUniforms { AudioInput audio; "
-        "};\n\n",
-        slot++);
-  }
-
-  for (int i = 0; i < m_objModels.size(); ++i) {
-    const auto& objName = m_parsed.m_objModels[i].name;
-    const auto& obj = m_objModels[i];
-    CODE_APPEND(
-        "[[vk::binding(%u, 1)]] StructuredBuffer<ObjVertex> %s_vertices;\n",
-        slot++,
-        objName.c_str());
-    CODE_APPEND(
-        "[[vk::binding(%u, 1)]] Buffer<uint> %s_indices;\n",
-        slot++,
-        objName.c_str());
-  }
-
-  // auto-gen pixel shader block, pre-include of user-file
-  {
-    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
-    for (const auto& pass : m_parsed.m_renderPasses) {
-      for (const auto& attachmentRef : pass.attachments) {
-        const auto& img = m_images[attachmentRef.imageIdx];
-        if ((img.image.getOptions().usage &
-             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
-          CODE_APPEND(
-              "#ifndef _ATTACHMENT_VAR_%s\n",
-              attachmentRef.aliasName.c_str());
-          CODE_APPEND(
-              "#define _ATTACHMENT_VAR_%s\n",
-              attachmentRef.aliasName.c_str());
-          CODE_APPEND("static float4 %s;\n", attachmentRef.aliasName.c_str());
-          CODE_APPEND(
-              "#endif // _ATTACHMENT_VAR_ %s\n",
-              attachmentRef.aliasName.c_str());
-        }
-      }
-    }
-    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
-  }
-
-  std::filesystem::path shaderFileName = m_projPath;
-  shaderFileName.replace_extension(".hlsl");
-
-  std::string userShaderName = shaderFileName.filename().string();
-  CODE_APPEND("#include \"%s\"\n\n", userShaderName.c_str());
-
-  {
-    CODE_APPEND("\n\n#ifdef IS_PIXEL_SHADER\n");
-    for (const auto& pass : m_parsed.m_renderPasses) {
-      for (const auto& draw : pass.draws) {
-        CODE_APPEND(
-            "#if defined(_ENTRY_POINT_%s) && !defined(_PS_WRAPPER)\n",
-            draw.pixelShader.c_str());
-        CODE_APPEND("#define _PS_WRAPPER\n");
-        CODE_APPEND("struct _PixelOutput {\n");
-        uint32_t colorAttachmentIdx = 0;
-        for (const auto& attachmentRef : pass.attachments) {
-          const auto& img = m_images[attachmentRef.imageIdx];
-          if ((img.image.getOptions().usage &
-               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
-            CODE_APPEND(
-                "\tfloat4 _%s : SV_Target%u;\n",
-                attachmentRef.aliasName.c_str(),
-                colorAttachmentIdx++);
-          }
-        }
-        const auto& structdef =
-            m_parsed.m_structDefs[draw.vertexOutputStructIdx];
-        CODE_APPEND("}; // struct _PixelOutput\n");
-        CODE_APPEND("_PixelOutput main(%s IN) {\n", structdef.name.c_str());
-        CODE_APPEND("\t_PixelOutput OUT;\n");
-        CODE_APPEND("\t%s(IN);\n", draw.pixelShader.c_str());
-        for (const auto& attachmentRef : pass.attachments) {
-          const auto& img = m_images[attachmentRef.imageIdx];
-          if ((img.image.getOptions().usage &
-               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) == 0) {
-            CODE_APPEND(
-                "\tOUT._%s = %s;\n",
-                attachmentRef.aliasName.c_str(),
-                attachmentRef.aliasName.c_str());
-          }
-        }
-        CODE_APPEND("\treturn OUT;\n");
-        CODE_APPEND("}\n");
-        CODE_APPEND(
-            "#endif // defined(_ENTRY_POINT_%s) && !defined(_PS_WRAPPER)\n",
-            draw.pixelShader.c_str());
-      }
-    }
-    CODE_APPEND("#endif // IS_PIXEL_SHADER\n");
-  }
-#undef CODE_APPEND
-
-  std::ofstream autoGenFile(autoGenFileName);
-  if (autoGenFile.is_open()) {
-    autoGenFile.write(codeBuf, codeOffs);
-    autoGenFile.close();
-  }
-
-  delete[] codeBuf;
-}
-
 void Project::serializeOptions() {
   using namespace OptionsParserImpl;
 
@@ -2027,13 +2524,15 @@ uint32_t Project::getSubBufferCount(BufferId buf) const {
 void Project::barrierRW(BufferId buf, VkCommandBuffer commandBuffer) const {
   assert(buf.isValid());
   const auto& bufInfo = m_parsed.m_buffers[buf.idx];
-  const auto& structInfo = m_parsed.m_structDefs[bufInfo.structIdx];
-  for (const auto& buf : m_buffers[buf.idx])
+  uint64_t byteSize = m_parsed.getBufferByteSize(bufInfo);
+  if (m_transientSlots[buf.idx] >= 0)
     BufferUtilities::rwBarrier(
         commandBuffer,
-        buf.getBuffer(),
-        0,
-        bufInfo.elemCount * structInfo.size);
+        m_transientPool.getBuffer(),
+        m_parsed.m_transientBuffers[m_transientSlots[buf.idx]].offset,
+        byteSize);
+  for (const auto& buf : m_buffers[buf.idx])
+    BufferUtilities::rwBarrier(commandBuffer, buf.getBuffer(), 0, byteSize);
 }
 
 void Project::setPushConstants(
@@ -2041,6 +2540,11 @@ void Project::setPushConstants(
     uint32_t push1,
     uint32_t push2,
     uint32 push3) {
+  // push constants are part of the recorded task lists
+  if (m_pushData.push0 != push0 || m_pushData.push1 != push1 ||
+      m_pushData.push2 != push2 || m_pushData.push3 != push3)
+    invalidateRecordedTaskLists();
+
   m_pushData.push0 = push0;
   m_pushData.push1 = push1;
   m_pushData.push2 = push2;
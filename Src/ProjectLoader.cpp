@@ -0,0 +1,169 @@
+#include "ProjectLoader.h"
+
+#include "CodeGen.h"
+#include "Parallel.h"
+#include "ShaderCache.h"
+#include "Trace.h"
+
+#include <Althea/ComputePipeline.h>
+#include <Althea/GraphicsPipeline.h>
+
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace flr {
+namespace {
+// Compiles every shader stage of the project into the shader cache, the
+// pipelines created by the Project later on will find them there. Cache keys
+// only depend on the contents of the sources, so compiling the pending
+// generated file fills in the entries of the final one. Returns the first
+// compile error in declaration order, if any.
+std::string precompileShaders(
+    const ParsedFlr& parsed,
+    const std::string& autoGenFileName,
+    ShaderCache& cache,
+    const std::atomic<bool>& bCancelled) {
+  std::vector<ShaderCache::ShaderDesc> jobs;
+  for (const auto& c : parsed.m_computeShaders)
+    jobs.push_back(cache.describe(
+        autoGenFileName,
+        getComputeShaderDefines(parsed, c),
+        parsed.m_language,
+        ShaderCache::STAGE_COMPUTE));
+  for (const auto& pass : parsed.m_renderPasses) {
+    for (const auto& draw : pass.draws) {
+      jobs.push_back(cache.describe(
+          autoGenFileName,
+          getVertexShaderDefines(parsed, pass, draw),
+          parsed.m_language,
+          ShaderCache::STAGE_VERTEX));
+      jobs.push_back(cache.describe(
+          autoGenFileName,
+          getPixelShaderDefines(parsed, pass, draw),
+          parsed.m_language,
+          ShaderCache::STAGE_PIXEL));
+    }
+  }
+
+  std::vector<std::string> jobErrors(jobs.size());
+  parallelFor(static_cast<uint32_t>(jobs.size()), [&](uint32_t i) {
+    if (bCancelled)
+      return;
+
+    FLR_TRACE_ZONE("Compile shader");
+    const ShaderCache::ShaderDesc& job = jobs[i];
+    ShaderCache::CompileStats stats;
+    if (job.stage == ShaderCache::STAGE_COMPUTE) {
+      ComputePipelineBuilder builder{};
+      builder.setComputeShader(autoGenFileName, job.defines, parsed.m_language);
+      jobErrors[i] = cache.compile(builder, &job, 1, stats);
+    } else {
+      GraphicsPipelineBuilder builder{};
+      if (job.stage == ShaderCache::STAGE_VERTEX)
+        builder.addVertexShader(
+            autoGenFileName,
+            job.defines,
+            parsed.m_language);
+      else
+        builder.addFragmentShader(
+            autoGenFileName,
+            job.defines,
+            parsed.m_language);
+      jobErrors[i] = cache.compile(builder, &job, 1, stats);
+    }
+  });
+
+  for (std::string& errors : jobErrors)
+    if (errors.size())
+      return std::move(errors);
+
+  return {};
+}
+} // namespace
+
+ProjectLoader::ProjectLoader(
+    const char* projPath,
+    const FlrParams& params,
+    const FlrTargetInfo& target,
+    std::shared_ptr<const ParsedFlr::IncrementalState> pPrevious)
+    : m_projPath(projPath),
+      m_params(params),
+      m_target(target),
+      m_pPrevious(std::move(pPrevious)),
+      m_pParsed(nullptr),
+      m_bCancelled(false),
+      m_bFinished(false),
+      m_thread([this]() { load(); }) {}
+
+ProjectLoader::~ProjectLoader() {
+  cancel();
+  if (m_thread.joinable())
+    m_thread.join();
+
+  // left over unless the generated code was committed
+  std::error_code err;
+  if (!m_pendingAutoGenFileName.empty())
+    std::filesystem::remove(m_pendingAutoGenFileName, err);
+}
+
+std::unique_ptr<ParsedFlr> ProjectLoader::takeParsedFlr() {
+  assert(isFinished());
+  if (m_thread.joinable())
+    m_thread.join();
+  return std::move(m_pParsed);
+}
+
+void ProjectLoader::commitGeneratedCode() {
+  assert(isFinished());
+  if (m_pendingAutoGenFileName.empty())
+    return;
+
+  // If this fails, the Project generates the file itself
+  std::error_code err;
+  std::filesystem::rename(m_pendingAutoGenFileName, m_autoGenFileName, err);
+  if (!err)
+    m_pendingAutoGenFileName.clear();
+}
+
+void ProjectLoader::load() {
+  FLR_TRACE_ZONE("ProjectLoader::load");
+  {
+    FLR_TRACE_ZONE("Parse");
+    m_pParsed = std::make_unique<ParsedFlr>(
+        m_target,
+        m_projPath.c_str(),
+        m_params,
+        m_pPrevious.get());
+  }
+  if (!m_pParsed->m_failed && !m_bCancelled) {
+    std::filesystem::path projPath(m_projPath);
+    m_autoGenFileName = getAutoGenFileName(*m_pParsed, projPath);
+    m_pendingAutoGenFileName = getPendingAutoGenFileName(*m_pParsed, projPath);
+    {
+      FLR_TRACE_ZONE("Code gen");
+      codeGen(*m_pParsed, projPath, m_pendingAutoGenFileName);
+    }
+
+    FLR_TRACE_ZONE("Precompile shaders");
+    ShaderCache shaderCache(GProjectDirectory + "/ShaderCache");
+    std::string errors = precompileShaders(
+        *m_pParsed,
+        m_pendingAutoGenFileName.string(),
+        shaderCache,
+        m_bCancelled);
+    if (errors.size()) {
+      m_pParsed->m_failed = true;
+      snprintf(
+          m_pParsed->m_errMsg,
+          sizeof(m_pParsed->m_errMsg),
+          "%s",
+          errors.c_str());
+    }
+  }
+
+  m_bFinished = true;
+}
+} // namespace flr
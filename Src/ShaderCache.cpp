@@ -0,0 +1,345 @@
+#include "ShaderCache.h"
+
+#include "Hash.h"
+
+#include <Althea/Application.h>
+
+#include <shaderc/shaderc.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+
+namespace flr {
+std::vector<std::filesystem::path> getShaderIncludeDirs() {
+  return {GProjectDirectory + "/Shaders", GEngineDirectory + "/Shaders"};
+}
+
+std::mutex& getShaderCompilerMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+namespace {
+constexpr uint32_t SHADER_CACHE_VERSION = 4;
+
+bool readWholeFile(const std::filesystem::path& path, std::string& out) {
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream.is_open())
+    return false;
+  size_t size = static_cast<size_t>(stream.tellg());
+  out.resize(size);
+  stream.seekg(0);
+  stream.read(out.data(), size);
+  return !stream.fail();
+}
+
+struct IncludeDirective {
+  std::string_view path;
+  // <path> rather than "path"
+  bool bAngled;
+};
+
+// Finds every #include directive in the source. Conditional includes are all
+// reported, which can only make the cache key more conservative. Returns
+// false if the path of a directive is not a literal, e.g. a macro.
+bool findIncludes(
+    std::string_view source,
+    std::vector<IncludeDirective>& includes) {
+  size_t lineStart = 0;
+  while (lineStart < source.size()) {
+    size_t lineEnd = source.find('\n', lineStart);
+    if (lineEnd == std::string_view::npos)
+      lineEnd = source.size();
+    std::string_view line = source.substr(lineStart, lineEnd - lineStart);
+    lineStart = lineEnd + 1;
+
+    size_t pos = line.find_first_not_of(" \t");
+    if (pos == std::string_view::npos || line[pos] != '#')
+      continue;
+    pos = line.find_first_not_of(" \t", pos + 1);
+    if (pos == std::string_view::npos || line.compare(pos, 7, "include"))
+      continue;
+    pos = line.find_first_not_of(" \t", pos + 7);
+    if (pos == std::string_view::npos ||
+        (line[pos] != '"' && line[pos] != '<'))
+      return false;
+
+    bool bAngled = line[pos] == '<';
+    size_t end = line.find(bAngled ? '>' : '"', pos + 1);
+    if (end == std::string_view::npos)
+      return false;
+    includes.push_back({line.substr(pos + 1, end - pos - 1), bAngled});
+  }
+  return true;
+}
+
+// Resolves an include the way the shader compiler does: quoted paths relative
+// to the including file first, then the include directories the compiler is
+// set up with, see getShaderIncludeDirs(). Since the order the compiler
+// searches the include directories in is up to the engine, a path found in
+// more than one of them isn't resolved either.
+std::optional<std::filesystem::path> resolveInclude(
+    const std::filesystem::path& includingDir,
+    const IncludeDirective& include) {
+  if (!include.bAngled) {
+    std::filesystem::path candidate = includingDir / include.path;
+    if (std::filesystem::exists(candidate))
+      return candidate.lexically_normal();
+  }
+
+  std::optional<std::filesystem::path> resolved;
+  for (const std::filesystem::path& dir : getShaderIncludeDirs()) {
+    std::filesystem::path candidate = dir / include.path;
+    if (!std::filesystem::exists(candidate))
+      continue;
+    candidate = candidate.lexically_normal();
+    if (resolved && std::filesystem::weakly_canonical(*resolved) !=
+                        std::filesystem::weakly_canonical(candidate))
+      return std::nullopt;
+    resolved = candidate;
+  }
+  return resolved;
+}
+
+// Resolves the includes of a shader being compiled, quoted paths relative to
+// the including file first, then the first of the include directories the
+// path is found in.
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+  shaderc_include_result* GetInclude(
+      const char* requestedSource,
+      shaderc_include_type type,
+      const char* requestingSource,
+      size_t includeDepth) override {
+    auto* pInclude = new Include();
+    std::vector<std::filesystem::path> candidates;
+    if (type == shaderc_include_type_relative)
+      candidates.push_back(
+          std::filesystem::path(requestingSource).parent_path() /
+          requestedSource);
+    for (const std::filesystem::path& dir : getShaderIncludeDirs())
+      candidates.push_back(dir / requestedSource);
+
+    for (const std::filesystem::path& candidate : candidates) {
+      if (readWholeFile(candidate, pInclude->content)) {
+        pInclude->name = candidate.lexically_normal().string();
+        break;
+      }
+    }
+    // an empty name reports the include as failed, with the content as error
+    if (pInclude->name.empty())
+      pInclude->content =
+          std::string("Could not resolve include ") + requestedSource;
+
+    pInclude->result.source_name = pInclude->name.c_str();
+    pInclude->result.source_name_length = pInclude->name.size();
+    pInclude->result.content = pInclude->content.c_str();
+    pInclude->result.content_length = pInclude->content.size();
+    pInclude->result.user_data = pInclude;
+    return &pInclude->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* pResult) override {
+    delete static_cast<Include*>(pResult->user_data);
+  }
+
+private:
+  struct Include {
+    shaderc_include_result result;
+    std::string name;
+    std::string content;
+  };
+};
+} // namespace
+
+ShaderCache::ShaderCache(const std::filesystem::path& cacheDir)
+    : m_cacheDir(cacheDir) {
+  std::error_code err;
+  std::filesystem::create_directories(m_cacheDir, err);
+}
+
+std::optional<uint64_t> ShaderCache::computeKey(
+    const std::string& path,
+    const ShaderDefines& defines,
+    ShaderLanguage language,
+    Stage stage) {
+  std::optional<uint64_t> sourceHash = hashSourceTree(path);
+  if (!sourceHash)
+    return std::nullopt;
+
+  uint64_t key = hashValue(SHADER_CACHE_VERSION, FNV_OFFSET_BASIS);
+  key = hashValue(*sourceHash, key);
+  key = hashValue(language, key);
+  key = hashValue(stage, key);
+
+  // defines are hashed in sorted order, independent of the container
+  std::vector<std::pair<std::string_view, std::string_view>> sortedDefines;
+  sortedDefines.reserve(defines.size());
+  for (const auto& [name, value] : defines)
+    sortedDefines.emplace_back(name, value);
+  std::sort(sortedDefines.begin(), sortedDefines.end());
+  for (const auto& [name, value] : sortedDefines) {
+    key = hashString(name, key);
+    key = hashString("=", key);
+    key = hashString(value, key);
+    key = hashString("\n", key);
+  }
+
+  return key;
+}
+
+ShaderCache::ShaderDesc ShaderCache::describe(
+    const std::string& path,
+    const ShaderDefines& defines,
+    ShaderLanguage language,
+    Stage stage) {
+  return {
+      path,
+      defines,
+      language,
+      stage,
+      computeKey(path, defines, language, stage)};
+}
+
+std::string ShaderCache::compileShader(
+    const ShaderDesc& desc,
+    std::vector<uint32_t>& spirv) {
+  std::string source;
+  if (!readWholeFile(desc.path, source))
+    return "Could not read shader " + desc.path;
+
+  shaderc::CompileOptions options;
+  options.SetIncluder(std::make_unique<ShaderIncluder>());
+  options.SetTargetEnvironment(
+      shaderc_target_env_vulkan,
+      shaderc_env_version_vulkan_1_2);
+  options.SetOptimizationLevel(shaderc_optimization_level_performance);
+  if (desc.language == SHADER_LANGUAGE_HLSL)
+    options.SetSourceLanguage(shaderc_source_language_hlsl);
+  for (const auto& [name, value] : desc.defines)
+    options.AddMacroDefinition(name, value);
+
+  shaderc_shader_kind kind = shaderc_compute_shader;
+  if (desc.stage == STAGE_VERTEX)
+    kind = shaderc_vertex_shader;
+  else if (desc.stage == STAGE_PIXEL)
+    kind = shaderc_fragment_shader;
+
+  // compilers are only used by one thread at a time
+  thread_local shaderc::Compiler compiler;
+  shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(
+      source,
+      kind,
+      desc.path.c_str(),
+      "main",
+      options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+    return result.GetErrorMessage();
+
+  spirv.assign(result.cbegin(), result.cend());
+  return {};
+}
+
+std::optional<uint64_t>
+ShaderCache::hashSourceTree(const std::filesystem::path& path) {
+  std::string pathStr = path.lexically_normal().string();
+  auto it = m_sourceHashes.find(pathStr);
+  if (it != m_sourceHashes.end())
+    return it->second;
+
+  // Placeholder for include cycles, the recursive include itself still
+  // contributes its name to the hash below.
+  m_sourceHashes.emplace(pathStr, FNV_OFFSET_BASIS);
+
+  // Sources that can't be read, or include anything that can't be resolved
+  // to exactly one file, are never cached. Their key would not change along
+  // with the files the compiler ends up reading.
+  std::string source;
+  std::vector<IncludeDirective> includes;
+  if (!readWholeFile(path, source) || !findIncludes(source, includes)) {
+    m_sourceHashes[pathStr] = std::nullopt;
+    return std::nullopt;
+  }
+
+  // The path itself is left out, a file generated elsewhere and moved into
+  // place keeps its key. Includes are hashed by what they resolve to.
+  uint64_t h = hashValue(source.size(), FNV_OFFSET_BASIS);
+  h = hashString(source, h);
+
+  std::filesystem::path dir = path.parent_path();
+  for (const IncludeDirective& include : includes) {
+    std::optional<std::filesystem::path> resolved =
+        resolveInclude(dir, include);
+    std::optional<uint64_t> includeHash =
+        resolved ? hashSourceTree(*resolved) : std::nullopt;
+    if (!includeHash) {
+      m_sourceHashes[pathStr] = std::nullopt;
+      return std::nullopt;
+    }
+    h = hashString(include.path, h);
+    h = hashValue(*includeHash, h);
+  }
+
+  m_sourceHashes[pathStr] = h;
+  return h;
+}
+
+bool ShaderCache::load(uint64_t key, std::vector<uint32_t>& spirv) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.spv", (unsigned long long)key);
+
+  std::ifstream stream(m_cacheDir / name, std::ios::binary | std::ios::ate);
+  if (!stream.is_open())
+    return false;
+
+  size_t size = static_cast<size_t>(stream.tellg());
+  if (size == 0 || (size % sizeof(uint32_t)) != 0)
+    return false;
+
+  spirv.resize(size / sizeof(uint32_t));
+  stream.seekg(0);
+  stream.read(reinterpret_cast<char*>(spirv.data()), size);
+  return !stream.fail();
+}
+
+void ShaderCache::store(uint64_t key, const std::vector<uint32_t>& spirv)
+    const {
+  if (spirv.empty())
+    return;
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.spv", (unsigned long long)key);
+
+  // Write to a temporary file first so a concurrent reader never sees a
+  // partially written entry. Identical stages may be compiled on several
+  // threads at once, so the temporary file is unique per thread.
+  std::filesystem::path finalPath = m_cacheDir / name;
+  std::filesystem::path tmpPath = finalPath;
+  tmpPath += "." +
+             std::to_string(
+                 std::hash<std::thread::id>{}(std::this_thread::get_id())) +
+             ".tmp";
+  {
+    std::ofstream stream(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+      std::cerr << "WARNING: Could not write shader cache entry "
+                << finalPath.string() << std::endl;
+      return;
+    }
+    stream.write(
+        reinterpret_cast<const char*>(spirv.data()),
+        spirv.size() * sizeof(uint32_t));
+  }
+
+  std::error_code err;
+  std::filesystem::rename(tmpPath, finalPath, err);
+  if (err)
+    std::filesystem::remove(tmpPath, err);
+}
+} // namespace flr
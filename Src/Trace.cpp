@@ -0,0 +1,257 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace flr {
+std::atomic<bool> CpuTracer::s_bEnabled = false;
+
+namespace {
+// 24 bytes per event, rings are only created for threads that record while
+// tracing is enabled
+constexpr uint64_t RING_SIZE = 16384;
+
+enum TraceEventType : uint32_t { TE_BEGIN = 0, TE_END, TE_FRAME };
+
+struct TraceEvent {
+  const char* name;
+  int64_t timestampNs;
+  uint32_t threadId;
+  TraceEventType type;
+};
+
+struct ThreadRing {
+  TraceEvent events[RING_SIZE];
+  // only advanced by the thread currently owning the ring
+  std::atomic<uint64_t> writeIdx{0};
+  // worker threads are short-lived, their rings are reused by later threads
+  std::atomic<bool> bInUse{false};
+};
+
+struct TraceState {
+  // Guards the list of rings and the capture state, recording events never
+  // takes it
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadRing>> rings;
+  uint32_t nextThreadId = 1;
+  uint32_t mainThreadId = 0;
+
+  std::filesystem::path outputPath = "flr_cpu_trace.json";
+  int64_t captureStartNs = 0;
+  uint32_t captureFrameCount = 0;
+  uint32_t framesLeft = 0;
+  bool bCapturing = false;
+};
+
+TraceState& getState() {
+  static TraceState s_state;
+  return s_state;
+}
+
+struct ThreadRingHandle {
+  ThreadRing* pRing = nullptr;
+  uint32_t threadId = 0;
+
+  ~ThreadRingHandle() {
+    if (pRing)
+      pRing->bInUse.store(false, std::memory_order_release);
+  }
+};
+thread_local ThreadRingHandle t_ring;
+
+ThreadRingHandle& getThreadRing() {
+  if (!t_ring.pRing) {
+    TraceState& state = getState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (auto& pRing : state.rings) {
+      bool bExpected = false;
+      if (pRing->bInUse.compare_exchange_strong(bExpected, true)) {
+        t_ring.pRing = pRing.get();
+        break;
+      }
+    }
+    if (!t_ring.pRing) {
+      t_ring.pRing = state.rings.emplace_back(std::make_unique<ThreadRing>())
+                         .get();
+      t_ring.pRing->bInUse = true;
+    }
+    t_ring.threadId = state.nextThreadId++;
+  }
+  return t_ring;
+}
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void recordEvent(const char* name, TraceEventType type) {
+  ThreadRingHandle& handle = getThreadRing();
+  ThreadRing& ring = *handle.pRing;
+  uint64_t idx = ring.writeIdx.load(std::memory_order_relaxed);
+  ring.events[idx % RING_SIZE] = {name, nowNs(), handle.threadId, type};
+  ring.writeIdx.store(idx + 1, std::memory_order_release);
+}
+
+// Copies the events recorded since startNs out of every ring. Rings may be
+// written to concurrently, events that might have been overwritten while
+// copying are dropped.
+std::vector<TraceEvent> gatherEvents(TraceState& state, int64_t startNs) {
+  std::vector<TraceEvent> events;
+  for (const auto& pRing : state.rings) {
+    uint64_t end = pRing->writeIdx.load(std::memory_order_acquire);
+    uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+    size_t firstCopied = events.size();
+    for (uint64_t i = begin; i < end; i++)
+      events.push_back(pRing->events[i % RING_SIZE]);
+
+    uint64_t endAfter = pRing->writeIdx.load(std::memory_order_acquire);
+    uint64_t overwritten = endAfter > RING_SIZE ? endAfter - RING_SIZE : 0;
+    if (overwritten > begin) {
+      size_t dropCount =
+          static_cast<size_t>(std::min(overwritten, end) - begin);
+      events.erase(
+          events.begin() + firstCopied,
+          events.begin() + firstCopied + dropCount);
+    }
+  }
+
+  events.erase(
+      std::remove_if(
+          events.begin(),
+          events.end(),
+          [startNs](const TraceEvent& e) { return e.timestampNs < startNs; }),
+      events.end());
+  std::stable_sort(
+      events.begin(),
+      events.end(),
+      [](const TraceEvent& a, const TraceEvent& b) {
+        return a.timestampNs < b.timestampNs;
+      });
+  return events;
+}
+
+void writeJsonString(std::ofstream& stream, const char* str) {
+  stream << '"';
+  for (const char* c = str; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      stream << '\\';
+    stream << *c;
+  }
+  stream << '"';
+}
+
+bool writeTrace(TraceState& state) {
+  std::vector<TraceEvent> events = gatherEvents(state, state.captureStartNs);
+
+  std::ofstream stream(state.outputPath, std::ios::trunc);
+  if (!stream.is_open())
+    return false;
+
+  stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool bFirst = true;
+  auto beginEvent = [&]() {
+    if (!bFirst)
+      stream << ",\n";
+    bFirst = false;
+  };
+
+  // Zones already open when the capture started only have their end in the
+  // trace, those are dropped
+  std::unordered_map<uint32_t, uint32_t> zoneDepths;
+  for (const TraceEvent& e : events) {
+    uint32_t& depth = zoneDepths[e.threadId];
+    if (e.type == TE_END) {
+      if (depth == 0)
+        continue;
+      depth--;
+    } else if (e.type == TE_BEGIN) {
+      depth++;
+    }
+
+    beginEvent();
+    stream << "{";
+    if (e.name) {
+      stream << "\"name\":";
+      writeJsonString(stream, e.name);
+      stream << ",";
+    }
+    stream << "\"ph\":\""
+           << (e.type == TE_BEGIN ? "B" : e.type == TE_END ? "E" : "i")
+           << "\",\"ts\":" << (e.timestampNs - state.captureStartNs) / 1000
+           << "." << (e.timestampNs - state.captureStartNs) % 1000 / 100
+           << ",\"pid\":1,\"tid\":" << e.threadId;
+    if (e.type == TE_FRAME)
+      stream << ",\"s\":\"g\"";
+    stream << "}";
+  }
+
+  for (const auto& [threadId, depth] : zoneDepths) {
+    beginEvent();
+    stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+           << threadId << ",\"args\":{\"name\":\""
+           << (threadId == state.mainThreadId ? "Main" : "Worker") << " "
+           << threadId << "\"}}";
+  }
+
+  stream << "\n]}\n";
+  return !stream.fail();
+}
+} // namespace
+
+void CpuTracer::setOutputPath(const std::filesystem::path& path) {
+  TraceState& state = getState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.outputPath = path;
+}
+
+void CpuTracer::captureFrames(uint32_t frameCount) {
+  if (frameCount == 0)
+    return;
+
+  TraceState& state = getState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.captureStartNs = nowNs();
+  state.captureFrameCount = frameCount;
+  state.framesLeft = frameCount;
+  state.bCapturing = true;
+  s_bEnabled = true;
+}
+
+void CpuTracer::beginFrame() {
+  if (!isEnabled())
+    return;
+
+  // resolve the ring before taking the lock below, it may need it
+  uint32_t threadId = getThreadRing().threadId;
+  recordEvent("Frame", TE_FRAME);
+
+  TraceState& state = getState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.mainThreadId = threadId;
+  if (!state.bCapturing || state.framesLeft-- > 0)
+    return;
+
+  // The frame that just started is not part of the capture anymore
+  s_bEnabled = false;
+  state.bCapturing = false;
+  if (writeTrace(state))
+    std::cout << "Wrote CPU trace of " << state.captureFrameCount
+              << " frames to " << state.outputPath.string() << std::endl;
+  else
+    std::cerr << "WARNING: Could not write CPU trace to "
+              << state.outputPath.string() << std::endl;
+}
+
+void CpuTracer::beginZone(const char* name) { recordEvent(name, TE_BEGIN); }
+
+void CpuTracer::endZone() { recordEvent(nullptr, TE_END); }
+} // namespace flr
@@ -4,7 +4,10 @@
 #include "IpcProgram.h"
 
 #include <Althea/Application.h>
+#include <GLFW/glfw3.h>
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <filesystem>
 #include <Windows.h>
@@ -12,37 +15,108 @@
 
 using namespace AltheaEngine;
 
+// With --headless, the project is rendered for a fixed number of frames in a
+// hidden window and the display image (or the image given with --image) is
+// saved to the output directory as <image>_<frame>.png. The image must be
+// rgba8, the run fails otherwise. E.g.
+//   Fluorescence Projects/Fractals/Fractals.flr --headless --frames 120 --fixed-dt 0.016
+//       --out renders --save-every 30
+// This also runs on software Vulkan implementations such as lavapipe or
+// SwiftShader by pointing VK_ICD_FILENAMES at their ICD manifest.
+//
+// --benchmark additionally runs --warmup frames first and then writes the GPU
+// time of every task, the CPU frame times, the load time and the peak memory
+// of the counted frames to a json file, images are only saved if --out is
+// given. Tools/Bench/flrbench.py runs this over all projects.
+namespace {
+void printUsage() {
+  std::cerr << "Usage: Fluorescence [project.flr] [-ipc] [--headless] "
+               "[--frames N] [--fixed-dt SECONDS] [--out DIR] [--image NAME] "
+               "[--save-every K] [--warmup N] [--benchmark results.json]"
+            << std::endl;
+}
+} // namespace
+
 int main(int argc, char* argv[]) {
   char exePathStr[512];
   GetModuleFileNameA(nullptr, exePathStr, 512);
   std::filesystem::path exeDir(exePathStr);
   exeDir.remove_filename();
+
+  const char* projPath = nullptr;
+  bool bIpc = false;
+  bool bHeadless = false;
+  flr::FlrHeadlessOptions headless{};
+  bool bHasOutputDir = false;
+  for (int i = 1; i < argc; i++) {
+    bool bHasValue = (i + 1) < argc;
+    if (!strcmp(argv[i], "-ipc")) {
+      bIpc = true;
+    } else if (!strcmp(argv[i], "--headless")) {
+      bHeadless = true;
+    } else if (!strcmp(argv[i], "--frames") && bHasValue) {
+      headless.frameCount = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--fixed-dt") && bHasValue) {
+      headless.fixedDeltaTime = static_cast<float>(atof(argv[++i]));
+    } else if (!strcmp(argv[i], "--out") && bHasValue) {
+      headless.outputDir = argv[++i];
+      bHasOutputDir = true;
+    } else if (!strcmp(argv[i], "--image") && bHasValue) {
+      headless.imageName = argv[++i];
+    } else if (!strcmp(argv[i], "--save-every") && bHasValue) {
+      headless.saveInterval = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--warmup") && bHasValue) {
+      headless.warmupFrameCount = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--benchmark") && bHasValue) {
+      headless.benchmarkPath = argv[++i];
+    } else if (i == 1 && argv[i][0] != '-') {
+      projPath = argv[i];
+    } else {
+      printUsage();
+      return EXIT_FAILURE; // unknown args
+    }
+  }
+
+  if (bHeadless) {
+    if (!projPath) {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+
+    // Resolve the output paths before switching to the exe directory
+    headless.bSaveImages = headless.benchmarkPath.empty() || bHasOutputDir;
+    headless.outputDir = std::filesystem::absolute(headless.outputDir);
+    if (headless.bSaveImages)
+      std::filesystem::create_directories(headless.outputDir);
+    if (!headless.benchmarkPath.empty())
+      headless.benchmarkPath = std::filesystem::absolute(headless.benchmarkPath);
+
+    // The engine always creates a window and swapchain, hide the window
+    // instead. The hint persists since glfwInit is a no-op once initialized.
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  }
+
   std::filesystem::current_path(exeDir);
 
   Application::CreateOptions options{};
   options.width = 1440;
   options.height = 1280;
-  options.frameRateLimit = 30;
+  // headless runs are not paced, 0 disables the limit
+  options.frameRateLimit = bHeadless ? 0 : 30;
   Application app("Fluorescence", "../..", "../../Extern/Althea", &options);
   app.createGame<flr::Fluorescence>();
 
   flr::Fluorescence* game = app.getGameInstance<flr::Fluorescence>();
   flr::IpcProgram* ipc = nullptr;
-  if (argc > 1) {
-    game->setStartupProject(argv[1]);
+  if (projPath) {
+    game->setStartupProject(projPath);
   }
-  if (argc > 2) {
-    if (!strcmp(argv[2], "-ipc"))
-    {
-      ipc = game->registerProgram<flr::IpcProgram>();
-    }
-    else
-    {
-      return EXIT_FAILURE; // unknown args
-    }
+  if (bIpc) {
+    ipc = game->registerProgram<flr::IpcProgram>();
   }
-  if (argc > 3) {
-    return EXIT_FAILURE; // unknown args
+  if (bHeadless) {
+    game->setHeadless(headless);
   }
 
   try {
@@ -52,7 +126,7 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  return EXIT_SUCCESS;
+  return game->hasHeadlessFailed() ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-#endif // BUILD_FLR_APP
\ No newline at end of file
+#endif // BUILD_FLR_APP
@@ -0,0 +1,225 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* RESOURCES = "struct P { float x; }\n"
+                        "structured_buffer a: P 64\n"
+                        "structured_buffer b: P 64\n"
+                        "image img: 64 64 rgba8\n"
+                        "display_image img\n"
+                        "compute_shader CS_WriteA: 32 1 1\n"
+                        "  writes: a\n"
+                        "compute_shader CS_WriteB: 32 1 1\n"
+                        "  writes: b\n"
+                        "compute_shader CS_ReadA: 32 1 1\n"
+                        "  reads: a\n"
+                        "compute_shader CS_CopyAB: 32 1 1\n"
+                        "  reads: a\n"
+                        "  writes: b\n"
+                        "compute_shader CS_DrawImage: 32 1 1\n"
+                        "  reads: b\n"
+                        "  writes: img\n";
+
+std::string
+planOf(const char* name, const std::string& tasks, bool* pFailed = nullptr) {
+  auto p = flrtest::parseSource(name, RESOURCES + tasks);
+  if (pFailed)
+    *pFailed = p->m_failed;
+  return p->m_failed ? p->m_errMsg : p->describeTaskPlan();
+}
+} // namespace
+
+FLR_TEST(barrierOnReadAfterWrite) {
+  std::string plan = planOf(
+      "barriers_raw",
+      "dispatch_threads: CS_WriteA 64 1 1\n"
+      "dispatch_threads: CS_ReadA 64 1 1\n");
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  barrier write: a\n"
+              "  dispatch CS_WriteA\n"
+              "  barrier read: a\n"
+              "  dispatch CS_ReadA\n");
+}
+
+FLR_TEST(noBarrierBetweenIndependentTasks) {
+  std::string plan = planOf(
+      "barriers_independent",
+      "dispatch_threads: CS_WriteA 64 1 1\n"
+      "dispatch_threads: CS_WriteB 64 1 1\n"
+      "dispatch_threads: CS_ReadA 64 1 1\n"
+      "dispatch_threads: CS_ReadA 64 1 1\n");
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  barrier write: a\n"
+              "  dispatch CS_WriteA\n"
+              "  barrier write: b\n"
+              "  dispatch CS_WriteB\n"
+              "  barrier read: a\n"
+              "  dispatch CS_ReadA\n"
+              "  dispatch CS_ReadA\n");
+}
+
+FLR_TEST(barrierOnWriteAfterRead) {
+  std::string plan = planOf(
+      "barriers_war",
+      "dispatch_threads: CS_WriteA 64 1 1\n"
+      "dispatch_threads: CS_ReadA 64 1 1\n"
+      "dispatch_threads: CS_WriteA 64 1 1\n");
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  barrier write: a\n"
+              "  dispatch CS_WriteA\n"
+              "  barrier read: a\n"
+              "  dispatch CS_ReadA\n"
+              "  barrier write: a\n"
+              "  dispatch CS_WriteA\n");
+}
+
+FLR_TEST(barriersInsideRepeatBody) {
+  // the body follows its own previous iteration
+  std::string plan = planOf(
+      "barriers_repeat",
+      "repeat: 4\n"
+      "  dispatch_threads: CS_CopyAB 64 1 1\n"
+      "  dispatch_threads: CS_WriteA 64 1 1\n"
+      "repeat_end\n");
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  repeat: 4\n"
+              "    barrier read: a\n"
+              "    barrier write: b\n"
+              "    dispatch CS_CopyAB\n"
+              "    barrier write: a\n"
+              "    dispatch CS_WriteA\n"
+              "  repeat_end\n");
+}
+
+FLR_TEST(imageTransitionsAreDerived) {
+  std::string plan = planOf(
+      "barriers_image",
+      "dispatch_threads: CS_CopyAB 64 1 1\n"
+      "dispatch_threads: CS_DrawImage 64 1 1\n");
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  barrier read: a\n"
+              "  barrier write: b\n"
+              "  dispatch CS_CopyAB\n"
+              "  barrier read: b\n"
+              "  transition_layout: img image\n"
+              "  dispatch CS_DrawImage\n");
+}
+
+FLR_TEST(laterReadersInOtherStagesGetBarriers) {
+  // the barrier before the compute read only covers the compute stage, the
+  // draw after it reads the same write from the vertex shader and as
+  // indirect args
+  std::string plan = planOf(
+      "barriers_stages",
+      "struct IndirectArgs { uint vertexCount; uint instanceCount; "
+      "uint firstVertex; uint firstInstance; }\n"
+      "structured_buffer args: IndirectArgs 1\n"
+      "image tex: 64 64 rgba8\n"
+      "image target: 64 64 rgba8\n"
+      "compute_shader CS_WriteAll: 32 1 1\n"
+      "  writes: a args tex\n"
+      "compute_shader CS_ReadAll: 32 1 1\n"
+      "  reads: a args tex\n"
+      "dispatch_threads: CS_WriteAll 64 1 1\n"
+      "dispatch_threads: CS_ReadAll 64 1 1\n"
+      "render_pass PASS:\n"
+      "  store_attachments: out=target\n"
+      "  draw: VS_Quad PS_Quad 3 1\n"
+      "    reads: a tex\n"
+      "  draw_indirect: VS_Quad PS_Quad args\n"
+      "    reads: none\n"
+      "dispatch_threads: CS_ReadAll 64 1 1\n");
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  barrier write: a args\n"
+              "  transition_layout: tex image\n"
+              "  dispatch CS_WriteAll\n"
+              "  barrier read: a args\n"
+              "  transition_layout: tex texture\n"
+              "  dispatch CS_ReadAll\n"
+              "  barrier read: a\n"
+              "  barrier indirectArgs: args\n"
+              "  transition_layout: tex texture\n"
+              "  render_pass PASS\n"
+              // the write is already visible to compute
+              "  dispatch CS_ReadAll\n");
+}
+
+FLR_TEST(manualBarriersAreDropped) {
+  auto p = flrtest::parseSource(
+      "barriers_manual",
+      RESOURCES + std::string("dispatch_threads: CS_WriteA 64 1 1\n"
+                              "barrier: a\n"
+                              "dispatch_threads: CS_ReadA 64 1 1\n"));
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(p->m_barriers.size() == 2);
+  FLR_REQUIRE(p->m_warnings.size() == 1);
+  FLR_CHECK(p->m_warnings[0].find("Ignoring 1") != std::string::npos);
+}
+
+FLR_TEST(undeclaredAccessIsRejected) {
+  bool bFailed = false;
+  std::string err = planOf(
+      "barriers_undeclared",
+      "compute_shader CS_Undeclared: 32 1 1\n"
+      "dispatch_threads: CS_WriteA 64 1 1\n"
+      "dispatch_threads: CS_Undeclared 64 1 1\n",
+      &bFailed);
+  FLR_CHECK(bFailed);
+  FLR_CHECK(err.find("CS_Undeclared") != std::string::npos);
+
+  err = planOf(
+      "barriers_undeclared_draw",
+      "render_pass PASS:\n"
+      "  store_attachments: out=img\n"
+      "  draw: VS_Quad PS_Quad 3 1\n"
+      "dispatch_threads: CS_WriteA 64 1 1\n",
+      &bFailed);
+  FLR_CHECK(bFailed);
+  FLR_CHECK(err.find("render pass PASS") != std::string::npos);
+}
+
+FLR_TEST(declaredNoAccess) {
+  bool bFailed = true;
+  std::string plan = planOf(
+      "barriers_none",
+      "compute_shader CS_Nothing: 32 1 1\n"
+      "  reads: none\n"
+      "dispatch_threads: CS_WriteA 64 1 1\n"
+      "dispatch_threads: CS_Nothing 64 1 1\n",
+      &bFailed);
+  FLR_CHECK(!bFailed);
+  FLR_CHECK(
+      plan == "task_list\n"
+              "  barrier write: a\n"
+              "  dispatch CS_WriteA\n"
+              "  dispatch CS_Nothing\n");
+}
+
+FLR_TEST(manualBarriersWithoutDeclaredAccess) {
+  // projects that never declare access keep their barriers and need no
+  // declarations
+  auto p = flrtest::parseSource(
+      "barriers_none_declared",
+      "struct P { float x; }\n"
+      "structured_buffer a: P 64\n"
+      "image img: 64 64 rgba8\n"
+      "display_image img\n"
+      "compute_shader CS_A: 32 1 1\n"
+      "compute_shader CS_B: 32 1 1\n"
+      "dispatch_threads: CS_A 64 1 1\n"
+      "barrier: a\n"
+      "dispatch_threads: CS_B 64 1 1\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(!p->m_bInferBarriers);
+  FLR_CHECK(p->m_taskList.size() == 3);
+  FLR_CHECK(p->m_taskList[1].type == ParsedFlr::TT_BARRIER);
+}
@@ -0,0 +1,99 @@
+#include "FlrTest.h"
+
+#include <filesystem>
+#include <string>
+
+using namespace flr;
+
+namespace {
+// struct_size disagrees with the std430 size of P, which is 4 bytes
+const char* WARNING_PROJECT = "struct P { float x; }\n"
+                              "struct_size: 8\n"
+                              "uint COUNT: 16\n"
+                              "structured_buffer a: P COUNT\n"
+                              "compute_shader CS_A: 32 1 1\n"
+                              "dispatch_threads: CS_A COUNT 1 1\n"
+                              "image img: 64 64 rgba8\n"
+                              "display_image img\n";
+} // namespace
+
+FLR_TEST(cacheRoundTrip) {
+  auto parsed = flrtest::parseSource("cache_round_trip", WARNING_PROJECT);
+  FLR_REQUIRE(!parsed->m_failed);
+  FLR_CHECK(!parsed->m_bLoadedFromCache);
+
+  std::string path = parsed->m_sourceFiles[0];
+  auto cached = flrtest::parseFile(path);
+  FLR_REQUIRE(!cached->m_failed);
+  FLR_CHECK(cached->m_bLoadedFromCache);
+  FLR_CHECK(cached->m_sourceFiles == parsed->m_sourceFiles);
+  FLR_REQUIRE(cached->m_buffers.size() == parsed->m_buffers.size());
+  for (size_t i = 0; i < parsed->m_buffers.size(); i++) {
+    FLR_CHECK(cached->m_buffers[i].name == parsed->m_buffers[i].name);
+    FLR_CHECK(cached->m_buffers[i].elemCount == parsed->m_buffers[i].elemCount);
+    FLR_CHECK(cached->m_buffers[i].flags == parsed->m_buffers[i].flags);
+  }
+  FLR_CHECK(cached->m_structDefs.size() == parsed->m_structDefs.size());
+  FLR_CHECK(cached->m_taskList.size() == parsed->m_taskList.size());
+  FLR_CHECK(cached->m_displayImageIdx == parsed->m_displayImageIdx);
+}
+
+FLR_TEST(cacheReplaysWarnings) {
+  auto parsed = flrtest::parseSource("cache_warnings", WARNING_PROJECT);
+  FLR_REQUIRE(!parsed->m_failed);
+  FLR_REQUIRE(parsed->m_warnings.size() == 1);
+  FLR_CHECK(parsed->m_warnings[0].find("struct_size") != std::string::npos);
+
+  auto cached = flrtest::parseFile(parsed->m_sourceFiles[0]);
+  FLR_REQUIRE(cached->m_bLoadedFromCache);
+  FLR_CHECK(cached->m_warnings == parsed->m_warnings);
+}
+
+FLR_TEST(cacheInvalidatedByIncludedFile) {
+  std::string includePath =
+      flrtest::writeTestFile("cache_include.flrh", "uint COUNT: 16\n");
+  std::string src = "include \"" + includePath + "\"\n" +
+                    "struct P { float x; }\n"
+                    "structured_buffer a: P COUNT\n"
+                    "image img: 64 64 rgba8\n"
+                    "display_image img\n";
+  auto parsed = flrtest::parseSource("cache_invalidate", src);
+  FLR_REQUIRE(!parsed->m_failed);
+
+  flrtest::writeTestFile("cache_include.flrh", "uint COUNT: 32\n");
+  auto reparsed = flrtest::parseFile(parsed->m_sourceFiles[0]);
+  FLR_REQUIRE(!reparsed->m_failed);
+  FLR_CHECK(!reparsed->m_bLoadedFromCache);
+  FLR_CHECK(reparsed->m_buffers[0].elemCount == 32);
+}
+
+FLR_TEST(cacheKeyedOnParams) {
+  FlrParams params{};
+  params.m_uintParams.push_back({"COUNT", 4});
+  auto parsed =
+      flrtest::parseSource("cache_params", WARNING_PROJECT, params);
+  FLR_REQUIRE(!parsed->m_failed);
+
+  params.m_uintParams[0].value = 8;
+  auto reparsed = flrtest::parseFile(parsed->m_sourceFiles[0], params);
+  FLR_REQUIRE(!reparsed->m_failed);
+  FLR_CHECK(!reparsed->m_bLoadedFromCache);
+  FLR_CHECK(reparsed->m_buffers[0].elemCount == 8);
+}
+
+FLR_TEST(cacheDisabled) {
+  FlrParams params{};
+  params.m_bUseCache = false;
+  auto parsed =
+      flrtest::parseSource("cache_disabled", WARNING_PROJECT, params);
+  FLR_REQUIRE(!parsed->m_failed);
+
+  std::filesystem::path cachePath = parsed->m_sourceFiles[0];
+  cachePath.replace_extension(".flrc");
+  FLR_CHECK(!std::filesystem::exists(cachePath));
+
+  flrtest::parseFile(parsed->m_sourceFiles[0]);
+  auto uncached = flrtest::parseFile(parsed->m_sourceFiles[0], params);
+  FLR_CHECK(!uncached->m_bLoadedFromCache);
+  FLR_CHECK(uncached->m_warnings.size() == 1);
+}
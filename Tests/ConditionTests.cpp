@@ -0,0 +1,247 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* RESOURCES = "struct P { float x; }\n"
+                        "struct Flag { uint v; }\n"
+                        "structured_buffer a: P 64\n"
+                        "structured_buffer flag: Flag 1\n"
+                        "structured_buffer other: Flag 1\n"
+                        "image img: 64 64 rgba8\n"
+                        "display_image img\n"
+                        "checkbox ENABLE: true\n"
+                        "button RESET\n"
+                        "slider_uint ITERS: 3 1 8\n"
+                        "slider_int OFFSET: 0 -4 4\n"
+                        "uint N: 2\n";
+
+const char* SHADERS = "compute_shader CS_WriteFlag: 1 1 1\n"
+                      "  writes: flag\n"
+                      "compute_shader CS_ReadA: 32 1 1\n"
+                      "  reads: a\n"
+                      "compute_shader CS_WriteA: 32 1 1\n"
+                      "  writes: a\n";
+
+std::unique_ptr<ParsedFlr> parse(const char* name, const std::string& tasks) {
+  return flrtest::parseSource(name, std::string(RESOURCES) + SHADERS + tasks);
+}
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+} // namespace
+
+FLR_TEST(conditionSources) {
+  auto p = parse(
+      "if_sources",
+      "if: ENABLE\n"
+      "if_end\n"
+      "if: !RESET\n"
+      "if_end\n"
+      "if: ITERS\n"
+      "if_end\n"
+      "if: OFFSET\n"
+      "if_end\n"
+      "if: !N\n"
+      "if_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_conditions.size() == 5);
+  FLR_CHECK(p->m_conditions[0].source == ParsedFlr::CS_CHECKBOX);
+  FLR_CHECK(!p->m_conditions[0].bNegate);
+  FLR_CHECK(p->m_conditions[1].source == ParsedFlr::CS_BUTTON);
+  FLR_CHECK(p->m_conditions[1].bNegate);
+  FLR_CHECK(p->m_conditions[2].source == ParsedFlr::CS_SLIDER_UINT);
+  FLR_CHECK(p->m_conditions[3].source == ParsedFlr::CS_SLIDER_INT);
+  // constants are resolved to their value
+  FLR_CHECK(p->m_conditions[4].source == ParsedFlr::CS_CONST);
+  FLR_CHECK(p->m_conditions[4].idx == 2);
+  FLR_CHECK(p->m_conditions[4].bNegate);
+
+  FLR_CHECK(failsWith(
+      *parse("if_unknown", "if: MISSING\nif_end\n"),
+      "Could not find checkbox, button, slider, uint constant or buffer"));
+}
+
+FLR_TEST(bufferPredicate) {
+  auto p = parse(
+      "if_buffer",
+      "compute_dispatch: CS_WriteFlag 1 1 1\n"
+      "if: !flag\n"
+      "  dispatch_threads: CS_WriteA 64 1 1\n"
+      "if_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_conditions.size() == 1);
+  FLR_CHECK(p->m_conditions[0].source == ParsedFlr::CS_BUFFER);
+  FLR_CHECK(p->m_conditions[0].idx == 1);
+  FLR_CHECK(p->m_conditions[0].bNegate);
+  // conditional rendering reads the predicate from the buffer
+  FLR_CHECK((p->m_buffers[1].flags & ParsedFlr::BF_PREDICATE) != 0);
+  FLR_CHECK((p->m_buffers[0].flags & ParsedFlr::BF_PREDICATE) == 0);
+
+  // the if itself reads the predicate, so the next frame's write waits on it
+  FLR_CHECK(
+      p->describeTaskPlan() == "task_list\n"
+                               "  barrier write: flag\n"
+                               "  dispatch CS_WriteFlag\n"
+                               "  if: !flag (gpu predicate)\n"
+                               "    barrier write: a\n"
+                               "    dispatch CS_WriteA\n"
+                               "  if_end\n");
+}
+
+FLR_TEST(nestedGpuConditionsAreRejected) {
+  FLR_CHECK(failsWith(
+      *parse(
+          "if_nested_gpu",
+          "if: flag\n"
+          "  if: other\n"
+          "  if_end\n"
+          "if_end\n"),
+      "An if on a buffer cannot be nested inside another if on a buffer."));
+
+  // also when an if on the cpu is in between
+  FLR_CHECK(failsWith(
+      *parse(
+          "if_nested_gpu_indirect",
+          "if: flag\n"
+          "  if: ENABLE\n"
+          "    if: other\n"
+          "    if_end\n"
+          "  if_end\n"
+          "if_end\n"),
+      "An if on a buffer cannot be nested inside another if on a buffer."));
+
+  // ifs on the cpu nest freely, also inside one on the gpu
+  auto p = parse(
+      "if_nested_cpu",
+      "if: ENABLE\n"
+      "  if: flag\n"
+      "    if: !RESET\n"
+      "      dispatch_threads: CS_ReadA 64 1 1\n"
+      "    if_end\n"
+      "  if_end\n"
+      "if_end\n"
+      "if: flag\n"
+      "if_end\n"
+      "if: other\n"
+      "if_end\n");
+  FLR_CHECK(!p->m_failed);
+}
+
+FLR_TEST(repeatInsideGpuCondition) {
+  FLR_CHECK(failsWith(
+      *parse(
+          "if_gpu_repeat",
+          "if: flag\n"
+          "  repeat: 2\n"
+          "    dispatch_threads: CS_ReadA 64 1 1\n"
+          "  repeat_end\n"
+          "if_end\n"),
+      "A repeat cannot be used inside an if on a buffer."));
+
+  // task blocks run inside the if are checked as well
+  FLR_CHECK(failsWith(
+      *parse(
+          "if_gpu_task_repeat",
+          "task_block_start Step\n"
+          "  repeat: 2\n"
+          "    dispatch_threads: CS_ReadA 64 1 1\n"
+          "  repeat_end\n"
+          "task_block_end\n"
+          "if: flag\n"
+          "  run_task: Step\n"
+          "if_end\n"),
+      "A task block containing a repeat or an if on a buffer cannot be run "
+      "inside an if on a buffer."));
+
+  // a repeat inside an if on the cpu, and an if on the gpu inside a repeat,
+  // are fine
+  auto p = parse(
+      "if_cpu_repeat",
+      "if: ENABLE\n"
+      "  repeat: ITERS\n"
+      "    if: flag\n"
+      "      dispatch_threads: CS_ReadA 64 1 1\n"
+      "    if_end\n"
+      "  repeat_end\n"
+      "if_end\n");
+  FLR_CHECK(!p->m_failed);
+}
+
+FLR_TEST(unbalancedConditions) {
+  FLR_CHECK(failsWith(
+      *parse("if_end_alone", "if_end\n"),
+      "Encountered if_end without corresponding if."));
+  FLR_CHECK(failsWith(
+      *parse("if_missing_end", "if: ENABLE\n"),
+      "Encountered a repeat or if that is missing its repeat_end / if_end."));
+  FLR_CHECK(failsWith(
+      *parse("if_extra_end", "if: ENABLE\nif_end\nif_end\n"),
+      "Encountered if_end without corresponding if."));
+
+  // the innermost open scope has to be closed first
+  FLR_CHECK(failsWith(
+      *parse(
+          "if_closes_repeat",
+          "repeat: 2\n"
+          "  if: ENABLE\n"
+          "repeat_end\n"
+          "if_end\n"),
+      "Encountered repeat_end without corresponding repeat."));
+  FLR_CHECK(failsWith(
+      *parse(
+          "repeat_closes_if",
+          "if: ENABLE\n"
+          "  repeat: 2\n"
+          "if_end\n"
+          "repeat_end\n"),
+      "Encountered if_end without corresponding if."));
+
+  // task blocks close their own scopes
+  FLR_CHECK(failsWith(
+      *parse(
+          "if_open_in_block",
+          "task_block_start Step\n"
+          "  if: ENABLE\n"
+          "task_block_end\n"
+          "if_end\n"),
+      "Encountered task_block_end with a repeat or if that is missing its "
+      "repeat_end / if_end."));
+}
+
+FLR_TEST(conditionTaskPlan) {
+  auto p = parse(
+      "if_plan",
+      "if: ENABLE\n"
+      "  dispatch_threads: CS_WriteA 64 1 1\n"
+      "if_end\n"
+      "if: !RESET\n"
+      "  if: ITERS\n"
+      "    dispatch_threads: CS_ReadA 64 1 1\n"
+      "  if_end\n"
+      "if_end\n"
+      "if: OFFSET\n"
+      "if_end\n"
+      "if: N\n"
+      "if_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(
+      p->describeTaskPlan() == "task_list\n"
+                               "  if: ENABLE\n"
+                               "    barrier write: a\n"
+                               "    dispatch CS_WriteA\n"
+                               "  if_end\n"
+                               "  if: !RESET\n"
+                               "    if: ITERS\n"
+                               "      barrier read: a\n"
+                               "      dispatch CS_ReadA\n"
+                               "    if_end\n"
+                               "  if_end\n"
+                               "  if: OFFSET\n"
+                               "  if_end\n"
+                               "  if: 2\n"
+                               "  if_end\n");
+}
@@ -0,0 +1,86 @@
+#include "FlrTest.h"
+
+#include "CodeGen.h"
+
+#include <vector>
+
+using namespace flr;
+
+namespace {
+// Runs the index recovery of the generated getThreadIdx2D() over every group
+// of the folded dispatch and checks that each unfolded group is hit once.
+bool coversAllGroups(const uint32_t unfolded[3], const uint32_t folded[3]) {
+  uint64_t total = uint64_t(unfolded[0]) * unfolded[1];
+  std::vector<uint32_t> hits(total, 0);
+  for (uint64_t z = 0; z < folded[2]; z++) {
+    for (uint64_t y = 0; y < folded[1]; y++) {
+      for (uint64_t x = 0; x < folded[0]; x++) {
+        uint64_t linear = x + folded[0] * (y + folded[1] * z);
+        uint64_t groupX = linear % unfolded[0];
+        uint64_t groupY = linear / unfolded[0];
+        // padding groups fail isThreadInBounds2D()
+        if (groupY >= unfolded[1])
+          continue;
+        hits[groupX + unfolded[0] * groupY]++;
+      }
+    }
+  }
+  for (uint32_t h : hits)
+    if (h != 1)
+      return false;
+  return true;
+}
+
+bool withinLimits(const uint32_t groupCounts[3], const uint32_t maxCounts[3]) {
+  return groupCounts[0] <= maxCounts[0] && groupCounts[1] <= maxCounts[1] &&
+         groupCounts[2] <= maxCounts[2];
+}
+} // namespace
+
+FLR_TEST(dispatchWithinLimitsIsUntouched) {
+  const uint32_t maxCounts[3] = {16, 16, 16};
+  uint32_t groupCounts[3] = {16, 3, 2};
+  FLR_CHECK(foldGroupCounts(groupCounts, maxCounts));
+  FLR_CHECK(groupCounts[0] == 16);
+  FLR_CHECK(groupCounts[1] == 3);
+  FLR_CHECK(groupCounts[2] == 2);
+}
+
+FLR_TEST(dispatch1DIsFolded) {
+  const uint32_t maxCounts[3] = {16, 8, 8};
+  for (uint32_t count : {17u, 100u, 128u, 129u, 1000u}) {
+    const uint32_t unfolded[3] = {count, 1, 1};
+    uint32_t groupCounts[3] = {count, 1, 1};
+    FLR_REQUIRE(foldGroupCounts(groupCounts, maxCounts));
+    FLR_CHECK(withinLimits(groupCounts, maxCounts));
+    FLR_CHECK(coversAllGroups(unfolded, groupCounts));
+  }
+}
+
+FLR_TEST(dispatch2DIsFolded) {
+  const uint32_t maxCounts[3] = {16, 8, 8};
+  // too many groups along x, along y and along both
+  const uint32_t cases[][2] = {{40, 3}, {100, 1}, {5, 30}, {16, 9}, {20, 20}};
+  for (const auto& c : cases) {
+    const uint32_t unfolded[3] = {c[0], c[1], 1};
+    uint32_t groupCounts[3] = {c[0], c[1], 1};
+    FLR_REQUIRE(foldGroupCounts(groupCounts, maxCounts));
+    FLR_CHECK(withinLimits(groupCounts, maxCounts));
+    FLR_CHECK(coversAllGroups(unfolded, groupCounts));
+  }
+}
+
+FLR_TEST(unfoldableDispatchesAreReported) {
+  const uint32_t maxCounts[3] = {16, 8, 8};
+
+  // more groups than fit into all three dimensions
+  uint32_t tooMany[3] = {16 * 8 * 8 + 1, 1, 1};
+  FLR_CHECK(!foldGroupCounts(tooMany, maxCounts));
+  FLR_CHECK(tooMany[0] == 16 * 8 * 8 + 1);
+
+  // 3D dispatches are not folded
+  uint32_t dispatch3D[3] = {17, 1, 2};
+  FLR_CHECK(!foldGroupCounts(dispatch3D, maxCounts));
+  FLR_CHECK(dispatch3D[0] == 17);
+  FLR_CHECK(dispatch3D[2] == 2);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ParsedFlr.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Minimal registry for the CPU only tests of the parser and the passes run on
+// its result. Tests parse small projects written to a temporary directory and
+// check the parsed result, no device or shader compiler is involved.
+namespace flrtest {
+struct TestCase {
+  const char* name;
+  void (*fn)();
+};
+std::vector<TestCase>& getTests();
+
+struct TestRegistrar {
+  TestRegistrar(const char* name, void (*fn)()) {
+    getTests().push_back({name, fn});
+  }
+};
+
+void reportFailure(const char* file, int line, const char* expr);
+
+// Writes the source to <name>.flr in the test directory and parses it. Any
+// .flrc cache left next to it by an earlier run is removed first.
+std::unique_ptr<flr::ParsedFlr> parseSource(
+    const char* name,
+    const std::string& source,
+    const flr::FlrParams& params = {});
+
+// Writes a file into the test directory, e.g. an .flrh included by a test
+// project, and returns its path
+std::string writeTestFile(const char* fileName, const std::string& contents);
+
+// Parses a project file as is, using the .flrc cache next to it if valid
+std::unique_ptr<flr::ParsedFlr>
+parseFile(const std::string& path, const flr::FlrParams& params = {});
+} // namespace flrtest
+
+#define FLR_TEST(NAME)                                                         \
+  static void NAME();                                                          \
+  static ::flrtest::TestRegistrar NAME##_registrar(#NAME, &NAME);              \
+  static void NAME()
+
+#define FLR_CHECK(X)                                                           \
+  if (!(X)) {                                                                  \
+    ::flrtest::reportFailure(__FILE__, __LINE__, #X);                          \
+  }
+
+// stops the test on failure, for checks later ones depend on
+#define FLR_REQUIRE(X)                                                         \
+  if (!(X)) {                                                                  \
+    ::flrtest::reportFailure(__FILE__, __LINE__, #X);                          \
+    return;                                                                    \
+  }
@@ -0,0 +1,85 @@
+#include "FlrTest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace flrtest {
+namespace {
+uint32_t GFailureCount = 0;
+
+std::filesystem::path getTestDirectory() {
+  static std::filesystem::path dir = []() {
+    std::filesystem::path d =
+        std::filesystem::temp_directory_path() / "flrtests";
+    std::filesystem::create_directories(d);
+    return d;
+  }();
+  return dir;
+}
+} // namespace
+
+std::vector<TestCase>& getTests() {
+  static std::vector<TestCase> tests;
+  return tests;
+}
+
+void reportFailure(const char* file, int line, const char* expr) {
+  fprintf(stderr, "  FAILED %s:%d: %s\n", file, line, expr);
+  GFailureCount++;
+}
+
+std::string writeTestFile(const char* fileName, const std::string& contents) {
+  std::filesystem::path path = getTestDirectory() / fileName;
+  std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+  stream.write(contents.data(), contents.size());
+  return path.string();
+}
+
+std::unique_ptr<flr::ParsedFlr>
+parseFile(const std::string& path, const flr::FlrParams& params) {
+  flr::FlrTargetInfo target{};
+  target.extent = {1440, 1280};
+  target.displayFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  target.depthFormat = VK_FORMAT_D32_SFLOAT_S8_UINT;
+  return std::make_unique<flr::ParsedFlr>(target, path.c_str(), params);
+}
+
+std::unique_ptr<flr::ParsedFlr> parseSource(
+    const char* name,
+    const std::string& source,
+    const flr::FlrParams& params) {
+  std::string fileName = std::string(name) + ".flr";
+  std::filesystem::path path = writeTestFile(fileName.c_str(), source);
+  std::filesystem::path cachePath = path;
+  cachePath.replace_extension(".flrc");
+  std::filesystem::remove(cachePath);
+  return parseFile(path.string(), params);
+}
+} // namespace flrtest
+
+// Usage: flrtests [name filter]
+int main(int argc, char* argv[]) {
+  // the projects include Shaders/FlrLib from the source tree
+  AltheaEngine::GProjectDirectory = FLR_SOURCE_DIR;
+
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+  uint32_t runCount = 0;
+  uint32_t failedTestCount = 0;
+  for (const flrtest::TestCase& test : flrtest::getTests()) {
+    if (filter && !strstr(test.name, filter))
+      continue;
+
+    printf("%s\n", test.name);
+    uint32_t failuresBefore = flrtest::GFailureCount;
+    test.fn();
+    runCount++;
+    if (flrtest::GFailureCount != failuresBefore)
+      failedTestCount++;
+  }
+
+  printf("%u tests, %u failed\n", runCount, failedTestCount);
+  return failedTestCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+FlrParams noCacheParams() {
+  FlrParams params{};
+  params.m_bUseCache = false;
+  return params;
+}
+
+std::unique_ptr<ParsedFlr>
+reparse(const ParsedFlr& previous, const FlrParams& params = noCacheParams()) {
+  flr::FlrTargetInfo target{};
+  target.extent = {1440, 1280};
+  target.displayFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  target.depthFormat = VK_FORMAT_D32_SFLOAT_S8_UINT;
+  return std::make_unique<ParsedFlr>(
+      target,
+      previous.m_sourceFiles[0].c_str(),
+      params,
+      previous.m_pIncrementalState.get());
+}
+
+// Compares the parts of the result the test projects declare
+bool isSameResult(const ParsedFlr& a, const ParsedFlr& b) {
+  if (a.m_constUints.size() != b.m_constUints.size() ||
+      a.m_structDefs.size() != b.m_structDefs.size() ||
+      a.m_buffers.size() != b.m_buffers.size() ||
+      a.m_computeShaders.size() != b.m_computeShaders.size() ||
+      a.m_taskList.size() != b.m_taskList.size() ||
+      a.m_warnings != b.m_warnings || a.m_sourceFiles != b.m_sourceFiles)
+    return false;
+  for (size_t i = 0; i < a.m_constUints.size(); i++)
+    if (a.m_constUints[i].name != b.m_constUints[i].name ||
+        a.m_constUints[i].value != b.m_constUints[i].value)
+      return false;
+  for (size_t i = 0; i < a.m_structDefs.size(); i++)
+    if (a.m_structDefs[i].name != b.m_structDefs[i].name ||
+        a.m_structDefs[i].size != b.m_structDefs[i].size)
+      return false;
+  for (size_t i = 0; i < a.m_buffers.size(); i++)
+    if (a.m_buffers[i].name != b.m_buffers[i].name ||
+        a.m_buffers[i].structIdx != b.m_buffers[i].structIdx ||
+        a.m_buffers[i].elemCount != b.m_buffers[i].elemCount ||
+        a.m_buffers[i].flags != b.m_buffers[i].flags)
+      return false;
+  for (size_t i = 0; i < a.m_computeShaders.size(); i++)
+    if (a.m_computeShaders[i].name != b.m_computeShaders[i].name)
+      return false;
+  for (size_t i = 0; i < a.m_taskList.size(); i++)
+    if (a.m_taskList[i].idx != b.m_taskList[i].idx ||
+        a.m_taskList[i].type != b.m_taskList[i].type)
+      return false;
+  return true;
+}
+
+std::string makeProject(const char* includeName, uint32_t count) {
+  return std::string("include \"") + includeName + "\"\n" +
+         "structured_buffer a: P COUNT\n"
+         "compute_shader CS_A: 32 1 1\n"
+         "dispatch_threads: CS_A " +
+         std::to_string(count) +
+         " 1 1\n"
+         "image img: 64 64 rgba8\n"
+         "display_image img\n";
+}
+} // namespace
+
+FLR_TEST(incrementalResumesAfterUnchangedInclude) {
+  flrtest::writeTestFile(
+      "inc_resume.flrh",
+      "uint COUNT: 16\nstruct P { float x; }\n");
+  auto first = flrtest::parseSource(
+      "inc_resume",
+      makeProject("inc_resume.flrh", 16),
+      noCacheParams());
+  FLR_REQUIRE(!first->m_failed);
+  FLR_REQUIRE(first->m_pIncrementalState);
+
+  // the project file changes after the include
+  auto full = flrtest::parseSource(
+      "inc_resume",
+      makeProject("inc_resume.flrh", 32),
+      noCacheParams());
+  auto resumed = reparse(*first);
+  FLR_REQUIRE(!full->m_failed && !resumed->m_failed);
+  FLR_CHECK(full->m_reusedInstrCount == 0);
+  // Fluorescence.flrh, the include and the included declarations
+  FLR_CHECK(resumed->m_reusedInstrCount > 2);
+  FLR_CHECK(isSameResult(*full, *resumed));
+  FLR_CHECK(resumed->m_computeDispatches[0].param0 == 32);
+}
+
+FLR_TEST(incrementalReparsesChangedInclude) {
+  flrtest::writeTestFile(
+      "inc_changed.flrh",
+      "uint COUNT: 16\nstruct P { float x; }\n");
+  auto first = flrtest::parseSource(
+      "inc_changed",
+      makeProject("inc_changed.flrh", 16),
+      noCacheParams());
+  FLR_REQUIRE(!first->m_failed);
+  uint32_t unchangedReuseCount = reparse(*first)->m_reusedInstrCount;
+
+  flrtest::writeTestFile(
+      "inc_changed.flrh",
+      "uint COUNT: 64\nstruct P { vec4 x; }\n");
+  auto resumed = reparse(*first);
+  FLR_REQUIRE(!resumed->m_failed);
+  // resumes at the include, after Fluorescence.flrh
+  FLR_CHECK(resumed->m_reusedInstrCount > 0);
+  FLR_CHECK(resumed->m_reusedInstrCount < unchangedReuseCount);
+  FLR_CHECK(resumed->m_buffers[0].elemCount == 64);
+  FLR_CHECK(resumed->m_structDefs[resumed->m_buffers[0].structIdx].size == 16);
+
+  auto full = flrtest::parseSource(
+      "inc_changed",
+      makeProject("inc_changed.flrh", 16),
+      noCacheParams());
+  FLR_CHECK(isSameResult(*full, *resumed));
+}
+
+FLR_TEST(incrementalUnchangedProject) {
+  flrtest::writeTestFile(
+      "inc_unchanged.flrh",
+      "uint COUNT: 16\nstruct P { float x; }\n");
+  auto first = flrtest::parseSource(
+      "inc_unchanged",
+      makeProject("inc_unchanged.flrh", 16),
+      noCacheParams());
+  FLR_REQUIRE(!first->m_failed);
+
+  auto resumed = reparse(*first);
+  FLR_REQUIRE(!resumed->m_failed);
+  FLR_CHECK(resumed->m_reusedInstrCount > 2);
+  FLR_CHECK(isSameResult(*first, *resumed));
+}
+
+FLR_TEST(incrementalKeyedOnParams) {
+  flrtest::writeTestFile(
+      "inc_params.flrh",
+      "uint COUNT: 16\nstruct P { float x; }\n");
+  auto first = flrtest::parseSource(
+      "inc_params",
+      makeProject("inc_params.flrh", 16),
+      noCacheParams());
+  FLR_REQUIRE(!first->m_failed);
+
+  FlrParams params = noCacheParams();
+  params.m_uintParams.push_back({"COUNT", 8});
+  auto reparsed = reparse(*first, params);
+  FLR_REQUIRE(!reparsed->m_failed);
+  FLR_CHECK(reparsed->m_reusedInstrCount == 0);
+  FLR_CHECK(reparsed->m_buffers[0].elemCount == 8);
+}
+
+FLR_TEST(incrementalKeepsWarnings) {
+  // the struct_size mismatch is found in the part that is reused
+  flrtest::writeTestFile(
+      "inc_warnings.flrh",
+      "uint COUNT: 16\nstruct P { float x; }\nstruct_size: 8\n"
+      "structured_buffer w: P 4\n");
+  auto first = flrtest::parseSource(
+      "inc_warnings",
+      makeProject("inc_warnings.flrh", 16),
+      noCacheParams());
+  FLR_REQUIRE(!first->m_failed);
+  FLR_REQUIRE(first->m_warnings.size() == 2);
+
+  flrtest::writeTestFile(
+      "inc_warnings.flr",
+      makeProject("inc_warnings.flrh", 32));
+  auto resumed = reparse(*first);
+  FLR_REQUIRE(!resumed->m_failed);
+  FLR_CHECK(resumed->m_reusedInstrCount > 2);
+  FLR_CHECK(resumed->m_warnings == first->m_warnings);
+}
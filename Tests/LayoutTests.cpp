@@ -0,0 +1,162 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* DISPLAY = "image img: 64 64 rgba8\n"
+                      "display_image img\n";
+
+const ParsedFlr::StructDef* findStruct(const ParsedFlr& p, const char* name) {
+  for (const auto& s : p.m_structDefs)
+    if (s.name == name)
+      return &s;
+  return nullptr;
+}
+
+bool hasWarning(const ParsedFlr& p, const char* msg) {
+  for (const std::string& warning : p.m_warnings)
+    if (warning.find(msg) != std::string::npos)
+      return true;
+  return false;
+}
+} // namespace
+
+FLR_TEST(std430ScalarsAndVectors) {
+  auto p = flrtest::parseSource(
+      "layout_vectors",
+      std::string(DISPLAY) + "struct A { float a; vec3 b; }\n"
+                             "struct B { vec3 a; float b; }\n"
+                             "struct C { float a; vec2 b; }\n"
+                             "struct D { uint a; }\n"
+                             "struct E { vec3 a; }\n"
+                             "struct F { vec3 c; float r; uint matID; }\n");
+  FLR_REQUIRE(!p->m_failed);
+
+  // vec3 aligns to 16 bytes but only takes 12
+  const auto* a = findStruct(*p, "A");
+  FLR_REQUIRE(a);
+  FLR_CHECK(a->layout.size == 32);
+  FLR_CHECK(a->layout.alignment == 16);
+  FLR_CHECK(a->layout.dataSize == 16);
+
+  const auto* b = findStruct(*p, "B");
+  FLR_REQUIRE(b);
+  FLR_CHECK(b->layout.size == 16);
+  FLR_CHECK(b->layout.dataSize == 16);
+
+  const auto* c = findStruct(*p, "C");
+  FLR_REQUIRE(c);
+  FLR_CHECK(c->layout.size == 16);
+  FLR_CHECK(c->layout.alignment == 8);
+
+  const auto* d = findStruct(*p, "D");
+  FLR_REQUIRE(d);
+  FLR_CHECK(d->layout.size == 4);
+  FLR_CHECK(d->layout.alignment == 4);
+
+  // arrays of these round the struct up to its alignment
+  const auto* e = findStruct(*p, "E");
+  FLR_REQUIRE(e);
+  FLR_CHECK(e->layout.size == 16);
+  FLR_CHECK(e->layout.dataSize == 12);
+
+  const auto* f = findStruct(*p, "F");
+  FLR_REQUIRE(f);
+  FLR_CHECK(f->layout.size == 32);
+  FLR_CHECK(f->layout.dataSize == 20);
+  // without struct_size, buffers use the derived size
+  FLR_CHECK(f->size == 32);
+}
+
+FLR_TEST(std430MatricesArraysAndNesting) {
+  auto p = flrtest::parseSource(
+      "layout_nested",
+      std::string(DISPLAY) + "uint N: 3\n"
+                             "struct M { mat4 m; }\n"
+                             "struct M3 { mat3 m; }\n"
+                             "struct Arr { float a[N]; }\n"
+                             "struct VecArr { vec3 v[2]; }\n"
+                             "struct Inner { vec2 a; }\n"
+                             "struct Outer { float f; Inner i; float g; }\n");
+  FLR_REQUIRE(!p->m_failed);
+
+  const auto* m = findStruct(*p, "M");
+  FLR_REQUIRE(m);
+  FLR_CHECK(m->layout.size == 64);
+
+  // matrix columns are laid out like an array of vec3
+  const auto* m3 = findStruct(*p, "M3");
+  FLR_REQUIRE(m3);
+  FLR_CHECK(m3->layout.size == 48);
+
+  // std430 arrays of scalars are tightly packed
+  const auto* arr = findStruct(*p, "Arr");
+  FLR_REQUIRE(arr);
+  FLR_CHECK(arr->layout.size == 12);
+
+  const auto* vecArr = findStruct(*p, "VecArr");
+  FLR_REQUIRE(vecArr);
+  FLR_CHECK(vecArr->layout.size == 32);
+
+  const auto* outer = findStruct(*p, "Outer");
+  FLR_REQUIRE(outer);
+  FLR_CHECK(outer->layout.alignment == 8);
+  FLR_CHECK(outer->layout.size == 24);
+}
+
+FLR_TEST(structSizeOverridesDerivedSize) {
+  auto p = flrtest::parseSource(
+      "layout_struct_size",
+      std::string(DISPLAY) + "struct Same { vec4 a; }\n"
+                             "struct_size: 16\n"
+                             "struct Differs { vec3 a; }\n"
+                             "struct_size: 12\n"
+                             "structured_buffer same: Same 4\n"
+                             "structured_buffer differs: Differs 4\n");
+  FLR_REQUIRE(!p->m_failed);
+  const auto* differs = findStruct(*p, "Differs");
+  FLR_REQUIRE(differs);
+  FLR_CHECK(differs->size == 12);
+  FLR_CHECK(differs->layout.size == 16);
+  FLR_CHECK(p->getBufferByteSize(p->m_buffers[1]) == 48);
+  FLR_CHECK(hasWarning(*p, "The struct_size of Differs is 12 bytes"));
+  FLR_CHECK(!hasWarning(*p, "The struct_size of Same"));
+}
+
+FLR_TEST(underivableLayoutNeedsStructSize) {
+  auto p = flrtest::parseSource(
+      "layout_underivable",
+      std::string(DISPLAY) + "struct U { UnknownType x; }\n"
+                             "structured_buffer u: U 4\n");
+  FLR_CHECK(p->m_failed);
+  FLR_CHECK(
+      std::string(p->m_errMsg).find("declare its size with struct_size") !=
+      std::string::npos);
+}
+
+FLR_TEST(sceneHeaderKeepsDeclaredSizes) {
+  // The shared scene header declares the sizes its buffers have always been
+  // allocated with, the derived std430 sizes are only reported
+  auto p = flrtest::parseSource(
+      "layout_scene",
+      std::string(DISPLAY) + "include \"FlrLib/Scene/Scene.flrh\"\n");
+  FLR_REQUIRE(!p->m_failed);
+
+  struct Expected {
+    const char* name;
+    uint32_t size;
+    uint32_t std430Size;
+  };
+  const Expected expected[] = {
+      {"Sphere", 20, 32},
+      {"Material", 64, 48},
+      {"SceneVertex", 12, 16}};
+  for (const Expected& e : expected) {
+    const auto* s = findStruct(*p, e.name);
+    FLR_REQUIRE(s);
+    FLR_CHECK(s->size == e.size);
+    FLR_CHECK(s->layout.size == e.std430Size);
+  }
+}
@@ -0,0 +1,125 @@
+#include "FlrTest.h"
+
+#include "CodeGen.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* DISPLAY = "image img: 64 64 rgba8\n"
+                      "display_image img\n";
+
+const ParsedFlr::StructDef* findStruct(const ParsedFlr& p, const char* name) {
+  for (const auto& s : p.m_structDefs)
+    if (s.name == name)
+      return &s;
+  return nullptr;
+}
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+} // namespace
+
+FLR_TEST(packedFieldLayouts) {
+  auto p = flrtest::parseSource(
+      "packed_layouts",
+      std::string(DISPLAY) + "struct H2 { half2 a; }\n"
+                             "struct H4 { half4 a; }\n"
+                             "struct U8 { unorm8x4 a; snorm8x4 b; }\n"
+                             "struct U16 { unorm16x4 a; snorm16x2 b; }\n"
+                             "struct Mixed { vec3 pos; half2 vel; }\n");
+  FLR_REQUIRE(!p->m_failed);
+
+  // stored like uint / uvec2
+  const auto* h2 = findStruct(*p, "H2");
+  FLR_REQUIRE(h2);
+  FLR_CHECK(h2->layout.size == 4);
+  FLR_CHECK(h2->layout.alignment == 4);
+
+  const auto* h4 = findStruct(*p, "H4");
+  FLR_REQUIRE(h4);
+  FLR_CHECK(h4->layout.size == 8);
+  FLR_CHECK(h4->layout.alignment == 8);
+
+  const auto* u8 = findStruct(*p, "U8");
+  FLR_REQUIRE(u8);
+  FLR_CHECK(u8->layout.size == 8);
+
+  const auto* u16 = findStruct(*p, "U16");
+  FLR_REQUIRE(u16);
+  FLR_CHECK(u16->layout.size == 16);
+
+  // the packed velocity fills the gap behind the vec3
+  const auto* mixed = findStruct(*p, "Mixed");
+  FLR_REQUIRE(mixed);
+  FLR_CHECK(mixed->layout.size == 16);
+  FLR_CHECK(mixed->layout.dataSize == 16);
+}
+
+FLR_TEST(packedFieldAccessors) {
+  auto p = flrtest::parseSource(
+      "packed_fields",
+      std::string(DISPLAY) + "struct P { vec3 pos; half2 vel; half4 h[2]; }\n"
+                             "structured_buffer particles: P 16\n");
+  FLR_REQUIRE(!p->m_failed);
+  const auto* s = findStruct(*p, "P");
+  FLR_REQUIRE(s);
+
+  // array fields go through the conversions directly
+  auto fields = p->getPackedFields(*s);
+  FLR_REQUIRE(fields.size() == 1);
+  FLR_CHECK(fields[0].name == "vel");
+  FLR_CHECK(std::string(fields[0].pType->name) == "half2");
+
+  std::filesystem::path projPath =
+      std::filesystem::temp_directory_path() / "flrtests" / "packed_fields.flr";
+  std::filesystem::path genPath =
+      std::filesystem::temp_directory_path() / "flrtests" /
+      "packed_fields.gen.glsl";
+  codeGen(*p, projPath, genPath);
+  std::ifstream genFile(genPath);
+  FLR_REQUIRE(genFile.is_open());
+  std::stringstream gen;
+  gen << genFile.rdbuf();
+  std::string code = gen.str();
+
+  FLR_CHECK(code.find("vec2 unpack_half2(uint v)") != std::string::npos);
+  FLR_CHECK(code.find("uint pack_half2(vec2 x)") != std::string::npos);
+  FLR_CHECK(code.find("uvec2 pack_half4(vec4 x)") != std::string::npos);
+  FLR_CHECK(
+      code.find("#define P_vel(S) unpack_half2((S).vel)") != std::string::npos);
+  FLR_CHECK(
+      code.find("#define P_set_vel(S, X) (S).vel = pack_half2(X)") !=
+      std::string::npos);
+  // the struct is declared with the storage types
+  FLR_CHECK(code.find("half2 vel;") == std::string::npos);
+  FLR_CHECK(code.find("uint vel;") != std::string::npos);
+  FLR_CHECK(code.find("uvec2 h[2]") != std::string::npos);
+}
+
+FLR_TEST(scalarHalfFieldsAreRejected) {
+  FLR_CHECK(failsWith(
+      *flrtest::parseSource(
+          "packed_half_scalar",
+          std::string(DISPLAY) + "struct S { float a; half b; }\n"),
+      "Struct S declares a half field"));
+  FLR_CHECK(failsWith(
+      *flrtest::parseSource(
+          "packed_half3",
+          std::string(DISPLAY) + "struct S {\n"
+                                 "  // a comment\n"
+                                 "  f16vec3 n;\n"
+                                 "}\n"),
+      "Struct S declares a f16vec3 field"));
+
+  // names merely containing half are fine
+  auto p = flrtest::parseSource(
+      "packed_half_name",
+      std::string(DISPLAY) + "struct halfStruct { float half_a; half2 b; }\n");
+  FLR_CHECK(!p->m_failed);
+}
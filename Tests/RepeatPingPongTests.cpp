@@ -0,0 +1,281 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* RESOURCES = "struct P { float x; }\n"
+                        "struct Q { uint y; }\n"
+                        "structured_buffer a: P 64\n"
+                        "structured_buffer b: P 64\n"
+                        "structured_buffer c: Q 64\n"
+                        "structured_buffer d: P 32\n"
+                        "image img: 64 64 rgba8\n"
+                        "display_image img\n"
+                        "slider_uint ITERS: 3 1 8\n"
+                        "uint N: 2\n";
+
+const char* SHADERS = "compute_shader CS_Step: 32 1 1\n"
+                      "  reads: a\n"
+                      "  writes: b\n"
+                      "compute_shader CS_ReadA: 32 1 1\n"
+                      "  reads: a\n"
+                      "compute_shader CS_ReadB: 32 1 1\n"
+                      "  reads: b\n";
+
+std::unique_ptr<ParsedFlr>
+parse(const char* name, const std::string& decls, const std::string& tasks) {
+  return flrtest::parseSource(
+      name,
+      std::string(RESOURCES) + decls + SHADERS + tasks);
+}
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+} // namespace
+
+FLR_TEST(repeatCounts) {
+  auto p = parse(
+      "repeat_counts",
+      "",
+      "repeat: 4\n"
+      "  dispatch_threads: CS_ReadA 64 1 1\n"
+      "repeat_end\n"
+      "repeat: N\n"
+      "  dispatch_threads: CS_ReadA 64 1 1\n"
+      "repeat_end\n"
+      "repeat: ITERS\n"
+      "  dispatch_threads: CS_ReadA 64 1 1\n"
+      "repeat_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_repeats.size() == 3);
+  FLR_CHECK(p->m_repeats[0].count == 4);
+  FLR_CHECK(p->m_repeats[0].sliderUintIdx == -1);
+  FLR_CHECK(p->m_repeats[1].count == 2);
+  FLR_CHECK(p->m_repeats[1].sliderUintIdx == -1);
+  // slider counts start at the default value and are read when recording
+  FLR_CHECK(p->m_repeats[2].count == 3);
+  FLR_CHECK(p->m_repeats[2].sliderUintIdx == 0);
+}
+
+FLR_TEST(nestedRepeats) {
+  auto p = parse(
+      "repeat_nested",
+      "",
+      "repeat: 2\n"
+      "  dispatch_threads: CS_ReadA 64 1 1\n"
+      "  repeat: 3\n"
+      "    dispatch_threads: CS_ReadA 64 1 1\n"
+      "  repeat_end\n"
+      "repeat_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_taskList.size() == 6);
+  FLR_CHECK(p->m_taskList[0].type == ParsedFlr::TT_REPEAT);
+  FLR_CHECK(p->m_taskList[2].type == ParsedFlr::TT_REPEAT);
+  // repeat_end refers to the repeat it closes
+  FLR_CHECK(p->m_taskList[4].type == ParsedFlr::TT_REPEAT_END);
+  FLR_CHECK(p->m_taskList[4].idx == p->m_taskList[2].idx);
+  FLR_CHECK(p->m_taskList[5].type == ParsedFlr::TT_REPEAT_END);
+  FLR_CHECK(p->m_taskList[5].idx == p->m_taskList[0].idx);
+}
+
+FLR_TEST(unbalancedRepeats) {
+  auto missingEnd = parse(
+      "repeat_missing_end",
+      "",
+      "repeat: 2\n"
+      "  dispatch_threads: CS_ReadA 64 1 1\n");
+  FLR_CHECK(failsWith(*missingEnd, "missing its repeat_end"));
+
+  auto strayEnd = parse(
+      "repeat_stray_end",
+      "",
+      "dispatch_threads: CS_ReadA 64 1 1\n"
+      "repeat_end\n");
+  FLR_CHECK(failsWith(*strayEnd, "repeat_end without corresponding repeat"));
+
+  auto blockMissingEnd = parse(
+      "repeat_block_missing_end",
+      "",
+      "task_block_start BLOCK:\n"
+      "  repeat: 2\n"
+      "    dispatch_threads: CS_ReadA 64 1 1\n"
+      "task_block_end\n");
+  FLR_CHECK(failsWith(*blockMissingEnd, "task_block_end with a repeat"));
+
+  auto badCount = parse(
+      "repeat_bad_count",
+      "",
+      "repeat: UNKNOWN\n"
+      "  dispatch_threads: CS_ReadA 64 1 1\n"
+      "repeat_end\n");
+  FLR_CHECK(failsWith(*badCount, "repeat count"));
+}
+
+FLR_TEST(pingPongPair) {
+  auto p = parse(
+      "ping_pong_pair",
+      "ping_pong: a b\n",
+      "repeat: 2 ping_pong: a b\n"
+      "  dispatch_threads: CS_Step 64 1 1\n"
+      "repeat_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_pingPongPairs.size() == 1);
+  FLR_CHECK(p->m_pingPongPairs[0].buffers[0] == 0);
+  FLR_CHECK(p->m_pingPongPairs[0].buffers[1] == 1);
+}
+
+FLR_TEST(invalidPingPongPairs) {
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_same", "ping_pong: a a\n", ""),
+      "must be different"));
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_struct", "ping_pong: a c\n", ""),
+      "same struct, element count"));
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_count", "ping_pong: a d\n", ""),
+      "same struct, element count"));
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_twice", "ping_pong: a b\nping_pong: b d\n", ""),
+      "single ping_pong pair"));
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_unknown", "ping_pong: a missing\n", ""),
+      "Could not find referenced buffer"));
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_one", "ping_pong: a\n", ""),
+      "Expected two buffers"));
+}
+
+FLR_TEST(repeatForgetsBodyState) {
+  // every iteration follows the previous one, so the barriers at the start of
+  // the body are needed again, and the tasks after the repeat cannot rely on
+  // the state inside of it
+  auto p = parse(
+      "repeat_barriers",
+      "",
+      "dispatch_threads: CS_Step 64 1 1\n"
+      "repeat: 2\n"
+      "  dispatch_threads: CS_Step 64 1 1\n"
+      "repeat_end\n"
+      "dispatch_threads: CS_ReadB 64 1 1\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(
+      p->describeTaskPlan() == "task_list\n"
+                               "  barrier write: b\n"
+                               "  dispatch CS_Step\n"
+                               "  repeat: 2\n"
+                               "    barrier write: b\n"
+                               "    dispatch CS_Step\n"
+                               "  repeat_end\n"
+                               "  barrier read: b\n"
+                               "  dispatch CS_ReadB\n");
+}
+
+FLR_TEST(pingPongPartnerWritesAreTracked) {
+  // a is only ever written through b's binding while the pair is swapped,
+  // its first read in the list still follows a write
+  auto p = parse(
+      "ping_pong_barriers",
+      "ping_pong: a b\n",
+      "dispatch_threads: CS_ReadA 64 1 1\n"
+      "repeat: ITERS ping_pong: b a\n"
+      "  dispatch_threads: CS_Step 64 1 1\n"
+      "repeat_end\n"
+      "dispatch_threads: CS_ReadA 64 1 1\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(
+      p->describeTaskPlan() == "ping_pong: a b\n"
+                               "task_list\n"
+                               "  barrier read: a\n"
+                               "  dispatch CS_ReadA\n"
+                               "  repeat: ITERS (slider_uint) ping_pong: a b\n"
+                               "    barrier read: a\n"
+                               "    barrier write: b\n"
+                               "    dispatch CS_Step\n"
+                               "  repeat_end\n"
+                               "  barrier read: a\n"
+                               "  dispatch CS_ReadA\n");
+}
+
+
+FLR_TEST(onlyListedPairsAreSwapped) {
+  // the second repeat doesn't list the pair, an odd count must not leave it
+  // swapped
+  auto p = parse(
+      "ping_pong_unrelated_repeat",
+      "structured_buffer e: Q 64\n"
+      "ping_pong: a b\n"
+      "ping_pong: c e\n",
+      "repeat: 2 ping_pong: a b\n"
+      "  dispatch_threads: CS_Step 64 1 1\n"
+      "repeat_end\n"
+      "repeat: 3\n"
+      "  dispatch_threads: CS_ReadB 64 1 1\n"
+      "repeat_end\n"
+      "repeat: N ping_pong: c e b a # both pairs\n"
+      "  dispatch_threads: CS_Step 64 1 1\n"
+      "repeat_end\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_repeats.size() == 3);
+  FLR_CHECK(p->m_repeats[0].pingPongMask == 1);
+  FLR_CHECK(p->m_repeats[1].pingPongMask == 0);
+  FLR_CHECK(p->m_repeats[2].pingPongMask == 3);
+  FLR_CHECK(p->m_warnings.empty());
+  // the state of the pair is only forgotten around the repeats swapping it
+  std::string plan = p->describeTaskPlan();
+  FLR_CHECK(
+      plan.find("  repeat: 3\n"
+                "    barrier read: b\n"
+                "    dispatch CS_ReadB\n"
+                "  repeat_end\n"
+                "  repeat: 2 ping_pong: a b ping_pong: c e\n") !=
+      std::string::npos);
+}
+
+FLR_TEST(invalidRepeatPingPongLists) {
+  FLR_CHECK(failsWith(
+      *parse(
+          "repeat_ping_pong_undeclared",
+          "",
+          "repeat: 2 ping_pong: a b\n"
+          "repeat_end\n"),
+      "must be declared as a ping_pong pair"));
+  FLR_CHECK(failsWith(
+      *parse(
+          "repeat_ping_pong_odd",
+          "ping_pong: a b\n",
+          "repeat: 2 ping_pong: a\n"
+          "repeat_end\n"),
+      "Expected the two buffers"));
+  FLR_CHECK(failsWith(
+      *parse(
+          "repeat_ping_pong_keyword",
+          "ping_pong: a b\n",
+          "repeat: 2 swap: a b\n"
+          "repeat_end\n"),
+      "Expected ping_pong: after the repeat count"));
+
+  auto unswapped = parse(
+      "ping_pong_unswapped",
+      "ping_pong: a b\n",
+      "repeat: 2\n"
+      "  dispatch_threads: CS_Step 64 1 1\n"
+      "repeat_end\n");
+  FLR_REQUIRE(!unswapped->m_failed);
+  FLR_REQUIRE(unswapped->m_warnings.size() == 1);
+  FLR_CHECK(
+      unswapped->m_warnings[0].find("a b is not swapped by any repeat") !=
+      std::string::npos);
+
+  std::string decls;
+  for (uint32_t i = 0; i < 10; i++)
+    decls += "structured_buffer p" + std::to_string(i) + ": P 4\n";
+  for (uint32_t i = 0; i < 10; i += 2)
+    decls += "ping_pong: p" + std::to_string(i) + " p" +
+             std::to_string(i + 1) + "\n";
+  FLR_CHECK(failsWith(
+      *parse("ping_pong_too_many", decls, ""),
+      "Too many ping_pong pairs, at most 4"));
+}
@@ -0,0 +1,108 @@
+#include "FlrTest.h"
+
+#include "ShaderCache.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+using namespace flr;
+
+namespace {
+std::optional<uint64_t> computeKey(const std::string& path) {
+  // a fresh instance, the cache only hashes each source once
+  ShaderCache cache(std::filesystem::temp_directory_path() / "flrtests_spv");
+  return cache.computeKey(
+      path,
+      {},
+      SHADER_LANGUAGE_GLSL,
+      ShaderCache::STAGE_COMPUTE);
+}
+} // namespace
+
+FLR_TEST(shaderKeyFollowsIncludedFiles) {
+  flrtest::writeTestFile("sc_inner.glsl", "float inner() { return 1.0; }\n");
+  flrtest::writeTestFile(
+      "sc_middle.glsl",
+      "#include \"sc_inner.glsl\"\nfloat middle() { return inner(); }\n");
+  std::string path = flrtest::writeTestFile(
+      "sc_main.glsl",
+      "  #  include \"sc_middle.glsl\"\nvoid main() {}\n");
+
+  std::optional<uint64_t> key = computeKey(path);
+  FLR_REQUIRE(key);
+  FLR_CHECK(computeKey(path) == key);
+
+  flrtest::writeTestFile("sc_inner.glsl", "float inner() { return 2.0; }\n");
+  std::optional<uint64_t> changedKey = computeKey(path);
+  FLR_REQUIRE(changedKey);
+  FLR_CHECK(*changedKey != *key);
+}
+
+FLR_TEST(shaderKeyIndependentOfPath) {
+  // the project loader compiles a pending file that is renamed afterwards
+  const char* src = "#include \"sc_inner.glsl\"\nvoid main() {}\n";
+  std::string pending = flrtest::writeTestFile("sc_gen.loading.glsl", src);
+  std::string final = flrtest::writeTestFile("sc_gen.glsl", src);
+  std::optional<uint64_t> pendingKey = computeKey(pending);
+  FLR_REQUIRE(pendingKey);
+  FLR_CHECK(computeKey(final) == pendingKey);
+}
+
+FLR_TEST(shaderKeyDependsOnDefines) {
+  std::string path =
+      flrtest::writeTestFile("sc_defines.glsl", "void main() {}\n");
+  ShaderCache cache(std::filesystem::temp_directory_path() / "flrtests_spv");
+  auto a = cache.computeKey(
+      path,
+      {{"A", "1"}, {"B", "2"}},
+      SHADER_LANGUAGE_GLSL,
+      ShaderCache::STAGE_COMPUTE);
+  auto b = cache.computeKey(
+      path,
+      {{"B", "2"}, {"A", "1"}},
+      SHADER_LANGUAGE_GLSL,
+      ShaderCache::STAGE_COMPUTE);
+  auto c = cache.computeKey(
+      path,
+      {{"A", "1"}, {"B", "3"}},
+      SHADER_LANGUAGE_GLSL,
+      ShaderCache::STAGE_COMPUTE);
+  auto d = cache.computeKey(
+      path,
+      {{"A", "1"}, {"B", "2"}},
+      SHADER_LANGUAGE_GLSL,
+      ShaderCache::STAGE_PIXEL);
+  FLR_REQUIRE(a && b && c && d);
+  FLR_CHECK(*a == *b);
+  FLR_CHECK(*a != *c);
+  FLR_CHECK(*a != *d);
+}
+
+FLR_TEST(unresolvedIncludesAreNotCached) {
+  std::string missing = flrtest::writeTestFile(
+      "sc_missing.glsl",
+      "#include <NoSuchDir/NoSuchFile.glsl>\nvoid main() {}\n");
+  FLR_CHECK(!computeKey(missing));
+
+  std::string nestedMissing = flrtest::writeTestFile(
+      "sc_nested_missing.glsl",
+      "#include \"sc_missing.glsl\"\nvoid main() {}\n");
+  FLR_CHECK(!computeKey(nestedMissing));
+
+  std::string macro = flrtest::writeTestFile(
+      "sc_macro.glsl",
+      "#define INC \"sc_inner.glsl\"\n#include INC\nvoid main() {}\n");
+  FLR_CHECK(!computeKey(macro));
+
+  FLR_CHECK(!computeKey(
+      (std::filesystem::temp_directory_path() / "flrtests" / "sc_none.glsl")
+          .string()));
+}
+
+FLR_TEST(commentedIncludesAreIgnored) {
+  std::string path = flrtest::writeTestFile(
+      "sc_commented.glsl",
+      "// #include <NoSuchDir/NoSuchFile.glsl>\nvoid main() {}\n");
+  FLR_CHECK(computeKey(path));
+}
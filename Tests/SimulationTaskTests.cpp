@@ -0,0 +1,85 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* DECLS = "struct P { float x; }\n"
+                    "structured_buffer a: P 64\n"
+                    "image img: 64 64 rgba8\n"
+                    "display_image img\n"
+                    "uint STEPS: 3\n"
+                    "float RATE: 120.0\n"
+                    "compute_shader CS_Step: 32 1 1\n"
+                    "task_block_start Step\n"
+                    "  dispatch_threads: CS_Step 64 1 1\n"
+                    "task_block_end\n";
+
+std::unique_ptr<ParsedFlr> parse(const char* name, const std::string& src) {
+  return flrtest::parseSource(name, std::string(DECLS) + src);
+}
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+} // namespace
+
+FLR_TEST(simulationSubsteps) {
+  auto p = parse("sim_none", "");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(p->m_simulationTask.taskBlockIdx == -1);
+
+  p = parse("sim_substeps", "simulation_task: Step substeps 4\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(p->m_simulationTask.taskBlockIdx == 0);
+  FLR_CHECK(p->m_simulationTask.mode == ParsedFlr::SM_SUBSTEPS);
+  FLR_CHECK(p->m_simulationTask.substepCount == 4);
+  FLR_CHECK(
+      p->describeTaskPlan().find("simulation_task: Step substeps 4\n") !=
+      std::string::npos);
+
+  p = parse("sim_substeps_const", "simulation_task: Step substeps STEPS\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(p->m_simulationTask.substepCount == 3);
+}
+
+FLR_TEST(simulationFixedRate) {
+  auto p = parse("sim_rate", "simulation_task: Step fixed_rate 60 4\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(p->m_simulationTask.mode == ParsedFlr::SM_FIXED_RATE);
+  FLR_CHECK(p->m_simulationTask.rate == 60.0f);
+  FLR_CHECK(p->m_simulationTask.substepCount == 4);
+  FLR_CHECK(
+      p->describeTaskPlan().find(
+          "simulation_task: Step fixed_rate 60 (at most 4 per frame)\n") !=
+      std::string::npos);
+
+  // the steps per frame are capped at 8 unless given
+  p = parse("sim_rate_default", "simulation_task: Step fixed_rate RATE\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(p->m_simulationTask.rate == 120.0f);
+  FLR_CHECK(p->m_simulationTask.substepCount == 8);
+}
+
+FLR_TEST(invalidSimulationTasks) {
+  FLR_CHECK(failsWith(
+      *parse("sim_unknown_block", "simulation_task: Missing substeps 2\n"),
+      "Could not find task block with specified name."));
+  FLR_CHECK(failsWith(
+      *parse("sim_unknown_mode", "simulation_task: Step steps 2\n"),
+      "Expected substeps or fixed_rate after the simulation_task block "
+      "name."));
+  FLR_CHECK(failsWith(
+      *parse("sim_zero_substeps", "simulation_task: Step substeps 0\n"),
+      "Expected a substep count greater than 0 in simulation_task."));
+  FLR_CHECK(failsWith(
+      *parse("sim_missing_substeps", "simulation_task: Step substeps\n"),
+      "Expected a substep count greater than 0 in simulation_task."));
+  FLR_CHECK(failsWith(
+      *parse("sim_zero_rate", "simulation_task: Step fixed_rate 0\n"),
+      "Expected a step rate greater than 0 in simulation_task."));
+  FLR_CHECK(failsWith(
+      *parse("sim_negative_rate", "simulation_task: Step fixed_rate -30\n"),
+      "Expected a step rate greater than 0 in simulation_task."));
+}
@@ -0,0 +1,162 @@
+#include "FlrTest.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+using namespace flr;
+
+namespace {
+const char* RESOURCES = "image img: 64 64 rgba8\n"
+                        "display_image img\n"
+                        "struct Particle { vec3 pos; float mass; vec2 vel; }\n";
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+} // namespace
+
+FLR_TEST(soaFieldLayout) {
+  auto p = flrtest::parseSource(
+      "soa_layout",
+      std::string(RESOURCES) + "structured_buffer particles: Particle 100\n"
+                               "soa\n");
+  FLR_REQUIRE(!p->m_failed);
+  const ParsedFlr::BufferDesc& desc = p->m_buffers[0];
+  FLR_CHECK(desc.isSoa());
+  FLR_REQUIRE(desc.soaFields.size() == 3);
+
+  const auto& pos = desc.soaFields[0];
+  FLR_CHECK(pos.name == "pos");
+  FLR_CHECK(pos.structOffset == 0);
+  FLR_CHECK(pos.size == 12);
+  // vec3 arrays keep their 16 byte alignment
+  FLR_CHECK(pos.stride == 16);
+  FLR_CHECK(pos.offset == 0);
+
+  // every field array starts 256 byte aligned
+  const auto& mass = desc.soaFields[1];
+  FLR_CHECK(mass.name == "mass");
+  FLR_CHECK(mass.structOffset == 12);
+  FLR_CHECK(mass.stride == 4);
+  FLR_CHECK(mass.offset == 1792);
+
+  const auto& vel = desc.soaFields[2];
+  FLR_CHECK(vel.name == "vel");
+  FLR_CHECK(vel.structOffset == 16);
+  FLR_CHECK(vel.stride == 8);
+  FLR_CHECK(vel.offset == 2304);
+
+  FLR_CHECK(p->getBufferByteSize(desc) == 2304 + 8 * 100);
+}
+
+FLR_TEST(soaArrayField) {
+  auto p = flrtest::parseSource(
+      "soa_array_field",
+      std::string(RESOURCES) + "struct W { float w[4]; uint id; }\n"
+                               "structured_buffer weights: W 8\n"
+                               "soa\n");
+  FLR_REQUIRE(!p->m_failed);
+  const ParsedFlr::BufferDesc& desc = p->m_buffers[0];
+  FLR_REQUIRE(desc.soaFields.size() == 2);
+  FLR_CHECK(desc.soaFields[0].arrayDims == "[4]");
+  FLR_CHECK(desc.soaFields[0].size == 16);
+  FLR_CHECK(desc.soaFields[0].stride == 16);
+  FLR_CHECK(desc.soaFields[1].structOffset == 16);
+  FLR_CHECK(desc.soaFields[1].offset == 256);
+}
+
+FLR_TEST(soaPackRoundTrip) {
+  auto p = flrtest::parseSource(
+      "soa_round_trip",
+      std::string(RESOURCES) + "structured_buffer particles: Particle 5\n"
+                               "soa\n");
+  FLR_REQUIRE(!p->m_failed);
+  const ParsedFlr::BufferDesc& desc = p->m_buffers[0];
+  uint32_t structSize = p->m_structDefs[desc.structIdx].size;
+  FLR_REQUIRE(structSize == 32);
+
+  std::vector<char> aos(structSize * desc.elemCount);
+  for (size_t i = 0; i < aos.size(); i++)
+    aos[i] = static_cast<char>(i + 1);
+
+  std::vector<char> soa(p->getBufferByteSize(desc), 0);
+  ParsedFlr::packSoa(desc, structSize, desc.elemCount, aos.data(), soa.data());
+
+  // element 3's mass lands in the mass array
+  const auto& mass = desc.soaFields[1];
+  FLR_CHECK(
+      memcmp(
+          soa.data() + mass.offset + 3 * mass.stride,
+          aos.data() + 3 * structSize + mass.structOffset,
+          mass.size) == 0);
+
+  std::vector<char> unpacked(aos.size(), 'x');
+  ParsedFlr::unpackSoa(desc, structSize, soa.data(), unpacked.data());
+  for (uint32_t i = 0; i < desc.elemCount; i++) {
+    for (const auto& field : desc.soaFields) {
+      size_t offset = size_t(i) * structSize + field.structOffset;
+      FLR_CHECK(
+          memcmp(unpacked.data() + offset, aos.data() + offset, field.size) ==
+          0);
+    }
+    // the padding after vel reads back as zero
+    for (uint32_t b = 24; b < structSize; b++)
+      FLR_CHECK(unpacked[size_t(i) * structSize + b] == 0);
+  }
+}
+
+FLR_TEST(soaPackPartial) {
+  // uploads may cover only the first elements of the buffer
+  auto p = flrtest::parseSource(
+      "soa_partial",
+      std::string(RESOURCES) + "structured_buffer particles: Particle 8\n"
+                               "soa\n");
+  FLR_REQUIRE(!p->m_failed);
+  const ParsedFlr::BufferDesc& desc = p->m_buffers[0];
+  uint32_t structSize = p->m_structDefs[desc.structIdx].size;
+
+  std::vector<char> aos(structSize * 2, 7);
+  std::vector<char> soa(p->getBufferByteSize(desc), 0);
+  ParsedFlr::packSoa(desc, structSize, 2, aos.data(), soa.data());
+
+  const auto& vel = desc.soaFields[2];
+  FLR_CHECK(soa[vel.offset + vel.stride - 1] == 7);
+  FLR_CHECK(soa[vel.offset + 2 * vel.stride] == 0);
+}
+
+FLR_TEST(invalidSoaBuffers) {
+  FLR_CHECK(failsWith(
+      *flrtest::parseSource(
+          "soa_no_body",
+          // builtin types have no body to derive the fields from
+          std::string(RESOURCES) + "structured_buffer o: vec4 4\n"
+                                   "soa\n"),
+      "layout can be derived"));
+
+  FLR_CHECK(failsWith(
+      *flrtest::parseSource(
+          "soa_struct_size",
+          std::string(RESOURCES) + "struct Small { vec4 a; vec4 b; }\n"
+                                   "struct_size: 16\n"
+                                   "structured_buffer s: Small 4\n"
+                                   "soa\n"),
+      "cannot be smaller than its std430 size"));
+
+  FLR_CHECK(failsWith(
+      *flrtest::parseSource(
+          "soa_array",
+          std::string(RESOURCES) + "structured_buffer p(2): Particle 4\n"
+                                   "soa\n"),
+      "Soa buffers cannot be buffer arrays"));
+
+  FLR_CHECK(failsWith(
+      *flrtest::parseSource(
+          "soa_ping_pong",
+          std::string(RESOURCES) + "structured_buffer a: Particle 4\n"
+                                   "soa\n"
+                                   "structured_buffer b: Particle 4\n"
+                                   "ping_pong: a b\n"),
+      "Either both or neither buffer of a ping_pong pair must be soa"));
+}
@@ -0,0 +1,109 @@
+#include "FlrTest.h"
+
+#include "Hash.h"
+
+#include <cstring>
+#include <string>
+
+using namespace flr;
+
+static_assert(hashString("") == FNV_OFFSET_BASIS);
+static_assert(hashString("a") == 0xaf63dc4c8601ec8cull);
+static_assert(hashString("foobar") == 0x85944171f73967e8ull);
+
+namespace {
+const char* DISPLAY_IMAGE = "image img: 64 64 rgba8\n"
+                            "display_image img\n";
+
+const ParsedFlr::BufferDesc* findBuffer(const ParsedFlr& p, const char* name) {
+  for (const auto& b : p.m_buffers)
+    if (b.name == name)
+      return &b;
+  return nullptr;
+}
+} // namespace
+
+FLR_TEST(symbolsResolveAcrossManyDeclarations) {
+  std::string src;
+  for (uint32_t i = 0; i < 2000; i++) {
+    std::string n = std::to_string(i);
+    src += "uint C_" + n + ": " + std::to_string(i + 1) + "\n";
+    src += "struct S_" + n + " { float a; uint b; }\n";
+    src += "structured_buffer B_" + n + ": S_" + n + " C_" + n + "\n";
+  }
+  src += DISPLAY_IMAGE;
+
+  auto p = flrtest::parseSource("symbols_many", src);
+  FLR_REQUIRE(!p->m_failed);
+
+  for (uint32_t i = 0; i < 2000; i += 97) {
+    std::string n = std::to_string(i);
+    const auto* b = findBuffer(*p, ("B_" + n).c_str());
+    FLR_REQUIRE(b);
+    FLR_CHECK(b->elemCount == i + 1);
+    FLR_CHECK(p->m_structDefs[b->structIdx].name == "S_" + n);
+  }
+}
+
+FLR_TEST(firstDeclarationWins) {
+  // FlrParams are declared ahead of the project and shadow its constants
+  FlrParams params{};
+  params.m_uintParams.push_back({"COUNT", 7});
+  auto p = flrtest::parseSource(
+      "symbols_shadow",
+      std::string("uint COUNT: 3\n"
+                  "uint OTHER: 5\n"
+                  "uint OTHER: 9\n"
+                  "struct P { float x; }\n"
+                  "structured_buffer a: P COUNT\n"
+                  "structured_buffer b: P OTHER\n") +
+          DISPLAY_IMAGE,
+      params);
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(findBuffer(*p, "a")->elemCount == 7);
+  FLR_CHECK(findBuffer(*p, "b")->elemCount == 5);
+}
+
+FLR_TEST(namesDifferingOnlyInSuffixDontCollide) {
+  auto p = flrtest::parseSource(
+      "symbols_prefix",
+      std::string("uint N: 1\n"
+                  "uint N2: 2\n"
+                  "uint N22: 3\n"
+                  "struct P { float x; }\n"
+                  "structured_buffer a: P N22\n"
+                  "structured_buffer b: P N\n"
+                  "structured_buffer c: P N2\n") +
+          DISPLAY_IMAGE);
+  FLR_REQUIRE(!p->m_failed);
+  FLR_CHECK(findBuffer(*p, "a")->elemCount == 3);
+  FLR_CHECK(findBuffer(*p, "b")->elemCount == 1);
+  FLR_CHECK(findBuffer(*p, "c")->elemCount == 2);
+}
+
+FLR_TEST(unknownSymbolsFail) {
+  auto p = flrtest::parseSource(
+      "symbols_unknown_struct",
+      std::string("structured_buffer a: Missing 4\n") + DISPLAY_IMAGE);
+  FLR_CHECK(p->m_failed);
+
+  p = flrtest::parseSource(
+      "symbols_unknown_instr",
+      std::string("structured_bufer a: uint 4\n") + DISPLAY_IMAGE);
+  FLR_CHECK(p->m_failed);
+
+  p = flrtest::parseSource(
+      "symbols_unknown_format",
+      "image img: 64 64 rgba9\ndisplay_image img\n");
+  FLR_CHECK(p->m_failed);
+}
+
+FLR_TEST(everyInstructionNameIsRecognized) {
+  // an instruction that is looked up but not followed by valid arguments
+  // fails with a different error than an unknown instruction
+  for (uint32_t i = 0; i < ParsedFlr::I_COUNT; i++) {
+    std::string name = ParsedFlr::INSTR_NAMES[i];
+    auto p = flrtest::parseSource("symbols_instr", name + " @\n");
+    FLR_CHECK(!strstr(p->m_errMsg, "Could not parse instruction!"));
+  }
+}
@@ -0,0 +1,117 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* DECLS = "struct P { float x; }\n"
+                    "structured_buffer a: P 64\n"
+                    "image img: 64 64 rgba8\n"
+                    "display_image img\n"
+                    "uint EVERY: 4\n"
+                    "compute_shader CS_Step: 32 1 1\n"
+                    "task_block_start Slow\n"
+                    "  dispatch_threads: CS_Step 64 1 1\n"
+                    "task_block_end\n"
+                    "task_block_start Fast\n"
+                    "  dispatch_threads: CS_Step 64 1 1\n"
+                    "task_block_end\n";
+
+std::unique_ptr<ParsedFlr> parse(const char* name, const std::string& src) {
+  return flrtest::parseSource(name, std::string(DECLS) + src);
+}
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+} // namespace
+
+FLR_TEST(taskCadences) {
+  auto p = parse(
+      "cadence_parse",
+      "task_cadence: Slow 8 3\n"
+      "task_cadence: Fast EVERY\n"
+      "run_task: Slow\n"
+      "run_task: Fast\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_taskCadences.size() == 2);
+
+  const auto* pSlow = p->findTaskCadence(0);
+  FLR_REQUIRE(pSlow);
+  FLR_CHECK(pSlow->interval == 8);
+  FLR_CHECK(pSlow->phase == 3);
+  // the phase defaults to 0, intervals can be constants
+  const auto* pFast = p->findTaskCadence(1);
+  FLR_REQUIRE(pFast);
+  FLR_CHECK(pFast->interval == 4);
+  FLR_CHECK(pFast->phase == 0);
+
+  std::string plan = p->describeTaskPlan();
+  FLR_CHECK(
+      plan.find("task_cadence: Slow every 8 frames, phase 3\n") !=
+      std::string::npos);
+  FLR_CHECK(
+      plan.find("task_cadence: Fast every 4 frames, phase 0\n") !=
+      std::string::npos);
+}
+
+FLR_TEST(invalidTaskCadences) {
+  FLR_CHECK(failsWith(
+      *parse(
+          "cadence_duplicate",
+          "task_cadence: Slow 8\n"
+          "task_cadence: Slow 4\n"),
+      "A task block can only have a single task_cadence."));
+  FLR_CHECK(failsWith(
+      *parse("cadence_zero", "task_cadence: Slow 0\n"),
+      "Expected a frame interval greater than 0 in task_cadence."));
+  FLR_CHECK(failsWith(
+      *parse("cadence_missing_interval", "task_cadence: Slow\n"),
+      "Expected a frame interval greater than 0 in task_cadence."));
+  FLR_CHECK(failsWith(
+      *parse("cadence_phase", "task_cadence: Slow 4 4\n"),
+      "The task_cadence phase must be less than the frame interval."));
+  FLR_CHECK(failsWith(
+      *parse("cadence_unknown", "task_cadence: Missing 4\n"),
+      "Could not find task block with specified name."));
+
+  // the largest phase is fine
+  auto p = parse("cadence_last_phase", "task_cadence: Slow 4 3\n");
+  FLR_CHECK(!p->m_failed);
+}
+
+FLR_TEST(cadencedBlocksMakeListsDynamic) {
+  auto p = parse(
+      "cadence_dynamic",
+      "task_cadence: Slow 8\n"
+      "task_block_start Outer\n"
+      "  run_task: Slow\n"
+      "task_block_end\n"
+      "task_block_start Plain\n"
+      "  run_task: Fast\n"
+      "task_block_end\n"
+      "run_task: Plain\n");
+  FLR_REQUIRE(!p->m_failed);
+  FLR_REQUIRE(p->m_taskBlocks.size() == 4);
+
+  // blocks running a cadenced block, also through other blocks, can't be
+  // recorded once
+  FLR_CHECK(!p->findTaskCadence(2));
+  FLR_CHECK(p->runsCadencedTaskBlock(p->m_taskBlocks[2].tasks));
+  FLR_CHECK(!p->runsCadencedTaskBlock(p->m_taskBlocks[3].tasks));
+  FLR_CHECK(!p->runsCadencedTaskBlock(p->m_taskList));
+  // the cadenced block itself runs the same commands whenever it runs
+  FLR_CHECK(!p->runsCadencedTaskBlock(p->m_taskBlocks[0].tasks));
+
+  auto q = parse(
+      "cadence_dynamic_list",
+      "task_cadence: Fast 2 1\n"
+      "task_block_start Outer\n"
+      "  run_task: Fast\n"
+      "task_block_end\n"
+      "run_task: Slow\n"
+      "run_task: Outer\n");
+  FLR_REQUIRE(!q->m_failed);
+  FLR_CHECK(q->runsCadencedTaskBlock(q->m_taskList));
+}
@@ -0,0 +1,144 @@
+#include "FlrTest.h"
+
+#include <string>
+
+using namespace flr;
+
+namespace {
+const char* RESOURCES = "struct P { float x; }\n"
+                        "structured_buffer a: P 64\n"
+                        "structured_buffer t0: P 64\n"
+                        "transient\n"
+                        "structured_buffer t1: P 64\n"
+                        "transient\n"
+                        "structured_buffer t2: P 64\n"
+                        "transient\n"
+                        "image img: 64 64 rgba8\n"
+                        "display_image img\n";
+
+const char* SHADERS = "compute_shader CS_W0: 32 1 1\n"
+                      "  writes: t0\n"
+                      "compute_shader CS_R0W1: 32 1 1\n"
+                      "  reads: t0\n"
+                      "  writes: t1\n"
+                      "compute_shader CS_R1W2: 32 1 1\n"
+                      "  reads: t1\n"
+                      "  writes: t2\n"
+                      "compute_shader CS_R2: 32 1 1\n"
+                      "  reads: t2\n"
+                      "  writes: a\n";
+
+std::unique_ptr<ParsedFlr> parse(
+    const char* name,
+    const std::string& tasks,
+    const char* shaders = SHADERS) {
+  return flrtest::parseSource(name, std::string(RESOURCES) + shaders + tasks);
+}
+
+bool failsWith(const ParsedFlr& p, const char* msg) {
+  return p.m_failed && std::string(p.m_errMsg).find(msg) != std::string::npos;
+}
+
+const ParsedFlr::TransientBuffer*
+findTransient(const ParsedFlr& p, const char* name) {
+  for (const auto& transient : p.m_transientBuffers)
+    if (p.m_buffers[transient.bufferIdx].name == name)
+      return &transient;
+  return nullptr;
+}
+} // namespace
+
+FLR_TEST(disjointTransientsAlias) {
+  auto p = parse(
+      "transients_chain",
+      "dispatch_threads: CS_W0 64 1 1\n"
+      "dispatch_threads: CS_R0W1 64 1 1\n"
+      "dispatch_threads: CS_R1W2 64 1 1\n"
+      "dispatch_threads: CS_R2 64 1 1\n");
+  FLR_REQUIRE(!p->m_failed);
+  const auto* t0 = findTransient(*p, "t0");
+  const auto* t1 = findTransient(*p, "t1");
+  const auto* t2 = findTransient(*p, "t2");
+  FLR_REQUIRE(t0 && t1 && t2);
+  // t0 is dead once t2 is written, the two can share memory
+  FLR_CHECK(t0->offset == t2->offset);
+  FLR_CHECK(t0->offset != t1->offset);
+  FLR_CHECK(t1->offset % 256 == 0);
+  FLR_CHECK(p->m_transientPoolSize == 512);
+}
+
+FLR_TEST(repeatKeepsTransientsLive) {
+  // the body reads t0 in every iteration, it cannot share memory with t2
+  auto p = parse(
+      "transients_repeat",
+      "dispatch_threads: CS_W0 64 1 1\n"
+      "repeat: 2\n"
+      "  dispatch_threads: CS_R0W1 64 1 1\n"
+      "  dispatch_threads: CS_R1W2 64 1 1\n"
+      "repeat_end\n"
+      "dispatch_threads: CS_R2 64 1 1\n");
+  FLR_REQUIRE(!p->m_failed);
+  const auto* t0 = findTransient(*p, "t0");
+  const auto* t2 = findTransient(*p, "t2");
+  FLR_REQUIRE(t0 && t2);
+  FLR_CHECK(t0->offset != t2->offset);
+  FLR_CHECK(p->m_transientPoolSize == 768);
+}
+
+FLR_TEST(transientReadBeforeWrite) {
+  auto list = parse(
+      "transients_rbw_list",
+      "dispatch_threads: CS_R0W1 64 1 1\n"
+      "dispatch_threads: CS_R1W2 64 1 1\n"
+      "dispatch_threads: CS_R2 64 1 1\n");
+  FLR_CHECK(failsWith(
+      *list,
+      "Transient buffer t0 is read before it is written in the task list"));
+
+  // a block run from the list reads what the list wrote before it
+  auto block = parse(
+      "transients_rbw_block",
+      "task_block_start READ_T0:\n"
+      "  dispatch_threads: CS_R0W1 64 1 1\n"
+      "  dispatch_threads: CS_R1W2 64 1 1\n"
+      "  dispatch_threads: CS_R2 64 1 1\n"
+      "task_block_end\n"
+      "dispatch_threads: CS_W0 64 1 1\n"
+      "run_task: READ_T0\n");
+  FLR_CHECK(!block->m_failed);
+
+  // unless it can also be run on its own
+  auto button = parse(
+      "transients_rbw_button",
+      "task_block_start READ_T0:\n"
+      "  dispatch_threads: CS_R0W1 64 1 1\n"
+      "  dispatch_threads: CS_R1W2 64 1 1\n"
+      "  dispatch_threads: CS_R2 64 1 1\n"
+      "task_block_end\n"
+      "task_button: READ_T0\n"
+      "dispatch_threads: CS_W0 64 1 1\n"
+      "run_task: READ_T0\n");
+  FLR_CHECK(failsWith(
+      *button,
+      "Transient buffer t0 is read before it is written in READ_T0"));
+}
+
+FLR_TEST(transientsRequireDeclaredAccess) {
+  // a task without declared access may bind any buffer, including one whose
+  // memory is shared
+  auto undeclared = parse(
+      "transients_undeclared_task",
+      "dispatch_threads: CS_W0 64 1 1\n"
+      "dispatch_threads: CS_Any 64 1 1\n"
+      "dispatch_threads: CS_R0W1 64 1 1\n"
+      "dispatch_threads: CS_R1W2 64 1 1\n"
+      "dispatch_threads: CS_R2 64 1 1\n",
+      (std::string(SHADERS) + "compute_shader CS_Any: 32 1 1\n").c_str());
+  FLR_CHECK(failsWith(*undeclared, "CS_Any does not declare its resource"));
+
+  auto noneDeclared = flrtest::parseSource(
+      "transients_none_declared",
+      std::string(RESOURCES) + "compute_shader CS_Any: 32 1 1\n"
+                               "dispatch_threads: CS_Any 64 1 1\n");
+  FLR_CHECK(failsWith(*noneDeclared, "Transient buffers require the resource"));
+}
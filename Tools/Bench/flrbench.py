@@ -0,0 +1,176 @@
+# flrbench - runs the projects in Projects/ as benchmarks
+#
+# Every project is rendered headless by the Fluorescence app (--headless
+# --benchmark) for a number of warmup frames followed by the measured frames,
+# with a fixed time step and the camera from the project's Options.ini. The
+# per-project results (GPU time of every task, CPU frame time, load time and
+# peak memory) are gathered into a single json file and compared against a
+# baseline, any metric regressing by more than its tolerance fails the run.
+#
+# The baseline is specific to the machine and driver it was recorded on, it is
+# recorded with --update-baseline on the reference machine and checked in as
+# Tools/Bench/baseline.json. Engine upgrades are gated by running
+#   python Tools/Bench/flrbench.py --exe build/Release/Fluorescence.exe
+# before and after, or with the "bench" build target.
+
+import argparse
+import glob
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), "..", ".."))
+DEFAULT_BASELINE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "baseline.json")
+
+# Projects that depend on live input, e.g. an audio device, and can not be compared run to run
+DEFAULT_SKIP = ["AudioTest"]
+
+def findProjects(projectsDir, names, skip):
+  projects = {}
+  for flrPath in sorted(glob.glob(os.path.join(projectsDir, "*", "*.flr"))):
+    name = os.path.splitext(os.path.basename(flrPath))[0]
+    dirName = os.path.basename(os.path.dirname(flrPath))
+    if names and name not in names and dirName not in names:
+      continue
+    if name in skip or dirName in skip:
+      continue
+    projects[name] = flrPath
+  return projects
+
+def runProject(args, flrPath):
+  with tempfile.TemporaryDirectory() as tmpDir:
+    resultsPath = os.path.join(tmpDir, "results.json")
+    cmd = [
+      args.exe, os.path.abspath(flrPath),
+      "--headless",
+      "--warmup", str(args.warmup),
+      "--frames", str(args.frames),
+      "--fixed-dt", str(args.fixed_dt),
+      "--benchmark", resultsPath]
+    try:
+      proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+      return None, "timed out after %ds" % args.timeout
+
+    if proc.returncode != 0 or not os.path.exists(resultsPath):
+      output = proc.stdout.decode(errors="replace").strip().splitlines()
+      return None, "exited with %d: %s" % (proc.returncode, " / ".join(output[-5:]))
+
+    with open(resultsPath) as f:
+      return json.load(f), None
+
+# Yields (metric name, baseline value, current value, relative tolerance, absolute slack)
+def comparedMetrics(args, baseline, current):
+  yield ("load ms", baseline["loadMs"], current["loadMs"], args.load_tolerance, 0.0)
+  yield ("cpu frame median ms", baseline["cpuFrameMs"]["median"], current["cpuFrameMs"]["median"], args.cpu_tolerance, args.min_ms)
+  yield ("peak working set bytes", baseline["peakWorkingSetBytes"], current["peakWorkingSetBytes"], args.memory_tolerance, 0.0)
+  yield ("peak private bytes", baseline["peakPrivateBytes"], current["peakPrivateBytes"], args.memory_tolerance, 0.0)
+
+  currentScopes = {scope["name"]: scope for scope in current["gpuScopes"]}
+  for scope in baseline["gpuScopes"]:
+    if scope["name"] in currentScopes:
+      yield (
+        "gpu " + scope["name"] + " median ms",
+        scope["medianMs"],
+        currentScopes[scope["name"]]["medianMs"],
+        args.gpu_tolerance,
+        args.min_ms)
+
+def compare(args, baseline, results):
+  regressions = []
+  for name, current in sorted(results.items()):
+    # a project without a baseline would otherwise never be gated
+    if name not in baseline:
+      regressions.append("%s: not in the baseline, record it with --update-baseline" % name)
+      continue
+
+    for metric, old, new, tolerance, slack in comparedMetrics(args, baseline[name], current):
+      # tiny timings are dominated by noise, they need to grow by the slack as well
+      if new > old * (1.0 + tolerance) and new - old > slack:
+        change = (new / old - 1.0) * 100.0 if old > 0 else float("inf")
+        regressions.append("%s: %s %.3f -> %.3f (+%.1f%%)" % (name, metric, old, new, change))
+
+  return regressions
+
+def main():
+  parser = argparse.ArgumentParser(description="Runs the flr projects as benchmarks and compares them against a baseline")
+  parser.add_argument("--exe", required=True, help="path to the Fluorescence app")
+  parser.add_argument("--projects-dir", default=os.path.join(ROOT_DIR, "Projects"))
+  parser.add_argument("--project", action="append", default=[], help="only run this project, may be repeated")
+  parser.add_argument("--skip", action="append", default=list(DEFAULT_SKIP), help="skip this project, may be repeated")
+  parser.add_argument("--warmup", type=int, default=60)
+  parser.add_argument("--frames", type=int, default=300)
+  parser.add_argument("--fixed-dt", type=float, default=1.0 / 60.0)
+  parser.add_argument("--timeout", type=int, default=600, help="seconds per project")
+  parser.add_argument("--out", default="flrbench_results.json", help="where the results of this run are written to")
+  parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+  parser.add_argument("--update-baseline", action="store_true", help="write the results as the new baseline instead of comparing")
+  parser.add_argument("--gpu-tolerance", type=float, default=0.10, help="allowed relative regression of per-task GPU times")
+  parser.add_argument("--cpu-tolerance", type=float, default=0.15, help="allowed relative regression of the CPU frame time")
+  parser.add_argument("--load-tolerance", type=float, default=0.25, help="allowed relative regression of the load time")
+  parser.add_argument("--memory-tolerance", type=float, default=0.10, help="allowed relative regression of the peak memory")
+  parser.add_argument("--min-ms", type=float, default=0.05, help="timings also need to regress by this many ms to count")
+  args = parser.parse_args()
+
+  # fail before spending minutes on running the projects
+  if not args.update_baseline and not os.path.exists(args.baseline):
+    print("No baseline at %s, record one with --update-baseline" % args.baseline)
+    return 1
+
+  projects = findProjects(args.projects_dir, args.project, args.skip)
+  if not projects:
+    print("No projects found in " + args.projects_dir)
+    return 1
+
+  results = {}
+  failures = []
+  for name, flrPath in projects.items():
+    print("Running %s..." % name, flush=True)
+    result, err = runProject(args, flrPath)
+    if err:
+      failures.append("%s: %s" % (name, err))
+      print("  FAILED " + err)
+      continue
+
+    results[name] = result
+    gpuMs = sum(scope["medianMs"] for scope in result["gpuScopes"])
+    print("  load %.1f ms, cpu frame %.3f ms, gpu tasks %.3f ms, peak %.1f MB" % (
+      result["loadMs"],
+      result["cpuFrameMs"]["median"],
+      gpuMs,
+      result["peakPrivateBytes"] / (1024.0 * 1024.0)))
+
+  with open(args.out, "w") as f:
+    json.dump(results, f, indent=2)
+
+  if args.update_baseline:
+    if failures:
+      print("Not updating the baseline, some projects failed:\n  " + "\n  ".join(failures))
+      return 1
+    with open(args.baseline, "w") as f:
+      json.dump(results, f, indent=2)
+    print("Wrote baseline of %d projects to %s" % (len(results), args.baseline))
+    return 0
+
+  with open(args.baseline) as f:
+    baseline = json.load(f)
+
+  # only compare the projects that were asked for
+  baseline = {name: value for name, value in baseline.items() if name in projects}
+
+  regressions = compare(args, baseline, results)
+  for failure in failures:
+    print("FAILED " + failure)
+  for regression in regressions:
+    print("REGRESSION " + regression)
+
+  if failures or regressions:
+    return 1
+
+  print("No regressions in %d projects" % len(results))
+  return 0
+
+if __name__ == "__main__":
+  sys.exit(main())
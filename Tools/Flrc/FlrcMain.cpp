@@ -0,0 +1,275 @@
+// flrc - headless flr compiler
+//
+// Parses a project, generates its shader file and compiles every shader entry
+// point without creating a window or a device. Prints a timing breakdown of
+// each phase, intended for profiling project build times on machines without
+// a GPU. With --print-tasks, the task list is printed along with the barriers
+// and layout transitions between tasks. With --print-layouts, the padding in
+// the std430 layout of every buffer is printed along with suggested field
+// orders that waste less. The parse time is that of loading the .flrc cache
+// when the project is unchanged since the last parse, --no-cache parses it
+// regardless.
+//
+// With --bench-parse, no project is loaded. Instead synthetic projects of up
+// to 50k lines are generated and the parse time of each is reported, with the
+// .flrc cache out of the way.
+
+#include "CodeGen.h"
+#include "ParsedFlr.h"
+
+#include <Althea/Application.h>
+#include <Althea/ComputePipeline.h>
+#include <Althea/GraphicsPipeline.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace AltheaEngine;
+
+namespace {
+using Clock = std::chrono::high_resolution_clock;
+
+double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+void printUsage() {
+  fprintf(
+      stderr,
+      "Usage: flrc <project.flr> [--width W] [--height H] "
+      "[--depth-format d32s8|d24s8|d32] [--root DIR] [--print-tasks] "
+      "[--print-layouts] [--no-cache]\n"
+      "       flrc --bench-parse [--root DIR]\n");
+}
+
+bool parseDepthFormat(const char* name, VkFormat& format) {
+  if (!strcmp(name, "d32s8"))
+    format = VK_FORMAT_D32_SFLOAT_S8_UINT;
+  else if (!strcmp(name, "d24s8"))
+    format = VK_FORMAT_D24_UNORM_S8_UINT;
+  else if (!strcmp(name, "d32"))
+    format = VK_FORMAT_D32_SFLOAT;
+  else
+    return false;
+  return true;
+}
+
+// Every declaration refers to symbols declared before it, so that the parse
+// time depends on how symbol lookups scale with the number of declarations
+std::string generateBenchProject(uint32_t lineCount) {
+  std::string src;
+  src += "image img: 64 64 rgba8\n";
+  src += "display_image img\n";
+  for (uint32_t i = 0; 5 * (i + 1) + 2 <= lineCount; i++) {
+    std::string n = std::to_string(i);
+    src += "uint C_" + n + ": " + std::to_string(i + 1) + "\n";
+    src += "struct S_" + n + " { vec4 a; float b; uint c; }\n";
+    src += "structured_buffer B_" + n + ": S_" + n + " C_" + n + "\n";
+    src += "compute_shader CS_" + n + ": 32 1 1\n";
+    src += "dispatch_threads: CS_" + n + " C_" + n + " 1 1\n";
+  }
+  return src;
+}
+
+int benchParse(const flr::FlrTargetInfo& target) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "flrc_bench_parse";
+  std::filesystem::create_directories(dir);
+
+  constexpr uint32_t RUN_COUNT = 5;
+  printf("lines        min ms    median ms\n");
+  for (uint32_t lineCount : {1000u, 10000u, 50000u}) {
+    std::filesystem::path projPath =
+        dir / ("bench_" + std::to_string(lineCount) + ".flr");
+    {
+      std::string src = generateBenchProject(lineCount);
+      std::ofstream stream(projPath, std::ios::binary | std::ios::trunc);
+      stream.write(src.data(), src.size());
+    }
+
+    std::vector<double> runMs;
+    for (uint32_t run = 0; run < RUN_COUNT; run++) {
+      auto start = Clock::now();
+      flr::FlrParams params{};
+      params.m_bUseCache = false;
+      flr::ParsedFlr parsed(target, projPath.string().c_str(), params);
+      runMs.push_back(msSince(start));
+      if (parsed.m_failed) {
+        fprintf(stderr, "%s\n", parsed.m_errMsg);
+        return EXIT_FAILURE;
+      }
+    }
+
+    std::sort(runMs.begin(), runMs.end());
+    printf(
+        "%-8u %9.2f    %9.2f\n",
+        lineCount,
+        runMs.front(),
+        runMs[RUN_COUNT / 2]);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+struct CompileStats {
+  uint32_t shaderCount = 0;
+  uint32_t failedCount = 0;
+  double totalMs = 0.0;
+};
+
+template <typename TBuilder>
+void compileAndReport(
+    TBuilder& builder,
+    const char* stage,
+    const std::string& entryPoint,
+    CompileStats& stats) {
+  auto start = Clock::now();
+  std::string errors = builder.compileShadersGetErrors();
+  double ms = msSince(start);
+
+  stats.shaderCount++;
+  stats.totalMs += ms;
+  printf("  %-8s %-40s %9.2f ms\n", stage, entryPoint.c_str(), ms);
+  if (errors.size()) {
+    stats.failedCount++;
+    fprintf(stderr, "%s\n", errors.c_str());
+  }
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  // Defaults match the window created by the standalone app
+  flr::FlrTargetInfo target{};
+  target.extent = {1440, 1280};
+  target.displayFormat = VK_FORMAT_B8G8R8A8_SRGB;
+  target.depthFormat = VK_FORMAT_D32_SFLOAT_S8_UINT;
+
+  std::filesystem::path root =
+      std::filesystem::absolute(argv[0]).parent_path() / "../..";
+
+  bool bBenchParse = !strcmp(argv[1], "--bench-parse");
+  bool bPrintTasks = false;
+  bool bPrintLayouts = false;
+  bool bUseCache = true;
+  for (int i = 2; i < argc; i++) {
+    bool bHasValue = (i + 1) < argc;
+    if (!strcmp(argv[i], "--width") && bHasValue) {
+      target.extent.width = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--height") && bHasValue) {
+      target.extent.height = static_cast<uint32_t>(atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--depth-format") && bHasValue) {
+      if (!parseDepthFormat(argv[++i], target.depthFormat)) {
+        fprintf(stderr, "Unknown depth format %s\n", argv[i]);
+        return EXIT_FAILURE;
+      }
+    } else if (!strcmp(argv[i], "--root") && bHasValue) {
+      root = argv[++i];
+    } else if (!strcmp(argv[i], "--print-tasks")) {
+      bPrintTasks = true;
+    } else if (!strcmp(argv[i], "--print-layouts")) {
+      bPrintLayouts = true;
+    } else if (!strcmp(argv[i], "--no-cache")) {
+      bUseCache = false;
+    } else {
+      printUsage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  root = std::filesystem::weakly_canonical(root);
+  GProjectDirectory = root.string();
+  GEngineDirectory = (root / "Extern/Althea").string();
+
+  if (bBenchParse)
+    return benchParse(target);
+
+  std::filesystem::path projPath = std::filesystem::absolute(argv[1]);
+
+  auto totalStart = Clock::now();
+
+  auto parseStart = Clock::now();
+  flr::FlrParams params{};
+  params.m_bUseCache = bUseCache;
+  flr::ParsedFlr parsed(target, projPath.string().c_str(), params);
+  double parseMs = msSince(parseStart);
+  if (parsed.m_failed) {
+    fprintf(stderr, "%s\n", parsed.m_errMsg);
+    return EXIT_FAILURE;
+  }
+
+  if (bPrintTasks)
+    printf("%s\n", parsed.describeTaskPlan().c_str());
+  if (bPrintLayouts)
+    printf("%s\n", parsed.describeBufferLayouts().c_str());
+
+  auto codeGenStart = Clock::now();
+  flr::CodeGenResult codeGenResult = flr::codeGen(parsed, projPath);
+  double codeGenMs = msSince(codeGenStart);
+
+  std::string autoGenFileName =
+      flr::getAutoGenFileName(parsed, projPath).string();
+
+  printf(
+      "parse    %9.2f ms%s\n",
+      parseMs,
+      parsed.m_bLoadedFromCache ? " (loaded from .flrc cache)" : "");
+  printf(
+      "codegen  %9.2f ms (%016llx%s)\n",
+      codeGenMs,
+      (unsigned long long)codeGenResult.hash,
+      codeGenResult.bWritten ? "" : ", unchanged");
+  printf("shaders\n");
+
+  CompileStats stats{};
+  for (const auto& c : parsed.m_computeShaders) {
+    ComputePipelineBuilder builder{};
+    builder.setComputeShader(
+        autoGenFileName,
+        flr::getComputeShaderDefines(parsed, c),
+        parsed.m_language);
+    compileAndReport(builder, "compute", c.name, stats);
+  }
+
+  for (const auto& pass : parsed.m_renderPasses) {
+    for (const auto& draw : pass.draws) {
+      {
+        GraphicsPipelineBuilder builder{};
+        builder.addVertexShader(
+            autoGenFileName,
+            flr::getVertexShaderDefines(parsed, pass, draw),
+            parsed.m_language);
+        compileAndReport(builder, "vertex", draw.vertexShader, stats);
+      }
+      {
+        GraphicsPipelineBuilder builder{};
+        builder.addFragmentShader(
+            autoGenFileName,
+            flr::getPixelShaderDefines(parsed, pass, draw),
+            parsed.m_language);
+        compileAndReport(builder, "pixel", draw.pixelShader, stats);
+      }
+    }
+  }
+
+  printf(
+      "compile  %9.2f ms (%u shaders, %u failed)\n",
+      stats.totalMs,
+      stats.shaderCount,
+      stats.failedCount);
+  printf("total    %9.2f ms\n", msSince(totalStart));
+
+  return stats.failedCount ? EXIT_FAILURE : EXIT_SUCCESS;
+}